@@ -8,7 +8,7 @@ ifeq ($(OMAP4_DEBUG_MEMLEAK),true)
 
 OMAP4_DEBUG_CFLAGS:= -DHEAPTRACKER
 OMAP4_DEBUG_LDFLAGS:= $(foreach f, $(strip malloc realloc calloc free), -Wl,--wrap=$(f))
-OMAP4_DEBUG_SHARED_LIBRARIES:= liblog
+OMAP4_DEBUG_SHARED_LIBRARIES:= liblog libdl libm
 BUILD_HEAPTRACKED_SHARED_LIBRARY:= hardware/ti/omap4xxx/heaptracked-shared-library.mk
 BUILD_HEAPTRACKED_EXECUTABLE:= hardware/ti/omap4xxx/heaptracked-executable.mk
 
@@ -25,6 +25,22 @@ LOCAL_MODULE:= tm
 LOCAL_MODULE_TAGS:= test
 include $(BUILD_HEAPTRACKED_EXECUTABLE)
 
+# host build of the tracker for "tm bench"
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES:= heaptracker.c stacktrace.c mapinfo.c
+LOCAL_MODULE:= libheaptracker
+LOCAL_MODULE_TAGS:= optional
+include $(BUILD_HOST_STATIC_LIBRARY)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES:= tm.c
+LOCAL_MODULE:= tm
+LOCAL_MODULE_TAGS:= tests
+LOCAL_STATIC_LIBRARIES:= libheaptracker liblog
+LOCAL_LDFLAGS:= $(OMAP4_DEBUG_LDFLAGS)
+LOCAL_LDLIBS:= -lpthread -ldl -lm
+include $(BUILD_HOST_EXECUTABLE)
+
 else
 BUILD_HEAPTRACKED_SHARED_LIBRARY:=$(BUILD_SHARED_LIBRARY)
 BUILD_HEAPTRACKED_EXECUTABLE:= $(BUILD_EXECUTABLE)
@@ -24,6 +24,7 @@
 #include <ui/GraphicBuffer.h>
 #include <ui/GraphicBufferMapper.h>
 #include <hal_public.h>
+#include <cutils/properties.h>
 
 namespace android {
 
@@ -34,6 +35,14 @@ const int ANativeWindowDisplayAdapter::DISPLAY_TIMEOUT = 1000;  // seconds
 //Suspends buffers after given amount of failed dq's
 const int ANativeWindowDisplayAdapter::FAILED_DQS_TO_SUSPEND = 3;
 
+//Frame pacing defaults, overridable with camera.display.* properties
+const int ANativeWindowDisplayAdapter::DEFAULT_REFRESH_RATE = 60;
+const int ANativeWindowDisplayAdapter::DEFAULT_LATE_THRESHOLD_MS = 100;
+const int ANativeWindowDisplayAdapter::DEFAULT_MIN_BUFFERS_WITH_CAMERA = 2;
+
+//Frames between two frame pacing statistics logs
+const int ANativeWindowDisplayAdapter::FRAME_STATS_PERIOD = 300;
+
 
 OMX_COLOR_FORMATTYPE toOMXPixFormat(const char* parameters_format)
 {
@@ -108,6 +117,24 @@ const char* getPixFormatConstant(const char* parameters_format)
     return pixFormat;
 }
 
+static uint8_t getBytesPerPixel(const char* parameters_format)
+{
+    if ( ( parameters_format != NULL ) &&
+         ( ( strcmp(parameters_format, (const char *) CameraParameters::PIXEL_FORMAT_YUV422I) == 0 ) ||
+           ( strcmp(parameters_format, (const char *) CameraParameters::PIXEL_FORMAT_RGB565) == 0 ) ) )
+        {
+        return 2;
+        }
+
+    return 1;
+}
+
+static inline unsigned int hashBufferHandle(const void *handle, unsigned int size)
+{
+    // size is a power of two
+    return ( ( ( uint32_t ) handle ) * 2654435761U ) & ( size - 1 );
+}
+
 const size_t getBufSize(const char* parameters_format, int width, int height)
 {
     int buf_size;
@@ -161,9 +188,13 @@ ANativeWindowDisplayAdapter::ANativeWindowDisplayAdapter():mDisplayThread(NULL),
     mMeasureStandby = false;
 #endif
 
-    mPixelFormat = NULL;
+    mBytesPerPixel = 1;
     mBufferHandleMap = NULL;
     mGrallocHandleMap = NULL;
+    mFramesWithCameraAdapter = NULL;
+    mBuffersWithCamera = 0;
+    mBufferIndexHash = NULL;
+    mBufferIndexHashSize = 0;
     mOffsetsMap = NULL;
     mFrameProvider = NULL;
     mANativeWindow = NULL;
@@ -183,6 +214,14 @@ ANativeWindowDisplayAdapter::ANativeWindowDisplayAdapter():mDisplayThread(NULL),
 
     mFD = -1;
 
+    mDisplayPeriod = s2ns(1) / DEFAULT_REFRESH_RATE;
+    mLateThreshold = ms2ns(DEFAULT_LATE_THRESHOLD_MS);
+    mMinBuffersWithCamera = DEFAULT_MIN_BUFFERS_WITH_CAMERA;
+    mLastPostTime = 0;
+    mFramesOnTime = 0;
+    mFramesLate = 0;
+    mFramesDropped = 0;
+
     LOG_FUNCTION_NAME_EXIT;
 }
 
@@ -233,8 +272,30 @@ ANativeWindowDisplayAdapter::~ANativeWindowDisplayAdapter()
 
 status_t ANativeWindowDisplayAdapter::initialize()
 {
+    char value[PROPERTY_VALUE_MAX];
+    int refresh;
+
     LOG_FUNCTION_NAME;
 
+    property_get("camera.display.refresh", value, "0");
+    refresh = atoi(value);
+    if ( 0 < refresh )
+        {
+        mDisplayPeriod = s2ns(1) / refresh;
+        }
+
+    property_get("camera.display.late_ms", value, "-1");
+    if ( 0 <= atoi(value) )
+        {
+        mLateThreshold = ms2ns(atoi(value));
+        }
+
+    property_get("camera.display.min_buffers", value, "-1");
+    if ( 0 <= atoi(value) )
+        {
+        mMinBuffersWithCamera = atoi(value);
+        }
+
     ///Create the display thread
     mDisplayThread = new DisplayThread(this);
     if ( !mDisplayThread.get() )
@@ -406,6 +467,11 @@ int ANativeWindowDisplayAdapter::enableDisplay(int width, int height, struct tim
     mPreviewWidth = width;
     mPreviewHeight = height;
 
+    mLastPostTime = 0;
+    mFramesOnTime = 0;
+    mFramesLate = 0;
+    mFramesDropped = 0;
+
     CAMHAL_LOGVB("mPreviewWidth = %d mPreviewHeight = %d", mPreviewWidth, mPreviewHeight);
 
     LOG_FUNCTION_NAME_EXIT;
@@ -431,6 +497,8 @@ int ANativeWindowDisplayAdapter::disableDisplay(bool cancel_buffer)
     mFrameProvider->disableFrameNotification(CameraFrame::PREVIEW_FRAME_SYNC);
     mFrameProvider->removeFramePointers();
 
+    dumpFrameStats();
+
     if ( NULL != mDisplayThread.get() )
         {
         //Send STOP_DISPLAY COMMAND to display thread. Display thread will stop and dequeue all messages
@@ -469,14 +537,14 @@ int ANativeWindowDisplayAdapter::disableDisplay(bool cancel_buffer)
 
        if(cancel_buffer)
         {
-        // Return the buffers to ANativeWindow here, the mFramesWithCameraAdapterMap is also cleared inside
+        // Return the buffers to ANativeWindow here, the mFramesWithCameraAdapter flags are also cleared inside
         returnBuffersToWindow();
         }
        else
         {
         mANativeWindow = NULL;
         // Clear the frames with camera adapter map
-        mFramesWithCameraAdapterMap.clear();
+        clearFramesWithCamera();
         }
 
 
@@ -528,6 +596,9 @@ void* ANativeWindowDisplayAdapter::allocateBuffer(int width, int height, const c
     const int lnumBufs = numBufs;
     mBufferHandleMap = new buffer_handle_t*[lnumBufs];
     mGrallocHandleMap = new IMG_native_handle_t*[lnumBufs];
+    mFramesWithCameraAdapter = new bool[lnumBufs];
+    memset(mFramesWithCameraAdapter, 0, lnumBufs * sizeof(bool));
+    mBuffersWithCamera = 0;
     int undequeued = 0;
     GraphicBufferMapper &mapper = GraphicBufferMapper::get();
     Rect bounds;
@@ -621,12 +692,20 @@ void* ANativeWindowDisplayAdapter::allocateBuffer(int width, int height, const c
 
         mBufferHandleMap[i] = (buffer_handle_t*) hndl2hndl;
         mGrallocHandleMap[i] = handle;
-        mFramesWithCameraAdapterMap.add((int) mGrallocHandleMap[i], i);
+        setFrameWithCamera(i, true);
 
         bytes =  getBufSize(format, width, height);
 
     }
 
+    ///Resolve gralloc handle to slot lookups once, PostFrame and
+    ///handleFrameReturn then use the slot index directly
+    if ( NO_ERROR != buildBufferIndex() )
+    {
+        CAMHAL_LOGEA("Couldn't create buffer index for ANativeWindow buffers");
+        goto fail;
+    }
+
     // lock the initial queueable buffers
     bounds.left = 0;
     bounds.top = 0;
@@ -657,7 +736,7 @@ void* ANativeWindowDisplayAdapter::allocateBuffer(int width, int height, const c
 
             goto fail;
         }
-        mFramesWithCameraAdapterMap.removeItem((int) mGrallocHandleMap[i]);
+        setFrameWithCamera(i, false);
         //LOCK UNLOCK TO GET YUV POINTERS
         void *y_uv[2];
         mapper.lock((buffer_handle_t) mGrallocHandleMap[i], CAMHAL_GRALLOC_USAGE, bounds, y_uv);
@@ -666,7 +745,7 @@ void* ANativeWindowDisplayAdapter::allocateBuffer(int width, int height, const c
     }
 
     mFirstInit = true;
-    mPixelFormat = getPixFormatConstant(format);
+    mBytesPerPixel = getBytesPerPixel(getPixFormatConstant(format));
     mFrameWidth = width;
     mFrameHeight = height;
 
@@ -680,7 +759,7 @@ void* ANativeWindowDisplayAdapter::allocateBuffer(int width, int height, const c
           CAMHAL_LOGEB("cancelBuffer failed w/ error 0x%08x", err);
           break;
         }
-        mFramesWithCameraAdapterMap.removeItem((int) mGrallocHandleMap[start]);
+        setFrameWithCamera(start, false);
     }
 
     freeBuffer(mGrallocHandleMap);
@@ -810,9 +889,11 @@ status_t ANativeWindowDisplayAdapter::returnBuffersToWindow()
 
      GraphicBufferMapper &mapper = GraphicBufferMapper::get();
     //Give the buffers back to display here -  sort of free it
-     if (mANativeWindow)
-         for(unsigned int i = 0; i < mFramesWithCameraAdapterMap.size(); i++) {
-             int value = mFramesWithCameraAdapterMap.valueAt(i);
+     if (mANativeWindow && mFramesWithCameraAdapter)
+         for(int value = 0; value < mBufferCount; value++) {
+             if ( !mFramesWithCameraAdapter[value] ) {
+                 continue;
+             }
 
              // unlock buffer before giving it up
              mapper.unlock((buffer_handle_t) mGrallocHandleMap[value]);
@@ -833,7 +914,7 @@ status_t ANativeWindowDisplayAdapter::returnBuffersToWindow()
          ALOGE("mANativeWindow is NULL");
 
      ///Clear the frames with camera adapter map
-     mFramesWithCameraAdapterMap.clear();
+     clearFramesWithCamera();
 
      return ret;
 
@@ -871,6 +952,20 @@ int ANativeWindowDisplayAdapter::freeBuffer(void* buf)
         mBufferHandleMap = NULL;
     }
 
+    if ( NULL != mFramesWithCameraAdapter )
+    {
+        delete [] mFramesWithCameraAdapter;
+        mFramesWithCameraAdapter = NULL;
+        mBuffersWithCamera = 0;
+    }
+
+    if ( NULL != mBufferIndexHash )
+    {
+        delete [] mBufferIndexHash;
+        mBufferIndexHash = NULL;
+        mBufferIndexHashSize = 0;
+    }
+
     if ( NULL != mOffsetsMap )
     {
         delete [] mOffsetsMap;
@@ -887,6 +982,97 @@ int ANativeWindowDisplayAdapter::freeBuffer(void* buf)
 }
 
 
+status_t ANativeWindowDisplayAdapter::buildBufferIndex()
+{
+    unsigned int size = 1;
+
+    // Keep the load factor at or below one half so probes stay short
+    while ( size < ( unsigned int ) ( mBufferCount * 2 ) )
+        {
+        size <<= 1;
+        }
+
+    if ( NULL != mBufferIndexHash )
+        {
+        delete [] mBufferIndexHash;
+        }
+
+    mBufferIndexHash = new int[size];
+    if ( NULL == mBufferIndexHash )
+        {
+        mBufferIndexHashSize = 0;
+        return NO_MEMORY;
+        }
+
+    memset(mBufferIndexHash, 0, size * sizeof(int));
+    mBufferIndexHashSize = size;
+
+    for ( int i = 0; i < mBufferCount; i++ )
+        {
+        unsigned int bucket = hashBufferHandle(mGrallocHandleMap[i], size);
+        while ( 0 != mBufferIndexHash[bucket] )
+            {
+            bucket = ( bucket + 1 ) & ( size - 1 );
+            }
+        mBufferIndexHash[bucket] = i + 1;
+        }
+
+    return NO_ERROR;
+}
+
+int ANativeWindowDisplayAdapter::getBufferIndex(const void *grallocHandle) const
+{
+    unsigned int bucket;
+
+    if ( ( NULL == mBufferIndexHash ) || ( NULL == grallocHandle ) )
+        {
+        return -1;
+        }
+
+    bucket = hashBufferHandle(grallocHandle, mBufferIndexHashSize);
+    while ( 0 != mBufferIndexHash[bucket] )
+        {
+        int index = mBufferIndexHash[bucket] - 1;
+        if ( grallocHandle == mGrallocHandleMap[index] )
+            {
+            return index;
+            }
+        bucket = ( bucket + 1 ) & ( mBufferIndexHashSize - 1 );
+        }
+
+    return -1;
+}
+
+///Keeps mBuffersWithCamera in step with the per slot flags, so dropFrame()
+///doesn't have to walk them. Callers serialize on mLock once buffers are
+///handed to the camera adapter.
+void ANativeWindowDisplayAdapter::setFrameWithCamera(int index, bool withCamera)
+{
+    if ( ( NULL == mFramesWithCameraAdapter ) || ( mFramesWithCameraAdapter[index] == withCamera ) )
+        {
+        return;
+        }
+
+    mFramesWithCameraAdapter[index] = withCamera;
+    if ( withCamera )
+        {
+        mBuffersWithCamera++;
+        }
+    else
+        {
+        mBuffersWithCamera--;
+        }
+}
+
+void ANativeWindowDisplayAdapter::clearFramesWithCamera()
+{
+    if ( NULL != mFramesWithCameraAdapter )
+        {
+        memset(mFramesWithCameraAdapter, 0, mBufferCount * sizeof(bool));
+        }
+    mBuffersWithCamera = 0;
+}
+
 bool ANativeWindowDisplayAdapter::supportsExternalBuffering()
 {
     return false;
@@ -1026,6 +1212,69 @@ bool ANativeWindowDisplayAdapter::processHalMsg()
 }
 
 
+void ANativeWindowDisplayAdapter::dumpFrameStats()
+{
+    CAMHAL_LOGDB("Display frames: %u on time, %u late, %u dropped",
+                 mFramesOnTime, mFramesLate, mFramesDropped);
+}
+
+///Decides whether a preview frame should skip the display and go straight
+///back to the camera adapter. A frame is dropped when
+/// - posting it would leave fewer than mMinBuffersWithCamera buffers with the
+///   camera adapter, i.e. the compositor is not keeping up. Buffers only come
+///   back from ANativeWindow through the dequeue that follows a post, so this
+///   applies only while such a dequeue is still queued for the display thread,
+/// - it arrives less than half a refresh period after the previous posted
+///   frame and would just be replaced before the next vsync,
+/// - it is older than mLateThreshold, unless the display would otherwise
+///   starve for several refresh periods. Only frames stamped on
+///   SYSTEM_TIME_MONOTONIC have a meaningful age.
+bool ANativeWindowDisplayAdapter::dropFrame(ANativeWindowDisplayAdapter::DisplayFrame &dispFrame)
+{
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    nsecs_t age = now - dispFrame.mTimestamp;
+    bool drop = false;
+
+    if ( CameraFrame::PREVIEW_FRAME_SYNC != dispFrame.mType )
+        {
+        return false;
+        }
+
+    {
+    Mutex::Autolock lock(mLock);
+
+    // the frame being posted is still counted with the camera adapter
+    if ( ( ( mBuffersWithCamera - 1 ) < mMinBuffersWithCamera ) && !mDisplayQ.isEmpty() )
+        {
+        mFramesDropped++;
+        drop = true;
+        }
+    else if ( ( 0 != mLastPostTime ) && ( ( now - mLastPostTime ) < ( mDisplayPeriod / 2 ) ) )
+        {
+        mFramesDropped++;
+        drop = true;
+        }
+    else if ( dispFrame.mTimestampMonotonic && ( 0 < mLateThreshold ) && ( mLateThreshold < age ) &&
+              ( ( now - mLastPostTime ) < ( mDisplayPeriod * 4 ) ) )
+        {
+        mFramesLate++;
+        drop = true;
+        }
+    else
+        {
+        mFramesOnTime++;
+        mLastPostTime = now;
+        }
+    }
+
+    if ( 0 == ( ( mFramesOnTime + mFramesLate + mFramesDropped ) % FRAME_STATS_PERIOD ) )
+        {
+        dumpFrameStats();
+        }
+
+    return drop;
+}
+
 status_t ANativeWindowDisplayAdapter::PostFrame(ANativeWindowDisplayAdapter::DisplayFrame &dispFrame)
 {
     status_t ret = NO_ERROR;
@@ -1035,8 +1284,6 @@ status_t ANativeWindowDisplayAdapter::PostFrame(ANativeWindowDisplayAdapter::Dis
     int i;
 
     ///@todo Do cropping based on the stabilized frame coordinates
-    ///@todo Insert logic to drop frames here based on refresh rate of
-    ///display or rendering rate whichever is lower
     ///Queue the buffer to overlay
 
     if (!mGrallocHandleMap || !dispFrame.mBuffer) {
@@ -1044,12 +1291,19 @@ status_t ANativeWindowDisplayAdapter::PostFrame(ANativeWindowDisplayAdapter::Dis
         return -EINVAL;
     }
 
-    for ( i = 0; i < mBufferCount; i++ )
-        {
-        if ( ((int) dispFrame.mBuffer ) == (int)mGrallocHandleMap[i] )
-            {
-            break;
-        }
+    i = dispFrame.mIndex;
+    if ( ( 0 > i ) || ( mBufferCount <= i ) ) {
+        CAMHAL_LOGEB("Unknown buffer %p sent to PostFrame", dispFrame.mBuffer);
+        return -EINVAL;
+    }
+
+    ///Dropped frames stay locked and go back to the camera adapter without
+    ///a round trip through ANativeWindow
+    if ( mDisplayState == ANativeWindowDisplayAdapter::DISPLAY_STARTED &&
+         !mPaused && !mSuspend && dropFrame(dispFrame) )
+    {
+        mFrameProvider->returnFrame(dispFrame.mBuffer, dispFrame.mType);
+        return NO_ERROR;
     }
 
     if ( mDisplayState == ANativeWindowDisplayAdapter::DISPLAY_STARTED &&
@@ -1064,24 +1318,8 @@ status_t ANativeWindowDisplayAdapter::PostFrame(ANativeWindowDisplayAdapter::Dis
         if((mXOff!=xOff) || (mYOff!=yOff))
         {
             CAMHAL_LOGDB("Offset %d xOff = %d, yOff = %d", dispFrame.mOffset, xOff, yOff);
-            uint8_t bytesPerPixel;
-            ///Calculate bytes per pixel based on the pixel format
-            if(strcmp(mPixelFormat, (const char *) CameraParameters::PIXEL_FORMAT_YUV422I) == 0)
-                {
-                bytesPerPixel = 2;
-                }
-            else if(strcmp(mPixelFormat, (const char *) CameraParameters::PIXEL_FORMAT_RGB565) == 0)
-                {
-                bytesPerPixel = 2;
-                }
-            else if(strcmp(mPixelFormat, (const char *) CameraParameters::PIXEL_FORMAT_YUV420SP) == 0)
-                {
-                bytesPerPixel = 1;
-                }
-            else
-                {
-                bytesPerPixel = 1;
-            }
+            ///Bytes per pixel is resolved from the pixel format in allocateBuffer
+            uint8_t bytesPerPixel = mBytesPerPixel;
 
             CAMHAL_LOGVB(" crop.left = %d crop.top = %d crop.right = %d crop.bottom = %d",
                           xOff/bytesPerPixel, yOff , (xOff/bytesPerPixel)+mPreviewWidth, yOff+mPreviewHeight);
@@ -1102,7 +1340,7 @@ status_t ANativeWindowDisplayAdapter::PostFrame(ANativeWindowDisplayAdapter::Dis
             ALOGE("Surface::queueBuffer returned error %d", ret);
         }
 
-        mFramesWithCameraAdapterMap.removeItem((int) dispFrame.mBuffer);
+        setFrameWithCamera(i, false);
 
 
         // HWComposer has not minimum buffer requirement. We should be able to dequeue
@@ -1144,7 +1382,7 @@ status_t ANativeWindowDisplayAdapter::PostFrame(ANativeWindowDisplayAdapter::Dis
             ALOGE("Surface::queueBuffer returned error %d", ret);
         }
 
-        mFramesWithCameraAdapterMap.removeItem((int) dispFrame.mBuffer);
+        setFrameWithCamera(i, false);
 
         TIUTILS::Message msg;
         mDisplayQ.put(&msg);
@@ -1195,10 +1433,15 @@ bool ANativeWindowDisplayAdapter::handleFrameReturn()
         return false;
     }
 
-    for(i = 0; i < mBufferCount; i++)
-    {
-        if (mBufferHandleMap[i] == buf)
-            break;
+    i = getBufferIndex(*buf);
+    if ( 0 > i ) {
+        CAMHAL_LOGEB("Dequeued unknown buffer %p", buf);
+        // hand it back, it would otherwise stay dequeued for the whole session
+        err = mANativeWindow->cancel_buffer(mANativeWindow, buf);
+        if (err != 0) {
+            CAMHAL_LOGEB("cancelBuffer failed: %s (%d)", strerror(-err), -err);
+        }
+        return false;
     }
 
     // lock buffer before sending to FrameProvider for filling
@@ -1219,7 +1462,10 @@ bool ANativeWindowDisplayAdapter::handleFrameReturn()
       usleep(15000);
     }
 
-    mFramesWithCameraAdapterMap.add((int) mGrallocHandleMap[i], i);
+    {
+    Mutex::Autolock lock(mLock);
+    setFrameWithCamera(i, true);
+    }
 
     CAMHAL_LOGVB("handleFrameReturn: found graphic buffer %d of %d", i, mBufferCount-1);
     mFrameProvider->returnFrame( (void*)mGrallocHandleMap[i], CameraFrame::PREVIEW_FRAME_SYNC);
@@ -1259,6 +1505,9 @@ void ANativeWindowDisplayAdapter::frameCallback(CameraFrame* caFrame)
     df.mLength = caFrame->mLength;
     df.mWidth = caFrame->mWidth;
     df.mHeight = caFrame->mHeight;
+    df.mIndex = getBufferIndex(caFrame->mBuffer);
+    df.mTimestamp = caFrame->mTimestamp;
+    df.mTimestampMonotonic = ( 0 != ( caFrame->mQuirks & CameraFrame::TIMESTAMP_MONOTONIC ) );
     PostFrame(df);
 }
 
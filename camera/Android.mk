@@ -24,6 +24,7 @@ OMAP4_CAMERA_COMMON_SRC:= \
 
 OMAP4_CAMERA_OMX_SRC:= \
 	BaseCameraAdapter.cpp \
+	FrameRefTable.cpp \
 	OMXCameraAdapter/OMX3A.cpp \
 	OMXCameraAdapter/OMXAlgo.cpp \
 	OMXCameraAdapter/OMXCameraAdapter.cpp \
@@ -37,6 +38,8 @@ OMAP4_CAMERA_OMX_SRC:= \
 
 OMAP4_CAMERA_USB_SRC:= \
 	BaseCameraAdapter.cpp \
+	FrameRefTable.cpp \
+	Decoder_libjpeg.cpp \
 	V4LCameraAdapter/V4LCameraAdapter.cpp
 
 #
@@ -115,7 +118,9 @@ LOCAL_C_INCLUDES += \
     hardware/ti/omap4xxx/ion \
     frameworks/base/include/ui \
     frameworks/base/include/utils \
-    frameworks/base/include/media/stagefright/openmax
+    frameworks/base/include/media/stagefright/openmax \
+    external/jpeg \
+    external/jhead
 
 LOCAL_SHARED_LIBRARIES:= \
     libui \
@@ -125,6 +130,8 @@ LOCAL_SHARED_LIBRARIES:= \
     libtiutils \
     libcamera_client \
     libion_ti \
+    libjpeg \
+    libexif \
 
 LOCAL_CFLAGS := -fno-short-enums -DCOPY_IMAGE_BUFFER
 
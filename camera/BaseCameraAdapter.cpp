@@ -266,37 +266,27 @@ void BaseCameraAdapter::returnFrame(void* frameBuf, CameraFrame::FrameType frame
 
     if ( NO_ERROR == res)
         {
-        Mutex::Autolock lock(mReturnFrameLock);
-
-        refCount = getFrameRefCount(frameBuf,  frameType);
+        FrameRefTable::Lane lane;
+        FrameRefTable *table = getFrameRefTable(frameType, lane);
 
         if(frameType == CameraFrame::PREVIEW_FRAME_SYNC)
             {
-            mFramesWithDisplay--;
+            android_atomic_dec(( volatile int32_t * ) &mFramesWithDisplay);
             }
         else if(frameType == CameraFrame::VIDEO_FRAME_SYNC)
             {
-            mFramesWithEncoder--;
+            android_atomic_dec(( volatile int32_t * ) &mFramesWithEncoder);
             }
 
-        if ( 0 < refCount )
+        //While recording the preview buffers are also held by the video
+        //subscribers, only the last release of both lanes refills the buffer
+        if ( NULL != table )
             {
-
-            refCount--;
-            setFrameRefCount(frameBuf, frameType, refCount);
-
-
-            if ( mRecording && (CameraFrame::VIDEO_FRAME_SYNC == frameType) ) {
-                refCount += getFrameRefCount(frameBuf, CameraFrame::PREVIEW_FRAME_SYNC);
-            } else if ( mRecording && (CameraFrame::PREVIEW_FRAME_SYNC == frameType) ) {
-                refCount += getFrameRefCount(frameBuf, CameraFrame::VIDEO_FRAME_SYNC);
-            } else if ( mRecording && (CameraFrame::SNAPSHOT_FRAME == frameType) ) {
-                refCount += getFrameRefCount(frameBuf, CameraFrame::VIDEO_FRAME_SYNC);
+            refCount = table->release(( int ) frameBuf, lane,
+                                      mRecording && ( &mPreviewBuffersAvailable == table ));
             }
 
-
-            }
-        else
+        if ( 0 > refCount )
             {
             CAMHAL_LOGDA("Frame returned when ref count is already zero!!");
             return;
@@ -355,19 +345,24 @@ status_t BaseCameraAdapter::sendCommand(CameraCommands operation, int value1, in
                     mPreviewBuffers = (int *) desc->mBuffers;
                     mPreviewBuffersLength = desc->mLength;
                     mPreviewBuffersAvailable.clear();
-                    for ( uint32_t i = 0 ; i < desc->mMaxQueueable ; i++ )
+                    for ( uint32_t i = 0 ; ( NO_ERROR == ret ) && ( i < desc->mMaxQueueable ) ; i++ )
                         {
-                        mPreviewBuffersAvailable.add(mPreviewBuffers[i], 0);
+                        ret = mPreviewBuffersAvailable.add(mPreviewBuffers[i], 0);
                         }
                     // initial ref count for undeqeueued buffers is 1 since buffer provider
                     // is still holding on to it
-                    for ( uint32_t i = desc->mMaxQueueable ; i < desc->mCount ; i++ )
+                    for ( uint32_t i = desc->mMaxQueueable ; ( NO_ERROR == ret ) && ( i < desc->mCount ) ; i++ )
+                        {
+                        ret = mPreviewBuffersAvailable.add(mPreviewBuffers[i], 1);
+                        }
+                    if ( NO_ERROR != ret )
                         {
-                        mPreviewBuffersAvailable.add(mPreviewBuffers[i], 1);
+                        CAMHAL_LOGEB("Unable to track preview buffers 0x%x", ret);
+                        mPreviewBuffersAvailable.clear();
                         }
                     }
 
-                if ( NULL != desc )
+                if ( ( NO_ERROR == ret ) && ( NULL != desc ) )
                     {
                     ret = useBuffers(CameraAdapter::CAMERA_PREVIEW,
                                      desc->mBuffers,
@@ -408,19 +403,24 @@ status_t BaseCameraAdapter::sendCommand(CameraCommands operation, int value1, in
                         mPreviewDataBuffers = (int *) desc->mBuffers;
                         mPreviewDataBuffersLength = desc->mLength;
                         mPreviewDataBuffersAvailable.clear();
-                        for ( uint32_t i = 0 ; i < desc->mMaxQueueable ; i++ )
+                        for ( uint32_t i = 0 ; ( NO_ERROR == ret ) && ( i < desc->mMaxQueueable ) ; i++ )
                             {
-                            mPreviewDataBuffersAvailable.add(mPreviewDataBuffers[i], 0);
+                            ret = mPreviewDataBuffersAvailable.add(mPreviewDataBuffers[i], 0);
                             }
                         // initial ref count for undeqeueued buffers is 1 since buffer provider
                         // is still holding on to it
-                        for ( uint32_t i = desc->mMaxQueueable ; i < desc->mCount ; i++ )
+                        for ( uint32_t i = desc->mMaxQueueable ; ( NO_ERROR == ret ) && ( i < desc->mCount ) ; i++ )
                             {
-                            mPreviewDataBuffersAvailable.add(mPreviewDataBuffers[i], 1);
+                            ret = mPreviewDataBuffersAvailable.add(mPreviewDataBuffers[i], 1);
+                            }
+                        if ( NO_ERROR != ret )
+                            {
+                            CAMHAL_LOGEB("Unable to track preview data buffers 0x%x", ret);
+                            mPreviewDataBuffersAvailable.clear();
                             }
                         }
 
-                    if ( NULL != desc )
+                    if ( ( NO_ERROR == ret ) && ( NULL != desc ) )
                         {
                         ret = useBuffers(CameraAdapter::CAMERA_MEASUREMENT,
                                          desc->mBuffers,
@@ -461,19 +461,24 @@ status_t BaseCameraAdapter::sendCommand(CameraCommands operation, int value1, in
                     mCaptureBuffers = (int *) desc->mBuffers;
                     mCaptureBuffersLength = desc->mLength;
                     mCaptureBuffersAvailable.clear();
-                    for ( uint32_t i = 0 ; i < desc->mMaxQueueable ; i++ )
+                    for ( uint32_t i = 0 ; ( NO_ERROR == ret ) && ( i < desc->mMaxQueueable ) ; i++ )
                         {
-                        mCaptureBuffersAvailable.add(mCaptureBuffers[i], 0);
+                        ret = mCaptureBuffersAvailable.add(mCaptureBuffers[i], 0);
                         }
                     // initial ref count for undeqeueued buffers is 1 since buffer provider
                     // is still holding on to it
-                    for ( uint32_t i = desc->mMaxQueueable ; i < desc->mCount ; i++ )
+                    for ( uint32_t i = desc->mMaxQueueable ; ( NO_ERROR == ret ) && ( i < desc->mCount ) ; i++ )
+                        {
+                        ret = mCaptureBuffersAvailable.add(mCaptureBuffers[i], 1);
+                        }
+                    if ( NO_ERROR != ret )
                         {
-                        mCaptureBuffersAvailable.add(mCaptureBuffers[i], 1);
+                        CAMHAL_LOGEB("Unable to track capture buffers 0x%x", ret);
+                        mCaptureBuffersAvailable.clear();
                         }
                     }
 
-                if ( NULL != desc )
+                if ( ( NO_ERROR == ret ) && ( NULL != desc ) )
                     {
                     ret = useBuffers(CameraAdapter::CAMERA_IMAGE_CAPTURE,
                                      desc->mBuffers,
@@ -1319,43 +1324,42 @@ int BaseCameraAdapter::setInitFrameRefCount(void* buf, unsigned int mask)
   return ret;
 }
 
-int BaseCameraAdapter::getFrameRefCount(void* frameBuf, CameraFrame::FrameType frameType)
+FrameRefTable *BaseCameraAdapter::getFrameRefTable(CameraFrame::FrameType frameType,
+                                                   FrameRefTable::Lane &lane)
 {
-    int res = -1;
-
-    LOG_FUNCTION_NAME;
+    lane = FrameRefTable::LANE_FRAME;
 
     switch ( frameType )
         {
         case CameraFrame::IMAGE_FRAME:
         case CameraFrame::RAW_FRAME:
-                {
-                Mutex::Autolock lock(mCaptureBufferLock);
-                res = mCaptureBuffersAvailable.valueFor( ( unsigned int ) frameBuf );
-                }
-            break;
+            return &mCaptureBuffersAvailable;
         case CameraFrame::PREVIEW_FRAME_SYNC:
         case CameraFrame::SNAPSHOT_FRAME:
-                {
-                Mutex::Autolock lock(mPreviewBufferLock);
-                res = mPreviewBuffersAvailable.valueFor( ( unsigned int ) frameBuf );
-                }
-            break;
+            return &mPreviewBuffersAvailable;
         case CameraFrame::FRAME_DATA_SYNC:
-                {
-                Mutex::Autolock lock(mPreviewDataBufferLock);
-                res = mPreviewDataBuffersAvailable.valueFor( ( unsigned int ) frameBuf );
-                }
-            break;
+            return &mPreviewDataBuffersAvailable;
         case CameraFrame::VIDEO_FRAME_SYNC:
-                {
-                Mutex::Autolock lock(mVideoBufferLock);
-                res = mVideoBuffersAvailable.valueFor( ( unsigned int ) frameBuf );
-                }
-            break;
+            lane = FrameRefTable::LANE_VIDEO;
+            return &mPreviewBuffersAvailable;
         default:
-            break;
+            return NULL;
         };
+}
+
+int BaseCameraAdapter::getFrameRefCount(void* frameBuf, CameraFrame::FrameType frameType)
+{
+    int res = -1;
+    FrameRefTable::Lane lane;
+    FrameRefTable *table;
+
+    LOG_FUNCTION_NAME;
+
+    table = getFrameRefTable(frameType, lane);
+    if ( NULL != table )
+        {
+        res = table->get(( int ) frameBuf, lane);
+        }
 
     LOG_FUNCTION_NAME_EXIT;
 
@@ -1364,40 +1368,16 @@ int BaseCameraAdapter::getFrameRefCount(void* frameBuf, CameraFrame::FrameType f
 
 void BaseCameraAdapter::setFrameRefCount(void* frameBuf, CameraFrame::FrameType frameType, int refCount)
 {
+    FrameRefTable::Lane lane;
+    FrameRefTable *table;
 
     LOG_FUNCTION_NAME;
 
-    switch ( frameType )
+    table = getFrameRefTable(frameType, lane);
+    if ( NULL != table )
         {
-        case CameraFrame::IMAGE_FRAME:
-        case CameraFrame::RAW_FRAME:
-                {
-                Mutex::Autolock lock(mCaptureBufferLock);
-                mCaptureBuffersAvailable.replaceValueFor(  ( unsigned int ) frameBuf, refCount);
-                }
-            break;
-        case CameraFrame::PREVIEW_FRAME_SYNC:
-        case CameraFrame::SNAPSHOT_FRAME:
-                {
-                Mutex::Autolock lock(mPreviewBufferLock);
-                mPreviewBuffersAvailable.replaceValueFor(  ( unsigned int ) frameBuf, refCount);
-                }
-            break;
-        case CameraFrame::FRAME_DATA_SYNC:
-                {
-                Mutex::Autolock lock(mPreviewDataBufferLock);
-                mPreviewDataBuffersAvailable.replaceValueFor(  ( unsigned int ) frameBuf, refCount);
-                }
-            break;
-        case CameraFrame::VIDEO_FRAME_SYNC:
-                {
-                Mutex::Autolock lock(mVideoBufferLock);
-                mVideoBuffersAvailable.replaceValueFor(  ( unsigned int ) frameBuf, refCount);
-                }
-            break;
-        default:
-            break;
-        };
+        table->set(( int ) frameBuf, refCount, lane);
+        }
 
     LOG_FUNCTION_NAME_EXIT;
 
@@ -1421,12 +1401,7 @@ status_t BaseCameraAdapter::startVideoCapture()
     if ( NO_ERROR == ret )
         {
 
-        mVideoBuffersAvailable.clear();
-
-        for ( unsigned int i = 0 ; i < mPreviewBuffersAvailable.size() ; i++ )
-            {
-            mVideoBuffersAvailable.add(mPreviewBuffersAvailable.keyAt(i), 0);
-            }
+        mPreviewBuffersAvailable.clearLane(FrameRefTable::LANE_VIDEO);
 
         mRecording = true;
         }
@@ -1449,9 +1424,9 @@ status_t BaseCameraAdapter::stopVideoCapture()
 
     if ( NO_ERROR == ret )
         {
-        for ( unsigned int i = 0 ; i < mVideoBuffersAvailable.size() ; i++ )
+        for ( unsigned int i = 0 ; i < mPreviewBuffersAvailable.size() ; i++ )
             {
-            void *frameBuf = ( void * ) mVideoBuffersAvailable.keyAt(i);
+            void *frameBuf = ( void * ) mPreviewBuffersAvailable.keyAt(i);
             if( getFrameRefCount(frameBuf,  CameraFrame::VIDEO_FRAME_SYNC) > 0)
                 {
                 returnFrame(frameBuf, CameraFrame::VIDEO_FRAME_SYNC);
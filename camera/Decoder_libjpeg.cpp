@@ -0,0 +1,313 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file Decoder_libjpeg.cpp
+*
+* This file decodes a JPEG/MJPEG frame to a YUV422I (UYVY) buffer
+*
+*/
+
+#define LOG_TAG "CameraHAL"
+
+#include "CameraHal.h"
+#include "Decoder_libjpeg.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+
+extern "C" {
+    #include "jpeglib.h"
+    #include "jerror.h"
+}
+
+#define MAX_DECODE_ROWS 4
+
+namespace android {
+
+struct libjpeg_error_mgr : jpeg_error_mgr {
+    jmp_buf jmp;
+};
+
+struct libjpeg_source_mgr : jpeg_source_mgr {
+    uint8_t* buf;
+    size_t bufsize;
+};
+
+struct libjpeg_decoder_ctx {
+    jpeg_decompress_struct cinfo;
+    libjpeg_error_mgr jerr;
+    libjpeg_source_mgr src;
+};
+
+// Standard Huffman tables (JPEG spec K.3). MJPEG streams from UVC cameras
+// omit the DHT segment and rely on these.
+static const UINT8 bits_dc_luminance[17] =
+    { 0, 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const UINT8 val_dc_luminance[] =
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const UINT8 bits_dc_chrominance[17] =
+    { 0, 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+static const UINT8 val_dc_chrominance[] =
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const UINT8 bits_ac_luminance[17] =
+    { 0, 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+static const UINT8 val_ac_luminance[] =
+    { 0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12,
+      0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+      0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08,
+      0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+      0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16,
+      0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+      0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
+      0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+      0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+      0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+      0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
+      0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+      0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98,
+      0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+      0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+      0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+      0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4,
+      0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+      0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea,
+      0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+      0xf9, 0xfa };
+
+static const UINT8 bits_ac_chrominance[17] =
+    { 0, 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+static const UINT8 val_ac_chrominance[] =
+    { 0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21,
+      0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+      0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+      0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+      0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34,
+      0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+      0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38,
+      0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+      0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+      0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+      0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78,
+      0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+      0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96,
+      0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+      0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+      0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+      0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2,
+      0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+      0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9,
+      0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+      0xf9, 0xfa };
+
+static void libjpeg_error_exit(j_common_ptr cinfo) {
+    libjpeg_error_mgr* err = (libjpeg_error_mgr*)cinfo->err;
+    char buffer[JMSG_LENGTH_MAX];
+
+    (*cinfo->err->format_message)(cinfo, buffer);
+    CAMHAL_LOGEB("Decoder: %s", buffer);
+
+    longjmp(err->jmp, 1);
+}
+
+static void libjpeg_output_message(j_common_ptr cinfo) {
+    // corrupt-data warnings are common on USB streams, don't flood the log
+}
+
+static void libjpeg_init_source(j_decompress_ptr cinfo) {
+}
+
+static boolean libjpeg_fill_input_buffer(j_decompress_ptr cinfo) {
+    static const JOCTET eoi[2] = { 0xFF, JPEG_EOI };
+
+    // truncated frame, terminate it so libjpeg can finish the scan
+    cinfo->src->next_input_byte = eoi;
+    cinfo->src->bytes_in_buffer = sizeof(eoi);
+    return TRUE;
+}
+
+static void libjpeg_skip_input_data(j_decompress_ptr cinfo, long num_bytes) {
+    if (num_bytes <= 0) {
+        return;
+    }
+
+    if ((size_t)num_bytes > cinfo->src->bytes_in_buffer) {
+        libjpeg_fill_input_buffer(cinfo);
+    } else {
+        cinfo->src->next_input_byte += num_bytes;
+        cinfo->src->bytes_in_buffer -= num_bytes;
+    }
+}
+
+static void libjpeg_term_source(j_decompress_ptr cinfo) {
+}
+
+static void add_huff_table(j_decompress_ptr cinfo, JHUFF_TBL** htblptr,
+                           const UINT8* bits, const UINT8* val, size_t nval) {
+    if (*htblptr == NULL) {
+        *htblptr = jpeg_alloc_huff_table((j_common_ptr) cinfo);
+    }
+
+    memcpy((*htblptr)->bits, bits, sizeof((*htblptr)->bits));
+    memcpy((*htblptr)->huffval, val, nval);
+    (*htblptr)->sent_table = FALSE;
+}
+
+static void add_std_huff_tables(j_decompress_ptr cinfo) {
+    if (cinfo->dc_huff_tbl_ptrs[0] == NULL) {
+        add_huff_table(cinfo, &cinfo->dc_huff_tbl_ptrs[0],
+                       bits_dc_luminance, val_dc_luminance, sizeof(val_dc_luminance));
+    }
+    if (cinfo->ac_huff_tbl_ptrs[0] == NULL) {
+        add_huff_table(cinfo, &cinfo->ac_huff_tbl_ptrs[0],
+                       bits_ac_luminance, val_ac_luminance, sizeof(val_ac_luminance));
+    }
+    if (cinfo->dc_huff_tbl_ptrs[1] == NULL) {
+        add_huff_table(cinfo, &cinfo->dc_huff_tbl_ptrs[1],
+                       bits_dc_chrominance, val_dc_chrominance, sizeof(val_dc_chrominance));
+    }
+    if (cinfo->ac_huff_tbl_ptrs[1] == NULL) {
+        add_huff_table(cinfo, &cinfo->ac_huff_tbl_ptrs[1],
+                       bits_ac_chrominance, val_ac_chrominance, sizeof(val_ac_chrominance));
+    }
+}
+
+/* private static functions */
+static void yuv_to_uyvy(uint8_t* dst, uint8_t* src, int width) {
+    // chroma of the even pixel is used for each pair
+    while ((width -= 2) >= 0) {
+        dst[0] = src[1];
+        dst[1] = src[0];
+        dst[2] = src[2];
+        dst[3] = src[3];
+        dst += 4;
+        src += 6;
+    }
+}
+
+/* public member functions */
+Decoder_libjpeg::Decoder_libjpeg() : mCtx(NULL), mRow(NULL), mRowSize(0) {
+    mCtx = (libjpeg_decoder_ctx*) calloc(1, sizeof(libjpeg_decoder_ctx));
+    if (!mCtx) {
+        return;
+    }
+
+    mCtx->cinfo.err = jpeg_std_error(&mCtx->jerr);
+    mCtx->jerr.error_exit = libjpeg_error_exit;
+    mCtx->jerr.output_message = libjpeg_output_message;
+
+    jpeg_create_decompress(&mCtx->cinfo);
+
+    mCtx->src.init_source = libjpeg_init_source;
+    mCtx->src.fill_input_buffer = libjpeg_fill_input_buffer;
+    mCtx->src.skip_input_data = libjpeg_skip_input_data;
+    mCtx->src.resync_to_restart = jpeg_resync_to_restart;
+    mCtx->src.term_source = libjpeg_term_source;
+    mCtx->cinfo.src = &mCtx->src;
+}
+
+Decoder_libjpeg::~Decoder_libjpeg() {
+    if (mCtx) {
+        jpeg_destroy_decompress(&mCtx->cinfo);
+        free(mCtx);
+        mCtx = NULL;
+    }
+
+    if (mRow) {
+        free(mRow);
+        mRow = NULL;
+    }
+}
+
+bool Decoder_libjpeg::decode(uint8_t* src, size_t size, uint8_t* dst,
+                             int width, int height, int stride) {
+    jpeg_decompress_struct* cinfo;
+    int rows;
+
+    if (!mCtx || !src || !dst || (size < 2) || (width < 2) || (height < 2) ||
+        (stride < (width * 2))) {
+        return false;
+    }
+
+    cinfo = &mCtx->cinfo;
+
+    if (setjmp(mCtx->jerr.jmp)) {
+        jpeg_abort_decompress(cinfo);
+        return false;
+    }
+
+    mCtx->src.buf = src;
+    mCtx->src.bufsize = size;
+    mCtx->src.next_input_byte = src;
+    mCtx->src.bytes_in_buffer = size;
+
+    jpeg_read_header(cinfo, TRUE);
+    add_std_huff_tables(cinfo);
+
+    if (((int)cinfo->image_width != width) || ((int)cinfo->image_height != height)) {
+        CAMHAL_LOGEB("Decoder: frame is %dx%d, expected %dx%d",
+                     cinfo->image_width, cinfo->image_height, width, height);
+        jpeg_abort_decompress(cinfo);
+        return false;
+    }
+
+    cinfo->out_color_space = JCS_YCbCr;
+    cinfo->dct_method = JDCT_IFAST;
+    cinfo->do_fancy_upsampling = FALSE;
+    cinfo->do_block_smoothing = FALSE;
+
+    jpeg_start_decompress(cinfo);
+
+    // libjpeg hands out up to rec_outbuf_height rows per call
+    rows = cinfo->rec_outbuf_height;
+    if (rows > MAX_DECODE_ROWS) {
+        rows = MAX_DECODE_ROWS;
+    }
+    if (mRowSize < (width * 3 * rows)) {
+        free(mRow);
+        mRowSize = width * 3 * rows;
+        mRow = (uint8_t*) malloc(mRowSize);
+        if (!mRow) {
+            mRowSize = 0;
+            jpeg_abort_decompress(cinfo);
+            return false;
+        }
+    }
+
+    while (cinfo->output_scanline < cinfo->output_height) {
+        JSAMPROW row[MAX_DECODE_ROWS];
+        int line = cinfo->output_scanline;
+        int n;
+
+        for (int i = 0; i < rows; i++) {
+            row[i] = mRow + (i * width * 3);
+        }
+
+        n = jpeg_read_scanlines(cinfo, row, rows);
+        for (int i = 0; i < n; i++) {
+            yuv_to_uyvy(dst + ((line + i) * stride), row[i], width);
+        }
+    }
+
+    jpeg_finish_decompress(cinfo);
+
+    return true;
+}
+
+};
@@ -41,6 +41,7 @@
 extern "C" {
     #include "jpeglib.h"
     #include "jerror.h"
+    #include <ion.h>
 }
 
 #define ARRAY_SIZE(array) (sizeof((array)) / sizeof((array)[0]))
@@ -363,6 +364,8 @@ size_t Encoder_libjpeg::encode(params* input) {
     int out_height = 0, in_height = 0;
     int bpp = 2; // for uyvy
     int right_crop = 0, start_offset = 0;
+    uint8_t* sync_src = NULL;
+    size_t sync_len = 0;
 
     if (!input) {
         return 0;
@@ -386,6 +389,18 @@ size_t Encoder_libjpeg::encode(params* input) {
         goto exit;
     }
 
+    // bracket the part of an ion backed frame that is read below;
+    // ion_registry_sync() ignores frames from other memory. the last row
+    // of a cropped or strided source ends out_width pixels into its line
+    if (strcmp(input->format, CameraParameters::PIXEL_FORMAT_YUV420SP) == 0) {
+        sync_src = src;
+        sync_len = (in_width * in_height * 3) / 2;
+    } else {
+        sync_src = src + start_offset;
+        sync_len = (out_height - 1) * in_width * bpp + out_width * bpp;
+    }
+    ion_registry_sync(sync_src, sync_len, ION_SYNC_READ | ION_SYNC_START);
+
     if (strcmp(input->format, CameraParameters::PIXEL_FORMAT_YUV420SP) == 0) {
         bpp = 1;
         if ((in_width != out_width) || (in_height != out_height)) {
@@ -463,6 +478,9 @@ size_t Encoder_libjpeg::encode(params* input) {
     if (row_tmp) free(row_tmp);
 
  exit:
+    if (sync_src) {
+        ion_registry_sync(sync_src, sync_len, ION_SYNC_READ | ION_SYNC_END);
+    }
     input->jpeg_size = dest_mgr.jpegsize;
     return dest_mgr.jpegsize;
 }
@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+#define LOG_TAG "CameraHAL"
+
+#include <string.h>
+#include <cutils/log.h>
+
+#include "FrameRefTable.h"
+
+namespace android {
+
+/*--------------------FrameRefTable Class STARTS here-----------------------------*/
+
+FrameRefTable::FrameRefTable()
+{
+    clear();
+}
+
+void FrameRefTable::clear()
+{
+    memset(mKeys, 0, sizeof(mKeys));
+    memset((void *) mRefs, 0, sizeof(mRefs));
+    memset(mHash, 0, sizeof(mHash));
+    mCount = 0;
+}
+
+status_t FrameRefTable::add(int key, int refCount)
+{
+    unsigned int bucket;
+
+    if ( 0 == key )
+        {
+        return BAD_VALUE;
+        }
+
+    if ( 0 <= slotFor(key) )
+        {
+        set(key, refCount);
+        return NO_ERROR;
+        }
+
+    if ( MAX_BUFFERS <= ( int ) mCount )
+        {
+        ALOGE("Too many buffers, only %d can be tracked", MAX_BUFFERS);
+        return NO_MEMORY;
+        }
+
+    bucket = ( ( uint32_t ) key * 2654435761U ) % HASH_SIZE;
+    while ( 0 != mHash[bucket] )
+        {
+        bucket = ( bucket + 1 ) % HASH_SIZE;
+        }
+
+    mKeys[mCount] = key;
+    mRefs[mCount] = refCount & LANE_MASK;
+    mHash[bucket] = mCount + 1;
+    mCount++;
+
+    return NO_ERROR;
+}
+
+void FrameRefTable::clearLane(Lane lane)
+{
+    for ( size_t i = 0 ; i < mCount ; i++ )
+        {
+        set(mKeys[i], 0, lane);
+        }
+}
+
+void FrameRefTable::reset()
+{
+    for ( int lane = 0 ; lane < LANE_MAX ; lane++ )
+        {
+        clearLane(( Lane ) lane);
+        }
+}
+
+int FrameRefTable::slotFor(int key) const
+{
+    unsigned int bucket = ( ( uint32_t ) key * 2654435761U ) % HASH_SIZE;
+
+    //The table is never full, so an empty bucket always ends the probe
+    while ( 0 != mHash[bucket] )
+        {
+        if ( mKeys[mHash[bucket] - 1] == key )
+            {
+            return mHash[bucket] - 1;
+            }
+        bucket = ( bucket + 1 ) % HASH_SIZE;
+        }
+
+    return -1;
+}
+
+int FrameRefTable::get(int key, Lane lane) const
+{
+    int slot = slotFor(key);
+
+    if ( 0 > slot )
+        {
+        return -1;
+        }
+
+    return ( android_atomic_acquire_load(&mRefs[slot]) >> ( lane * LANE_BITS ) ) & LANE_MASK;
+}
+
+void FrameRefTable::set(int key, int refCount, Lane lane)
+{
+    int slot = slotFor(key);
+    int shift = lane * LANE_BITS;
+    int32_t oldValue, newValue;
+
+    if ( 0 > slot )
+        {
+        return;
+        }
+
+    do
+        {
+        oldValue = mRefs[slot];
+        newValue = ( oldValue & ~( LANE_MASK << shift ) ) | ( ( refCount & LANE_MASK ) << shift );
+        } while ( android_atomic_release_cas(oldValue, newValue, &mRefs[slot]) );
+}
+
+int FrameRefTable::release(int key, Lane lane, bool combined)
+{
+    int slot = slotFor(key);
+    int shift = lane * LANE_BITS;
+    int32_t oldValue, newValue;
+    int ret = 0;
+
+    if ( 0 > slot )
+        {
+        return -1;
+        }
+
+    do
+        {
+        oldValue = mRefs[slot];
+        if ( 0 == ( ( oldValue >> shift ) & LANE_MASK ) )
+            {
+            return -1;
+            }
+        newValue = oldValue - ( 1 << shift );
+        } while ( android_atomic_release_cas(oldValue, newValue, &mRefs[slot]) );
+
+    if ( combined )
+        {
+        for ( int i = 0 ; i < LANE_MAX ; i++ )
+            {
+            ret += ( newValue >> ( i * LANE_BITS ) ) & LANE_MASK;
+            }
+        }
+    else
+        {
+        ret = ( newValue >> shift ) & LANE_MASK;
+        }
+
+    return ret;
+}
+
+};
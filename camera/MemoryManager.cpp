@@ -40,6 +40,9 @@ namespace android {
 
 #define ALLOCATION_2D 2
 
+///Name the camera buffers are accounted under in the ion registry
+#define ION_CLIENT_NAME "CameraHal"
+
 ///Utility Macro Declarations
 
 /*--------------------MemoryManager Class STARTS here-----------------------------*/
@@ -49,10 +52,10 @@ void* MemoryManager::allocateBuffer(int width, int height, const char* format, i
 
     if(mIonFd < 0)
         {
-        mIonFd = ion_open();
+        mIonFd = ion_registry_open();
         if(mIonFd < 0)
             {
-            CAMHAL_LOGEA("ion_open failed!!!");
+            CAMHAL_LOGEA("ion_registry_open failed!!!");
             return NULL;
             }
         }
@@ -77,29 +80,28 @@ void* MemoryManager::allocateBuffer(int width, int height, const char* format, i
     if(bytes != 0)
         {
         struct ion_handle *handle;
-        int mmap_fd;
+        int share_fd;
 
         ///1D buffers
         for (int i = 0; i < numBufs; i++)
             {
-            int ret = ion_alloc(mIonFd, bytes, 0, 1 << ION_HEAP_TYPE_CARVEOUT, &handle);
+            int ret = ion_registry_alloc(bytes, 0, 1 << ION_HEAP_TYPE_CARVEOUT,
+                                         ION_CLIENT_NAME, &handle, &share_fd);
             if(ret < 0)
                 {
-                CAMHAL_LOGEB("ion_alloc resulted in error %d", ret);
+                CAMHAL_LOGEB("ion_registry_alloc resulted in error %d", ret);
                 goto error;
                 }
 
             CAMHAL_LOGDB("Before mapping, handle = %x, nSize = %d", handle, bytes);
-            if ((ret = ion_map(mIonFd, handle, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, 0,
-                          (unsigned char**)&bufsArr[i], &mmap_fd)) < 0)
+            if ((ret = ion_registry_map(share_fd, (unsigned char**)&bufsArr[i])) < 0)
                 {
                 CAMHAL_LOGEB("Userspace mapping of ION buffers returned error %d", ret);
-                ion_free(mIonFd, handle);
+                ion_registry_release(share_fd, ION_CLIENT_NAME);
                 goto error;
                 }
 
-            mIonHandleMap.add(bufsArr[i], (unsigned int)handle);
-            mIonFdMap.add(bufsArr[i], (unsigned int) mmap_fd);
+            mIonFdMap.add(bufsArr[i], (unsigned int) share_fd);
             mIonBufLength.add(bufsArr[i], (unsigned int) bytes);
             }
 
@@ -122,9 +124,9 @@ error:
         mErrorNotifier->errorNotify(-ENOMEM);
         }
 
-    if (mIonFd >= 0)
+    if ((mIonFd >= 0) && (mIonBufLength.size() == 0))
     {
-        ion_close(mIonFd);
+        ion_registry_close();
         mIonFd = -1;
     }
 
@@ -171,10 +173,10 @@ int MemoryManager::freeBuffer(void* buf)
         unsigned int ptr = (unsigned int) *bufEntry++;
         if(mIonBufLength.valueFor(ptr))
             {
-            munmap((void *)ptr, mIonBufLength.valueFor(ptr));
-            close(mIonFdMap.valueFor(ptr));
-            ion_free(mIonFd, (ion_handle*)mIonHandleMap.valueFor(ptr));
-            mIonHandleMap.removeItem(ptr);
+            ///Drops our reference only. A DOMX proxy given this buffer holds
+            ///its own from ion_registry_import() until its FreeBuffer
+            ion_registry_unmap(mIonFdMap.valueFor(ptr));
+            ion_registry_release(mIonFdMap.valueFor(ptr), ION_CLIENT_NAME);
             mIonBufLength.removeItem(ptr);
             mIonFdMap.removeItem(ptr);
             }
@@ -192,7 +194,7 @@ int MemoryManager::freeBuffer(void* buf)
         {
         if(mIonFd >= 0)
             {
-            ion_close(mIonFd);
+            ion_registry_close();
             mIonFd = -1;
             }
         }
@@ -394,7 +394,8 @@ status_t OMXCameraAdapter::fillThisBuffer(void* frameBuf, CameraFrame::FrameType
                     CAMHAL_LOGEB("OMX_FillThisBuffer 0x%x", eError);
                     goto EXIT;
                     }
-                mFramesWithDucati++;
+                //fillThisBuffer runs on the threads returning frames
+                android_atomic_inc(( volatile int32_t * ) &mFramesWithDucati);
                 break;
                 }
             }
@@ -2058,10 +2059,7 @@ status_t OMXCameraAdapter::stopPreview()
                 GOTO_EXIT_IF((eError!=OMX_ErrorNone), eError);
                 }
 
-            {
-            Mutex::Autolock lock(mPreviewDataBufferLock);
-            mPreviewDataBuffersAvailable.clear();
-            }
+            mPreviewDataBuffersAvailable.reset();
 
         }
 
@@ -2090,11 +2088,10 @@ status_t OMXCameraAdapter::stopPreview()
         goto EXIT;
         }
 
-        {
-        Mutex::Autolock lock(mPreviewBufferLock);
-        ///Clear all the available preview buffers
-        mPreviewBuffersAvailable.clear();
-        }
+    ///Drop the references of all the preview buffers. returnFrame doesn't take
+    ///mPreviewBufferLock, so the counts are zeroed atomically and the buffers
+    ///stay registered until the next CAMERA_USE_BUFFERS_PREVIEW
+    mPreviewBuffersAvailable.reset();
 
     switchToLoaded();
 
@@ -2111,11 +2108,7 @@ status_t OMXCameraAdapter::stopPreview()
 
 EXIT:
     CAMHAL_LOGEB("Exiting function %s because of ret %d eError=%x", __FUNCTION__, ret, eError);
-    {
-    Mutex::Autolock lock(mPreviewBufferLock);
-    ///Clear all the available preview buffers
-    mPreviewBuffersAvailable.clear();
-    }
+    mPreviewBuffersAvailable.reset();
     performCleanupAfterError();
     LOG_FUNCTION_NAME_EXIT;
     return (ret | ErrorUtils::omxToAndroidError(eError));
@@ -3026,7 +3019,7 @@ OMX_ERRORTYPE OMXCameraAdapter::OMXCameraAdapterFillBufferDone(OMX_IN OMX_HANDLE
         if (mRecording)
             {
             mask |= (unsigned int)CameraFrame::VIDEO_FRAME_SYNC;
-            mFramesWithEncoder++;
+            android_atomic_inc(( volatile int32_t * ) &mFramesWithEncoder);
             }
 
         //ALOGV("FBD pBuffer = 0x%x", pBuffHeader->pBuffer);
@@ -3043,9 +3036,9 @@ OMX_ERRORTYPE OMXCameraAdapter::OMXCameraAdapterFillBufferDone(OMX_IN OMX_HANDLE
           }
 
         stat = sendCallBacks(cameraFrame, pBuffHeader, mask, pPortParam);
-        mFramesWithDisplay++;
+        android_atomic_inc(( volatile int32_t * ) &mFramesWithDisplay);
 
-        mFramesWithDucati--;
+        android_atomic_dec(( volatile int32_t * ) &mFramesWithDucati);
 
 #ifdef DEBUG_LOG
         if(mBuffersWithDucati.indexOfKey((int)pBuffHeader->pBuffer)<0)
@@ -3269,6 +3262,13 @@ status_t OMXCameraAdapter::sendCallBacks(CameraFrame frame, OMX_IN OMX_BUFFERHEA
 
   frame.mTimestamp = (pBuffHeader->nTimeStamp * 1000) - mTimeSourceDelta;
 
+  // Until the first recorded frame anchors mTimeSourceDelta the timestamps
+  // are on the Ducati clock
+  if ( !onlyOnce )
+    {
+      frame.mQuirks |= CameraFrame::TIMESTAMP_MONOTONIC;
+    }
+
   ret = setInitFrameRefCount(frame.mBuffer, mask);
 
   if (ret != NO_ERROR) {
@@ -32,6 +32,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <poll.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/select.h>
@@ -78,7 +79,9 @@ status_t V4LCameraAdapter::initialize(CameraProperties::Properties* caps)
         return NO_MEMORY;
         }
 
-    if ((mCameraHandle = open(device, O_RDWR)) == -1)
+    // Non-blocking so that the preview thread can drain every ready buffer
+    // after a single poll() wakeup
+    if ((mCameraHandle = open(device, O_RDWR | O_NONBLOCK)) == -1)
         {
         CAMHAL_LOGEB("Error while opening handle to V4L2 Camera: %s", strerror(errno));
         return -EINVAL;
@@ -103,10 +106,32 @@ status_t V4LCameraAdapter::initialize(CameraProperties::Properties* caps)
         return -EINVAL;
         }
 
+    // MJPEG lets USB2 cameras reach 720p30/1080p30, raw YUYV is kept
+    // as fallback and can be forced by setting camera.v4l.mjpeg to 0
+    mMJPEGSupported = false;
+    property_get("camera.v4l.mjpeg", value, "1");
+    if ( atoi(value) )
+        {
+        struct v4l2_fmtdesc fmtdesc;
+
+        memset(&fmtdesc, 0, sizeof(fmtdesc));
+        fmtdesc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        while ( 0 == ioctl(mCameraHandle, VIDIOC_ENUM_FMT, &fmtdesc) )
+            {
+            if ( V4L2_PIX_FMT_MJPEG == fmtdesc.pixelformat )
+                {
+                mMJPEGSupported = true;
+                }
+            fmtdesc.index++;
+            }
+        }
+    CAMHAL_LOGDB("MJPEG capture %s", mMJPEGSupported ? "enabled" : "disabled");
+
     // Initialize flags
     mPreviewing = false;
     mVideoInfo->isStreaming = false;
     mRecording = false;
+    resetFrameStats();
 
     LOG_FUNCTION_NAME_EXIT;
 
@@ -129,11 +154,15 @@ status_t V4LCameraAdapter::fillThisBuffer(void* frameBuf, CameraFrame::FrameType
         return BAD_VALUE;
         }
 
-    mVideoInfo->buf.index = i;
-    mVideoInfo->buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    mVideoInfo->buf.memory = V4L2_MEMORY_MMAP;
+    // Buffers come back from the display and decode threads while the
+    // preview thread is dequeuing, so don't share mVideoInfo->buf
+    struct v4l2_buffer buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.index = i;
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
 
-    ret = ioctl(mCameraHandle, VIDIOC_QBUF, &mVideoInfo->buf);
+    ret = ioctl(mCameraHandle, VIDIOC_QBUF, &buf);
     if (ret < 0) {
        CAMHAL_LOGEA("Init: VIDIOC_QBUF Failed");
        return -1;
@@ -160,19 +189,45 @@ status_t V4LCameraAdapter::setParameters(const CameraParameters &params)
     mVideoInfo->width = width;
     mVideoInfo->height = height;
     mVideoInfo->framesizeIn = (width * height << 1);
-    mVideoInfo->formatIn = DEFAULT_PIXEL_FORMAT;
+    mVideoInfo->formatIn = mMJPEGSupported ? V4L2_PIX_FMT_MJPEG : DEFAULT_PIXEL_FORMAT;
 
     mVideoInfo->format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     mVideoInfo->format.fmt.pix.width = width;
     mVideoInfo->format.fmt.pix.height = height;
-    mVideoInfo->format.fmt.pix.pixelformat = DEFAULT_PIXEL_FORMAT;
+    mVideoInfo->format.fmt.pix.pixelformat = mVideoInfo->formatIn;
 
     ret = ioctl(mCameraHandle, VIDIOC_S_FMT, &mVideoInfo->format);
+    if ( ( ret < 0 ) && ( V4L2_PIX_FMT_MJPEG == mVideoInfo->formatIn ) ) {
+        CAMHAL_LOGDB("MJPEG %d x %d not accepted, falling back to YUYV", width, height);
+        mVideoInfo->formatIn = DEFAULT_PIXEL_FORMAT;
+        mVideoInfo->format.fmt.pix.width = width;
+        mVideoInfo->format.fmt.pix.height = height;
+        mVideoInfo->format.fmt.pix.pixelformat = DEFAULT_PIXEL_FORMAT;
+        ret = ioctl(mCameraHandle, VIDIOC_S_FMT, &mVideoInfo->format);
+    }
     if (ret < 0) {
         CAMHAL_LOGEB("Open: VIDIOC_S_FMT Failed: %s", strerror(errno));
         return ret;
     }
 
+    if ( V4L2_PIX_FMT_MJPEG == mVideoInfo->formatIn ) {
+        struct v4l2_streamparm parm;
+        int fps = params.getPreviewFrameRate();
+
+        mVideoInfo->framesizeIn = mVideoInfo->format.fmt.pix.sizeimage;
+
+        // Compressed frames fit the bus, so ask for the full preview rate
+        if ( 0 < fps ) {
+            memset(&parm, 0, sizeof(parm));
+            parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            parm.parm.capture.timeperframe.numerator = 1;
+            parm.parm.capture.timeperframe.denominator = fps;
+            if ( ioctl(mCameraHandle, VIDIOC_S_PARM, &parm) < 0 ) {
+                CAMHAL_LOGDB("VIDIOC_S_PARM %d fps failed: %s", fps, strerror(errno));
+            }
+        }
+    }
+
     // Udpate the current parameter set
     mParams = params;
 
@@ -321,6 +376,13 @@ status_t V4LCameraAdapter::startPreview()
        mVideoInfo->isStreaming = true;
    }
 
+   resetFrameStats();
+
+   if ( V4L2_PIX_FMT_MJPEG == mVideoInfo->formatIn )
+       {
+       startDecoders();
+       }
+
    // Create and start preview thread for receiving buffers from V4L Camera
    mPreviewThread = new PreviewThread(this);
 
@@ -346,6 +408,19 @@ status_t V4LCameraAdapter::stopPreview()
         return NO_INIT;
         }
 
+    // The preview thread wakes up at least every FRAME_POLL_TIMEOUT, or is
+    // parked after persistent poll errors, so it can be joined before the
+    // mapped buffers go away
+        {
+        Mutex::Autolock lock(mPollErrorLock);
+        mPreviewing = false;
+        mPollErrorCondition.signal();
+        }
+    mPreviewThread->requestExitAndWait();
+    mPreviewThread.clear();
+
+    stopDecoders();
+
     if (mVideoInfo->isStreaming) {
         bufType = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 
@@ -371,14 +446,74 @@ status_t V4LCameraAdapter::stopPreview()
 
     mPreviewBufs.clear();
 
-    mPreviewThread->requestExitAndWait();
-    mPreviewThread.clear();
+    CAMHAL_LOGDB("Preview stopped: %d frames, %u dropped by the driver",
+                 mFrameCount, mDroppedFrames);
 
     return ret;
 
 }
 
-char * V4LCameraAdapter::GetFrame(int &index)
+void V4LCameraAdapter::resetFrameStats()
+{
+    mFrameCount = 0;
+    mLastFrameCount = 0;
+    mIter = 1;
+    mLastFPSTime = systemTime();
+    mFPS = mLastFPS = 0;
+
+    mPollErrors = 0;
+    mLastSequence = 0;
+    mSequenceValid = false;
+    mDroppedFrames = 0;
+    mLatencyCount = 0;
+    mLatencySum = 0;
+    mLatencyMax = 0;
+    mDecodeCount = 0;
+    mDecodeErrors = 0;
+    mDecodeTimeSum = 0;
+}
+
+void V4LCameraAdapter::startDecoders()
+{
+    Mutex::Autolock lock(mDecodeLock);
+
+    mDecodeQueue.clear();
+    mDecodeSeq = 0;
+    mDeliverSeq = 0;
+    mDecodeExit = false;
+
+    for ( int i = 0; i < MJPEG_DECODE_THREADS; i++ )
+        {
+        mDecodeThreads[i] = new DecodeThread(this);
+        }
+
+    CAMHAL_LOGDB("Started %d MJPEG decode threads", MJPEG_DECODE_THREADS);
+}
+
+void V4LCameraAdapter::stopDecoders()
+{
+    {
+    Mutex::Autolock lock(mDecodeLock);
+    mDecodeExit = true;
+    mDecodeCondition.broadcast();
+    mDeliverCondition.broadcast();
+    }
+
+    for ( int i = 0; i < MJPEG_DECODE_THREADS; i++ )
+        {
+        if ( NULL != mDecodeThreads[i].get() )
+            {
+            mDecodeThreads[i]->requestExitAndWait();
+            mDecodeThreads[i].clear();
+            }
+        }
+
+    mDecodeQueue.clear();
+}
+
+///Dequeues one filled buffer without blocking. Returns NULL once the driver
+///has no more ready buffers (EAGAIN) or on error.
+char * V4LCameraAdapter::GetFrame(int &index, nsecs_t &timestamp)
 {
     int ret;
 
@@ -388,11 +523,34 @@ char * V4LCameraAdapter::GetFrame(int &index)
     /* DQ */
     ret = ioctl(mCameraHandle, VIDIOC_DQBUF, &mVideoInfo->buf);
     if (ret < 0) {
-        CAMHAL_LOGEA("GetFrame: VIDIOC_DQBUF Failed");
+        if (errno != EAGAIN) {
+            CAMHAL_LOGEB("GetFrame: VIDIOC_DQBUF Failed: %s", strerror(errno));
+        }
         return NULL;
     }
     nDequeued++;
 
+    //The driver increments the sequence for every captured frame, including
+    //the ones it had to discard because no buffer was queued
+    if (mSequenceValid && (mVideoInfo->buf.sequence > (mLastSequence + 1))) {
+        mDroppedFrames += mVideoInfo->buf.sequence - mLastSequence - 1;
+    }
+    mLastSequence = mVideoInfo->buf.sequence;
+    mSequenceValid = true;
+
+#ifdef V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC
+    if ((mVideoInfo->buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) ==
+        V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+        timestamp = s2ns(mVideoInfo->buf.timestamp.tv_sec) +
+                    us2ns(mVideoInfo->buf.timestamp.tv_usec);
+    } else
+#endif
+    {
+        //Driver timestamp is not on the monotonic clock, fall back to
+        //the dequeue time
+        timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
+    }
+
     index = mVideoInfo->buf.index;
 
     return (char *)mVideoInfo->mem[mVideoInfo->buf.index];
@@ -469,6 +627,25 @@ status_t V4LCameraAdapter::recalculateFPS()
 
         mLastFPS = mFPS;
         mIter++;
+
+        if ( UNLIKELY(mDebugFps) && ( 0 < mLatencyCount ) )
+            {
+            ALOGD("Camera %d Frames, %f FPS, %u dropped, latency avg %lld us max %lld us",
+                  mFrameCount, mFPS, mDroppedFrames,
+                  ns2us(mLatencySum / mLatencyCount), ns2us(mLatencyMax));
+            }
+
+        if ( UNLIKELY(mDebugFps) && ( 0 < mDecodeCount ) )
+            {
+            ALOGD("Camera MJPEG decode avg %lld us/frame, %u corrupted frames",
+                  ns2us(mDecodeTimeSum / mDecodeCount), mDecodeErrors);
+            }
+
+        mLatencyCount = 0;
+        mLatencySum = 0;
+        mLatencyMax = 0;
+        mDecodeCount = 0;
+        mDecodeTimeSum = 0;
         }
 
     return NO_ERROR;
@@ -513,16 +690,95 @@ V4LCameraAdapter::~V4LCameraAdapter()
 int V4LCameraAdapter::previewThread()
 {
     status_t ret = NO_ERROR;
-    int width, height;
-    CameraFrame frame;
 
-    if (mPreviewing)
+    if (!mPreviewing)
+        {
+        return NO_ERROR;
+        }
+
+    //The capture failed: leave the device alone until stopPreview
+    if ( POLL_ERROR_LIMIT <= mPollErrors )
+        {
+        Mutex::Autolock lock(mPollErrorLock);
+        while ( mPreviewing )
+            {
+            mPollErrorCondition.wait(mPollErrorLock);
+            }
+        return NO_ERROR;
+        }
+
+    struct pollfd pfd;
+    pfd.fd = mCameraHandle;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    ret = poll(&pfd, 1, FRAME_POLL_TIMEOUT);
+    if ( 0 == ret )
+        {
+        CAMHAL_LOGDA("No frame from the V4L camera within the poll timeout");
+        return TIMED_OUT;
+        }
+    else if ( 0 > ret )
+        {
+        if ( EINTR != errno )
+            {
+            CAMHAL_LOGEB("Poll on V4L camera failed: %s", strerror(errno));
+            }
+        return -errno;
+        }
+    else if ( pfd.revents & ( POLLERR | POLLHUP | POLLNVAL ) )
+        {
+        //A persistent error condition makes poll() return immediately:
+        //back off instead of spinning, and give up after a few attempts
+        mPollErrors++;
+        if ( POLL_ERROR_LIMIT == mPollErrors )
+            {
+            CAMHAL_LOGEB("V4L camera poll error persists (revents 0x%x), capture failed",
+                         pfd.revents);
+            if ( NULL != mErrorNotifier )
+                {
+                mErrorNotifier->errorNotify(CAMERA_ERROR_HARD);
+                }
+            }
+        else if ( 1 == mPollErrors )
+            {
+            CAMHAL_LOGEB("V4L camera poll error, revents 0x%x", pfd.revents);
+            }
+
+        //Past the limit, the next round parks the thread instead
+        if ( POLL_ERROR_LIMIT > mPollErrors )
+            {
+            usleep((POLL_ERROR_BACKOFF << (mPollErrors - 1)) * 1000);
+            }
+        return UNKNOWN_ERROR;
+        }
+
+    ret = NO_ERROR;
+    mPollErrors = 0;
+
+    //Drain every buffer the driver has ready before sleeping again
+    while (mPreviewing)
         {
         int index = 0;
-        char *fp = this->GetFrame(index);
+        nsecs_t timestamp = 0;
+        char *fp = this->GetFrame(index, timestamp);
         if(!fp)
             {
-            return BAD_VALUE;
+            break;
+            }
+
+        if ( V4L2_PIX_FMT_MJPEG == mVideoInfo->formatIn )
+            {
+            //Hand the frame to the decode pool, delivery happens there
+            Mutex::Autolock lock(mDecodeLock);
+            DecodeJob job;
+            job.index = index;
+            job.size = mVideoInfo->buf.bytesused;
+            job.seq = mDecodeSeq++;
+            job.timestamp = timestamp;
+            mDecodeQueue.push_back(job);
+            mDecodeCondition.signal();
+            continue;
             }
 
         uint8_t* ptr = (uint8_t*) mPreviewBufs.keyAt(index);
@@ -542,24 +798,112 @@ int V4LCameraAdapter::previewThread()
                 src++;
                 dest++;
                 }
-                dest += 4096/2-width;
+                dest += PREVIEW_BUFFER_STRIDE/2-width;
             }
 
-        mParams.getPreviewSize(&width, &height);
-        frame.mFrameType = CameraFrame::PREVIEW_FRAME_SYNC;
-        frame.mBuffer = ptr;
-        frame.mLength = width*height*2;
-        frame.mAlignment = width*2;
-        frame.mOffset = 0;
-        frame.mTimestamp = systemTime(SYSTEM_TIME_MONOTONIC);;
+        ret = deliverFrame(ptr, timestamp);
+        }
+
+    return ret;
+}
 
-        ret = sendFrameToSubscribers(&frame);
+status_t V4LCameraAdapter::deliverFrame(uint8_t *ptr, nsecs_t timestamp)
+{
+    status_t ret = NO_ERROR;
+    int width, height;
+    CameraFrame frame;
 
+    mParams.getPreviewSize(&width, &height);
+    frame.mFrameType = CameraFrame::PREVIEW_FRAME_SYNC;
+    frame.mBuffer = ptr;
+    frame.mLength = width*height*2;
+    frame.mAlignment = width*2;
+    frame.mOffset = 0;
+    frame.mTimestamp = timestamp;
+    //GetFrame falls back to the dequeue time for other driver clocks
+    frame.mQuirks = CameraFrame::TIMESTAMP_MONOTONIC;
+
+    ret = sendFrameToSubscribers(&frame);
+
+    nsecs_t latency = systemTime(SYSTEM_TIME_MONOTONIC) - timestamp;
+    mLatencySum += latency;
+    mLatencyCount++;
+    if ( latency > mLatencyMax )
+        {
+        mLatencyMax = latency;
         }
 
+    recalculateFPS();
+
     return ret;
 }
 
+bool V4LCameraAdapter::decodeThread(Decoder_libjpeg &decoder)
+{
+    DecodeJob job;
+    uint8_t *ptr;
+    nsecs_t decodeTime;
+    bool decoded;
+
+    {
+    Mutex::Autolock lock(mDecodeLock);
+    while ( mDecodeQueue.isEmpty() && !mDecodeExit )
+        {
+        mDecodeCondition.wait(mDecodeLock);
+        }
+
+    if ( mDecodeExit )
+        {
+        return false;
+        }
+
+    job = mDecodeQueue[0];
+    mDecodeQueue.removeAt(0);
+    }
+
+    ptr = (uint8_t*) mPreviewBufs.keyAt(job.index);
+
+    decodeTime = systemTime();
+    decoded = decoder.decode((uint8_t*) mVideoInfo->mem[job.index], job.size, ptr,
+                             mVideoInfo->width, mVideoInfo->height, PREVIEW_BUFFER_STRIDE);
+    decodeTime = systemTime() - decodeTime;
+
+    //Deliver in capture order, frame N goes out while N+1 is still decoding
+    {
+    Mutex::Autolock lock(mDecodeLock);
+    while ( ( job.seq != mDeliverSeq ) && !mDecodeExit )
+        {
+        mDeliverCondition.wait(mDecodeLock);
+        }
+
+    if ( mDecodeExit )
+        {
+        return false;
+        }
+    }
+
+    if ( decoded )
+        {
+        mDecodeTimeSum += decodeTime;
+        mDecodeCount++;
+        deliverFrame(ptr, job.timestamp);
+        }
+    else
+        {
+        CAMHAL_LOGDB("Dropping corrupted MJPEG frame %u", job.seq);
+        mDecodeErrors++;
+        fillThisBuffer(ptr, CameraFrame::PREVIEW_FRAME_SYNC);
+        }
+
+    {
+    Mutex::Autolock lock(mDecodeLock);
+    mDeliverSeq++;
+    mDeliverCondition.broadcast();
+    }
+
+    return true;
+}
+
 extern "C" CameraAdapter* CameraAdapter_Factory()
 {
     CameraAdapter *adapter = NULL;
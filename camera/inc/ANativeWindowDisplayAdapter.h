@@ -43,6 +43,9 @@ public:
         int mWidthStride;
         int mHeightStride;
         int mLength;
+        int mIndex; ///< Slot in the gralloc handle maps, resolved once per frame
+        nsecs_t mTimestamp;
+        bool mTimestampMonotonic; ///< mTimestamp is on SYSTEM_TIME_MONOTONIC
         CameraFrame::FrameType mType;
         } DisplayFrame;
 
@@ -99,11 +102,21 @@ public:
     status_t PostFrame(ANativeWindowDisplayAdapter::DisplayFrame &dispFrame);
     bool handleFrameReturn();
     status_t returnBuffersToWindow();
+    status_t buildBufferIndex();
+    bool dropFrame(ANativeWindowDisplayAdapter::DisplayFrame &dispFrame);
+    void dumpFrameStats();
+    int getBufferIndex(const void *grallocHandle) const;
+    void setFrameWithCamera(int index, bool withCamera);
+    void clearFramesWithCamera();
 
 public:
 
     static const int DISPLAY_TIMEOUT;
     static const int FAILED_DQS_TO_SUSPEND;
+    static const int DEFAULT_REFRESH_RATE;
+    static const int DEFAULT_LATE_THRESHOLD_MS;
+    static const int DEFAULT_MIN_BUFFERS_WITH_CAMERA;
+    static const int FRAME_STATS_PERIOD;
 
     class DisplayThread : public Thread
         {
@@ -159,7 +172,13 @@ private:
     IMG_native_handle_t** mGrallocHandleMap;
     uint32_t* mOffsetsMap;
     int mFD;
-    KeyedVector<int, int> mFramesWithCameraAdapterMap;
+    ///Per buffer slot, true while the buffer is with the camera adapter
+    bool *mFramesWithCameraAdapter;
+    ///Number of slots set in mFramesWithCameraAdapter
+    int mBuffersWithCamera;
+    ///Open addressed gralloc handle to slot index, holds index + 1
+    int *mBufferIndexHash;
+    unsigned int mBufferIndexHashSize;
     sp<ErrorNotifier> mErrorNotifier;
 
     uint32_t mFrameWidth;
@@ -170,7 +189,16 @@ private:
     uint32_t mXOff;
     uint32_t mYOff;
 
-    const char *mPixelFormat;
+    uint8_t mBytesPerPixel;
+
+    ///Frame pacing, see dropFrame()
+    nsecs_t mDisplayPeriod;
+    nsecs_t mLateThreshold;
+    nsecs_t mLastPostTime;
+    int mMinBuffersWithCamera;
+    uint32_t mFramesOnTime;
+    uint32_t mFramesLate;
+    uint32_t mFramesDropped;
 
 #if PPM_INSTRUMENTATION || PPM_INSTRUMENTATION_ABS
     //Used for calculating standby to first shot
@@ -20,6 +20,7 @@
 #define BASE_CAMERA_ADAPTER_H
 
 #include "CameraHal.h"
+#include "FrameRefTable.h"
 
 namespace android {
 
@@ -163,6 +164,7 @@ protected:
 
 // private member functions
 private:
+    FrameRefTable *getFrameRefTable(CameraFrame::FrameType frameType, FrameRefTable::Lane &lane);
     status_t __sendFrameToSubscribers(CameraFrame* frame,
                                       KeyedVector<int, frame_callback> *subscribers,
                                       CameraFrame::FrameType frameType);
@@ -198,8 +200,6 @@ protected:
 
 #endif
 
-    mutable Mutex mReturnFrameLock;
-
     //Lock protecting the Adapter state
     mutable Mutex mLock;
     AdapterState mAdapterState;
@@ -220,26 +220,26 @@ protected:
     int *mPreviewBuffers;
     int mPreviewBufferCount;
     size_t mPreviewBuffersLength;
-    KeyedVector<int, int> mPreviewBuffersAvailable;
+    //Preview and video references share this table, one lane each
+    FrameRefTable mPreviewBuffersAvailable;
     mutable Mutex mPreviewBufferLock;
 
     //Video buffer management data
     int *mVideoBuffers;
-    KeyedVector<int, int> mVideoBuffersAvailable;
     int mVideoBuffersCount;
     size_t mVideoBuffersLength;
     mutable Mutex mVideoBufferLock;
 
     //Image buffer management data
     int *mCaptureBuffers;
-    KeyedVector<int, bool> mCaptureBuffersAvailable;
+    FrameRefTable mCaptureBuffersAvailable;
     int mCaptureBuffersCount;
     size_t mCaptureBuffersLength;
     mutable Mutex mCaptureBufferLock;
 
     //Metadata buffermanagement
     int *mPreviewDataBuffers;
-    KeyedVector<int, bool> mPreviewDataBuffersAvailable;
+    FrameRefTable mPreviewDataBuffersAvailable;
     int mPreviewDataBuffersCount;
     size_t mPreviewDataBuffersLength;
     mutable Mutex mPreviewDataBufferLock;
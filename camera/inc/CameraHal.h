@@ -249,6 +249,7 @@ class CameraFrame
     {
         ENCODE_RAW_YUV422I_TO_JPEG = 0x1 << 0,
         HAS_EXIF_DATA = 0x1 << 1,
+        TIMESTAMP_MONOTONIC = 0x1 << 2, ///mTimestamp is on SYSTEM_TIME_MONOTONIC
     };
 
     //default contrustor
@@ -699,7 +700,6 @@ private:
 
     sp<ErrorNotifier> mErrorNotifier;
     int mIonFd;
-    KeyedVector<unsigned int, unsigned int> mIonHandleMap;
     KeyedVector<unsigned int, unsigned int> mIonFdMap;
     KeyedVector<unsigned int, unsigned int> mIonBufLength;
 };
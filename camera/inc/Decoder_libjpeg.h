@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file Decoder_libjpeg.h
+*
+* This defines API for camerahal to decode MJPEG frames using libjpeg
+*
+*/
+
+#ifndef ANDROID_CAMERA_HARDWARE_DECODER_LIBJPEG_H
+#define ANDROID_CAMERA_HARDWARE_DECODER_LIBJPEG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace android {
+
+struct libjpeg_decoder_ctx;
+
+/**
+ * libjpeg decoder class - decodes a single JPEG/MJPEG frame into UYVY
+ *
+ * An instance keeps its libjpeg state between frames, so it must only be
+ * used from one thread at a time. Frames without Huffman tables (as sent by
+ * most UVC cameras) are decoded with the standard tables from the spec.
+ */
+class Decoder_libjpeg {
+    public:
+        Decoder_libjpeg();
+        ~Decoder_libjpeg();
+
+        /**
+         * Decodes src into a UYVY image of width x height pixels, with
+         * stride bytes between output rows. Returns false if the frame is
+         * corrupted or its dimensions don't match.
+         */
+        bool decode(uint8_t* src, size_t size, uint8_t* dst,
+                    int width, int height, int stride);
+
+    private:
+        libjpeg_decoder_ctx* mCtx;
+        uint8_t* mRow;
+        int mRowSize;
+};
+
+}
+
+#endif
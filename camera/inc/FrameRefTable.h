@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+#ifndef FRAME_REF_TABLE_H
+#define FRAME_REF_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <cutils/atomic.h>
+#include <utils/Errors.h>
+
+namespace android {
+
+/**
+  * Per buffer reference counts, indexed by the buffer address.
+  *
+  * The buffer set is registered with clear()/add() at useBuffers time, while no
+  * frames are in flight. After that the address to slot lookup is read-only and
+  * the counts are updated with atomic operations, so frame delivery and returns
+  * don't need a lock. Each slot packs one 16-bit count per lane, which lets a
+  * buffer shared by preview and video be released exactly once.
+  */
+class FrameRefTable
+{
+public:
+
+    enum Lane {
+        LANE_FRAME = 0,
+        LANE_VIDEO,
+        LANE_MAX
+    };
+
+    static const int MAX_BUFFERS = 32;
+
+    FrameRefTable();
+
+    //Not thread safe, buffers must not be in flight
+    void clear();
+    status_t add(int key, int refCount);
+
+    size_t size() const { return mCount; }
+    int keyAt(size_t index) const { return mKeys[index]; }
+
+    //Lock-free accessors, -1 is returned for unknown buffers
+    int get(int key, Lane lane = LANE_FRAME) const;
+    void set(int key, int refCount, Lane lane = LANE_FRAME);
+
+    //Drops one reference in lane and returns the references left in that lane,
+    //or in all lanes if combined is set. Returns -1 if the lane count was zero.
+    int release(int key, Lane lane, bool combined);
+
+    //Zero the counts of one lane, or of all lanes. The buffers stay registered,
+    //so a concurrent release() either drops a reference first or finds a zero
+    //count, it can't bring a count back after the reset.
+    void clearLane(Lane lane);
+    void reset();
+
+private:
+
+    static const int HASH_SIZE = MAX_BUFFERS * 2;
+    static const int LANE_BITS = 16;
+    static const int32_t LANE_MASK = 0xFFFF;
+
+    int slotFor(int key) const;
+
+    int mKeys[MAX_BUFFERS];
+    volatile int32_t mRefs[MAX_BUFFERS];
+    //open addressed, holds slot + 1, 0 marks an empty bucket
+    int mHash[HASH_SIZE];
+    size_t mCount;
+};
+
+};
+
+#endif //FRAME_REF_TABLE_H
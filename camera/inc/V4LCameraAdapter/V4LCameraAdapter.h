@@ -22,12 +22,14 @@
 #include "CameraHal.h"
 #include "BaseCameraAdapter.h"
 #include "DebugUtils.h"
+#include "Decoder_libjpeg.h"
 
 namespace android {
 
 #define DEFAULT_PIXEL_FORMAT V4L2_PIX_FMT_YUYV
 #define NB_BUFFER 10
 #define DEVICE "/dev/video4"
+#define PREVIEW_BUFFER_STRIDE 4096
 
 
 struct VideoInfo {
@@ -62,6 +64,18 @@ public:
     ///Five second timeout
     static const int CAMERA_ADAPTER_TIMEOUT = 5000*1000;
 
+    ///One second wait for the driver to signal a filled buffer, in ms
+    static const int FRAME_POLL_TIMEOUT = 1000;
+
+    ///Back-off after a poll error, doubled on each consecutive error, in ms
+    static const int POLL_ERROR_BACKOFF = 10;
+
+    ///Consecutive poll errors after which the capture is reported as failed
+    static const unsigned int POLL_ERROR_LIMIT = 8;
+
+    ///Number of worker threads decoding MJPEG frames in parallel
+    static const int MJPEG_DECODE_THREADS = 2;
+
 public:
 
     V4LCameraAdapter();
@@ -112,13 +126,42 @@ private:
             }
         };
 
+    class DecodeThread : public Thread {
+            V4LCameraAdapter* mAdapter;
+            Decoder_libjpeg mDecoder;
+        public:
+            DecodeThread(V4LCameraAdapter* hw) :
+                    Thread(false), mAdapter(hw) { }
+            virtual void onFirstRef() {
+                run("CameraMJPEGDecodeThread", PRIORITY_URGENT_DISPLAY);
+            }
+            virtual bool threadLoop() {
+                return mAdapter->decodeThread(mDecoder);
+            }
+        };
+
+    struct DecodeJob {
+        int index;
+        size_t size;
+        unsigned int seq;
+        nsecs_t timestamp;
+    };
+
     //Used for calculation of the average frame rate during preview
     status_t recalculateFPS();
 
-    char * GetFrame(int &index);
+    char * GetFrame(int &index, nsecs_t &timestamp);
+
+    void resetFrameStats();
 
     int previewThread();
 
+    status_t deliverFrame(uint8_t *ptr, nsecs_t timestamp);
+
+    void startDecoders();
+    void stopDecoders();
+    bool decodeThread(Decoder_libjpeg &decoder);
+
 public:
 
 private:
@@ -148,10 +191,41 @@ private:
      struct VideoInfo *mVideoInfo;
      int mCameraHandle;
 
+     //MJPEG decode pool, frames are delivered in mDecodeSeq order
+     bool mMJPEGSupported;
+     sp<DecodeThread> mDecodeThreads[MJPEG_DECODE_THREADS];
+     Vector<DecodeJob> mDecodeQueue;
+     Mutex mDecodeLock;
+     Condition mDecodeCondition;
+     Condition mDeliverCondition;
+     unsigned int mDecodeSeq;
+     unsigned int mDeliverSeq;
+     bool mDecodeExit;
+
 
     int nQueued;
     int nDequeued;
 
+    //Consecutive POLLERR/POLLHUP wakeups, only touched by the preview thread
+    unsigned int mPollErrors;
+    //Wakes the preview thread parked after POLL_ERROR_LIMIT for stopPreview
+    Mutex mPollErrorLock;
+    Condition mPollErrorCondition;
+
+    //Capture accounting. The sequence and drop counters are updated by the
+    //preview thread, the latency and decode counters by the thread that
+    //delivers the frame: the preview thread for raw formats, the decode
+    //thread holding the current mDeliverSeq turn for MJPEG
+    uint32_t mLastSequence;
+    bool mSequenceValid;
+    unsigned int mDroppedFrames;
+    unsigned int mLatencyCount;
+    nsecs_t mLatencySum;
+    nsecs_t mLatencyMax;
+    unsigned int mDecodeCount;
+    unsigned int mDecodeErrors;
+    nsecs_t mDecodeTimeSum;
+
 };
 }; //// namespace
 #endif //V4L_CAMERA_ADAPTER_H
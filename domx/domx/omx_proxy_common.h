@@ -145,6 +145,9 @@ extern "C"
 #ifdef USE_ION
 		int mmap_fd;
 		int mmap_fd_metadata_buff;
+		/* registry buffer passed by pointer, see RPC_RegisterBuffer */
+		OMX_BOOL bRemoteRegistered;
+		int registered_fd;
 #endif
 	} PROXY_BUFFER_INFO;
 
@@ -181,42 +181,61 @@ char Core_Array[][MAX_CORENAME_LENGTH] =
 
 #ifdef USE_ION
 
+/* The remote core uses a buffer it was given until FreeBuffer, whoever
+ * owns it on this side. Registering takes a registry reference and
+ * mapping for it and imports it into the rpmsg-omx client, so neither is
+ * freed while the remote still addresses it. fd must be a registry share
+ * fd. */
 RPC_OMX_ERRORTYPE RPC_RegisterBuffer(OMX_HANDLETYPE hRPCCtx, int fd,
-				     struct ion_handle **handle)
+				     const char *client, struct ion_handle **handle)
 {
 	int status;
 	struct ion_fd_data data;
+	unsigned char *ptr;
 	RPC_OMX_CONTEXT *pRPCCtx = (RPC_OMX_CONTEXT *) hRPCCtx;
 
+	if (ion_registry_import(fd, client, NULL) < 0)
+		return RPC_OMX_ErrorBadParameter;
+	if (ion_registry_map(fd, &ptr) < 0)
+	{
+		ion_registry_release(fd, client);
+		return RPC_OMX_ErrorInsufficientResources;
+	}
+
 	data.fd = fd;
 	status = ioctl(pRPCCtx->fd_omx, ION_IOC_IMPORT, &data);
 	if (status < 0)
+	{
+		ion_registry_unmap(fd);
+		ion_registry_release(fd, client);
 		return RPC_OMX_ErrorInsufficientResources;
+	}
 	*handle = data.handle;
 	return RPC_OMX_ErrorNone;
 }
 
+/* Drops what RPC_RegisterBuffer took on this side. rpmsg-omx keeps its
+ * import until fd_omx is closed by RPC_InstanceDeInit. */
+RPC_OMX_ERRORTYPE RPC_UnRegisterBuffer(OMX_HANDLETYPE hRPCCtx, int fd,
+				       const char *client)
+{
+	ion_registry_unmap(fd);
+	if (ion_registry_release(fd, client) < 0)
+		return RPC_OMX_ErrorBadParameter;
+	return RPC_OMX_ErrorNone;
+}
+
 static OMX_ERRORTYPE PROXY_AllocateBufferIonCarveout(PROXY_COMPONENT_PRIVATE *pCompPrv,
-						 size_t len, struct ion_handle **handle)
+						 size_t len, struct ion_handle **handle, int *share_fd)
 {
-	int fd;
 	int ret;
 	struct ion_handle *temp;
 
-	ret = ion_alloc(pCompPrv->ion_fd, len, 0x1000, 1 << ION_HEAP_TYPE_CARVEOUT, &temp);
+	ret = ion_registry_alloc(len, 0x1000, 1 << ION_HEAP_TYPE_CARVEOUT,
+				 pCompPrv->cCompName, &temp, share_fd);
 	DOMX_DEBUG("ION being USED for allocation!!!!! handle = %x, ret =%x",temp,ret);
 	if (ret)
 			return OMX_ErrorInsufficientResources;
-	/*
-	ret = ion_share(pCompPrv->ion_fd, temp, &fd);
-	if (ret) {
-		ion_free(pCompPrv->ion_fd, temp);
-		return OMX_ErrorHardware;
-	}
-	RPC_RegisterBuffer(pCompPrv->hRemoteComp, fd, handle);
-	close(fd);
-	ion_free(pCompPrv->ion_fd, temp);
-	*/
 	*handle = temp;
 	return OMX_ErrorNone;
 }
@@ -646,6 +665,7 @@ OMX_ERRORTYPE PROXY_AllocateBuffer(OMX_IN OMX_HANDLETYPE hComponent,
 	OMX_BOOL bSlotFound = OMX_FALSE;
 #ifdef USE_ION
 	struct ion_handle *handle = NULL;
+	int share_fd = -1;
 #else
      	MemAllocBlock block;
         MemAllocBlock blocks[2];
@@ -755,7 +775,7 @@ OMX_ERRORTYPE PROXY_AllocateBuffer(OMX_IN OMX_HANDLETYPE hComponent,
 #ifdef USE_ION
 	else if (pCompPrv->bUseIon == OMX_TRUE)
 	{
-		eError = PROXY_AllocateBufferIonCarveout(pCompPrv, nSize, &handle);
+		eError = PROXY_AllocateBufferIonCarveout(pCompPrv, nSize, &handle, &share_fd);
 		pMemptr = handle;
 		DOMX_DEBUG ("Ion handle recieved = %x",handle);
 		if (eError != OMX_ErrorNone)
@@ -800,7 +820,7 @@ OMX_ERRORTYPE PROXY_AllocateBuffer(OMX_IN OMX_HANDLETYPE hComponent,
 	if(eError != OMX_ErrorNone) {
 		DOMX_ERROR("PROXY_UseBuffer in PROXY_AllocateBuffer failed with error %d (0x%08x)", eError, eError);
 #ifdef USE_ION
-		ion_free(pCompPrv->ion_fd, pMemptr);
+		ion_registry_release(share_fd, pCompPrv->cCompName);
 #else
 		MemMgr_Free(pMemptr);
 #endif
@@ -808,15 +828,17 @@ OMX_ERRORTYPE PROXY_AllocateBuffer(OMX_IN OMX_HANDLETYPE hComponent,
 	}
 	else {
 		pCompPrv->tBufList[currentBuffer].pYBuffer = pMemptr;
+#ifdef USE_ION
+		/* The share fd doubles as the mmap fd and the registry key */
+		pCompPrv->tBufList[currentBuffer].mmap_fd = share_fd;
+#endif
 	}
 
 #ifdef USE_ION
 	if (pCompPrv->bUseIon == OMX_TRUE && pCompPrv->bMapIonBuffers == OMX_TRUE)
 	{
 		DOMX_DEBUG("before mapping, handle = %x, nSize = %d",handle,nSize);
-        	if (ion_map(pCompPrv->ion_fd, handle, nSize, PROT_READ | PROT_WRITE, MAP_SHARED, 0,
-                          &((*ppBufferHdr)->pBuffer),
-                                    &(pCompPrv->tBufList[currentBuffer].mmap_fd)) < 0)
+        	if (ion_registry_map(share_fd, &((*ppBufferHdr)->pBuffer)) < 0)
 		{
 			DOMX_ERROR("userspace mapping of ION buffers returned error");
 			return OMX_ErrorInsufficientResources;
@@ -960,6 +982,8 @@ static OMX_ERRORTYPE PROXY_UseBuffer(OMX_IN OMX_HANDLETYPE hComponent,
 
 #ifdef USE_ION
 	OMX_PTR pMetadataBuffer = NULL;
+	struct ion_handle *hRegistered = NULL;
+	int nRegisteredFd = -1;
 #else
 	MemAllocBlock block;
 #endif
@@ -1121,7 +1145,8 @@ static OMX_ERRORTYPE PROXY_UseBuffer(OMX_IN OMX_HANDLETYPE hComponent,
 		((OMX_TI_PLATFORMPRIVATE *)pBufferHeader->pPlatformPrivate)->nMetaDataSize = 
 			(tMetaDataBuffer.nMetaDataSize + LINUX_PAGE_SIZE - 1) & ~(LINUX_PAGE_SIZE -1);
 		eError = PROXY_AllocateBufferIonCarveout(pCompPrv, ((OMX_TI_PLATFORMPRIVATE *)pBufferHeader->pPlatformPrivate)->nMetaDataSize,
-			&(((OMX_TI_PLATFORMPRIVATE *)pBufferHeader->pPlatformPrivate)->pMetaDataBuffer));
+			&(((OMX_TI_PLATFORMPRIVATE *)pBufferHeader->pPlatformPrivate)->pMetaDataBuffer),
+			&(pCompPrv->tBufList[currentBuffer].mmap_fd_metadata_buff));
 		pCompPrv->tBufList[currentBuffer].pMetaDataBuffer = ((OMX_TI_PLATFORMPRIVATE *)pBufferHeader->
 			pPlatformPrivate)->pMetaDataBuffer;
 		DOMX_DEBUG("Metadata buffer ion handle = %d",((OMX_TI_PLATFORMPRIVATE *)pBufferHeader->pPlatformPrivate)->pMetaDataBuffer);
@@ -1143,6 +1168,24 @@ static OMX_ERRORTYPE PROXY_UseBuffer(OMX_IN OMX_HANDLETYPE hComponent,
 
 	PROXY_checkRpcError();
 
+#ifdef USE_ION
+	/* Registry buffers handed in by pointer (camera MemoryManager) must
+	 * outlive their owner's release until this FreeBuffer */
+	pCompPrv->tBufList[currentBuffer].bRemoteRegistered = OMX_FALSE;
+	if (pCompPrv->bUseIon == OMX_TRUE &&
+	    pCompPrv->proxyPortBuffers[nPortIndex].proxyBufferType == VirtualPointers)
+	{
+		nRegisteredFd = ion_registry_lookup(pBuffer, nSizeBytes);
+		if (nRegisteredFd >= 0 &&
+		    RPC_RegisterBuffer(pCompPrv->hRemoteComp, nRegisteredFd,
+				       pCompPrv->cCompName, &hRegistered) == RPC_OMX_ErrorNone)
+		{
+			pCompPrv->tBufList[currentBuffer].registered_fd = nRegisteredFd;
+			pCompPrv->tBufList[currentBuffer].bRemoteRegistered = OMX_TRUE;
+		}
+	}
+#endif
+
 	DOMX_DEBUG("Use Buffer Successful");
 	DOMX_DEBUG
 	    ("Value of pBufHeaderRemote: %p LocalBufferHdr :%p, LocalBuffer :%p",
@@ -1153,9 +1196,8 @@ static OMX_ERRORTYPE PROXY_UseBuffer(OMX_IN OMX_HANDLETYPE hComponent,
 	{
 		DOMX_DEBUG("Metadata buffer ion handle given to ion map = %d",
 			((OMX_TI_PLATFORMPRIVATE *)pBufferHeader->pPlatformPrivate)->pMetaDataBuffer);
-        	if (ion_map(pCompPrv->ion_fd, ((OMX_TI_PLATFORMPRIVATE *)pBufferHeader->pPlatformPrivate)->pMetaDataBuffer,
-			((OMX_TI_PLATFORMPRIVATE *)pBufferHeader->pPlatformPrivate)->nMetaDataSize, PROT_READ | PROT_WRITE, MAP_SHARED, 0,
-				&pMetadataBuffer,&(pCompPrv->tBufList[currentBuffer].mmap_fd_metadata_buff)) < 0)
+        	if (ion_registry_map(pCompPrv->tBufList[currentBuffer].mmap_fd_metadata_buff,
+				&pMetadataBuffer) < 0)
 		{
 			DOMX_ERROR("userspace mapping of ION metadata buffers returned error");
 			return OMX_ErrorInsufficientResources;
@@ -1252,6 +1294,13 @@ OMX_ERRORTYPE PROXY_FreeBuffer(OMX_IN OMX_HANDLETYPE hComponent,
 
 	if (pCompPrv->tBufList[count].pBufHeader)
 	{
+#ifdef USE_ION
+		if (pCompPrv->tBufList[count].bRemoteRegistered)
+		{
+			RPC_UnRegisterBuffer(pCompPrv->hRemoteComp,
+			    pCompPrv->tBufList[count].registered_fd, pCompPrv->cCompName);
+		}
+#endif
 #ifdef ALLOCATE_TILER_BUFFER_IN_PROXY
 #ifdef USE_ION
 		if(pCompPrv->tBufList[count].pYBuffer)
@@ -1260,10 +1309,9 @@ OMX_ERRORTYPE PROXY_FreeBuffer(OMX_IN OMX_HANDLETYPE hComponent,
 			{
 				if(pCompPrv->bMapIonBuffers == OMX_TRUE)
 				{
-	                                munmap(pBufferHdr->pBuffer, pBufferHdr->nAllocLen);
-        				close(pCompPrv->tBufList[count].mmap_fd);
+					ion_registry_unmap(pCompPrv->tBufList[count].mmap_fd);
 				}
-				ion_free(pCompPrv->ion_fd, pCompPrv->tBufList[count].pYBuffer);
+				ion_registry_release(pCompPrv->tBufList[count].mmap_fd, pCompPrv->cCompName);
 				pCompPrv->tBufList[count].pYBuffer = NULL;
 			}
 		}
@@ -1284,11 +1332,9 @@ OMX_ERRORTYPE PROXY_FreeBuffer(OMX_IN OMX_HANDLETYPE hComponent,
 			{
 				if(pCompPrv->bMapIonBuffers == OMX_TRUE)
 				{
-	                                munmap(pMetaDataBuffer, ((OMX_TI_PLATFORMPRIVATE *)(pCompPrv->tBufList[count].pBufHeader)->
-							pPlatformPrivate)->nMetaDataSize);
-        				close(pCompPrv->tBufList[count].mmap_fd_metadata_buff);
+					ion_registry_unmap(pCompPrv->tBufList[count].mmap_fd_metadata_buff);
 				}
-				ion_free(pCompPrv->ion_fd, pCompPrv->tBufList[count].pMetaDataBuffer);
+				ion_registry_release(pCompPrv->tBufList[count].mmap_fd_metadata_buff, pCompPrv->cCompName);
 				((OMX_TI_PLATFORMPRIVATE *)(pCompPrv->tBufList[count].pBufHeader)->
 					pPlatformPrivate)->pMetaDataBuffer = NULL;
 			}
@@ -1953,12 +1999,17 @@ OMX_ERRORTYPE PROXY_ComponentDeInit(OMX_HANDLETYPE hComponent)
 
 	pCompPrv = (PROXY_COMPONENT_PRIVATE *) hComp->pComponentPrivate;
 
-	ion_close(pCompPrv->ion_fd);
-
 	for (count = 0; count < pCompPrv->nTotalBuffers; count++)
 	{
 		if (pCompPrv->tBufList[count].pBufHeader)
 		{
+#ifdef USE_ION
+			if (pCompPrv->tBufList[count].bRemoteRegistered)
+			{
+				RPC_UnRegisterBuffer(pCompPrv->hRemoteComp,
+				    pCompPrv->tBufList[count].registered_fd, pCompPrv->cCompName);
+			}
+#endif
 #ifdef ALLOCATE_TILER_BUFFER_IN_PROXY
 			if(pCompPrv->tBufList[count].pYBuffer)
 			{
@@ -1969,10 +2020,9 @@ OMX_ERRORTYPE PROXY_ComponentDeInit(OMX_HANDLETYPE hComponent)
 					{
 						if(pCompPrv->bMapIonBuffers == OMX_TRUE)
 						{
-					                munmap(pCompPrv->tBufList[count].pBufHeader->pBuffer, pCompPrv->tBufList[count].pBufHeader->nAllocLen);
-							close(pCompPrv->tBufList[count].mmap_fd);
+							ion_registry_unmap(pCompPrv->tBufList[count].mmap_fd);
 						}
-						ion_free(pCompPrv->ion_fd, pCompPrv->tBufList[count].pYBuffer);
+						ion_registry_release(pCompPrv->tBufList[count].mmap_fd, pCompPrv->cCompName);
 						pCompPrv->tBufList[count].pYBuffer = NULL;
 					}
 				}
@@ -1990,11 +2040,9 @@ OMX_ERRORTYPE PROXY_ComponentDeInit(OMX_HANDLETYPE hComponent)
 				{
 					if(pCompPrv->bMapIonBuffers == OMX_TRUE)
 					{
-			                        munmap(pMetaDataBuffer, ((OMX_TI_PLATFORMPRIVATE *)(pCompPrv->tBufList[count].pBufHeader)->
-								pPlatformPrivate)->nMetaDataSize);
-						close(pCompPrv->tBufList[count].mmap_fd_metadata_buff);
+						ion_registry_unmap(pCompPrv->tBufList[count].mmap_fd_metadata_buff);
 					}
-					ion_free(pCompPrv->ion_fd, pMetaDataBuffer);
+					ion_registry_release(pCompPrv->tBufList[count].mmap_fd_metadata_buff, pCompPrv->cCompName);
 					((OMX_TI_PLATFORMPRIVATE *)(pCompPrv->tBufList[count].pBufHeader)->
 						pPlatformPrivate)->pMetaDataBuffer = NULL;
 				}
@@ -2013,6 +2061,10 @@ OMX_ERRORTYPE PROXY_ComponentDeInit(OMX_HANDLETYPE hComponent)
 		}
 	}
 
+#ifdef USE_ION
+	ion_registry_close();
+#endif
+
 	eRPCError = RPC_FreeHandle(pCompPrv->hRemoteComp, &eCompReturn);
 	if (eRPCError != RPC_OMX_ErrorNone)
 		eTmpRPCError = eRPCError;
@@ -2115,10 +2167,10 @@ OMX_ERRORTYPE OMX_ProxyCommonInit(OMX_HANDLETYPE hComponent)
 	pCompPrv->bUseIon = OMX_TRUE;
 	pCompPrv->bMapIonBuffers = OMX_TRUE;
 
-	pCompPrv->ion_fd = ion_open();
-	if(pCompPrv->ion_fd == 0)
+	pCompPrv->ion_fd = ion_registry_open();
+	if(pCompPrv->ion_fd < 0)
 	{
-		DOMX_ERROR("ion_open failed!!!");
+		DOMX_ERROR("ion_registry_open failed!!!");
 		return OMX_ErrorInsufficientResources;
 	}
 #endif
@@ -105,13 +105,15 @@ LOCAL_C_INCLUDES += \
 	$(LOCAL_PATH)/../../hwc \
 	$(HARDWARE_TI_OMAP4_BASE)/camera/inc \
 	frameworks/base/include/media/stagefright \
-	frameworks/native/include/media/hardware
+	frameworks/native/include/media/hardware \
+	$(LOCAL_PATH)/omx_colorconvert/inc
 
 LOCAL_SHARED_LIBRARIES := \
 	libmm_osal \
 	libc \
 	libOMX_Core \
 	liblog \
+	libcutils \
 	libdomx \
 	libhardware
 
@@ -122,7 +124,8 @@ LOCAL_CFLAGS += -DUSE_ENHANCED_PORTRECONFIG -DENABLE_GRALLOC_BUFFER -DANDROID_QU
 LOCAL_CFLAGS += -DANDROID_CUSTOM_OPAQUECOLORFORMAT
 LOCAL_MODULE_TAGS:= optional
 
-LOCAL_SRC_FILES:= omx_h264_enc/src/omx_proxy_h264enc.c
+LOCAL_SRC_FILES:= omx_h264_enc/src/omx_proxy_h264enc.c \
+	omx_colorconvert/src/colorconvert_cpu.c.neon
 LOCAL_MODULE:= libOMX.TI.DUCATI1.VIDEO.H264E
 include $(BUILD_HEAPTRACKED_SHARED_LIBRARY)
 
@@ -141,13 +144,15 @@ LOCAL_C_INCLUDES += \
 	$(LOCAL_PATH)/../../hwc \
 	$(HARDWARE_TI_OMAP4_BASE)/camera/inc \
 	frameworks/base/include/media/stagefright \
-	frameworks/native/include/media/hardware
+	frameworks/native/include/media/hardware \
+	$(LOCAL_PATH)/omx_colorconvert/inc
 
 LOCAL_SHARED_LIBRARIES := \
 	libmm_osal \
 	libc \
 	libOMX_Core \
 	liblog \
+	libcutils \
 	libdomx \
 	libhardware
 
@@ -157,7 +162,8 @@ LOCAL_CFLAGS += -DUSE_ENHANCED_PORTRECONFIG -DENABLE_GRALLOC_BUFFER -DANDROID_QU
 LOCAL_CFLAGS += -DANDROID_CUSTOM_OPAQUECOLORFORMAT
 LOCAL_MODULE_TAGS:= optional
 
-LOCAL_SRC_FILES:= omx_mpeg4_enc/src/omx_proxy_mpeg4enc.c
+LOCAL_SRC_FILES:= omx_mpeg4_enc/src/omx_proxy_mpeg4enc.c \
+	omx_colorconvert/src/colorconvert_cpu.c.neon
 LOCAL_MODULE:= libOMX.TI.DUCATI1.VIDEO.MPEG4E
 include $(BUILD_HEAPTRACKED_SHARED_LIBRARY)
 
@@ -447,21 +447,27 @@ OMX_ERRORTYPE DCC_Init(OMX_HANDLETYPE hComponent)
     }
 
 #ifdef USE_ION
-	ion_fd = ion_open();
-	if(ion_fd == 0)
+	ion_fd = ion_registry_open();
+	if(ion_fd < 0)
 	{
-		DOMX_ERROR("ion_open failed!!!");
+		DOMX_ERROR("ion_registry_open failed!!!");
 		return OMX_ErrorInsufficientResources;
 	}
 	dccbuf_size = (dccbuf_size + LINUX_PAGE_SIZE -1) & ~(LINUX_PAGE_SIZE - 1);
-	ret = ion_alloc(ion_fd, dccbuf_size, 0x1000, 1 << ION_HEAP_TYPE_CARVEOUT, &DCC_Buff);
+	ret = ion_registry_alloc(dccbuf_size, 0x1000, 1 << ION_HEAP_TYPE_CARVEOUT,
+				 "DCC", (struct ion_handle **)&DCC_Buff, &mmap_fd);
 	if (ret)
-			return OMX_ErrorInsufficientResources;
+	{
+		ion_registry_close();
+		return OMX_ErrorInsufficientResources;
+	}
 
-	if (ion_map(ion_fd, DCC_Buff, dccbuf_size, PROT_READ | PROT_WRITE, MAP_SHARED, 0,
-                  &DCC_Buff_ptr,&mmap_fd) < 0)
+	if (ion_registry_map(mmap_fd, (unsigned char **)&DCC_Buff_ptr) < 0)
 	{
 		DOMX_ERROR("userspace mapping of ION buffers returned error");
+		ion_registry_release(mmap_fd, "DCC");
+		ion_registry_close();
+		DCC_Buff = NULL;
 		return OMX_ErrorInsufficientResources;
 	}
 	ptempbuf = DCC_Buff_ptr;
@@ -641,10 +647,11 @@ void DCC_DeInit()
 	if (DCC_Buff)
 	{
 #ifdef USE_ION
-		munmap(DCC_Buff_ptr, dccbuf_size);
-		close(mmap_fd);
-		ion_free(ion_fd, DCC_Buff);
-		ion_close(ion_fd);
+		/* dccbuf_size is rewritten by read_DCCdir; the registry
+		 * remembers the mapped length */
+		ion_registry_unmap(mmap_fd);
+		ion_registry_release(mmap_fd, "DCC");
+		ion_registry_close();
 		DCC_Buff = NULL;
 #else
 		MemMgr_Free(DCC_Buff);
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2010, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file  colorconvert_cpu.h
+ *         CPU fallback for the encoder proxies' opaque color format path.
+ *         Converts 32-bit RGBA/BGRA frames to NV12 using NEON when
+ *         available, splitting the frame into row bands that are
+ *         converted in parallel by a small pool of worker threads.
+ *
+ *  @path \WTSD_DucatiMMSW\omx\omx_il_1_x\omx_proxy_component\omx_colorconvert\inc
+ *
+ *  @rev 1.0
+ */
+
+#ifndef COLORCONVERT_CPU_H
+#define COLORCONVERT_CPU_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Source pixel layouts, in memory byte order */
+#define COLORCONVERT_CPU_FMT_RGBA   (0x0)
+#define COLORCONVERT_CPU_FMT_BGRA   (0x1)
+
+/* Matrices; output is always limited (video) range */
+#define COLORCONVERT_CPU_BT601      (0x0)
+#define COLORCONVERT_CPU_BT709      (0x1)
+
+/* Number of threads (including the caller) sharing a frame */
+#define COLORCONVERT_CPU_MAX_THREADS (4)
+
+/* ===========================================================================*/
+/**
+ * @name COLORCONVERT_CPU_open()
+ * @brief Creates a converter with nThreads - 1 worker threads. nThreads is
+ *        clamped to [1, COLORCONVERT_CPU_MAX_THREADS].
+ * @return 0 on success, -1 on failure
+ */
+/* ===========================================================================*/
+int COLORCONVERT_CPU_open(void **hCpuCC, int nThreads);
+
+/* ===========================================================================*/
+/**
+ * @name COLORCONVERT_CPU_RGBToNV12()
+ * @brief Converts nWidth x nHeight pixels of pSrc (nSrcStride bytes per row)
+ *        to a Y plane at pDstY and an interleaved CbCr plane at pDstUV, both
+ *        with nDstStride bytes per row. Chroma is the rounded average of
+ *        each 2x2 block; odd trailing rows/columns are replicated.
+ *        Results are identical with and without NEON.
+ * @return 0 on success, -1 on bad parameters
+ */
+/* ===========================================================================*/
+int COLORCONVERT_CPU_RGBToNV12(void *hCpuCC, const void *pSrc, int nSrcStride,
+			       int nSrcFormat, void *pDstY, void *pDstUV,
+			       int nDstStride, int nWidth, int nHeight,
+			       int nStandard);
+
+/* ===========================================================================*/
+/**
+ * @name COLORCONVERT_CPU_close()
+ * @brief Stops the worker threads and frees the converter.
+ */
+/* ===========================================================================*/
+int COLORCONVERT_CPU_close(void *hCpuCC);
+
+#ifdef ANDROID_CUSTOM_OPAQUECOLORFORMAT
+/* Gralloc front end shared by the encoder proxies' opaque color format path */
+#include <hardware/hardware.h>
+
+#define HAL_PIXEL_FORMAT_TI_NV12 (0x100)
+
+#define COLORCONVERT_MAX_SUB_BUFFERS (3)
+
+#define COLORCONVERT_BUFTYPE_VIRTUAL (0x0)
+#define COLORCONVERT_BUFTYPE_ION     (0x1)
+#define COLORCONVERT_BUFTYPE_GRALLOCOPAQUE (0x2)
+
+/* ===========================================================================*/
+/**
+ * @name COLORCONVERT_CPU_GrallocOpen()
+ * @brief Creates the conversion context for the gralloc module. The CPU
+ *        converter itself is only started on the first fallback.
+ *        Setting debug.video.colorconvert.cpu=1 disables the blitter.
+ * @return 0 on success, -1 on failure
+ */
+/* ===========================================================================*/
+int COLORCONVERT_CPU_GrallocOpen(void **hCC, hw_module_t const *module);
+
+/* ===========================================================================*/
+/**
+ * @name COLORCONVERT_PlatformOpaqueToNV12()
+ * @brief Converts the gralloc opaque buffer pSrc[0] to NV12, into the
+ *        virtual planes pDst[0], pDst[1] or into the gralloc buffer pDst[0].
+ *        Uses the gralloc Blit/Blit2 hooks and falls back to the CPU
+ *        converter when they are missing or fail.
+ * @return 0 on success
+ */
+/* ===========================================================================*/
+int COLORCONVERT_PlatformOpaqueToNV12(void *hCC,
+				      void *pSrc[COLORCONVERT_MAX_SUB_BUFFERS],
+				      void *pDst[COLORCONVERT_MAX_SUB_BUFFERS],
+				      int nWidth, int nHeight, int nStride,
+				      int nSrcBufType, int nDstBufType);
+
+/* ===========================================================================*/
+/**
+ * @name COLORCONVERT_CPU_GrallocClose()
+ * @brief Stops the CPU converter, if started, and frees the context.
+ */
+/* ===========================================================================*/
+void COLORCONVERT_CPU_GrallocClose(void *hCC);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COLORCONVERT_CPU_H */
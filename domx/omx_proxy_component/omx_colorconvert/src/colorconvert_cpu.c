@@ -0,0 +1,622 @@
+/*
+ * Copyright (c) 2010, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file  colorconvert_cpu.c
+ *         RGBA/BGRA to NV12 conversion on the CPU, used by the H264 and
+ *         MPEG4 encoder proxies when the gralloc blitter can't convert
+ *         an opaque input buffer.
+ *
+ *         With ANDROID_CUSTOM_OPAQUECOLORFORMAT this file also holds the
+ *         gralloc front end of both proxies: blit first, CPU fallback.
+ *
+ *         All arithmetic is 8.8 fixed point:
+ *           Y  = ((Yr*R + Yg*G + Yb*B + 128) >> 8) + 16
+ *           Cb = ((-Ur*R - Ug*G + Ub*B + 128) >> 8) + 128
+ *           Cr = ((Vr*R - Vg*G - Vb*B + 128) >> 8) + 128
+ *         with R, G, B for chroma being the rounded 2x2 average. The NEON
+ *         and C paths evaluate exactly these expressions, so their output
+ *         is bit identical.
+ *
+ *  @path \WTSD_DucatiMMSW\omx\omx_il_1_x\omx_proxy_component\omx_colorconvert\src
+ *
+ *  @rev 1.0
+ */
+
+/******************************************************************
+ *   INCLUDE FILES
+ ******************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+#include "colorconvert_cpu.h"
+
+#ifdef ANDROID_CUSTOM_OPAQUECOLORFORMAT
+#include <cutils/properties.h>
+#include <hal_public.h>
+#include "omx_rpc_utils.h"
+
+/* Threads used by the CPU fallback converter; OMAP4 has two A9 cores */
+#define COLORCONVERT_CPU_THREADS (2)
+
+typedef struct _COLORCONVERT_GRALLOC_CTX
+{
+	IMG_gralloc_module_public_t const *module;
+	void *hCpuCC;
+	int bForceCpu;
+} COLORCONVERT_GRALLOC_CTX;
+#endif
+
+/* Pixels per NEON iteration */
+#define COLORCONVERT_CPU_BLOCK (16)
+
+typedef struct _COLORCONVERT_CPU_COEFFS
+{
+	int16_t nYr, nYg, nYb;
+	int16_t nUr, nUg, nUb;
+	int16_t nVr, nVg, nVb;
+} COLORCONVERT_CPU_COEFFS;
+
+/* Magnitudes only; signs are applied in the kernels (see file header) */
+static const COLORCONVERT_CPU_COEFFS tCoeffs[] = {
+	/* BT.601 */
+	{ 66, 129, 25, 38, 74, 112, 112, 94, 18 },
+	/* BT.709 */
+	{ 47, 157, 16, 26, 86, 112, 112, 102, 10 },
+};
+
+typedef struct _COLORCONVERT_CPU_JOB
+{
+	const uint8_t *pSrc;
+	int nSrcStride;
+	int nRIdx;
+	int nBIdx;
+	uint8_t *pDstY;
+	uint8_t *pDstUV;
+	int nDstStride;
+	int nWidth;
+	int nHeight;
+	const COLORCONVERT_CPU_COEFFS *pCoeffs;
+} COLORCONVERT_CPU_JOB;
+
+struct _COLORCONVERT_CPU_CTX;
+
+typedef struct _COLORCONVERT_CPU_WORKER
+{
+	struct _COLORCONVERT_CPU_CTX *pCtx;
+	int nBand;
+} COLORCONVERT_CPU_WORKER;
+
+typedef struct _COLORCONVERT_CPU_CTX
+{
+	pthread_mutex_t tLock;
+	pthread_cond_t tStartCond;
+	pthread_cond_t tDoneCond;
+	pthread_t tThreads[COLORCONVERT_CPU_MAX_THREADS - 1];
+	COLORCONVERT_CPU_WORKER tWorkers[COLORCONVERT_CPU_MAX_THREADS - 1];
+	int nThreads;		/* including the caller */
+	int nWorkers;		/* worker threads actually started */
+	unsigned int nGeneration;
+	int nPending;
+	int bExit;
+	COLORCONVERT_CPU_JOB tJob;
+} COLORCONVERT_CPU_CTX;
+
+static inline uint8_t COLORCONVERT_CPU_Luma(const COLORCONVERT_CPU_COEFFS *c,
+    int r, int g, int b)
+{
+	return (uint8_t) (((c->nYr * r + c->nYg * g + c->nYb * b + 128) >> 8) + 16);
+}
+
+static inline uint8_t COLORCONVERT_CPU_Clamp(int v)
+{
+	return (uint8_t) (v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+/*
+ * Converts one pair of source rows starting at column x0. s1 may equal s0
+ * (odd height) and the last column is replicated for odd widths.
+ */
+static void COLORCONVERT_CPU_RowPairC(const COLORCONVERT_CPU_JOB *pJob,
+    const uint8_t *s0, const uint8_t *s1, uint8_t *y0, uint8_t *y1,
+    uint8_t *uv, int x0)
+{
+	const COLORCONVERT_CPU_COEFFS *c = pJob->pCoeffs;
+	int ri = pJob->nRIdx, bi = pJob->nBIdx;
+	int x, x1, r, g, b;
+
+	for (x = x0; x < pJob->nWidth; x += 2)
+	{
+		x1 = (x + 1 < pJob->nWidth) ? x + 1 : x;
+
+		y0[x] = COLORCONVERT_CPU_Luma(c, s0[4 * x + ri], s0[4 * x + 1],
+		    s0[4 * x + bi]);
+		y1[x] = COLORCONVERT_CPU_Luma(c, s1[4 * x + ri], s1[4 * x + 1],
+		    s1[4 * x + bi]);
+		if (x1 != x)
+		{
+			y0[x1] = COLORCONVERT_CPU_Luma(c, s0[4 * x1 + ri],
+			    s0[4 * x1 + 1], s0[4 * x1 + bi]);
+			y1[x1] = COLORCONVERT_CPU_Luma(c, s1[4 * x1 + ri],
+			    s1[4 * x1 + 1], s1[4 * x1 + bi]);
+		}
+
+		r = (s0[4 * x + ri] + s0[4 * x1 + ri] + s1[4 * x + ri] +
+		    s1[4 * x1 + ri] + 2) >> 2;
+		g = (s0[4 * x + 1] + s0[4 * x1 + 1] + s1[4 * x + 1] +
+		    s1[4 * x1 + 1] + 2) >> 2;
+		b = (s0[4 * x + bi] + s0[4 * x1 + bi] + s1[4 * x + bi] +
+		    s1[4 * x1 + bi] + 2) >> 2;
+
+		uv[x] = COLORCONVERT_CPU_Clamp(((c->nUb * b - c->nUr * r -
+			    c->nUg * g + 128) >> 8) + 128);
+		uv[x + 1] = COLORCONVERT_CPU_Clamp(((c->nVr * r - c->nVg * g -
+			    c->nVb * b + 128) >> 8) + 128);
+	}
+}
+
+#ifdef __ARM_NEON__
+static inline uint8x8_t COLORCONVERT_CPU_LumaNeon(const COLORCONVERT_CPU_COEFFS *c,
+    uint8x8_t r, uint8x8_t g, uint8x8_t b)
+{
+	uint16x8_t t;
+
+	t = vmull_u8(r, vdup_n_u8((uint8_t) c->nYr));
+	t = vmlal_u8(t, g, vdup_n_u8((uint8_t) c->nYg));
+	t = vmlal_u8(t, b, vdup_n_u8((uint8_t) c->nYb));
+	return vadd_u8(vrshrn_n_u16(t, 8), vdup_n_u8(16));
+}
+
+/* Handles COLORCONVERT_CPU_BLOCK pixels of a row pair per iteration and
+ * returns the first column left for the C tail. */
+static int COLORCONVERT_CPU_RowPairNeon(const COLORCONVERT_CPU_JOB *pJob,
+    const uint8_t *s0, const uint8_t *s1, uint8_t *y0, uint8_t *y1,
+    uint8_t *uv)
+{
+	const COLORCONVERT_CPU_COEFFS *c = pJob->pCoeffs;
+	int nBlocks = pJob->nWidth & ~(COLORCONVERT_CPU_BLOCK - 1);
+	int16x8_t vBias = vdupq_n_s16(128);
+	uint8x16x4_t p0, p1;
+	uint8x16_t r0, g0, b0, r1, g1, b1;
+	int16x8_t r, g, b, u, v;
+	uint8x8x2_t tUV;
+	int x;
+
+	for (x = 0; x < nBlocks; x += COLORCONVERT_CPU_BLOCK)
+	{
+		p0 = vld4q_u8(s0 + 4 * x);
+		p1 = vld4q_u8(s1 + 4 * x);
+
+		if (pJob->nRIdx == 0)
+		{
+			r0 = p0.val[0]; b0 = p0.val[2];
+			r1 = p1.val[0]; b1 = p1.val[2];
+		}
+		else
+		{
+			r0 = p0.val[2]; b0 = p0.val[0];
+			r1 = p1.val[2]; b1 = p1.val[0];
+		}
+		g0 = p0.val[1];
+		g1 = p1.val[1];
+
+		vst1q_u8(y0 + x, vcombine_u8(
+			COLORCONVERT_CPU_LumaNeon(c, vget_low_u8(r0),
+			    vget_low_u8(g0), vget_low_u8(b0)),
+			COLORCONVERT_CPU_LumaNeon(c, vget_high_u8(r0),
+			    vget_high_u8(g0), vget_high_u8(b0))));
+		vst1q_u8(y1 + x, vcombine_u8(
+			COLORCONVERT_CPU_LumaNeon(c, vget_low_u8(r1),
+			    vget_low_u8(g1), vget_low_u8(b1)),
+			COLORCONVERT_CPU_LumaNeon(c, vget_high_u8(r1),
+			    vget_high_u8(g1), vget_high_u8(b1))));
+
+		/* 2x2 sums, then rounded average */
+		r = vreinterpretq_s16_u16(vrshrq_n_u16(
+			vpadalq_u8(vpaddlq_u8(r0), r1), 2));
+		g = vreinterpretq_s16_u16(vrshrq_n_u16(
+			vpadalq_u8(vpaddlq_u8(g0), g1), 2));
+		b = vreinterpretq_s16_u16(vrshrq_n_u16(
+			vpadalq_u8(vpaddlq_u8(b0), b1), 2));
+
+		u = vmulq_n_s16(b, c->nUb);
+		u = vmlsq_n_s16(u, r, c->nUr);
+		u = vmlsq_n_s16(u, g, c->nUg);
+		v = vmulq_n_s16(r, c->nVr);
+		v = vmlsq_n_s16(v, g, c->nVg);
+		v = vmlsq_n_s16(v, b, c->nVb);
+
+		tUV.val[0] = vqmovun_s16(vaddq_s16(vrshrq_n_s16(u, 8), vBias));
+		tUV.val[1] = vqmovun_s16(vaddq_s16(vrshrq_n_s16(v, 8), vBias));
+		vst2_u8(uv + x, tUV);
+	}
+
+	return x;
+}
+#endif
+
+/* Converts row pairs [nFirst, nLast) of the job */
+static void COLORCONVERT_CPU_Band(const COLORCONVERT_CPU_JOB *pJob,
+    int nFirst, int nLast)
+{
+	const uint8_t *s0, *s1;
+	uint8_t *y0, *y1, *uv;
+	int i, x;
+
+	for (i = nFirst; i < nLast; i++)
+	{
+		s0 = pJob->pSrc + (2 * i) * pJob->nSrcStride;
+		y0 = pJob->pDstY + (2 * i) * pJob->nDstStride;
+		if (2 * i + 1 < pJob->nHeight)
+		{
+			s1 = s0 + pJob->nSrcStride;
+			y1 = y0 + pJob->nDstStride;
+		}
+		else
+		{
+			/* Odd height: average the last row with itself and write
+			 * its luma twice into the same line */
+			s1 = s0;
+			y1 = y0;
+		}
+		uv = pJob->pDstUV + i * pJob->nDstStride;
+
+		x = 0;
+#ifdef __ARM_NEON__
+		x = COLORCONVERT_CPU_RowPairNeon(pJob, s0, s1, y0, y1, uv);
+#endif
+		COLORCONVERT_CPU_RowPairC(pJob, s0, s1, y0, y1, uv, x);
+	}
+}
+
+static void COLORCONVERT_CPU_RunBand(COLORCONVERT_CPU_CTX *pCtx, int nBand)
+{
+	int nPairs = (pCtx->tJob.nHeight + 1) / 2;
+
+	COLORCONVERT_CPU_Band(&pCtx->tJob, nBand * nPairs / pCtx->nThreads,
+	    (nBand + 1) * nPairs / pCtx->nThreads);
+}
+
+static void *COLORCONVERT_CPU_Worker(void *pArg)
+{
+	COLORCONVERT_CPU_WORKER *pWorker = (COLORCONVERT_CPU_WORKER *) pArg;
+	COLORCONVERT_CPU_CTX *pCtx = pWorker->pCtx;
+	unsigned int nSeen = 0;
+
+	pthread_mutex_lock(&pCtx->tLock);
+	for (;;)
+	{
+		while (!pCtx->bExit && pCtx->nGeneration == nSeen)
+		{
+			pthread_cond_wait(&pCtx->tStartCond, &pCtx->tLock);
+		}
+		if (pCtx->bExit)
+		{
+			break;
+		}
+		nSeen = pCtx->nGeneration;
+		pthread_mutex_unlock(&pCtx->tLock);
+
+		COLORCONVERT_CPU_RunBand(pCtx, pWorker->nBand);
+
+		pthread_mutex_lock(&pCtx->tLock);
+		if (--pCtx->nPending == 0)
+		{
+			pthread_cond_signal(&pCtx->tDoneCond);
+		}
+	}
+	pthread_mutex_unlock(&pCtx->tLock);
+
+	return NULL;
+}
+
+int COLORCONVERT_CPU_open(void **hCpuCC, int nThreads)
+{
+	COLORCONVERT_CPU_CTX *pCtx = NULL;
+	COLORCONVERT_CPU_WORKER *pWorker = NULL;
+	int i;
+
+	if (hCpuCC == NULL)
+	{
+		return -1;
+	}
+
+	if (nThreads < 1)
+	{
+		nThreads = 1;
+	}
+	else if (nThreads > COLORCONVERT_CPU_MAX_THREADS)
+	{
+		nThreads = COLORCONVERT_CPU_MAX_THREADS;
+	}
+
+	pCtx = (COLORCONVERT_CPU_CTX *) calloc(1, sizeof(COLORCONVERT_CPU_CTX));
+	if (pCtx == NULL)
+	{
+		return -1;
+	}
+	pWorker = pCtx->tWorkers;
+
+	pthread_mutex_init(&pCtx->tLock, NULL);
+	pthread_cond_init(&pCtx->tStartCond, NULL);
+	pthread_cond_init(&pCtx->tDoneCond, NULL);
+
+	for (i = 0; i < nThreads - 1; i++)
+	{
+		pWorker[i].pCtx = pCtx;
+		pWorker[i].nBand = i + 1;
+		if (pthread_create(&pCtx->tThreads[i], NULL,
+			COLORCONVERT_CPU_Worker, &pWorker[i]) != 0)
+		{
+			break;
+		}
+		pCtx->nWorkers++;
+	}
+	/* Carry on with fewer bands if some threads couldn't start */
+	pCtx->nThreads = pCtx->nWorkers + 1;
+
+	*hCpuCC = pCtx;
+	return 0;
+}
+
+int COLORCONVERT_CPU_RGBToNV12(void *hCpuCC, const void *pSrc, int nSrcStride,
+			       int nSrcFormat, void *pDstY, void *pDstUV,
+			       int nDstStride, int nWidth, int nHeight,
+			       int nStandard)
+{
+	COLORCONVERT_CPU_CTX *pCtx = (COLORCONVERT_CPU_CTX *) hCpuCC;
+	COLORCONVERT_CPU_JOB *pJob;
+
+	if ((pCtx == NULL) || (pSrc == NULL) || (pDstY == NULL) ||
+	    (pDstUV == NULL) || (nWidth <= 0) || (nHeight <= 0) ||
+	    (nSrcStride < 4 * nWidth) || (nDstStride < nWidth + (nWidth & 1)))
+	{
+		return -1;
+	}
+	if (((nSrcFormat != COLORCONVERT_CPU_FMT_RGBA) &&
+		(nSrcFormat != COLORCONVERT_CPU_FMT_BGRA)) ||
+	    ((nStandard != COLORCONVERT_CPU_BT601) &&
+		(nStandard != COLORCONVERT_CPU_BT709)))
+	{
+		return -1;
+	}
+
+	pJob = &pCtx->tJob;
+	pJob->pSrc = (const uint8_t *) pSrc;
+	pJob->nSrcStride = nSrcStride;
+	pJob->nRIdx = (nSrcFormat == COLORCONVERT_CPU_FMT_RGBA) ? 0 : 2;
+	pJob->nBIdx = 2 - pJob->nRIdx;
+	pJob->pDstY = (uint8_t *) pDstY;
+	pJob->pDstUV = (uint8_t *) pDstUV;
+	pJob->nDstStride = nDstStride;
+	pJob->nWidth = nWidth;
+	pJob->nHeight = nHeight;
+	pJob->pCoeffs = &tCoeffs[nStandard];
+
+	if (pCtx->nWorkers == 0)
+	{
+		COLORCONVERT_CPU_RunBand(pCtx, 0);
+		return 0;
+	}
+
+	pthread_mutex_lock(&pCtx->tLock);
+	pCtx->nPending = pCtx->nWorkers;
+	pCtx->nGeneration++;
+	pthread_cond_broadcast(&pCtx->tStartCond);
+	pthread_mutex_unlock(&pCtx->tLock);
+
+	COLORCONVERT_CPU_RunBand(pCtx, 0);
+
+	pthread_mutex_lock(&pCtx->tLock);
+	while (pCtx->nPending > 0)
+	{
+		pthread_cond_wait(&pCtx->tDoneCond, &pCtx->tLock);
+	}
+	pthread_mutex_unlock(&pCtx->tLock);
+
+	return 0;
+}
+
+int COLORCONVERT_CPU_close(void *hCpuCC)
+{
+	COLORCONVERT_CPU_CTX *pCtx = (COLORCONVERT_CPU_CTX *) hCpuCC;
+	int i;
+
+	if (pCtx == NULL)
+	{
+		return 0;
+	}
+
+	pthread_mutex_lock(&pCtx->tLock);
+	pCtx->bExit = 1;
+	pthread_cond_broadcast(&pCtx->tStartCond);
+	pthread_mutex_unlock(&pCtx->tLock);
+
+	for (i = 0; i < pCtx->nWorkers; i++)
+	{
+		pthread_join(pCtx->tThreads[i], NULL);
+	}
+
+	pthread_cond_destroy(&pCtx->tDoneCond);
+	pthread_cond_destroy(&pCtx->tStartCond);
+	pthread_mutex_destroy(&pCtx->tLock);
+	free(pCtx);
+
+	return 0;
+}
+
+#ifdef ANDROID_CUSTOM_OPAQUECOLORFORMAT
+int COLORCONVERT_CPU_GrallocOpen(void **hCC, hw_module_t const *module)
+{
+	COLORCONVERT_GRALLOC_CTX *pCtx = NULL;
+	char value[PROPERTY_VALUE_MAX];
+
+	pCtx = (COLORCONVERT_GRALLOC_CTX *) calloc(1, sizeof(COLORCONVERT_GRALLOC_CTX));
+	if (pCtx == NULL)
+	{
+		DOMX_ERROR("Could not allocate color convert context");
+		return -1;
+	}
+	pCtx->module = (IMG_gralloc_module_public_t const *) module;
+
+	/* Allow the CPU path to be forced for debugging */
+	property_get("debug.video.colorconvert.cpu", value, "0");
+	pCtx->bForceCpu = (atoi(value) != 0);
+
+	*hCC = pCtx;
+	return 0;
+}
+
+/* ===========================================================================*/
+/**
+ * @name COLORCONVERT_CPU_GrallocToNV12()
+ * @brief Converts a gralloc RGBA/BGRA buffer into NV12 planes on the CPU.
+ * @return 0 on success
+ */
+/* ===========================================================================*/
+static int COLORCONVERT_CPU_GrallocToNV12(COLORCONVERT_GRALLOC_CTX *pCtx,
+					  buffer_handle_t hSrc, void *pDstY,
+					  void *pDstUV, int nWidth, int nHeight,
+					  int nStride)
+{
+	IMG_native_handle_t *pSrcHandle = (IMG_native_handle_t *) hSrc;
+	gralloc_module_t const *gralloc = &pCtx->module->base;
+	void *pSrc = NULL;
+	int nFormat, nErr;
+
+	switch (pSrcHandle->iFormat)
+	{
+		case HAL_PIXEL_FORMAT_RGBA_8888:
+		case HAL_PIXEL_FORMAT_RGBX_8888:
+			nFormat = COLORCONVERT_CPU_FMT_RGBA;
+			break;
+		case HAL_PIXEL_FORMAT_BGRA_8888:
+			nFormat = COLORCONVERT_CPU_FMT_BGRA;
+			break;
+		default:
+			DOMX_ERROR("No CPU color conversion for format %d",
+				   pSrcHandle->iFormat);
+			return -1;
+	}
+
+	if (pCtx->hCpuCC == NULL)
+	{
+		nErr = COLORCONVERT_CPU_open(&pCtx->hCpuCC, COLORCONVERT_CPU_THREADS);
+		if (nErr != 0)
+		{
+			DOMX_ERROR("Could not open CPU color converter");
+			return nErr;
+		}
+	}
+
+	nErr = gralloc->lock(gralloc, hSrc, GRALLOC_USAGE_SW_READ_OFTEN,
+			     0, 0, nWidth, nHeight, &pSrc);
+	if (nErr != 0)
+	{
+		DOMX_ERROR("Could not lock source buffer err = %d", nErr);
+		return nErr;
+	}
+
+	/* BT.601, matching the output of the gralloc blitter */
+	nErr = COLORCONVERT_CPU_RGBToNV12(pCtx->hCpuCC, pSrc,
+					  ALIGN(pSrcHandle->iWidth, HW_ALIGN) * 4,
+					  nFormat, pDstY, pDstUV, nStride,
+					  nWidth, nHeight, COLORCONVERT_CPU_BT601);
+
+	gralloc->unlock(gralloc, hSrc);
+
+	return nErr;
+}
+
+int COLORCONVERT_PlatformOpaqueToNV12(void *hCC,
+				      void *pSrc[COLORCONVERT_MAX_SUB_BUFFERS],
+				      void *pDst[COLORCONVERT_MAX_SUB_BUFFERS],
+				      int nWidth, int nHeight, int nStride,
+				      int nSrcBufType, int nDstBufType)
+{
+	COLORCONVERT_GRALLOC_CTX *pCtx = (COLORCONVERT_GRALLOC_CTX *) hCC;
+	IMG_gralloc_module_public_t const* module = pCtx->module;
+	void *pDstPlanes[COLORCONVERT_MAX_SUB_BUFFERS];
+	int nErr = -1;
+
+	if((nSrcBufType == COLORCONVERT_BUFTYPE_GRALLOCOPAQUE) && (nDstBufType == COLORCONVERT_BUFTYPE_VIRTUAL))
+	{
+		if(!pCtx->bForceCpu && module->Blit)
+		{
+			nErr = module->Blit(module, pSrc[0], pDst, HAL_PIXEL_FORMAT_TI_NV12);
+		}
+		if(nErr != 0)
+		{
+			nErr = COLORCONVERT_CPU_GrallocToNV12(pCtx, pSrc[0], pDst[0], pDst[1],
+							      nWidth, nHeight, nStride);
+		}
+	}
+	else if((nSrcBufType == COLORCONVERT_BUFTYPE_GRALLOCOPAQUE) && (nDstBufType == COLORCONVERT_BUFTYPE_GRALLOCOPAQUE))
+	{
+		if(!pCtx->bForceCpu && module->Blit2)
+		{
+			nErr = module->Blit2(module, pSrc[0], pDst[0], nWidth, nHeight, 0, 0);
+		}
+		if(nErr != 0)
+		{
+			nErr = module->base.lock(&module->base, pDst[0], GRALLOC_USAGE_SW_WRITE_OFTEN,
+						 0, 0, nWidth, nHeight, pDstPlanes);
+			if(nErr == 0)
+			{
+				nErr = COLORCONVERT_CPU_GrallocToNV12(pCtx, pSrc[0], pDstPlanes[0],
+								      pDstPlanes[1], nWidth, nHeight,
+								      nStride);
+				module->base.unlock(&module->base, pDst[0]);
+			}
+		}
+	}
+
+	return nErr;
+}
+
+void COLORCONVERT_CPU_GrallocClose(void *hCC)
+{
+	COLORCONVERT_GRALLOC_CTX *pCtx = (COLORCONVERT_GRALLOC_CTX *) hCC;
+
+	if (pCtx != NULL)
+	{
+		COLORCONVERT_CPU_close(pCtx->hCpuCC);
+		free(pCtx);
+	}
+}
+#endif
@@ -74,6 +74,10 @@
 #include <hal_public.h>
 #include <VideoMetadata.h>
 #endif
+#ifdef ANDROID_CUSTOM_OPAQUECOLORFORMAT
+#include <time.h>
+#include "colorconvert_cpu.h"
+#endif
 
 #define COMPONENT_NAME "OMX.TI.DUCATI1.VIDEO.H264E"
 /* needs to be specific for every configuration wrapper */
@@ -97,19 +101,9 @@ OMX_ERRORTYPE LOCAL_PROXY_H264E_SetParameter(OMX_IN OMX_HANDLETYPE hComponent,
  * ANDROID_QUIRCK_CHANGE_PORT_VALUES
  */
 #define OMX_H264VE_NUM_INTERNAL_BUF (8)
-#define HAL_PIXEL_FORMAT_TI_NV12 (0x100)
-
-#define COLORCONVERT_MAX_SUB_BUFFERS (3)
-
-#define COLORCONVERT_BUFTYPE_VIRTUAL (0x0)
-#define COLORCONVERT_BUFTYPE_ION     (0x1)
-#define COLORCONVERT_BUFTYPE_GRALLOCOPAQUE (0x2)
-
+/* Frames between two reports of the conversion pipeline statistics */
+#define OMX_H264VE_STATS_PERIOD (300)
 int COLORCONVERT_open(void **hCC, PROXY_COMPONENT_PRIVATE *pCompPrv);
-int COLORCONVERT_PlatformOpaqueToNV12(void *hCC, void *pSrc[],
-				      void *pDst[], int nWidth,
-				      int nHeight, int nStride,
-				      int nSrcBufType, int nDstBufType);
 int COLORCONVERT_close(void *hCC,PROXY_COMPONENT_PRIVATE *pCompPrv);
 
 static OMX_ERRORTYPE LOCAL_PROXY_H264E_AllocateBuffer(OMX_IN OMX_HANDLETYPE hComponent,
@@ -121,6 +115,9 @@ static OMX_ERRORTYPE LOCAL_PROXY_H264E_FreeBuffer(OMX_IN OMX_HANDLETYPE hCompone
 
 static OMX_ERRORTYPE LOCAL_PROXY_H264E_ComponentDeInit(OMX_HANDLETYPE hComponent);
 
+static OMX_ERRORTYPE LOCAL_PROXY_H264E_EmptyBufferDone(OMX_HANDLETYPE hComponent,
+    OMX_U32 remoteBufHdr, OMX_U32 nfilledLen, OMX_U32 nOffset, OMX_U32 nFlags);
+
 typedef struct _OMX_PROXY_H264E_PRIVATE
 {
 	OMX_PTR  hBufPipe;
@@ -129,6 +126,23 @@ typedef struct _OMX_PROXY_H264E_PRIVATE
 	IMG_native_handle_t* gralloc_handle[OMX_H264VE_NUM_INTERNAL_BUF];
 	OMX_S32  nCurBufIndex;
 	alloc_device_t* mAllocDev;
+	PROXY_EMPTYBUFFER_DONE proxyEmptyBufferDone;
+
+	/* Internal NV12 buffers stay with the encoder until the EmptyBufferDone
+	 * of the client header they were sent with. hBufLock protects the
+	 * ownership table and the statistics below */
+	OMX_PTR  hBufLock;
+	OMX_BUFFERHEADERTYPE* pInFlightHdr[OMX_H264VE_NUM_INTERNAL_BUF];
+	OMX_U64  nSubmitTime[OMX_H264VE_NUM_INTERNAL_BUF];
+	OMX_U32  nInFlight;
+	OMX_U32  nStatFrames;
+	OMX_U32  nMaxInFlight;
+	OMX_U64  nInFlightSum;
+	OMX_U64  nWaitTimeSum;
+	OMX_U64  nConvTimeSum;
+	OMX_U64  nConvTimeMax;
+	OMX_U64  nEncTimeSum;
+	OMX_U32  nEncCount;
 }OMX_PROXY_H264E_PRIVATE;
 #endif
 
@@ -198,6 +212,11 @@ OMX_ERRORTYPE OMX_ComponentInit(OMX_HANDLETYPE hComponent)
 	PROXY_assert(eOSALStatus == TIMM_OSAL_ERR_NONE,
 			OMX_ErrorInsufficientResources,
 			"Pipe creation failed");
+
+	eOSALStatus = TIMM_OSAL_MutexCreate(&pProxy->hBufLock);
+	PROXY_assert(eOSALStatus == TIMM_OSAL_ERR_NONE,
+			OMX_ErrorInsufficientResources,
+			"Mutex creation failed");
 #endif
 
 	// Copying component Name - this will be picked up in the proxy common
@@ -220,6 +239,8 @@ OMX_ERRORTYPE OMX_ComponentInit(OMX_HANDLETYPE hComponent)
 	pHandle->ComponentDeInit = LOCAL_PROXY_H264E_ComponentDeInit;
 	pHandle->FreeBuffer = LOCAL_PROXY_H264E_FreeBuffer;
 	pHandle->AllocateBuffer = LOCAL_PROXY_H264E_AllocateBuffer;
+	pProxy->proxyEmptyBufferDone = pComponentPrivate->proxyEmptyBufferDone;
+	pComponentPrivate->proxyEmptyBufferDone = LOCAL_PROXY_H264E_EmptyBufferDone;
 #endif
 
     EXIT:
@@ -234,6 +255,12 @@ OMX_ERRORTYPE OMX_ComponentInit(OMX_HANDLETYPE hComponent)
 			pProxy->hBufPipe = NULL;
 		}
 
+		if(pProxy->hBufLock != NULL)
+		{
+			TIMM_OSAL_MutexDelete(pProxy->hBufLock);
+			pProxy->hBufLock = NULL;
+		}
+
 		if(pComponentPrivate->pCompProxyPrv != NULL)
 		{
 			TIMM_OSAL_Free(pComponentPrivate->pCompProxyPrv);
@@ -534,6 +561,159 @@ OMX_ERRORTYPE LOCAL_PROXY_H264E_GetExtensionIndex(OMX_IN OMX_HANDLETYPE hCompone
 	return eError;
 }
 
+#ifdef ANDROID_CUSTOM_OPAQUECOLORFORMAT
+static OMX_U64 LOCAL_PROXY_H264E_GetTimeUs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((OMX_U64) ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+static void LOCAL_PROXY_H264E_DumpStats(OMX_PROXY_H264E_PRIVATE *pProxy)
+{
+	DOMX_INFO("H264E color conversion: %d frames, queue depth avg %llu max %d, "
+		  "buffer wait avg %llu us, conversion avg %llu us max %llu us, "
+		  "encoder hold avg %llu us",
+		  pProxy->nStatFrames,
+		  pProxy->nInFlightSum / pProxy->nStatFrames, pProxy->nMaxInFlight,
+		  pProxy->nWaitTimeSum / pProxy->nStatFrames,
+		  pProxy->nConvTimeSum / pProxy->nStatFrames, pProxy->nConvTimeMax,
+		  pProxy->nEncCount ? pProxy->nEncTimeSum / pProxy->nEncCount : 0);
+
+	pProxy->nStatFrames = 0;
+	pProxy->nMaxInFlight = 0;
+	pProxy->nInFlightSum = 0;
+	pProxy->nWaitTimeSum = 0;
+	pProxy->nConvTimeSum = 0;
+	pProxy->nConvTimeMax = 0;
+	pProxy->nEncTimeSum = 0;
+	pProxy->nEncCount = 0;
+}
+
+/* ===========================================================================*/
+/**
+ * @name LOCAL_PROXY_H264E_AcquireInternalBuffer()
+ * @brief Records that internal buffer nBufIndex now carries pBufferHdr's
+ *        frame and accounts for the time spent waiting and converting.
+ */
+/* ===========================================================================*/
+static void LOCAL_PROXY_H264E_AcquireInternalBuffer(OMX_PROXY_H264E_PRIVATE *pProxy,
+    OMX_U32 nBufIndex, OMX_BUFFERHEADERTYPE *pBufferHdr,
+    OMX_U64 nStartTime, OMX_U64 nConvStartTime)
+{
+	OMX_U64 nNow = LOCAL_PROXY_H264E_GetTimeUs();
+
+	TIMM_OSAL_MutexObtain(pProxy->hBufLock, TIMM_OSAL_SUSPEND);
+
+	pProxy->pInFlightHdr[nBufIndex] = pBufferHdr;
+	pProxy->nSubmitTime[nBufIndex] = nNow;
+	pProxy->nInFlight++;
+
+	pProxy->nStatFrames++;
+	pProxy->nInFlightSum += pProxy->nInFlight;
+	if (pProxy->nInFlight > pProxy->nMaxInFlight)
+	{
+		pProxy->nMaxInFlight = pProxy->nInFlight;
+	}
+	pProxy->nWaitTimeSum += nConvStartTime - nStartTime;
+	pProxy->nConvTimeSum += nNow - nConvStartTime;
+	if (nNow - nConvStartTime > pProxy->nConvTimeMax)
+	{
+		pProxy->nConvTimeMax = nNow - nConvStartTime;
+	}
+	if (pProxy->nStatFrames >= OMX_H264VE_STATS_PERIOD)
+	{
+		LOCAL_PROXY_H264E_DumpStats(pProxy);
+	}
+
+	TIMM_OSAL_MutexRelease(pProxy->hBufLock);
+}
+
+/* ===========================================================================*/
+/**
+ * @name LOCAL_PROXY_H264E_ReleaseInternalBuffer()
+ * @brief Returns the internal buffer carrying pBufferHdr's frame, if any,
+ *        to the free pipe.
+ */
+/* ===========================================================================*/
+static void LOCAL_PROXY_H264E_ReleaseInternalBuffer(OMX_PROXY_H264E_PRIVATE *pProxy,
+    OMX_BUFFERHEADERTYPE *pBufferHdr)
+{
+	TIMM_OSAL_ERRORTYPE eOSALStatus = TIMM_OSAL_ERR_NONE;
+	OMX_U32 nBufIndex;
+
+	TIMM_OSAL_MutexObtain(pProxy->hBufLock, TIMM_OSAL_SUSPEND);
+
+	for (nBufIndex = 0; nBufIndex < OMX_H264VE_NUM_INTERNAL_BUF; nBufIndex++)
+	{
+		if (pProxy->pInFlightHdr[nBufIndex] == pBufferHdr)
+		{
+			pProxy->pInFlightHdr[nBufIndex] = NULL;
+			pProxy->nInFlight--;
+			pProxy->nEncTimeSum += LOCAL_PROXY_H264E_GetTimeUs() -
+						pProxy->nSubmitTime[nBufIndex];
+			pProxy->nEncCount++;
+			break;
+		}
+	}
+
+	TIMM_OSAL_MutexRelease(pProxy->hBufLock);
+
+	if (nBufIndex < OMX_H264VE_NUM_INTERNAL_BUF)
+	{
+		eOSALStatus = TIMM_OSAL_WriteToPipe(pProxy->hBufPipe, (void *) &nBufIndex,
+					    sizeof(OMX_U32), TIMM_OSAL_SUSPEND);
+		if (eOSALStatus != TIMM_OSAL_ERR_NONE)
+		{
+			DOMX_ERROR("Pipe write failed for internal buffer %d", nBufIndex);
+		}
+	}
+}
+
+/* ===========================================================================*/
+/**
+ * @name LOCAL_PROXY_H264E_EmptyBufferDone()
+ * @brief Recirculates the internal NV12 buffer used for this frame now that
+ *        the encoder is done with it, then forwards the callback.
+ */
+/* ===========================================================================*/
+static OMX_ERRORTYPE LOCAL_PROXY_H264E_EmptyBufferDone(OMX_HANDLETYPE hComponent,
+    OMX_U32 remoteBufHdr, OMX_U32 nfilledLen, OMX_U32 nOffset, OMX_U32 nFlags)
+{
+	OMX_ERRORTYPE eError = OMX_ErrorNone;
+	PROXY_COMPONENT_PRIVATE *pCompPrv = NULL;
+	OMX_COMPONENTTYPE *hComp = (OMX_COMPONENTTYPE *) hComponent;
+	OMX_PROXY_H264E_PRIVATE *pProxy = NULL;
+	OMX_U32 count;
+
+	PROXY_require(hComp != NULL && hComp->pComponentPrivate != NULL,
+	    OMX_ErrorBadParameter, NULL);
+	pCompPrv = (PROXY_COMPONENT_PRIVATE *) hComp->pComponentPrivate;
+	pProxy = (OMX_PROXY_H264E_PRIVATE *) pCompPrv->pCompProxyPrv;
+	PROXY_require(pProxy != NULL, OMX_ErrorBadParameter, NULL);
+
+	if (pProxy->bAndroidOpaqueFormat)
+	{
+		for (count = 0; count < pCompPrv->nTotalBuffers; ++count)
+		{
+			if (pCompPrv->tBufList[count].pBufHeaderRemote == remoteBufHdr)
+			{
+				LOCAL_PROXY_H264E_ReleaseInternalBuffer(pProxy,
+						pCompPrv->tBufList[count].pBufHeader);
+				break;
+			}
+		}
+	}
+
+	eError = pProxy->proxyEmptyBufferDone(hComponent, remoteBufHdr, nfilledLen,
+					      nOffset, nFlags);
+
+      EXIT:
+	return eError;
+}
+#endif
+
 /* ===========================================================================*/
 /**
  * @name PROXY_H264E_EmptyThisBuffer()
@@ -559,6 +739,8 @@ OMX_ERRORTYPE LOCAL_PROXY_H264E_EmptyThisBuffer(OMX_HANDLETYPE hComponent,
 	OMX_PROXY_H264E_PRIVATE *pProxy = NULL;
 	TIMM_OSAL_ERRORTYPE eOSALStatus = TIMM_OSAL_ERR_NONE;
 	OMX_U32 nBufIndex = 0, nSize=0, nRet=0;
+	OMX_BOOL bInternalBuf = OMX_FALSE;
+	OMX_U64 nStartTime = 0, nConvStartTime = 0;
 #endif
 
 	PROXY_require(pBufferHdr != NULL, OMX_ErrorBadParameter, NULL);
@@ -644,11 +826,14 @@ OMX_ERRORTYPE LOCAL_PROXY_H264E_EmptyThisBuffer(OMX_HANDLETYPE hComponent,
 #ifdef ANDROID_CUSTOM_OPAQUECOLORFORMAT
 			if (pProxy->bAndroidOpaqueFormat)
 			{
-				/* Dequeue NV12 buffer for encoder */
+				/* Dequeue NV12 buffer for encoder. This blocks while
+				 * the encoder holds all internal buffers */
+				nStartTime = LOCAL_PROXY_H264E_GetTimeUs();
 				eOSALStatus = TIMM_OSAL_ReadFromPipe(pProxy->hBufPipe, &nBufIndex,
 						                     sizeof(OMX_PTR), (TIMM_OSAL_U32 *)(&nSize),
 						                     TIMM_OSAL_SUSPEND);
 				PROXY_assert(eOSALStatus == TIMM_OSAL_ERR_NONE, OMX_ErrorBadParameter, NULL);
+				nConvStartTime = LOCAL_PROXY_H264E_GetTimeUs();
 
 				/* Get NV12 data after colorconv*/
 				nRet = COLORCONVERT_PlatformOpaqueToNV12(pProxy->hCC, (void **) &pGrallocHandle, (void **) &pProxy->gralloc_handle[nBufIndex],
@@ -666,6 +851,12 @@ OMX_ERRORTYPE LOCAL_PROXY_H264E_EmptyThisBuffer(OMX_HANDLETYPE hComponent,
 				/* Update pBufferHdr with NV12 buffers for OMX component */
 				pBufferHdr->pBuffer= pProxy->gralloc_handle[nBufIndex]->fd[0];
 				((OMX_TI_PLATFORMPRIVATE *) pBufferHdr->pPlatformPrivate)->pAuxBuf1 = pProxy->gralloc_handle[nBufIndex]->fd[1];
+
+				/* Hand the buffer to this header before the encoder can
+				 * return it */
+				LOCAL_PROXY_H264E_AcquireInternalBuffer(pProxy, nBufIndex,
+						pBufferHdr, nStartTime, nConvStartTime);
+				bInternalBuf = OMX_TRUE;
 			}
 #endif
 #endif
@@ -676,14 +867,13 @@ OMX_ERRORTYPE LOCAL_PROXY_H264E_EmptyThisBuffer(OMX_HANDLETYPE hComponent,
 		}
 	}
 
-	PROXY_EmptyThisBuffer(hComponent, pBufferHdr);
+	eError = PROXY_EmptyThisBuffer(hComponent, pBufferHdr);
 #ifdef ANDROID_CUSTOM_OPAQUECOLORFORMAT
-	if (pProxy->bAndroidOpaqueFormat)
+	if (bInternalBuf && eError != OMX_ErrorNone)
 	{
-		/*Write buffer to end of pipe for re-circulation for future ETB()*/
-		eOSALStatus = TIMM_OSAL_WriteToPipe(pProxy->hBufPipe, (void *) &nBufIndex,
-					    sizeof(OMX_U32), TIMM_OSAL_SUSPEND);
-		PROXY_assert(eOSALStatus == TIMM_OSAL_ERR_NONE, OMX_ErrorBadParameter, "Pipe write failed");
+		/* The encoder never got the buffer, so no EmptyBufferDone will
+		 * return it; recirculate it now */
+		LOCAL_PROXY_H264E_ReleaseInternalBuffer(pProxy, pBufferHdr);
 	}
 #endif
 	if( pCompPrv->proxyPortBuffers[pBufferHdr->nInputPortIndex].proxyBufferType == EncoderMetadataPointers)
@@ -808,16 +998,10 @@ OMX_ERRORTYPE LOCAL_PROXY_H264E_ComponentDeInit(OMX_HANDLETYPE hComponent)
 	    NULL);
 	pCompPrv = (PROXY_COMPONENT_PRIVATE *) hComp->pComponentPrivate;
 	pProxy = (OMX_PROXY_H264E_PRIVATE *) pCompPrv->pCompProxyPrv;
-
-	if(pProxy->hBufPipe != NULL)
+	if(pProxy == NULL)
 	{
-		eOSALStatus = TIMM_OSAL_DeletePipe(pProxy->hBufPipe);
-		pProxy->hBufPipe = NULL;
-
-		if(eOSALStatus != TIMM_OSAL_ERR_NONE)
-		{
-			DOMX_ERROR("Pipe deletion failed");
-		}
+		eError = PROXY_ComponentDeInit(hComponent);
+		goto EXIT;
 	}
 
 	if(pProxy->bAndroidOpaqueFormat == OMX_TRUE)
@@ -835,15 +1019,30 @@ OMX_ERRORTYPE LOCAL_PROXY_H264E_ComponentDeInit(OMX_HANDLETYPE hComponent)
 
 		COLORCONVERT_close(pProxy->hCC,pCompPrv);
 		pProxy->bAndroidOpaqueFormat = OMX_FALSE;
+	}
+
+	/* EmptyBufferDone may run until the remote handle is freed, keep the
+	 * pipe, the lock and pProxy alive until then. pCompPrv is gone after. */
+	eError = PROXY_ComponentDeInit(hComponent);
+
+	if(pProxy->hBufPipe != NULL)
+	{
+		eOSALStatus = TIMM_OSAL_DeletePipe(pProxy->hBufPipe);
+		pProxy->hBufPipe = NULL;
 
-		if(pCompPrv->pCompProxyPrv != NULL)
+		if(eOSALStatus != TIMM_OSAL_ERR_NONE)
 		{
-			TIMM_OSAL_Free(pCompPrv->pCompProxyPrv);
-			pCompPrv->pCompProxyPrv = NULL;
+			DOMX_ERROR("Pipe deletion failed");
 		}
 	}
 
-	eError = PROXY_ComponentDeInit(hComponent);
+	if(pProxy->hBufLock != NULL)
+	{
+		TIMM_OSAL_MutexDelete(pProxy->hBufLock);
+		pProxy->hBufLock = NULL;
+	}
+
+	TIMM_OSAL_Free(pProxy);
 EXIT:
 	DOMX_EXIT("eError: %d", eError);
 	return eError;
@@ -855,12 +1054,18 @@ int COLORCONVERT_open(void **hCC, PROXY_COMPONENT_PRIVATE *pCompPrv)
 	hw_module_t const* module = NULL;
 	OMX_PROXY_H264E_PRIVATE *pProxy = NULL;
 
+	/* SetParameter() may select the opaque format more than once */
+	if (*hCC != NULL)
+	{
+		return 0;
+	}
+
 	pProxy = (OMX_PROXY_H264E_PRIVATE *) pCompPrv->pCompProxyPrv;
 	nErr = hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &module);
 
 	if (nErr == 0)
 	{
-		*hCC = (void *) ((IMG_gralloc_module_public_t const *)module);
+		nErr = COLORCONVERT_CPU_GrallocOpen(hCC, module);
 	}
 	else
 	{
@@ -873,35 +1078,16 @@ int COLORCONVERT_open(void **hCC, PROXY_COMPONENT_PRIVATE *pCompPrv)
 	return nErr;
 }
 
-int COLORCONVERT_PlatformOpaqueToNV12(void *hCC,
-				      void *pSrc[COLORCONVERT_MAX_SUB_BUFFERS],
-				      void *pDst[COLORCONVERT_MAX_SUB_BUFFERS],
-				      int nWidth, int nHeight, int nStride,
-				      int nSrcBufType,int nDstBufType)
-{
-	IMG_gralloc_module_public_t const* module = hCC;
-	int nErr = -1;
-
-	if((nSrcBufType == COLORCONVERT_BUFTYPE_GRALLOCOPAQUE) && (nDstBufType == COLORCONVERT_BUFTYPE_VIRTUAL))
-	{
-		nErr = module->Blit(module, pSrc[0], pDst, HAL_PIXEL_FORMAT_TI_NV12);
-	}
-	else if((nSrcBufType == COLORCONVERT_BUFTYPE_GRALLOCOPAQUE) && (nDstBufType == COLORCONVERT_BUFTYPE_GRALLOCOPAQUE ))
-	{
-		nErr = module->Blit2(module, pSrc[0], pDst[0], nWidth, nHeight, 0, 0);
-	}
-
-	return nErr;
-}
-
 int COLORCONVERT_close(void *hCC,PROXY_COMPONENT_PRIVATE *pCompPrv)
 {
 	OMX_PROXY_H264E_PRIVATE *pProxy = NULL;
+
 	pProxy = (OMX_PROXY_H264E_PRIVATE *) pCompPrv->pCompProxyPrv;
 	if(pProxy && pProxy->mAllocDev)
 	{
 		gralloc_close(pProxy->mAllocDev);
 	}
+	COLORCONVERT_CPU_GrallocClose(hCC);
 	return 0;
 }
 #endif
@@ -74,6 +74,9 @@
 #include <hal_public.h>
 #include <VideoMetadata.h>
 #endif
+#ifdef ANDROID_CUSTOM_OPAQUECOLORFORMAT
+#include "colorconvert_cpu.h"
+#endif
 
 #define COMPONENT_NAME "OMX.TI.DUCATI1.VIDEO.MPEG4E"
 /* needs to be specific for every configuration wrapper */
@@ -96,19 +99,7 @@ OMX_ERRORTYPE LOCAL_PROXY_MPEG4E_SetParameter(OMX_IN OMX_HANDLETYPE hComponent,
 
 #ifdef ANDROID_CUSTOM_OPAQUECOLORFORMAT
 #define OMX_MPEG4E_NUM_INTERNAL_BUF (8)
-#define HAL_PIXEL_FORMAT_TI_NV12 (0x100)
-
-#define COLORCONVERT_MAX_SUB_BUFFERS (3)
-
-#define COLORCONVERT_BUFTYPE_VIRTUAL (0x0)
-#define COLORCONVERT_BUFTYPE_ION     (0x1)
-#define COLORCONVERT_BUFTYPE_GRALLOCOPAQUE (0x2)
-
 int COLORCONVERT_open(void **hCC, PROXY_COMPONENT_PRIVATE *pCompPrv);
-int COLORCONVERT_PlatformOpaqueToNV12(void *hCC, void *pSrc[],
-				      void *pDst[], int nWidth,
-				      int nHeight, int nStride,
-				      int nSrcBufType, int nDstBufType);
 int COLORCONVERT_close(void *hCC,PROXY_COMPONENT_PRIVATE *pCompPrv);
 
 static OMX_ERRORTYPE LOCAL_PROXY_MPEG4E_AllocateBuffer(OMX_IN OMX_HANDLETYPE hComponent,
@@ -842,12 +833,18 @@ int COLORCONVERT_open(void **hCC, PROXY_COMPONENT_PRIVATE *pCompPrv)
 	hw_module_t const* module = NULL;
 	OMX_PROXY_MPEG4E_PRIVATE *pProxy = NULL;
 
+	/* SetParameter() may select the opaque format more than once */
+	if (*hCC != NULL)
+	{
+		return 0;
+	}
+
 	pProxy = (OMX_PROXY_MPEG4E_PRIVATE *) pCompPrv->pCompProxyPrv;
 	nErr = hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &module);
 
 	if (nErr == 0)
 	{
-		*hCC = (void *) ((IMG_gralloc_module_public_t const *)module);
+		nErr = COLORCONVERT_CPU_GrallocOpen(hCC, module);
 	}
 	else
 	{
@@ -860,36 +857,16 @@ int COLORCONVERT_open(void **hCC, PROXY_COMPONENT_PRIVATE *pCompPrv)
 	return nErr;
 }
 
-int COLORCONVERT_PlatformOpaqueToNV12(void *hCC,
-				      void *pSrc[COLORCONVERT_MAX_SUB_BUFFERS],
-				      void *pDst[COLORCONVERT_MAX_SUB_BUFFERS],
-				      int nWidth, int nHeight, int nStride,
-				      int nSrcBufType,int nDstBufType)
-{
-	IMG_gralloc_module_public_t const* module = hCC;
-	int nErr = -1;
-
-	if((nSrcBufType == COLORCONVERT_BUFTYPE_GRALLOCOPAQUE) && (nDstBufType == COLORCONVERT_BUFTYPE_VIRTUAL))
-	{
-		nErr = module->Blit(module, pSrc[0], pDst, HAL_PIXEL_FORMAT_TI_NV12);
-
-	}
-	else if((nSrcBufType == COLORCONVERT_BUFTYPE_GRALLOCOPAQUE) && (nDstBufType == COLORCONVERT_BUFTYPE_GRALLOCOPAQUE ))
-	{
-		nErr = module->Blit2(module, pSrc[0], pDst[0], nWidth, nHeight, 0, 0);
-	}
-
-	return nErr;
-}
-
 int COLORCONVERT_close(void *hCC,PROXY_COMPONENT_PRIVATE *pCompPrv)
 {
 	OMX_PROXY_MPEG4E_PRIVATE *pProxy = NULL;
+
 	pProxy = (OMX_PROXY_MPEG4E_PRIVATE *) pCompPrv->pCompProxyPrv;
 	if(pProxy && pProxy->mAllocDev)
 	{
 		gralloc_close(pProxy->mAllocDev);
 	}
+	COLORCONVERT_CPU_GrallocClose(hCC);
 	return 0;
 }
 #endif
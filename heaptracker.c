@@ -17,9 +17,17 @@
 
 #include <android/log.h>
 #include <pthread.h>
+#include <signal.h>
 #include <time.h>
+#include <math.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
+#include "heaptracker.h"
 #include "mapinfo.h"
 
 extern int heaptracker_stacktrace(intptr_t*, size_t);
@@ -28,7 +36,7 @@ extern void *__real_realloc(void *ptr, size_t size);
 extern void *__real_calloc(int nmemb, int size);
 extern void __real_free(void *ptr);
 
-static mapinfo *milist;
+static mapindex *maps;
 
 #define MAX_BACKTRACE_DEPTH 15
 #define ALLOCATION_TAG      0x1ee7d00d
@@ -40,23 +48,62 @@ static mapinfo *milist;
 #define REAR_GUARD          0xbb
 #define REAR_GUARD_LEN      (1<<4)
 #define SCANNER_SLEEP_S     3
+#define SHARD_BITS          4
+#define NUM_SHARDS          (1 << SHARD_BITS)
+#define BACKLOG_SHARD_MAX   ((BACKLOG_MAX + NUM_SHARDS - 1) / NUM_SHARDS)
+#define STACK_HASH_BITS     12
+#define STACK_CHUNK_BITS    10
+#define STACK_CHUNK         (1 << STACK_CHUNK_BITS)
+#define MAX_STACK_CHUNKS    256
+#define LIGHT_TAG           0x5ca1ab1e
+/* what malloc guarantees, and so what user data must keep */
+#define MALLOC_ALIGN        __alignof__(max_align_t)
 
 struct hdr {
     uint32_t tag;
     struct hdr *prev;
     struct hdr *next;
-    intptr_t bt[MAX_BACKTRACE_DEPTH];
-    int bt_depth;
-    intptr_t freed_bt[MAX_BACKTRACE_DEPTH];
-    int freed_bt_depth;
+    uint32_t bt_id;         /* stack id of the allocation, 0 if none */
+    uint32_t freed_bt_id;   /* stack id of the free, while in the backlog */
+    uint32_t shard;         /* live or backlog shard the header is on */
     size_t size;
-    char front_guard[FRONT_GUARD_LEN];
+    unsigned char front_guard[FRONT_GUARD_LEN];
 } __attribute__((packed));
 
 struct ftr {
-    char rear_guard[REAR_GUARD_LEN];
+    unsigned char rear_guard[REAR_GUARD_LEN];
 } __attribute__((packed));
 
+/*
+ * A tracked block is padded in front of its header to keep the user data
+ * MALLOC_ALIGN aligned; the front guard stays right before the user data.
+ */
+#define HDR_PAD ((MALLOC_ALIGN - sizeof(struct hdr) % MALLOC_ALIGN) % MALLOC_ALIGN)
+#define HDR_LEN (HDR_PAD + sizeof(struct hdr))
+
+static inline struct hdr *to_hdr(void *block)
+{
+    return block ? (struct hdr *)((char *)block + HDR_PAD) : NULL;
+}
+
+static inline void *to_block(struct hdr *hdr)
+{
+    return (char *)hdr - HDR_PAD;
+}
+
+/*
+ * In sampling mode, allocations that are not sampled only get this header:
+ * no backtrace, guards, poison or backlog, just enough to keep counts. It
+ * sits right before the user data, where a tracked allocation has its
+ * front guard, so free() can tell the two apart, and is padded in front
+ * like struct hdr.
+ */
+struct light_hdr {
+    unsigned char pad[(MALLOC_ALIGN - 2 * sizeof(uint32_t) % MALLOC_ALIGN) % MALLOC_ALIGN];
+    uint32_t size;
+    uint32_t tag;
+};
+
 static inline struct ftr * to_ftr(struct hdr *hdr)
 {
     return (struct ftr *)(((char *)(hdr + 1)) + hdr->size);
@@ -86,20 +133,337 @@ void (*malloc_log)(const char *fmt, ...) = default_log;
 /* Call this ad dlclose() to get leaked memory */
 void free_leaked_memory(void);
 
-static unsigned num;
-static struct hdr *first;
-static struct hdr *last;
-static pthread_rwlock_t lock = PTHREAD_RWLOCK_INITIALIZER;
+/*
+ * Live allocations and the backlog of freed ones are split into shards by
+ * the thread that added them, each list with its own lock. A thread keeps
+ * working on the same shard, so its lock and list stay in that core's
+ * cache instead of bouncing between cores on every call, as they do with
+ * a single lock or shards picked by address. The header records its
+ * shard for frees from other threads. Shards are cache line aligned to
+ * keep their locks apart.
+ */
+struct shard {
+    pthread_rwlock_t lock;
+    unsigned num;
+    struct hdr *first;
+    struct hdr *last;
+} __attribute__((aligned(64)));
+
+static struct shard live[NUM_SHARDS] = {
+    [0 ... NUM_SHARDS - 1] = { .lock = PTHREAD_RWLOCK_INITIALIZER }
+};
+static struct shard backlog[NUM_SHARDS] = {
+    [0 ... NUM_SHARDS - 1] = { .lock = PTHREAD_RWLOCK_INITIALIZER }
+};
+
+/* the calling thread's shard; threads may share one */
+static inline uint32_t thread_shard(void)
+{
+    uint32_t h = (uint32_t)(uintptr_t)pthread_self() * 2654435761u;
+    return h >> (32 - SHARD_BITS);
+}
+
+static inline struct shard *shard_of(struct shard *shards, struct hdr *hdr)
+{
+    return &shards[hdr->shard & (NUM_SHARDS - 1)];
+}
+
+/*
+ * Backtraces are interned: most allocations come from a handful of call
+ * sites, so each distinct stack is stored once and headers carry its 32-bit
+ * id. Stacks are kept for the life of the process, so that the common case,
+ * finding a known stack, only reads shared memory: a refcount or a read
+ * lock there would be written by every thread on every call from the same
+ * site. Hash chains are only ever prepended to, under a lock striped over
+ * NUM_SHARDS, and are walked without one. Ids index a table of chunks that
+ * never move, so looking up an id needs no lock either. Once all ids are
+ * used, new stacks are not recorded.
+ */
+struct stack {
+    struct stack *next;     /* hash chain */
+    uint32_t hash;
+    uint32_t id;
+    uint32_t leaks;         /* leak report only: leaked allocations... */
+    size_t leaked;          /* ...and their bytes */
+    double est_count;       /* live heap report only: scaled allocations... */
+    double est_bytes;       /* ...and their bytes */
+    int depth;
+    intptr_t bt[];
+};
+
+static struct stack *stack_hash[1 << STACK_HASH_BITS];
+static pthread_mutex_t stack_locks[NUM_SHARDS] = {
+    [0 ... NUM_SHARDS - 1] = PTHREAD_MUTEX_INITIALIZER
+};
+
+static struct stack **stack_chunks[MAX_STACK_CHUNKS];
+static pthread_mutex_t stack_id_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t next_stack_id = 1;  /* 0 means "no backtrace" */
+static unsigned num_stacks;
+static size_t stack_bytes;
+
+static inline struct stack *stack_of(uint32_t id)
+{
+    struct stack **chunk;
+
+    if (!id || id >= MAX_STACK_CHUNKS * STACK_CHUNK)
+        return NULL;
+    chunk = stack_chunks[id >> STACK_CHUNK_BITS];
+    return chunk ? chunk[id & (STACK_CHUNK - 1)] : NULL;
+}
+
+static inline size_t stack_size(int depth)
+{
+    return sizeof(struct stack) + depth * sizeof(intptr_t);
+}
+
+static uint32_t alloc_stack_id(struct stack *st)
+{
+    uint32_t id = 0;
+
+    pthread_mutex_lock(&stack_id_lock);
+    if (next_stack_id < MAX_STACK_CHUNKS * STACK_CHUNK) {
+        struct stack ***chunk = &stack_chunks[next_stack_id >> STACK_CHUNK_BITS];
+        if (!*chunk)
+            *chunk = __real_calloc(STACK_CHUNK, sizeof(struct stack *));
+        if (*chunk)
+            id = next_stack_id++;
+    }
+    if (id) {
+        stack_chunks[id >> STACK_CHUNK_BITS][id & (STACK_CHUNK - 1)] = st;
+        num_stacks++;
+        stack_bytes += stack_size(st->depth);
+    }
+    pthread_mutex_unlock(&stack_id_lock);
+    return id;
+}
+
+static inline uint32_t hash_stack(const intptr_t *bt, int depth)
+{
+    uint32_t h = 2166136261u;
+    int i;
+    for (i = 0; i < depth; i++)
+        h = (h ^ (uint32_t)bt[i]) * 16777619u;
+    return h;
+}
+
+static inline pthread_mutex_t *stack_lock(uint32_t hash)
+{
+    return &stack_locks[hash & (NUM_SHARDS - 1)];
+}
 
-static unsigned backlog_num;
-static struct hdr *backlog_first;
-static struct hdr *backlog_last;
-static pthread_rwlock_t backlog_lock = PTHREAD_RWLOCK_INITIALIZER;
+static inline struct stack **stack_bucket(uint32_t hash)
+{
+    return &stack_hash[hash >> (32 - STACK_HASH_BITS)];
+}
+
+static struct stack *__find_stack(uint32_t hash, const intptr_t *bt, int depth)
+{
+    struct stack *st;
+    for (st = *(struct stack * volatile *)stack_bucket(hash); st; st = st->next)
+        if (st->hash == hash && st->depth == depth &&
+            !memcmp(st->bt, bt, depth * sizeof(*bt)))
+            return st;
+    return NULL;
+}
+
+/* returns the stack id for bt, or 0 if it could not be stored */
+static uint32_t get_stack(const intptr_t *bt, int depth)
+{
+    uint32_t hash = hash_stack(bt, depth);
+    pthread_mutex_t *lock;
+    struct stack *st, *new;
+    uint32_t id = 0;
+
+    st = __find_stack(hash, bt, depth);
+    if (st)
+        return st->id;
+
+    new = __real_malloc(stack_size(depth));
+    if (!new)
+        return 0;
+
+    lock = stack_lock(hash);
+    pthread_mutex_lock(lock);
+    /* someone may have stored the same stack since we looked */
+    st = __find_stack(hash, bt, depth);
+    if (st) {
+        id = st->id;
+    } else {
+        new->hash = hash;
+        new->leaks = 0;
+        new->leaked = 0;
+        new->est_count = 0;
+        new->est_bytes = 0;
+        new->depth = depth;
+        memcpy(new->bt, bt, depth * sizeof(*bt));
+        new->id = id = alloc_stack_id(new);
+        if (id) {
+            new->next = *stack_bucket(hash);
+            /* the stack must be complete before walkers can see it */
+            __sync_synchronize();
+            *stack_bucket(hash) = new;
+            new = NULL;
+        }
+    }
+    pthread_mutex_unlock(lock);
+
+    if (new)
+        __real_free(new);
+    return id;
+}
+
+/*
+ * Sampling mode, enabled with HEAPTRACKER_SAMPLE=[poisson:|interval:]<bytes>.
+ * Unwinding on every malloc and free is what makes tracking expensive, so
+ * only about one allocation per <bytes> allocated is tracked in full:
+ *  poisson:  the bytes between samples are exponentially distributed with
+ *            that mean, so every byte is equally likely to be sampled
+ *            (the default)
+ *  interval: every <bytes>th byte is sampled
+ * The live heap report scales each sampled allocation by the inverse of
+ * its probability of being sampled.
+ *
+ * Sampling state is kept per shard of threads; two threads sharing a
+ * shard race on it, which only perturbs the sampling.
+ */
+enum { SAMPLE_ALL, SAMPLE_POISSON, SAMPLE_INTERVAL };
+static int sample_mode = SAMPLE_ALL;
+static size_t sample_bytes;
+
+struct sampler {
+    uint32_t rand;
+    size_t countdown;       /* bytes until the next sample */
+    int light_num;          /* unsampled allocations and bytes, may go */
+    long light_bytes;       /* negative when freed from another slot */
+} __attribute__((aligned(64)));
+
+static struct sampler samplers[NUM_SHARDS];
+
+static inline struct sampler *thread_sampler(void)
+{
+    return &samplers[thread_shard()];
+}
+
+static size_t next_sample(struct sampler *sm)
+{
+    uint32_t r;
+
+    if (sample_mode == SAMPLE_INTERVAL)
+        return sample_bytes;
+
+    /* xorshift32; the seed only needs to be nonzero */
+    r = sm->rand ? sm->rand : (uint32_t)(uintptr_t)sm | 1;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    sm->rand = r;
+
+    /* -ln(u) * mean for u = r / 2^32 */
+    return (size_t)(-log(r / 4294967296.0) * sample_bytes) + 1;
+}
+
+static inline int should_sample(size_t size)
+{
+    struct sampler *sm;
+
+    if (sample_mode == SAMPLE_ALL)
+        return 1;
+
+    sm = thread_sampler();
+    if (sm->countdown > size) {
+        sm->countdown -= size;
+        return 0;
+    }
+    /*
+     * The interval carries the bytes past the sample point, so every
+     * sample_bytes-th byte stays sampled however the allocations fall.
+     * Poisson gaps are memoryless and start over.
+     */
+    if (sample_mode == SAMPLE_INTERVAL)
+        sm->countdown = sample_bytes - (size - sm->countdown) % sample_bytes;
+    else
+        sm->countdown = next_sample(sm);
+    return 1;
+}
+
+/* how many allocations a sampled one of this size stands for */
+static double sample_weight(size_t size)
+{
+    switch (sample_mode) {
+    case SAMPLE_POISSON:
+        return size ? 1.0 / (1.0 - exp(-(double)size / sample_bytes)) : 1.0;
+    case SAMPLE_INTERVAL:
+        return size && size < sample_bytes ? (double)sample_bytes / size : 1.0;
+    default:
+        return 1.0;
+    }
+}
+
+static inline void count_light(long bytes, int num)
+{
+    struct sampler *sm = thread_sampler();
+    __sync_fetch_and_add(&sm->light_num, num);
+    __sync_fetch_and_add(&sm->light_bytes, bytes);
+}
+
+static inline struct light_hdr *light(void *user)
+{
+    return ((struct light_hdr *)user) - 1;
+}
+
+static inline int is_light(void *user)
+{
+    return light(user)->tag == LIGHT_TAG;
+}
+
+static void *light_alloc(size_t size, int zero)
+{
+    struct light_hdr *lh;
+
+    lh = zero ? __real_calloc(1, sizeof(*lh) + size) :
+                __real_malloc(sizeof(*lh) + size);
+    if (!lh)
+        return NULL;
+    lh->size = size;
+    lh->tag = LIGHT_TAG;
+    count_light(size, 1);
+    return lh + 1;
+}
+
+static void light_free(void *ptr)
+{
+    struct light_hdr *lh = light(ptr);
+
+    count_light(-(long)lh->size, -1);
+    lh->tag = 0;
+    __real_free(lh);
+}
+
+static void light_totals(unsigned *num, size_t *bytes)
+{
+    long b = 0;
+    int n = 0, i;
+
+    for (i = 0; i < NUM_SHARDS; i++) {
+        n += samplers[i].light_num;
+        b += samplers[i].light_bytes;
+    }
+    *num = n;
+    *bytes = b;
+}
+
+static inline __attribute__((always_inline)) uint32_t record_stack(void)
+{
+    intptr_t bt[MAX_BACKTRACE_DEPTH];
+    int depth = heaptracker_stacktrace(bt, MAX_BACKTRACE_DEPTH);
+    return get_stack(bt, depth);
+}
 
 void print_backtrace(const intptr_t *bt, int depth)
 {
-    mapinfo *mi;
-    int cnt, rel_pc;
+    mapsym ms;
+    int cnt;
     intptr_t self_bt[MAX_BACKTRACE_DEPTH];
 
     if (!bt) {
@@ -109,13 +473,26 @@ void print_backtrace(const intptr_t *bt, int depth)
 
     malloc_log("*** *** *** *** *** *** *** *** *** *** *** *** *** *** *** ***\n");
     for (cnt = 0; cnt < depth && cnt < MAX_BACKTRACE_DEPTH; cnt++) {
-        mi = pc_to_mapinfo(milist, bt[cnt], &rel_pc);
-        malloc_log("\t#%02d  pc %08x  %s\n", cnt,
-                   mi ? rel_pc : bt[cnt],
-                   mi ? mi->name : "(unknown)");
+        mapindex_lookup(maps, bt[cnt], &ms);
+        if (ms.symbol[0])
+            malloc_log("\t#%02d  pc %08lx  %s (%s+%u)\n", cnt, (unsigned long)ms.rel_pc,
+                       ms.mi->name, ms.symbol, ms.sym_offset);
+        else
+            malloc_log("\t#%02d  pc %08lx  %s\n", cnt, (unsigned long)ms.rel_pc,
+                       ms.mi ? ms.mi->name : "(unknown)");
     }
 }
 
+static void print_stack(uint32_t id)
+{
+    struct stack *st = stack_of(id);
+
+    if (st)
+        print_backtrace(st->bt, st->depth);
+    else
+        malloc_log("*** (no backtrace recorded)\n");
+}
+
 static inline void init_front_guard(struct hdr *hdr)
 {
     memset(hdr->front_guard, FRONT_GUARD, FRONT_GUARD_LEN);
@@ -185,25 +562,32 @@ static inline int __del(struct hdr *hdr, struct hdr **first, struct hdr **last)
 
 static inline void add(struct hdr *hdr, size_t size)
 {
-    pthread_rwlock_wrlock(&lock);
+    struct shard *s;
+
+    hdr->shard = thread_shard();
+    s = shard_of(live, hdr);
     hdr->tag = ALLOCATION_TAG;
     hdr->size = size;
     init_front_guard(hdr);
     init_rear_guard(hdr);
-    num++;
-    __add(hdr, &first, &last);
-    pthread_rwlock_unlock(&lock);
+    pthread_rwlock_wrlock(&s->lock);
+    s->num++;
+    __add(hdr, &s->first, &s->last);
+    pthread_rwlock_unlock(&s->lock);
 }
 
 static inline int del(struct hdr *hdr)
 {
+    struct shard *s;
+
     if (hdr->tag != ALLOCATION_TAG)
         return -1;
 
-    pthread_rwlock_wrlock(&lock);
-    __del(hdr, &first, &last);
-    num--;
-    pthread_rwlock_unlock(&lock);
+    s = shard_of(live, hdr);
+    pthread_rwlock_wrlock(&s->lock);
+    __del(hdr, &s->first, &s->last);
+    s->num--;
+    pthread_rwlock_unlock(&s->lock);
     return 0;
 }
 
@@ -215,7 +599,7 @@ static inline void poison(struct hdr *hdr)
 static int was_used_after_free(struct hdr *hdr)
 {
     unsigned i;
-    const char *data = (const char *)user(hdr);
+    const unsigned char *data = (const unsigned char *)user(hdr);
     for (i = 0; i < hdr->size; i++)
         if (data[i] != FREE_POISON)
             return 1;
@@ -277,11 +661,11 @@ static inline int __check_allocation(struct hdr *hdr, int *safe)
     if (!valid && *safe) {
         malloc_log("+++ ALLOCATION %p SIZE %d ALLOCATED HERE:\n",
                         user(hdr), hdr->size);
-        print_backtrace(hdr->bt, hdr->bt_depth);
+        print_stack(hdr->bt_id);
         if (hdr->tag == BACKLOG_TAG) {
             malloc_log("+++ ALLOCATION %p SIZE %d FREED HERE:\n",
                        user(hdr), hdr->size);
-            print_backtrace(hdr->freed_bt, hdr->freed_bt_depth);
+            print_stack(hdr->freed_bt_id);
         }
     }
 
@@ -301,69 +685,85 @@ static inline int __del_and_check(struct hdr *hdr,
     return valid;
 }
 
-static inline void __del_from_backlog(struct hdr *hdr)
+static inline void __del_from_backlog(struct shard *s, struct hdr *hdr)
 {
         int safe;
         (void)__del_and_check(hdr,
-                              &backlog_first, &backlog_last, &backlog_num,
+                              &s->first, &s->last, &s->num,
                               &safe);
         hdr->tag = 0; /* clear the tag */
 }
 
 static inline void del_from_backlog(struct hdr *hdr)
 {
-    pthread_rwlock_wrlock(&backlog_lock);
-    __del_from_backlog(hdr);
-    pthread_rwlock_unlock(&backlog_lock);
+    struct shard *s = shard_of(backlog, hdr);
+
+    pthread_rwlock_wrlock(&s->lock);
+    __del_from_backlog(s, hdr);
+    pthread_rwlock_unlock(&s->lock);
 }
 
-static inline int del_leak(struct hdr *hdr, int *safe)
+static inline int del_leak(struct shard *s, struct hdr *hdr, int *safe)
 {
     int valid;
-    pthread_rwlock_wrlock(&lock);
+    pthread_rwlock_wrlock(&s->lock);
     valid = __del_and_check(hdr,
-                            &first, &last, &num,
+                            &s->first, &s->last, &s->num,
                             safe);
-    pthread_rwlock_unlock(&lock);
+    pthread_rwlock_unlock(&s->lock);
     return valid;
 }
 
 static inline void add_to_backlog(struct hdr *hdr)
 {
-    pthread_rwlock_wrlock(&backlog_lock);
+    struct shard *s;
+
+    hdr->shard = thread_shard();
+    s = shard_of(backlog, hdr);
     hdr->tag = BACKLOG_TAG;
-    backlog_num++;
-    __add(hdr, &backlog_first, &backlog_last);
     poison(hdr);
-    /* If we've exceeded the maximum backlog, clear it up */
-    while (backlog_num > BACKLOG_MAX) {
-        struct hdr *gone = backlog_first;
-        __del_from_backlog(gone);
-        __real_free(gone);
+    pthread_rwlock_wrlock(&s->lock);
+    s->num++;
+    __add(hdr, &s->first, &s->last);
+    /* If we've exceeded the shard's part of the backlog, clear it up */
+    while (s->num > BACKLOG_SHARD_MAX) {
+        struct hdr *gone = s->first;
+        __del_from_backlog(s, gone);
+        __real_free(to_block(gone));
     }
-    pthread_rwlock_unlock(&backlog_lock);
+    pthread_rwlock_unlock(&s->lock);
 }
 
-void* __wrap_malloc(size_t size)
+static inline __attribute__((always_inline)) void *tracked_malloc(size_t size)
 {
-//  malloc_tracker_log("%s: %s\n", __FILE__, __FUNCTION__);
-    struct hdr *hdr = __real_malloc(sizeof(struct hdr) + size +
-                                    sizeof(struct ftr));
+    struct hdr *hdr = to_hdr(__real_malloc(HDR_LEN + size + sizeof(struct ftr)));
     if (hdr) {
-        hdr->bt_depth = heaptracker_stacktrace(
-                            hdr->bt, MAX_BACKTRACE_DEPTH);
+        hdr->bt_id = record_stack();
         add(hdr, size);
         return user(hdr);
     }
     return NULL;
 }
 
+void* __wrap_malloc(size_t size)
+{
+//  malloc_tracker_log("%s: %s\n", __FILE__, __FUNCTION__);
+    if (!should_sample(size))
+        return light_alloc(size, 0);
+    return tracked_malloc(size);
+}
+
 void __wrap_free(void *ptr)
 {
     struct hdr *hdr;
     if (!ptr) /* ignore free(NULL) */
         return;
 
+    if (is_light(ptr)) {
+        light_free(ptr);
+        return;
+    }
+
     hdr = meta(ptr);
 
     if (del(hdr) < 0) {
@@ -375,11 +775,11 @@ void __wrap_free(void *ptr)
                        user(hdr), hdr->size);
             malloc_log("+++ ALLOCATION %p SIZE %d ALLOCATED HERE:\n",
                        user(hdr), hdr->size);
-            print_backtrace(hdr->bt, hdr->bt_depth);
-            /* hdr->freed_bt_depth should be nonzero here */
+            print_stack(hdr->bt_id);
+            /* hdr->freed_bt_id should be nonzero here */
             malloc_log("+++ ALLOCATION %p SIZE %d FIRST FREED HERE:\n",
                        user(hdr), hdr->size);
-            print_backtrace(hdr->freed_bt, hdr->freed_bt_depth);
+            print_stack(hdr->freed_bt_id);
             malloc_log("+++ ALLOCATION %p SIZE %d NOW BEING FREED HERE:\n",
                        user(hdr), hdr->size);
             print_backtrace(bt, depth);
@@ -393,8 +793,7 @@ void __wrap_free(void *ptr)
         }
     }
     else {
-        hdr->freed_bt_depth = heaptracker_stacktrace(hdr->freed_bt,
-                                      MAX_BACKTRACE_DEPTH);
+        hdr->freed_bt_id = record_stack();
         add_to_backlog(hdr);
     }
 }
@@ -411,6 +810,28 @@ void *__wrap_realloc(void *ptr, size_t size)
     if (!ptr)
         return __wrap_malloc(size);
 
+    if (is_light(ptr)) {
+        struct light_hdr *lh = light(ptr);
+        size_t old_size = lh->size;
+        void *new;
+
+        if (should_sample(size)) {
+            new = tracked_malloc(size);
+            if (new) {
+                memcpy(new, ptr, old_size < size ? old_size : size);
+                light_free(ptr);
+            }
+            return new;
+        }
+
+        lh = __real_realloc(lh, sizeof(*lh) + size);
+        if (!lh)
+            return NULL;
+        lh->size = size;
+        count_light((long)size - (long)old_size, 0);
+        return lh + 1;
+    }
+
     hdr = meta(ptr);
 
 //  malloc_log("%s: %s\n", __FILE__, __FUNCTION__);
@@ -423,11 +844,11 @@ void *__wrap_realloc(void *ptr, size_t size)
                        user(hdr), size, hdr->size);
             malloc_log("+++ ALLOCATION %p SIZE %d ALLOCATED HERE:\n",
                        user(hdr), hdr->size);
-            print_backtrace(hdr->bt, hdr->bt_depth);
-            /* hdr->freed_bt_depth should be nonzero here */
+            print_stack(hdr->bt_id);
+            /* hdr->freed_bt_id should be nonzero here */
             malloc_log("+++ ALLOCATION %p SIZE %d FIRST FREED HERE:\n",
                        user(hdr), hdr->size);
-            print_backtrace(hdr->freed_bt, hdr->freed_bt_depth);
+            print_stack(hdr->freed_bt_id);
             malloc_log("+++ ALLOCATION %p SIZE %d NOW BEING REALLOCATED HERE:\n",
                        user(hdr), hdr->size);
             print_backtrace(bt, depth);
@@ -447,10 +868,10 @@ void *__wrap_realloc(void *ptr, size_t size)
             // return __real_realloc(user(hdr), size); // assuming it was allocated externally
         }
     }
- 
-    hdr = __real_realloc(hdr, sizeof(struct hdr) + size + sizeof(struct ftr));
+
+    hdr = to_hdr(__real_realloc(to_block(hdr), HDR_LEN + size + sizeof(struct ftr)));
     if (hdr) {
-        hdr->bt_depth = heaptracker_stacktrace(hdr->bt, MAX_BACKTRACE_DEPTH);
+        hdr->bt_id = record_stack();
         add(hdr, size);
         return user(hdr);
     }
@@ -463,59 +884,221 @@ void *__wrap_calloc(int nmemb, size_t size)
 //  malloc_tracker_log("%s: %s\n", __FILE__, __FUNCTION__);
     struct hdr *hdr;
     size_t __size = nmemb * size;
-    hdr = __real_calloc(1, sizeof(struct hdr) + __size + sizeof(struct ftr));
+    if (!should_sample(__size))
+        return light_alloc(__size, 1);
+    hdr = to_hdr(__real_calloc(1, HDR_LEN + __size + sizeof(struct ftr)));
     if (hdr) {
-        hdr->bt_depth = heaptracker_stacktrace(
-                            hdr->bt, MAX_BACKTRACE_DEPTH);
+        hdr->bt_id = record_stack();
         add(hdr, __size);
         return user(hdr);
     }
     return NULL;
 }
 
+static int cmp_leaked(const void *a, const void *b)
+{
+    const struct stack *sa = *(struct stack * const *)a;
+    const struct stack *sb = *(struct stack * const *)b;
+    if (sa->leaked != sb->leaked)
+        return sa->leaked < sb->leaked ? 1 : -1;
+    return sb->leaks - sa->leaks;
+}
+
+/*
+ * Leaks are reported per allocation site, largest first, rather than with
+ * one backtrace per leaked block.
+ */
 void heaptracker_free_leaked_memory(void)
 {
     struct hdr *del; int cnt;
+    unsigned num = 0, max_sites = 0, num_sites = 0, i;
+    unsigned untraced = 0;
+    size_t untraced_bytes = 0;
+    struct stack **sites = NULL;
+
+    for (cnt = 0; cnt < NUM_SHARDS; cnt++)
+        num += live[cnt].num;
+    if (num) {
+        malloc_log("+++ THERE ARE %d LEAKED ALLOCATIONS\n", num);
+        /* one site per leak counted now; threads still allocating can
+         * add more, those are listed one by one */
+        max_sites = num;
+        sites = __real_malloc(max_sites * sizeof(*sites));
+    }
 
+    for (cnt = 0; cnt < NUM_SHARDS; cnt++) {
+        struct shard *s = &live[cnt];
+
+        while (s->last) {
+            int safe;
+            struct stack *st;
+            del = s->last;
+            if (del_leak(s, del, &safe)) {
+                /* safe == 1, because the allocation is valid */
+                st = stack_of(del->bt_id);
+                if (st && sites && (st->leaks || num_sites < max_sites)) {
+                    if (!st->leaks++)
+                        sites[num_sites++] = st;
+                    st->leaked += del->size;
+                }
+                else if (st) {
+                    malloc_log("+++ ALLOCATION %p SIZE %d ALLOCATED HERE:\n",
+                               user(del), del->size);
+                    print_stack(del->bt_id);
+                }
+                else {
+                    untraced++;
+                    untraced_bytes += del->size;
+                }
+            }
+            __real_free(to_block(del));
+        }
+    }
+
+    qsort(sites, num_sites, sizeof(*sites), cmp_leaked);
+    for (i = 0; i < num_sites; i++) {
+        struct stack *st = sites[i];
+        malloc_log("+++ %u BYTES LEAKED IN %u ALLOCATIONS FROM:\n",
+                   (unsigned)st->leaked, st->leaks);
+        print_backtrace(st->bt, st->depth);
+        st->leaks = 0;
+        st->leaked = 0;
+    }
+    if (untraced)
+        malloc_log("+++ %u BYTES LEAKED IN %u ALLOCATIONS WITHOUT A BACKTRACE\n",
+                   (unsigned)untraced_bytes, untraced);
+    __real_free(sites);
+
+    /* unsampled allocations are not listed anywhere and cannot be freed */
+    light_totals(&num, &untraced_bytes);
     if (num)
-        malloc_log("+++ THERE ARE %d LEAKED ALLOCATIONS\n", num);
+        malloc_log("+++ %u BYTES IN %u UNSAMPLED ALLOCATIONS WERE NOT FREED\n",
+                   (unsigned)untraced_bytes, num);
+
+    for (cnt = 0; cnt < NUM_SHARDS; cnt++) {
+        while (backlog[cnt].last) {
+            del = backlog[cnt].first;
+            del_from_backlog(del);
+            __real_free(to_block(del));
+        }
+    }
+}
 
-    while (last) {
-        int safe;
-        del = last;
-        malloc_log("+++ DELETING %d BYTES OF LEAKED MEMORY AT %p (%d REMAINING)\n",
-                del->size, user(del), num);
-        if (del_leak(del, &safe)) {
-            /* safe == 1, because the allocation is valid */
-            malloc_log("+++ ALLOCATION %p SIZE %d ALLOCATED HERE:\n",
-                        user(del), del->size);
-            print_backtrace(del->bt, del->bt_depth);
+static int cmp_est_bytes(const void *a, const void *b)
+{
+    const struct stack *sa = *(struct stack * const *)a;
+    const struct stack *sb = *(struct stack * const *)b;
+    if (sa->est_bytes != sb->est_bytes)
+        return sa->est_bytes < sb->est_bytes ? 1 : -1;
+    return 0;
+}
+
+static pthread_mutex_t live_heap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Live heap by allocation site, largest first. In sampling mode the counts
+ * are estimates scaled up from the sampled allocations. Returns the
+ * estimated live bytes, or -1 if the report could not be made.
+ */
+double heaptracker_dump_live_heap(void)
+{
+    struct stack **sites;
+    unsigned num = 0, max_sites, num_sites = 0, light_num, i;
+    size_t bytes = 0, light_bytes;
+    double est_bytes = 0;
+    int cnt;
+
+    pthread_mutex_lock(&live_heap_lock);
+    for (cnt = 0; cnt < NUM_SHARDS; cnt++)
+        num += live[cnt].num;
+    /* allocations added while we walk are skipped once this is full */
+    max_sites = num + 1;
+    sites = __real_malloc(max_sites * sizeof(*sites));
+    if (!sites) {
+        pthread_mutex_unlock(&live_heap_lock);
+        return -1;
+    }
+
+    num = 0;
+    for (cnt = 0; cnt < NUM_SHARDS; cnt++) {
+        struct shard *s = &live[cnt];
+        struct hdr *hdr;
+
+        pthread_rwlock_rdlock(&s->lock);
+        for (hdr = s->last; hdr; hdr = hdr->next) {
+            struct stack *st = stack_of(hdr->bt_id);
+            double w = sample_weight(hdr->size);
+
+            num++;
+            bytes += hdr->size;
+            if (!st)
+                continue;
+            if (!st->est_count) {
+                if (num_sites == max_sites)
+                    continue;
+                sites[num_sites++] = st;
+            }
+            st->est_count += w;
+            st->est_bytes += w * hdr->size;
+            est_bytes += w * hdr->size;
         }
-        __real_free(del);
+        pthread_rwlock_unlock(&s->lock);
     }
 
-//  malloc_log("+++ DELETING %d BACKLOGGED ALLOCATIONS\n", backlog_num);
-    while (backlog_last) {
-	del = backlog_first;
-        del_from_backlog(del);
-        __real_free(del);
+    light_totals(&light_num, &light_bytes);
+    malloc_log("+++ LIVE HEAP: %u BYTES IN %u ALLOCATIONS, %u OF THEM SAMPLED\n",
+               (unsigned)(bytes + light_bytes), num + light_num, num);
+    if (sample_mode != SAMPLE_ALL)
+        malloc_log("+++ ESTIMATED FROM SAMPLES: %.0f BYTES\n", est_bytes);
+
+    qsort(sites, num_sites, sizeof(*sites), cmp_est_bytes);
+    for (i = 0; i < num_sites; i++) {
+        struct stack *st = sites[i];
+        malloc_log("+++ %.0f BYTES IN %.0f ALLOCATIONS FROM:\n",
+                   st->est_bytes, st->est_count);
+        print_backtrace(st->bt, st->depth);
+        st->est_count = 0;
+        st->est_bytes = 0;
     }
+    __real_free(sites);
+    pthread_mutex_unlock(&live_heap_lock);
+    return est_bytes;
 }
 
-static int check_list(struct hdr *list, pthread_rwlock_t *rwlock)
+/* Tracking overhead, for comparing against the allocations themselves */
+void heaptracker_dump_stats(void)
+{
+    unsigned num_live = 0, num_backlog = 0;
+    int cnt;
+
+    for (cnt = 0; cnt < NUM_SHARDS; cnt++) {
+        num_live += live[cnt].num;
+        num_backlog += backlog[cnt].num;
+    }
+
+    pthread_mutex_lock(&stack_id_lock);
+    malloc_log("+++ %u ALLOCATIONS (%u FREED IN BACKLOG), %u BYTES OF HEADER AND GUARDS EACH\n",
+               num_live, num_backlog, (unsigned)(HDR_LEN + sizeof(struct ftr)));
+    malloc_log("+++ %u UNIQUE BACKTRACES IN %u BYTES\n",
+               num_stacks, (unsigned)stack_bytes);
+    pthread_mutex_unlock(&stack_id_lock);
+}
+
+/* the shard is locked only while its own list is checked */
+static int check_list(struct shard *s)
 {
     struct hdr *hdr;
     int safe, num_checked;
 
-    pthread_rwlock_rdlock(rwlock);
+    pthread_rwlock_rdlock(&s->lock);
     num_checked = 0;
-    hdr = list;
+    hdr = s->last;
     while (hdr) {
         (void)__check_allocation(hdr, &safe);
         hdr = hdr->next;
         num_checked++;
     }
-    pthread_rwlock_unlock(rwlock);
+    pthread_rwlock_unlock(&s->lock);
 
     return num_checked;
 }
@@ -525,18 +1108,34 @@ static pthread_cond_t scanner_cond = PTHREAD_COND_INITIALIZER;
 static int scanner_stop;
 static pthread_mutex_t scanner_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/* set by HEAPTRACKER_DUMP_SIGNAL, reported from the scanner thread */
+static volatile sig_atomic_t dump_requested;
+
+static void dump_signal(int sig __attribute__((unused)))
+{
+    dump_requested = 1;
+}
+
 static void* scanner(void *data __attribute__((unused)))
 {
     struct timespec ts;
-    int num_checked, num_checked_backlog;
+    int num_checked, num_checked_backlog, i;
 
     while (1) {
-        num_checked = check_list(last, &lock);
-        num_checked_backlog = check_list(backlog_last, &backlog_lock);
+        num_checked = num_checked_backlog = 0;
+        for (i = 0; i < NUM_SHARDS; i++) {
+            num_checked += check_list(&live[i]);
+            num_checked_backlog += check_list(&backlog[i]);
+        }
 
-//      malloc_log("@@@ scanned %d/%d allocs and %d/%d freed\n",
-//                 num_checked, num,
-//                 num_checked_backlog, backlog_num);
+//      malloc_log("@@@ scanned %d allocs and %d freed\n",
+//                 num_checked, num_checked_backlog);
+
+        if (dump_requested) {
+            dump_requested = 0;
+            heaptracker_dump_stats();
+            heaptracker_dump_live_heap();
+        }
 
         pthread_mutex_lock(&scanner_lock);
         if (!scanner_stop) {
@@ -558,8 +1157,39 @@ static void* scanner(void *data __attribute__((unused)))
 static void init(void) __attribute__((constructor));
 static void init(void)
 {
+    const char *sample = getenv("HEAPTRACKER_SAMPLE");
+    const char *dump_sig = getenv("HEAPTRACKER_DUMP_SIGNAL");
+
+    if (sample) {
+        sample_mode = SAMPLE_POISSON;
+        if (!strncmp(sample, "interval:", 9)) {
+            sample_mode = SAMPLE_INTERVAL;
+            sample += 9;
+        } else if (!strncmp(sample, "poisson:", 8))
+            sample += 8;
+        sample_bytes = strtoul(sample, NULL, 0);
+        if (!sample_bytes)
+            sample_mode = SAMPLE_ALL;
+        else
+            malloc_log("+++ SAMPLING ONE ALLOCATION PER %u BYTES (%s)\n",
+                       (unsigned)sample_bytes,
+                       sample_mode == SAMPLE_POISSON ? "poisson" : "interval");
+    }
+
+    if (dump_sig) {
+        struct sigaction sa;
+        int sig = atoi(dump_sig);
+
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = dump_signal;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        if (sig > 0 && sig < NSIG && !sigaction(sig, &sa, NULL))
+            malloc_log("+++ SIGNAL %d DUMPS THE LIVE HEAP\n", sig);
+    }
+
 //  malloc_log("@@@ start scanner thread");
-    milist = init_mapinfo(getpid());
+    maps = init_mapindex(getpid());
     pthread_create(&scanner_thread,
                    NULL,
                    scanner,
@@ -579,5 +1209,5 @@ static void deinit(void)
 //  malloc_log("@@@ scanner thread stopped");
 
     heaptracker_free_leaked_memory();
-    deinit_mapinfo(milist);
+    deinit_mapindex(maps);
 }
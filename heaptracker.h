@@ -0,0 +1,28 @@
+#ifndef HEAPTRACKER_H
+#define HEAPTRACKER_H
+
+/*
+ * Reports for code linked with libheaptracker. Each goes through
+ * malloc_log, which can be overridden for non-printf reporting.
+ *
+ * A running process can also be asked for the live heap and stats by
+ * starting it with HEAPTRACKER_DUMP_SIGNAL set to a signal number, e.g.
+ * HEAPTRACKER_DUMP_SIGNAL=12 for SIGUSR2. The scanner thread makes the
+ * report within a few seconds of the signal.
+ */
+extern void (*malloc_log)(const char *fmt, ...);
+
+/* tracking overhead, for comparing against the allocations themselves */
+void heaptracker_dump_stats(void);
+
+/*
+ * Live heap by allocation site, largest first, scaled up from the sampled
+ * allocations when HEAPTRACKER_SAMPLE is set. Returns the estimated live
+ * bytes, or -1 if the report could not be made.
+ */
+double heaptracker_dump_live_heap(void);
+
+/* reports the allocations still live by site and frees them */
+void heaptracker_free_leaked_memory(void);
+
+#endif
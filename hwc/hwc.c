@@ -25,6 +25,7 @@
 #include <linux/omapfb.h>
 #include <sys/mman.h>
 #include <sys/resource.h>
+#include <time.h>
 
 #ifdef SYSFS_VSYNC_NOTIFICATION
 #include <sys/prctl.h>
@@ -56,6 +57,8 @@
 #include <video/dsscomp.h>
 
 #include "hal_public.h"
+#include "overlay_assign.h"
+#include "hwc_trace.h"
 
 #define MAX_HW_OVERLAYS 4
 #define NUM_NONSCALING_OVERLAYS 1
@@ -96,6 +99,7 @@ struct omap4_hwc_ext {
     __u16 height;
     __u32 xres;                         /* external screen resolution */
     __u32 yres;
+    __u32 refresh;                      /* external refresh rate in Hz, 0 if unknown */
     float m[2][3];                      /* external transformation matrix */
     hwc_rect_t mirror_region;           /* region of screen to mirror */
 };
@@ -116,6 +120,98 @@ struct omap4_hwc_img {
     unsigned char *ptr;
 } dock_image = { .rowbytes = 0 };
 
+#define DOCK_CACHE_SIZE 4
+
+/* copy of the dock image in fb memory, scaled to the size it is shown at */
+struct omap4_hwc_dock_copy {
+    int width;
+    int height;
+    int stride;
+    __u32 offset;               /* into fb memory */
+    __u32 size;
+    __u32 mode;                 /* HDMI mode it was made for, for the dump */
+    int ready;                  /* scaled, DSS may fetch it */
+    int scaling;                /* being scaled outside the lock, pinned */
+};
+
+#define MAX_PLAN_LAYERS 32
+
+/* per-layer inputs of the composition plan */
+struct omap4_hwc_layer_key {
+    __u32 flags;
+    __u32 transform;
+    __s32 blending;
+    hwc_rect_t sourceCrop;
+    hwc_rect_t displayFrame;
+    int format;                 /* 0 if there is no buffer */
+    int width;
+    int height;
+    int usage;
+};
+
+/* device state the composition plan depends on */
+struct omap4_hwc_state_key {
+    int force_sgx;
+    int last_ext_ovls;
+    int last_int_ovls;
+    struct ext_transform_t mirror;
+    struct ext_transform_t dock;
+    struct ext_transform_t last;
+    __u8 force_dock;
+    __u8 on_tv;
+};
+
+/* per-layer results of the composition plan */
+enum {
+    PLAN_OVERLAY    = (1 << 0), /* HWC_OVERLAY */
+    PLAN_CLEAR_FB   = (1 << 1), /* HWC_HINT_CLEAR_FB */
+};
+
+/*
+ * Last composition plan. It is reused while SF reports no geometry change
+ * and the layer and state keys are unchanged; only the buffer handles
+ * passed to Post2 are then refreshed from the layers.
+ */
+struct omap4_hwc_plan {
+    int valid;
+    unsigned int num_layers;
+    struct omap4_hwc_state_key state;
+    struct omap4_hwc_layer_key layers[MAX_PLAN_LAYERS];
+    __u8 result[MAX_PLAN_LAYERS];
+    int buffer_layer[MAX_HW_OVERLAYS]; /* layer behind each Post2 buffer, -1 for fb */
+
+    struct dsscomp_setup_dispc_data dsscomp;
+    struct ext_transform_t ext_current;
+    int use_sgx;
+    int swap_rb;
+    int ovls_blending;
+    unsigned int post2_layers;
+    int ext_ovls;
+    int ext_ovls_wanted;
+
+    /* statistics */
+    __u32 hits;
+    __u32 misses;
+    __u64 prepare_us;           /* total time spent in prepare */
+    __u32 prepare_max_us;
+};
+
+/*
+ * What the framebuffer holds since the last eglSwapBuffers: the layer
+ * geometry and which layers SGX composed from which buffers. A frame that
+ * would compose the same layers from the same buffers reuses it as is.
+ */
+struct omap4_hwc_fb_content {
+    int valid;
+    unsigned int num_layers;
+    struct omap4_hwc_layer_key layers[MAX_PLAN_LAYERS];
+    buffer_handle_t handles[MAX_PLAN_LAYERS];   /* NULL for overlay layers */
+
+    /* statistics */
+    __u32 composed;             /* SGX compositions swapped */
+    __u32 skipped;              /* SGX compositions reused */
+};
+
 struct omap4_hwc_module {
     hwc_module_t base;
 
@@ -167,6 +263,25 @@ struct omap4_hwc_device {
     int ext_ovls_wanted;        /* # of overlays that should be on external display for current composition */
     int last_ext_ovls;          /* # of overlays on external/internal display for last composition */
     int last_int_ovls;
+
+    struct omap4_hwc_plan plan; /* cached composition plan */
+    struct omap4_hwc_fb_content fb_content;
+    int fb_reuse;               /* skip eglSwapBuffers for the current composition */
+
+    struct omap4_hwc_dock_copy dock_copies[DOCK_CACHE_SIZE];
+    int num_dock_copies;
+    struct omap4_hwc_dock_copy dock_scale; /* copy to scale after set, width 0 if none */
+    int dock_next;              /* offset of the copy in the prepared composition, -1 if none */
+    int dock_posted[2];         /* offsets of the copies in the last two posts, -1 if none */
+    __u32 dock_hotplug_us;      /* time of the last docking hotplug, 0 once shown */
+    __u32 dock_latency_us;      /* from hotplug to the first dock frame */
+    __u32 dock_latency_max_us;
+
+    __u32 fetch_budget;         /* DSS fetch bandwidth budget, KB/s */
+    __u32 fetch_bw;             /* estimated fetch of the current plan, KB/s */
+    __u32 fetch_bw_max;         /* highest estimate so far */
+    __u32 fetch_limited;        /* prepares sent to SGX by the budget alone */
+    FILE *trace;                /* composition trace, see hwc_trace.h */
 };
 typedef struct omap4_hwc_device omap4_hwc_device_t;
 
@@ -895,6 +1010,9 @@ static int omap4_hwc_set_best_hdmi_mode(omap4_hwc_device_t *hwc_dev, __u32 xres,
     ext->height = d.dis.height_in_mm;
     ext->xres = d.dis.timings.x_res;
     ext->yres = d.dis.timings.y_res;
+    ext->refresh = 0;
+    if (ext->last_mode && ~ext->last_mode < d.dis.modedb_len)
+        ext->refresh = d.modedb[~ext->last_mode].refresh;
 
     /* use VGA external resolution as default */
     if (!ext->xres || !ext->yres) {
@@ -950,6 +1068,7 @@ static int omap4_hwc_set_best_hdmi_mode(omap4_hwc_device_t *hwc_dev, __u32 xres,
             ext->height = ext_height;
             ext->xres = mode_xres;
             ext->yres = mode_yres;
+            ext->refresh = d.modedb[i].refresh;
             best = i;
             best_score = score;
         }
@@ -986,6 +1105,89 @@ static int omap4_hwc_set_best_hdmi_mode(omap4_hwc_device_t *hwc_dev, __u32 xres,
     return 0;
 }
 
+/*
+ * output lines scanned per second by overlay manager mgr_ix. Lines come
+ * from the display timings, the LCD rate from the framebuffer and the
+ * HDMI rate from the mode picked for it, 60Hz where either is unknown.
+ */
+static __u32 display_line_rate(omap4_hwc_device_t *hwc_dev, int mgr_ix)
+{
+    __u32 fps;
+
+    if (mgr_ix) {
+        fps = hwc_dev->ext.refresh ? : 60;
+        return hwc_dev->ext.yres * fps;
+    }
+    fps = hwc_dev->fb_dev->base.fps > 0 ? hwc_dev->fb_dev->base.fps + 0.5f : 60;
+    return hwc_dev->fb_dis.timings.y_res * fps;
+}
+
+static __u32 layer_fetch_bw(omap4_hwc_device_t *hwc_dev, hwc_layer_1_t *layer,
+                            IMG_native_handle_t *handle)
+{
+    __u32 bpp = is_NV12(handle) ? 12 : handle->iFormat == HAL_PIXEL_FORMAT_RGB_565 ? 16 : 32;
+    int src_w = WIDTH(layer->sourceCrop);
+    int src_h = HEIGHT(layer->sourceCrop);
+    int rot90 = (layer->transform & HWC_TRANSFORM_ROT_90) != 0;
+
+    if (rot90)
+        swap(src_w, src_h);
+    return overlay_fetch_bw(src_w, src_h, bpp, HEIGHT(layer->displayFrame),
+                            display_line_rate(hwc_dev, 0), rot90 && is_NV12(handle));
+}
+
+/* mirrored overlays are fetched once per display */
+static __u32 fetch_clones(omap4_hwc_device_t *hwc_dev)
+{
+    omap4_hwc_ext_t *ext = &hwc_dev->ext;
+
+    return ext->current.enabled && !ext->current.docking && hwc_dev->ext_ovls ? 2 : 1;
+}
+
+/* budget left for the overlays when SGX composes into the framebuffer */
+static __u32 overlay_fetch_budget(omap4_hwc_device_t *hwc_dev)
+{
+    __u32 bpp = hwc_dev->fb_dev->base.format == HAL_PIXEL_FORMAT_RGB_565 ? 16 : 32;
+    __u32 fb_bw = overlay_fetch_bw(hwc_dev->fb_dev->base.width, hwc_dev->fb_dev->base.height,
+                                   bpp, hwc_dev->fb_dis.timings.y_res,
+                                   display_line_rate(hwc_dev, 0), 0) * fetch_clones(hwc_dev);
+
+    if (!hwc_dev->fetch_budget)
+        return 0xffffffff;
+    return hwc_dev->fetch_budget > fb_bw ? hwc_dev->fetch_budget - fb_bw : 0;
+}
+
+/*
+ * estimated fetch of an overlay as set up, on the display it is on. Only
+ * NV12 is in TILER 2D and can be rotated; RGB buffers are 1D and never are
+ * (is_dss_candidate), so only rotated NV12 pays the TILER view penalty.
+ */
+static __u32 ovl_fetch_bw(omap4_hwc_device_t *hwc_dev, struct dss2_ovl_cfg *c)
+{
+    __u32 bpp = c->color_mode == OMAP_DSS_COLOR_NV12 ? 12 :
+                c->color_mode == OMAP_DSS_COLOR_RGB16 ? 16 : 32;
+    __u32 lines = display_line_rate(hwc_dev, c->mgr_ix);
+    __u32 src_w = c->crop.w, src_h = c->crop.h;
+
+    if (!c->enabled)
+        return 0;
+    if (c->rotation & 1)
+        swap(src_w, src_h);
+    return overlay_fetch_bw(src_w, src_h, bpp, c->win.h, lines,
+                            (c->rotation & 1) && c->color_mode == OMAP_DSS_COLOR_NV12);
+}
+
+static __u32 plan_fetch_bw(omap4_hwc_device_t *hwc_dev)
+{
+    struct dsscomp_setup_dispc_data *dsscomp = &hwc_dev->dsscomp_data;
+    __u64 bw = 0;
+    int i;
+
+    for (i = 0; i < dsscomp->num_ovls; i++)
+        bw += ovl_fetch_bw(hwc_dev, &dsscomp->ovls[i].cfg);
+    return bw > 0xffffffff ? 0xffffffff : (__u32) bw;
+}
+
 struct counts {
     unsigned int possible_overlay_layers;
     unsigned int composited_layers;
@@ -999,6 +1201,7 @@ struct counts {
     unsigned int max_hw_overlays;
     unsigned int max_scaling_overlays;
     unsigned int mem;
+    __u32 bw;
 };
 
 static void gather_layer_statistics(omap4_hwc_device_t *hwc_dev, struct counts *num, hwc_display_contents_1_t *list)
@@ -1033,6 +1236,7 @@ static void gather_layer_statistics(omap4_hwc_device_t *hwc_dev, struct counts *
                 num->protected++;
 
             num->mem += mem1d(handle);
+            num->bw += layer_fetch_bw(hwc_dev, layer, handle);
         }
     }
 }
@@ -1140,6 +1344,55 @@ static inline int can_dss_render_layer(omap4_hwc_device_t *hwc_dev,
            !(on_tv && is_BGR(handle));
 }
 
+static int is_dss_candidate(omap4_hwc_device_t *hwc_dev, hwc_layer_1_t *layer)
+{
+    return can_dss_render_layer(hwc_dev, layer) &&
+           (!hwc_dev->force_sgx ||
+            /* render protected and dockable layers via DSS */
+            is_protected(layer) ||
+            (hwc_dev->ext.current.docking && hwc_dev->ext.current.enabled && dockable(layer)));
+}
+
+static __u32 layer_score(hwc_layer_1_t *layer, IMG_native_handle_t *handle)
+{
+    __u32 bpp = is_NV12(handle) ? 12 : handle->iFormat == HAL_PIXEL_FORMAT_RGB_565 ? 16 : 32;
+
+    return overlay_score(WIDTH(layer->sourceCrop), HEIGHT(layer->sourceCrop), bpp,
+                         WIDTH(layer->displayFrame), HEIGHT(layer->displayFrame));
+}
+
+/*
+ * When SGX composes some layers, pick the overlay layers that save it the
+ * most work instead of the first ones that fit. Returns 0 if the list is
+ * too long, in which case layers are assigned greedily in z-order.
+ */
+static int assign_overlays(omap4_hwc_device_t *hwc_dev, struct counts *num,
+                           hwc_display_contents_1_t *list, __u32 *dss_layers)
+{
+    struct ovl_candidate layers[MAX_ASSIGN_LAYERS];
+    __u32 clones = fetch_clones(hwc_dev);
+    unsigned int i;
+
+    if (!hwc_dev->use_sgx || !list || list->numHwLayers > MAX_ASSIGN_LAYERS)
+        return 0;
+
+    for (i = 0; i < list->numHwLayers; i++) {
+        hwc_layer_1_t *layer = &list->hwLayers[i];
+        IMG_native_handle_t *handle = (IMG_native_handle_t *)layer->handle;
+
+        layers[i].eligible = is_dss_candidate(hwc_dev, layer);
+        layers[i].blended = is_BLENDED(layer);
+        layers[i].mem = layers[i].eligible ? mem1d(handle) : 0;
+        layers[i].bw = layers[i].eligible ? layer_fetch_bw(hwc_dev, layer, handle) * clones : 0;
+        layers[i].score = layers[i].eligible ? layer_score(layer, handle) : 0;
+    }
+
+    /* one overlay is taken by the framebuffer */
+    *dss_layers = overlay_assign(layers, list->numHwLayers, num->max_hw_overlays - 1,
+                                 MAX_TILER_SLOT, overlay_fetch_budget(hwc_dev));
+    return 1;
+}
+
 static inline int display_area(struct dss2_ovl_info *o)
 {
     return o->cfg.win.w * o->cfg.win.h;
@@ -1213,6 +1466,189 @@ static int clone_external_layer(omap4_hwc_device_t *hwc_dev, int ix) {
     return clone_layer(hwc_dev, ix);
 }
 
+static __u32 time_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* bilinear scale of a BGRA image, 16.16 fixed point */
+static void scale_image(struct omap4_hwc_img *src, unsigned char *dst,
+                        int width, int height, int stride)
+{
+    int x_step = (src->width << 16) / width;
+    int y_step = (src->height << 16) / height;
+    int x, y, c;
+
+    for (y = 0; y < height; y++) {
+        int sy = max(y * y_step + (y_step >> 1) - 0x8000, 0);
+        int y0 = min(sy >> 16, src->height - 1), y1 = min(y0 + 1, src->height - 1);
+        int fy = (sy >> 8) & 0xff;
+        unsigned char *row0 = src->ptr + y0 * src->rowbytes;
+        unsigned char *row1 = src->ptr + y1 * src->rowbytes;
+        unsigned char *out = dst + y * stride;
+
+        for (x = 0; x < width; x++) {
+            int sx = max(x * x_step + (x_step >> 1) - 0x8000, 0);
+            int x0 = min(sx >> 16, src->width - 1), x1 = min(x0 + 1, src->width - 1);
+            int fx = (sx >> 8) & 0xff;
+
+            for (c = 0; c < 4; c++) {
+                int top = row0[x0 * 4 + c] * (256 - fx) + row0[x1 * 4 + c] * fx;
+                int bot = row1[x0 * 4 + c] * (256 - fx) + row1[x1 * 4 + c] * fx;
+                *out++ = (top * (256 - fy) + bot * fy + (1 << 15)) >> 16;
+            }
+        }
+    }
+}
+
+/* DSS may still fetch a copy used by either of the last two posts */
+static int dock_copy_busy(omap4_hwc_device_t *hwc_dev, struct omap4_hwc_dock_copy *copy)
+{
+    return (int) copy->offset == hwc_dev->dock_posted[0] ||
+           (int) copy->offset == hwc_dev->dock_posted[1];
+}
+
+/* lowest fb memory offset for size bytes clear of the cached copies, or -1 */
+static int find_dock_space(omap4_hwc_device_t *hwc_dev, __u32 size)
+{
+    __u32 offset = 0;
+    int i, moved;
+
+    do {
+        moved = 0;
+        for (i = 0; i < hwc_dev->num_dock_copies; i++) {
+            struct omap4_hwc_dock_copy *copy = &hwc_dev->dock_copies[i];
+
+            if (offset < copy->offset + copy->size && copy->offset < offset + size) {
+                offset = copy->offset + copy->size;
+                moved = 1;
+            }
+        }
+    } while (moved);
+
+    return offset + size <= (__u32) hwc_dev->img_mem_size ? (int) offset : -1;
+}
+
+/*
+ * Returns the copy of the dock image scaled to width x height, reserving
+ * fb memory for it the first time a size is asked for. A new copy is not
+ * ready until omap4_hwc_set has scaled it. Copies stay across hotplugs;
+ * when memory or slots run out the copies DSS may still fetch or that
+ * are being scaled are kept and the others dropped.
+ */
+static struct omap4_hwc_dock_copy *get_dock_copy(omap4_hwc_device_t *hwc_dev,
+                                                 int width, int height)
+{
+    struct omap4_hwc_dock_copy *copy;
+    int stride = ALIGN(width, HW_ALIGN) * 4;
+    __u32 size = ALIGN(stride * height, 4096);
+    int i, n, offset;
+
+    for (i = 0; i < hwc_dev->num_dock_copies; i++) {
+        copy = &hwc_dev->dock_copies[i];
+        if (copy->width == width && copy->height == height)
+            return copy;
+    }
+
+    if (!dock_image.ptr || width <= 0 || height <= 0 || size > (__u32) hwc_dev->img_mem_size)
+        return NULL;
+    offset = find_dock_space(hwc_dev, size);
+    if (hwc_dev->num_dock_copies == DOCK_CACHE_SIZE || offset < 0) {
+        for (i = n = 0; i < hwc_dev->num_dock_copies; i++)
+            if (hwc_dev->dock_copies[i].scaling ||
+                dock_copy_busy(hwc_dev, &hwc_dev->dock_copies[i]))
+                hwc_dev->dock_copies[n++] = hwc_dev->dock_copies[i];
+        hwc_dev->num_dock_copies = n;
+        offset = find_dock_space(hwc_dev, size);
+        if (offset < 0)
+            return NULL;
+    }
+
+    copy = &hwc_dev->dock_copies[hwc_dev->num_dock_copies++];
+    copy->width = width;
+    copy->height = height;
+    copy->stride = stride;
+    copy->offset = offset;
+    copy->size = size;
+    copy->mode = ~hwc_dev->ext.last_mode;
+    copy->ready = 0;
+    copy->scaling = 0;
+    return copy;
+}
+
+/*
+ * Point the external dock layer at a copy of the image it can fetch 1:1.
+ * Returns -1 if there is no copy to show yet.
+ */
+static int setup_dock_layer(omap4_hwc_device_t *hwc_dev, struct dss2_ovl_info *oi)
+{
+    struct dss2_ovl_cfg *oc = &oi->cfg;
+    int width = oc->rotation & 1 ? oc->win.h : oc->win.w;
+    int height = oc->rotation & 1 ? oc->win.w : oc->win.h;
+    struct omap4_hwc_dock_copy *copy = get_dock_copy(hwc_dev, width, height);
+
+    /* fall back to an unscaled copy and DSS scaling */
+    if (!copy)
+        copy = get_dock_copy(hwc_dev, dock_image.width, dock_image.height);
+    if (!copy)
+        return -1;
+    if (!copy->ready) {
+        if (!copy->scaling)
+            hwc_dev->dock_scale = *copy;
+        return -1;
+    }
+
+    oc->width = oc->crop.w = copy->width;
+    oc->height = oc->crop.h = copy->height;
+    oc->crop.x = oc->crop.y = 0;
+    oc->stride = copy->stride;
+    oi->addressing = OMAP_DSS_BUFADDR_FB;
+    oi->ba = copy->offset;
+    hwc_dev->dock_next = copy->offset;
+
+    if (hwc_dev->dock_hotplug_us) {
+        hwc_dev->dock_latency_us = time_us() - hwc_dev->dock_hotplug_us;
+        if (hwc_dev->dock_latency_us > hwc_dev->dock_latency_max_us)
+            hwc_dev->dock_latency_max_us = hwc_dev->dock_latency_us;
+        hwc_dev->dock_hotplug_us = 0;
+    }
+    return 0;
+}
+
+/*
+ * Scales the dock copy the last prepare asked for. Runs without the lock:
+ * omap4_hwc_set pinned the copy so its fb memory stays reserved, and
+ * nothing fetches it before it is marked ready. Returns 1 if a new copy
+ * is ready to be shown.
+ */
+static int scale_dock_copy(omap4_hwc_device_t *hwc_dev, struct omap4_hwc_dock_copy *scale)
+{
+    int i, ready = 0;
+
+    scale_image(&dock_image, (unsigned char *) hwc_dev->img_mem_ptr + scale->offset,
+                scale->width, scale->height, scale->stride);
+    ALOGD("scaled dock image %dx%d to %dx%d", dock_image.width, dock_image.height,
+          scale->width, scale->height);
+
+    pthread_mutex_lock(&hwc_dev->lock);
+    for (i = 0; i < hwc_dev->num_dock_copies; i++) {
+        struct omap4_hwc_dock_copy *copy = &hwc_dev->dock_copies[i];
+
+        if (copy->offset == scale->offset && copy->width == scale->width &&
+            copy->height == scale->height) {
+            copy->scaling = 0;
+            copy->ready = ready = 1;
+            /* the cached plan was made without the dock layer */
+            hwc_dev->plan.valid = 0;
+        }
+    }
+    pthread_mutex_unlock(&hwc_dev->lock);
+    return ready;
+}
+
 static int setup_mirroring(omap4_hwc_device_t *hwc_dev)
 {
     omap4_hwc_ext_t *ext = &hwc_dev->ext;
@@ -1257,6 +1693,295 @@ static void check_sync_fds(size_t numDisplays, hwc_display_contents_1_t** displa
     }
 }
 
+/* returns 0 if the list is too long to be cached */
+static int get_plan_keys(omap4_hwc_device_t *hwc_dev, hwc_display_contents_1_t *list,
+                         struct omap4_hwc_state_key *state,
+                         struct omap4_hwc_layer_key *keys)
+{
+    omap4_hwc_ext_t *ext = &hwc_dev->ext;
+    unsigned int i, num_layers = list ? list->numHwLayers : 0;
+
+    if (num_layers > MAX_PLAN_LAYERS)
+        return 0;
+
+    /* keys are compared with memcmp, so clear padding */
+    memset(state, 0, sizeof(*state));
+    state->force_sgx = !!hwc_dev->force_sgx;
+    state->last_ext_ovls = hwc_dev->last_ext_ovls;
+    state->last_int_ovls = hwc_dev->last_int_ovls;
+    state->mirror = ext->mirror;
+    state->dock = ext->dock;
+    state->last = ext->last;
+    state->force_dock = ext->force_dock;
+    state->on_tv = ext->on_tv;
+
+    memset(keys, 0, num_layers * sizeof(*keys));
+    for (i = 0; i < num_layers; i++) {
+        hwc_layer_1_t *layer = &list->hwLayers[i];
+        IMG_native_handle_t *handle = (IMG_native_handle_t *)layer->handle;
+
+        keys[i].flags = layer->flags;
+        keys[i].transform = layer->transform;
+        keys[i].blending = layer->blending;
+        keys[i].sourceCrop = layer->sourceCrop;
+        keys[i].displayFrame = layer->displayFrame;
+        if (handle) {
+            keys[i].format = handle->iFormat;
+            keys[i].width = handle->iWidth;
+            keys[i].height = handle->iHeight;
+            keys[i].usage = handle->usage;
+        }
+    }
+    return 1;
+}
+
+static int reuse_plan(omap4_hwc_device_t *hwc_dev, hwc_display_contents_1_t *list,
+                      struct omap4_hwc_state_key *state,
+                      struct omap4_hwc_layer_key *keys)
+{
+    struct omap4_hwc_plan *plan = &hwc_dev->plan;
+    struct dsscomp_setup_dispc_data *dsscomp = &hwc_dev->dsscomp_data;
+    unsigned int i, num_layers = list ? list->numHwLayers : 0;
+
+    if (!plan->valid || (list && (list->flags & HWC_GEOMETRY_CHANGED)) ||
+        plan->num_layers != num_layers ||
+        memcmp(&plan->state, state, sizeof(*state)) ||
+        memcmp(plan->layers, keys, num_layers * sizeof(*keys)))
+        return 0;
+
+    *dsscomp = plan->dsscomp;
+    dsscomp->sync_id = sync_id++;
+
+    hwc_dev->use_sgx = plan->use_sgx;
+    hwc_dev->swap_rb = plan->swap_rb;
+    hwc_dev->ovls_blending = plan->ovls_blending;
+    hwc_dev->post2_layers = plan->post2_layers;
+    hwc_dev->ext_ovls = plan->ext_ovls;
+    hwc_dev->ext_ovls_wanted = plan->ext_ovls_wanted;
+    hwc_dev->ext.current = hwc_dev->ext.last = plan->ext_current;
+
+    for (i = 0; i < num_layers; i++) {
+        hwc_layer_1_t *layer = &list->hwLayers[i];
+
+        layer->compositionType = (plan->result[i] & PLAN_OVERLAY) ? HWC_OVERLAY : HWC_FRAMEBUFFER;
+        if (plan->result[i] & PLAN_CLEAR_FB)
+            layer->hints |= HWC_HINT_CLEAR_FB;
+    }
+    for (i = 0; i < plan->post2_layers; i++)
+        hwc_dev->buffers[i] = plan->buffer_layer[i] < 0 ? NULL :
+                              list->hwLayers[plan->buffer_layer[i]].handle;
+    return 1;
+}
+
+static void save_plan(omap4_hwc_device_t *hwc_dev, hwc_display_contents_1_t *list,
+                      struct omap4_hwc_state_key *state,
+                      struct omap4_hwc_layer_key *keys)
+{
+    struct omap4_hwc_plan *plan = &hwc_dev->plan;
+    unsigned int i, j, num_layers = list ? list->numHwLayers : 0;
+
+    plan->num_layers = num_layers;
+    plan->state = *state;
+    memcpy(plan->layers, keys, num_layers * sizeof(*keys));
+
+    for (i = 0; i < num_layers; i++) {
+        hwc_layer_1_t *layer = &list->hwLayers[i];
+
+        plan->result[i] = 0;
+        if (layer->compositionType == HWC_OVERLAY)
+            plan->result[i] |= PLAN_OVERLAY;
+        if (layer->hints & HWC_HINT_CLEAR_FB)
+            plan->result[i] |= PLAN_CLEAR_FB;
+    }
+
+    /* Post2 buffers are layer handles (or NULL for the fb) */
+    plan->valid = 1;
+    for (i = 0; i < hwc_dev->post2_layers; i++) {
+        plan->buffer_layer[i] = -1;
+        for (j = 0; hwc_dev->buffers[i] && j < num_layers; j++)
+            if (list->hwLayers[j].handle == hwc_dev->buffers[i])
+                break;
+        if (j < num_layers)
+            plan->buffer_layer[i] = j;
+        else if (hwc_dev->buffers[i])
+            plan->valid = 0;
+    }
+
+    plan->dsscomp = hwc_dev->dsscomp_data;
+    plan->ext_current = hwc_dev->ext.current;
+    plan->use_sgx = hwc_dev->use_sgx;
+    plan->swap_rb = hwc_dev->swap_rb;
+    plan->ovls_blending = hwc_dev->ovls_blending;
+    plan->post2_layers = hwc_dev->post2_layers;
+    plan->ext_ovls = hwc_dev->ext_ovls;
+    plan->ext_ovls_wanted = hwc_dev->ext_ovls_wanted;
+}
+
+/*
+ * SF draws the HWC_FRAMEBUFFER layers even if none of them changed, e.g.
+ * when only a video overlay got a new buffer. Buffer handles serve as
+ * damage: if no SGX layer got a new buffer and no geometry changed, hand
+ * the framebuffer layers to "overlay" so SF skips them and keep posting
+ * the framebuffer SGX composed last.
+ */
+static void check_fb_reuse(omap4_hwc_device_t *hwc_dev, hwc_display_contents_1_t *list,
+                           int cacheable, struct omap4_hwc_layer_key *keys)
+{
+    struct omap4_hwc_fb_content *fb = &hwc_dev->fb_content;
+    unsigned int i, num_layers = list ? list->numHwLayers : 0;
+
+    hwc_dev->fb_reuse = 0;
+    if (!hwc_dev->use_sgx || !cacheable) {
+        fb->valid = 0;
+        return;
+    }
+
+    if (fb->valid && !(list->flags & HWC_GEOMETRY_CHANGED) &&
+        fb->num_layers == num_layers &&
+        !memcmp(fb->layers, keys, num_layers * sizeof(*keys))) {
+        for (i = 0; i < num_layers; i++) {
+            hwc_layer_1_t *layer = &list->hwLayers[i];
+            buffer_handle_t handle = layer->compositionType == HWC_FRAMEBUFFER ?
+                                     layer->handle : NULL;
+
+            /* a composed layer without a buffer (e.g. dim) is always drawn */
+            if (handle != fb->handles[i] ||
+                (layer->compositionType == HWC_FRAMEBUFFER && !handle))
+                break;
+        }
+        if (i == num_layers) {
+            for (i = 0; i < num_layers; i++)
+                list->hwLayers[i].compositionType = HWC_OVERLAY;
+            hwc_dev->fb_reuse = 1;
+            return;
+        }
+    }
+
+    /* this frame gets composed: remember what goes into the framebuffer */
+    fb->valid = 1;
+    fb->num_layers = num_layers;
+    memcpy(fb->layers, keys, num_layers * sizeof(*keys));
+    for (i = 0; i < num_layers; i++) {
+        hwc_layer_1_t *layer = &list->hwLayers[i];
+
+        fb->handles[i] = layer->compositionType == HWC_FRAMEBUFFER ? layer->handle : NULL;
+    }
+}
+
+static void trace_layer(struct hwc_trace_layer *t, hwc_layer_1_t *layer)
+{
+    IMG_native_handle_t *handle = (IMG_native_handle_t *)layer->handle;
+
+    memset(t, 0, sizeof(*t));
+    t->handle = (__u32) (uintptr_t) handle;
+    if (handle) {
+        t->format = handle->iFormat;
+        t->width = handle->iWidth;
+        t->height = handle->iHeight;
+        t->usage = handle->usage;
+    }
+    t->flags = layer->flags;
+    t->transform = layer->transform;
+    t->blending = layer->blending;
+    t->crop[0] = layer->sourceCrop.left;
+    t->crop[1] = layer->sourceCrop.top;
+    t->crop[2] = layer->sourceCrop.right;
+    t->crop[3] = layer->sourceCrop.bottom;
+    t->frame[0] = layer->displayFrame.left;
+    t->frame[1] = layer->displayFrame.top;
+    t->frame[2] = layer->displayFrame.right;
+    t->frame[3] = layer->displayFrame.bottom;
+    t->composition_type = layer->compositionType;
+    t->hints = layer->hints;
+}
+
+static void trace_ovl(struct hwc_trace_ovl *t, struct dss2_ovl_info *o)
+{
+    struct dss2_ovl_cfg *c = &o->cfg;
+
+    memset(t, 0, sizeof(*t));
+    t->ix = c->ix;
+    t->mgr_ix = c->mgr_ix;
+    t->enabled = c->enabled;
+    t->zorder = c->zorder;
+    t->color_mode = c->color_mode;
+    t->width = c->width;
+    t->height = c->height;
+    t->stride = c->stride;
+    t->rotation = c->rotation;
+    t->mirror = c->mirror;
+    t->pre_mult_alpha = c->pre_mult_alpha;
+    t->global_alpha = c->global_alpha;
+    t->crop[0] = c->crop.x;
+    t->crop[1] = c->crop.y;
+    t->crop[2] = c->crop.w;
+    t->crop[3] = c->crop.h;
+    t->win[0] = c->win.x;
+    t->win[1] = c->win.y;
+    t->win[2] = c->win.w;
+    t->win[3] = c->win.h;
+    t->addressing = o->addressing;
+    t->ba = o->ba;
+}
+
+static void trace_open(omap4_hwc_device_t *hwc_dev, const char *path)
+{
+    struct hwc_trace_header h = {
+        .magic = HWC_TRACE_MAGIC,
+        .version = HWC_TRACE_VERSION,
+        .fb_width = hwc_dev->fb_dev->base.width,
+        .fb_height = hwc_dev->fb_dev->base.height,
+        .fb_format = hwc_dev->fb_dev->base.format,
+        .lcd_xres = hwc_dev->fb_dis.timings.x_res,
+        .lcd_yres = hwc_dev->fb_dis.timings.y_res,
+        .lcd_pixel_clock = hwc_dev->fb_dis.timings.pixel_clock,
+        .lcd_width_mm = hwc_dev->fb_dis.width_in_mm,
+        .lcd_height_mm = hwc_dev->fb_dis.height_in_mm,
+        .lcd_channel = hwc_dev->fb_dis.channel,
+    };
+
+    hwc_dev->trace = fopen(path, "wb");
+    if (!hwc_dev->trace) {
+        ALOGE("failed to open trace %s (%d)", path, errno);
+        return;
+    }
+    fwrite(&h, sizeof(h), 1, hwc_dev->trace);
+    ALOGI("tracing compositions to %s", path);
+}
+
+static void trace_frame(omap4_hwc_device_t *hwc_dev, hwc_display_contents_1_t *list,
+                        int force_sgx, __u32 prepare_us)
+{
+    struct dsscomp_setup_dispc_data *dsscomp = &hwc_dev->dsscomp_data;
+    struct hwc_trace_frame f = {
+        .num_layers = list ? list->numHwLayers : 0,
+        .list_flags = list ? list->flags : 0,
+        .force_sgx = force_sgx,
+        .ext_enabled = hwc_dev->ext.current.enabled,
+        .prepare_us = prepare_us,
+        .use_sgx = hwc_dev->use_sgx,
+        .swap_rb = hwc_dev->swap_rb,
+        .post2_layers = hwc_dev->post2_layers,
+        .num_ovls = dsscomp->num_ovls,
+        .num_mgrs = dsscomp->num_mgrs,
+    };
+    struct hwc_trace_layer l;
+    struct hwc_trace_ovl o;
+    unsigned int i;
+
+    fwrite(&f, sizeof(f), 1, hwc_dev->trace);
+    for (i = 0; i < f.num_layers; i++) {
+        trace_layer(&l, &list->hwLayers[i]);
+        fwrite(&l, sizeof(l), 1, hwc_dev->trace);
+    }
+    for (i = 0; i < f.num_ovls; i++) {
+        trace_ovl(&o, &dsscomp->ovls[i]);
+        fwrite(&o, sizeof(o), 1, hwc_dev->trace);
+    }
+    /* SF rarely closes the device, keep the trace usable at all times */
+    fflush(hwc_dev->trace);
+}
+
 static int omap4_hwc_prepare(struct hwc_composer_device_1 *dev, size_t numDisplays,
         hwc_display_contents_1_t** displays)
 {
@@ -1268,9 +1993,27 @@ static int omap4_hwc_prepare(struct hwc_composer_device_1 *dev, size_t numDispla
     omap4_hwc_device_t *hwc_dev = (omap4_hwc_device_t *)dev;
     struct dsscomp_setup_dispc_data *dsscomp = &hwc_dev->dsscomp_data;
     struct counts num = { .composited_layers = list ? list->numHwLayers : 0 };
+    struct omap4_hwc_state_key state_key;
+    struct omap4_hwc_layer_key layer_keys[MAX_PLAN_LAYERS];
     unsigned int i, ix;
+    int cacheable;
+    __u32 start = time_us(), elapsed;
+    int force_sgx;
 
     pthread_mutex_lock(&hwc_dev->lock);
+    force_sgx = hwc_dev->force_sgx;
+
+    cacheable = get_plan_keys(hwc_dev, list, &state_key, layer_keys);
+    if (cacheable && reuse_plan(hwc_dev, list, &state_key, layer_keys)) {
+        hwc_dev->plan.hits++;
+        if (debug)
+            ALOGD("prepare (%d) - reusing plan", dsscomp->sync_id);
+        goto done;
+    }
+    hwc_dev->plan.misses++;
+    hwc_dev->dock_next = -1;
+    hwc_dev->dock_scale.width = 0;
+
     memset(dsscomp, 0x0, sizeof(*dsscomp));
     dsscomp->sync_id = sync_id++;
 
@@ -1283,12 +2026,16 @@ static int omap4_hwc_prepare(struct hwc_composer_device_1 *dev, size_t numDispla
         hwc_dev->force_sgx = 0;
 
     /* phase 3 logic */
-    if (can_dss_render_all(hwc_dev, &num)) {
+    int fits_budget = !hwc_dev->fetch_budget ||
+                      (__u64) num.bw * fetch_clones(hwc_dev) <= hwc_dev->fetch_budget;
+    if (can_dss_render_all(hwc_dev, &num) && fits_budget) {
         /* All layers can be handled by the DSS -- don't use SGX for composition */
         hwc_dev->use_sgx = 0;
         hwc_dev->swap_rb = num.BGR != 0;
     } else {
         /* Use SGX for composition plus first 3 layers that are DSS renderable */
+        if (!fits_budget && can_dss_render_all(hwc_dev, &num))
+            hwc_dev->fetch_limited++;
         hwc_dev->use_sgx = 1;
         hwc_dev->swap_rb = is_BGR_format(hwc_dev->fb_dev->base.format);
     }
@@ -1302,23 +2049,25 @@ static int omap4_hwc_prepare(struct hwc_composer_device_1 *dev, size_t numDispla
 
     /* set up if DSS layers */
     unsigned int mem_used = 0;
+    __u32 bw_used = 0, bw_max = overlay_fetch_budget(hwc_dev), clones = fetch_clones(hwc_dev);
+    __u32 dss_layers = 0;
+    int assigned = assign_overlays(hwc_dev, &num, list, &dss_layers);
     hwc_dev->ovls_blending = 0;
     for (i = 0; list && i < list->numHwLayers; i++) {
         hwc_layer_1_t *layer = &list->hwLayers[i];
         IMG_native_handle_t *handle = (IMG_native_handle_t *)layer->handle;
 
-        if (dsscomp->num_ovls < num.max_hw_overlays &&
-            can_dss_render_layer(hwc_dev, layer) &&
-            (!hwc_dev->force_sgx ||
-             /* render protected and dockable layers via DSS */
-             is_protected(layer) ||
-             (hwc_dev->ext.current.docking && hwc_dev->ext.current.enabled && dockable(layer))) &&
-            mem_used + mem1d(handle) < MAX_TILER_SLOT &&
-            /* can't have a transparent overlay in the middle of the framebuffer stack */
-            !(is_BLENDED(layer) && fb_z >= 0)) {
+        if (assigned ? (dss_layers & (1U << i)) != 0 :
+            (dsscomp->num_ovls < num.max_hw_overlays &&
+             is_dss_candidate(hwc_dev, layer) &&
+             mem_used + mem1d(handle) < MAX_TILER_SLOT &&
+             bw_used + layer_fetch_bw(hwc_dev, layer, handle) * clones <= bw_max &&
+             /* can't have a transparent overlay in the middle of the framebuffer stack */
+             !(is_BLENDED(layer) && fb_z >= 0))) {
 
             /* render via DSS overlay */
             mem_used += mem1d(handle);
+            bw_used += layer_fetch_bw(hwc_dev, layer, handle) * clones;
             layer->compositionType = HWC_OVERLAY;
 
             /* clear FB above all opaque layers if rendering via SGX */
@@ -1412,9 +2161,10 @@ static int omap4_hwc_prepare(struct hwc_composer_device_1 *dev, size_t numDispla
                                        dock_image.width, dock_image.height);
             oi->cfg.stride = dock_image.rowbytes;
             if (clone_external_layer(hwc_dev, ix_docking) == 0) {
-                oi->addressing = OMAP_DSS_BUFADDR_FB;
-                oi->ba = 0;
-                z++;
+                if (setup_dock_layer(hwc_dev, oi) == 0)
+                    z++;
+                else
+                    dsscomp->num_ovls--;
             }
         } else if (!ext->current.docking) {
             int res = 0;
@@ -1468,6 +2218,10 @@ static int omap4_hwc_prepare(struct hwc_composer_device_1 *dev, size_t numDispla
         hwc_dev->ext_ovls = dsscomp->num_ovls - hwc_dev->post2_layers;
     }
 
+    hwc_dev->fetch_bw = plan_fetch_bw(hwc_dev);
+    if (hwc_dev->fetch_bw > hwc_dev->fetch_bw_max)
+        hwc_dev->fetch_bw_max = hwc_dev->fetch_bw;
+
     if (debug) {
         ALOGD("prepare (%d) - %s (comp=%d, poss=%d/%d scaled, RGB=%d,BGR=%d,NV12=%d) (ext=%s%s%ddeg%s %dex/%dmx (last %dex,%din)\n",
              dsscomp->sync_id,
@@ -1482,6 +2236,22 @@ static int omap4_hwc_prepare(struct hwc_composer_device_1 *dev, size_t numDispla
              hwc_dev->ext_ovls, num.max_hw_overlays, hwc_dev->last_ext_ovls, hwc_dev->last_int_ovls);
     }
 
+    if (cacheable)
+        save_plan(hwc_dev, list, &state_key, layer_keys);
+    else
+        hwc_dev->plan.valid = 0;
+
+done:
+    check_fb_reuse(hwc_dev, list, cacheable, layer_keys);
+
+    elapsed = time_us() - start;
+    hwc_dev->plan.prepare_us += elapsed;
+    if (elapsed > hwc_dev->plan.prepare_max_us)
+        hwc_dev->plan.prepare_max_us = elapsed;
+
+    if (hwc_dev->trace)
+        trace_frame(hwc_dev, list, force_sgx, elapsed);
+
     pthread_mutex_unlock(&hwc_dev->lock);
     return 0;
 }
@@ -1530,8 +2300,10 @@ static int omap4_hwc_set(struct hwc_composer_device_1 *dev,
     }
     omap4_hwc_device_t *hwc_dev = (omap4_hwc_device_t *)dev;
     struct dsscomp_setup_dispc_data *dsscomp = &hwc_dev->dsscomp_data;
+    struct omap4_hwc_dock_copy scale;
     int err = 0;
     int invalidate;
+    int i;
 
     pthread_mutex_lock(&hwc_dev->lock);
 
@@ -1547,12 +2319,16 @@ static int omap4_hwc_set(struct hwc_composer_device_1 *dev,
         // however, if dpy and sur are null it means we're turning the
         // screen off. no shall not call eglSwapBuffers() in that case.
 
-        if (hwc_dev->use_sgx) {
+        if (hwc_dev->use_sgx && hwc_dev->fb_reuse) {
+            hwc_dev->fb_content.skipped++;
+        } else if (hwc_dev->use_sgx) {
             if (!eglSwapBuffers((EGLDisplay)dpy, (EGLSurface)sur)) {
                 ALOGE("eglSwapBuffers error");
+                hwc_dev->fb_content.valid = 0;
                 err = HWC_EGL_ERROR;
                 goto err_out;
             }
+            hwc_dev->fb_content.composed++;
         }
 
         //dump_dsscomp(dsscomp);
@@ -1566,6 +2342,11 @@ static int omap4_hwc_set(struct hwc_composer_device_1 *dev,
                                  hwc_dev->buffers,
                                  hwc_dev->post2_layers,
                                  dsscomp, sizeof(*dsscomp));
+        hwc_dev->dock_posted[1] = hwc_dev->dock_posted[0];
+        hwc_dev->dock_posted[0] = hwc_dev->dock_next;
+    } else {
+        /* nothing was swapped, so the framebuffer holds something else */
+        hwc_dev->fb_content.valid = 0;
     }
     hwc_dev->last_ext_ovls = hwc_dev->ext_ovls;
     hwc_dev->last_int_ovls = hwc_dev->post2_layers;
@@ -1575,8 +2356,15 @@ static int omap4_hwc_set(struct hwc_composer_device_1 *dev,
     check_sync_fds(numDisplays, displays);
 
 err_out:
+    scale = hwc_dev->dock_scale;
+    hwc_dev->dock_scale.width = 0;
+    for (i = 0; scale.width && i < hwc_dev->num_dock_copies; i++)
+        if (hwc_dev->dock_copies[i].offset == scale.offset)
+            hwc_dev->dock_copies[i].scaling = 1;
     pthread_mutex_unlock(&hwc_dev->lock);
 
+    if (scale.width && scale_dock_copy(hwc_dev, &scale))
+        invalidate = 1;
     if (invalidate)
         hwc_dev->procs->invalidate(hwc_dev->procs);
 
@@ -1592,9 +2380,33 @@ static void omap4_hwc_dump(struct hwc_composer_device_1 *dev, char *buff, int bu
         .buf_len = buff_len,
     };
     int i;
+    __u32 prepares;
 
     dump_printf(&log, "omap4_hwc %d:\n", dsscomp->num_ovls);
     dump_printf(&log, "  idle timeout: %dms\n", hwc_dev->idle);
+    prepares = hwc_dev->plan.hits + hwc_dev->plan.misses;
+    dump_printf(&log, "  plan cache: %u/%u hits (%u%%), prepare avg %uus max %uus\n",
+                hwc_dev->plan.hits, prepares,
+                prepares ? hwc_dev->plan.hits * 100 / prepares : 0,
+                prepares ? (__u32) (hwc_dev->plan.prepare_us / prepares) : 0,
+                hwc_dev->plan.prepare_max_us);
+    if (dock_image.ptr) {
+        dump_printf(&log, "  dock image: %dx%d, hotplug to dock frame %ums (max %ums)\n",
+                    dock_image.width, dock_image.height,
+                    hwc_dev->dock_latency_us / 1000, hwc_dev->dock_latency_max_us / 1000);
+        for (i = 0; i < hwc_dev->num_dock_copies; i++)
+            dump_printf(&log, "    copy %dx%d for mode #%u at +%u%s\n",
+                        hwc_dev->dock_copies[i].width, hwc_dev->dock_copies[i].height,
+                        hwc_dev->dock_copies[i].mode, hwc_dev->dock_copies[i].offset,
+                        hwc_dev->dock_copies[i].ready ? "" :
+                        hwc_dev->dock_copies[i].scaling ? " (scaling)" : " (not scaled yet)");
+    }
+    dump_printf(&log, "  fb reuse: %u of %u SGX compositions skipped\n",
+                hwc_dev->fb_content.skipped,
+                hwc_dev->fb_content.skipped + hwc_dev->fb_content.composed);
+    dump_printf(&log, "  fetch: %uMB/s (max %uMB/s) of %uMB/s budget, %u prepares limited\n",
+                hwc_dev->fetch_bw / 1024, hwc_dev->fetch_bw_max / 1024,
+                hwc_dev->fetch_budget / 1024, hwc_dev->fetch_limited);
 
     for (i = 0; i < dsscomp->num_ovls; i++) {
         struct dss2_ovl_cfg *cfg = &dsscomp->ovls[i].cfg;
@@ -1609,12 +2421,14 @@ static void omap4_hwc_dump(struct hwc_composer_device_1 *dev, char *buff, int bu
         dump_printf(&log, "     dst: (%d,%d) %dx%d\n",
                           cfg->win.x, cfg->win.y, cfg->win.w, cfg->win.h);
         dump_printf(&log, "     ix: %d\n", cfg->ix);
+        dump_printf(&log, "     fetch: %uMB/s\n", ovl_fetch_bw(hwc_dev, cfg) / 1024);
         dump_printf(&log, "     zorder: %d\n\n", cfg->zorder);
     }
 }
 
 static void free_png_image(omap4_hwc_device_t *hwc_dev, struct omap4_hwc_img *img)
 {
+    free(img->ptr);
     memset(img, 0, sizeof(*img));
 }
 
@@ -1688,13 +2502,14 @@ static int load_png_image(omap4_hwc_device_t *hwc_dev, char *path, struct omap4_
     if (bit_depth == 16)
         png_set_strip_16(png_ptr);
 
+    /* decoded once, copies scaled for the external display go to fb memory */
     const int bpp = 4;
-    img->size = ALIGN(width * height * bpp, 4096);
-    if (img->size > hwc_dev->img_mem_size) {
-        ALOGE("image does not fit into framebuffer area (%d > %d)", img->size, hwc_dev->img_mem_size);
+    img->size = width * height * bpp;
+    img->ptr = malloc(img->size);
+    if (!img->ptr) {
+        ALOGE("failed to allocate %dx%d image", width, height);
         goto fail_alloc;
     }
-    img->ptr = hwc_dev->img_mem_ptr;
 
     row_pointers = calloc(height, sizeof(*row_pointers));
     if (!row_pointers) {
@@ -1740,6 +2555,8 @@ static int omap4_hwc_device_close(hw_device_t* device)
             close(hwc_dev->hdmi_fb_fd);
         if (hwc_dev->fb_fd >= 0)
             close(hwc_dev->fb_fd);
+        if (hwc_dev->trace)
+            fclose(hwc_dev->trace);
         /* pthread will get killed when parent process exits */
         pthread_mutex_destroy(&hwc_dev->lock);
         free(hwc_dev);
@@ -1834,6 +2651,9 @@ static void handle_hotplug(omap4_hwc_device_t *hwc_dev)
     }
 
     pthread_mutex_lock(&hwc_dev->lock);
+    /* HDMI modes and the primary transform may change below */
+    hwc_dev->plan.valid = 0;
+    hwc_dev->fb_content.valid = 0;
     ext->dock.enabled = ext->mirror.enabled = 0;
     if (state) {
         /* check whether we can clone and/or dock */
@@ -1865,6 +2685,7 @@ static void handle_hotplug(omap4_hwc_device_t *hwc_dev)
                 property_get("persist.hwc.dock_image", value, "/vendor/res/images/dock/dock.png");
                 load_png_image(hwc_dev, value, &dock_image);
             }
+            hwc_dev->dock_hotplug_us = time_us() ? : 1;
         }
 
         /* select best mode for mirroring */
@@ -2130,6 +2951,7 @@ static int omap4_hwc_device_open(const hw_module_t* module, const char* name,
         return -ENOMEM;
 
     memset(hwc_dev, 0, sizeof(*hwc_dev));
+    hwc_dev->dock_next = hwc_dev->dock_posted[0] = hwc_dev->dock_posted[1] = -1;
 
     hwc_dev->base.common.tag = HARDWARE_DEVICE_TAG;
     hwc_dev->base.common.version = HWC_DEVICE_API_VERSION_1_0;
@@ -2232,6 +3054,11 @@ static int omap4_hwc_device_open(const hw_module_t* module, const char* name,
     hwc_dev->flags_nv12_only = atoi(value);
     property_get("debug.hwc.idle", value, "250");
     hwc_dev->idle = atoi(value);
+    /* DSS fetch bandwidth budget in MB/s, 0 (the default) for none */
+    property_get("debug.hwc.fetch_budget", value, "0");
+    hwc_dev->fetch_budget = atoi(value) * 1024;
+    if (property_get("debug.hwc.trace", value, "") > 0)
+        trace_open(hwc_dev, value);
 
     /* get the board specific clone properties */
     /* 0:0:1280:720 */
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OMAP4_HWC_TRACE_H
+#define OMAP4_HWC_TRACE_H
+
+#include <linux/types.h>
+
+/*
+ * Composition trace written when debug.hwc.trace names a file, and
+ * replayed on a host by test/hwc/hwc_replay. All fields are 32-bit
+ * little-endian, so the records have the same layout on the device and
+ * the host.
+ *
+ * The file is a struct hwc_trace_header followed by one record per
+ * prepare: a struct hwc_trace_frame, its layers and the overlays of the
+ * resulting plan.
+ */
+#define HWC_TRACE_MAGIC     0x54435748  /* "HWCT" */
+#define HWC_TRACE_VERSION   1
+
+struct hwc_trace_header {
+    __u32 magic;
+    __u32 version;
+    __u32 fb_width;
+    __u32 fb_height;
+    __s32 fb_format;
+    __u32 lcd_xres;
+    __u32 lcd_yres;
+    __u32 lcd_pixel_clock;      /* kHz, 0 for manual update panels */
+    __u32 lcd_width_mm;
+    __u32 lcd_height_mm;
+    __u32 lcd_channel;
+};
+
+struct hwc_trace_frame {
+    __u32 num_layers;
+    __u32 list_flags;
+    __u32 force_sgx;
+    __u32 ext_enabled;          /* cloning to an external display */
+    __u32 prepare_us;
+    __u32 use_sgx;
+    __u32 swap_rb;
+    __u32 post2_layers;
+    __u32 num_ovls;
+    __u32 num_mgrs;
+};
+
+struct hwc_trace_layer {
+    __u32 handle;               /* buffer identity, 0 for none */
+    __s32 format;
+    __s32 width;
+    __s32 height;
+    __s32 usage;
+    __u32 flags;
+    __u32 transform;
+    __s32 blending;
+    __s32 crop[4];              /* left, top, right, bottom */
+    __s32 frame[4];
+    /* results of prepare */
+    __s32 composition_type;
+    __u32 hints;
+};
+
+struct hwc_trace_ovl {
+    __u32 ix;
+    __u32 mgr_ix;
+    __u32 enabled;
+    __u32 zorder;
+    __u32 color_mode;
+    __u32 width;
+    __u32 height;
+    __u32 stride;
+    __u32 rotation;
+    __u32 mirror;
+    __u32 pre_mult_alpha;
+    __u32 global_alpha;
+    __s32 crop[4];              /* x, y, w, h */
+    __s32 win[4];
+    __u32 addressing;
+    __u32 ba;
+};
+
+#endif
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "overlay_assign.h"
+
+struct assign_state {
+    const struct ovl_candidate *layers;
+    int num;
+    int max_ovls;
+    __u32 max_mem;
+    __u32 max_bw;
+
+    __u32 best_mask;
+    __u32 best_score;
+};
+
+__u32 overlay_score(__u32 src_w, __u32 src_h, __u32 bits_per_pixel,
+                    __u32 dst_w, __u32 dst_h)
+{
+    return src_w * src_h * bits_per_pixel / 8 + dst_w * dst_h * 4;
+}
+
+__u32 overlay_fetch_bw(__u32 src_w, __u32 src_h, __u32 bits_per_pixel,
+                       __u32 dst_h, __u32 line_rate, int tiler_rotated)
+{
+    __u64 bw = (__u64) src_w * bits_per_pixel / 8 * src_h * line_rate;
+
+    if (!dst_h)
+        return 0;
+    if (tiler_rotated)
+        bw = bw * 3 / 2;
+    bw /= (__u64) dst_h * 1024;
+    return bw > 0xffffffff ? 0xffffffff : (__u32) bw;
+}
+
+static __u32 mask_score(const struct ovl_candidate *layers, int num, __u32 mask)
+{
+    __u32 score = 0;
+    int i;
+
+    for (i = 0; i < num; i++)
+        if (mask & (1U << i))
+            score += layers[i].score;
+    return score;
+}
+
+__u32 overlay_assign_greedy(const struct ovl_candidate *layers, int num,
+                            int max_ovls, __u32 max_mem, __u32 max_bw)
+{
+    __u32 mask = 0, mem = 0, bw = 0;
+    int i, ovls = 0, fb_below = 0;
+
+    for (i = 0; i < num && i < MAX_ASSIGN_LAYERS; i++) {
+        const struct ovl_candidate *l = &layers[i];
+
+        if (ovls < max_ovls && l->eligible &&
+            mem + l->mem < max_mem &&
+            bw + l->bw <= max_bw &&
+            !(l->blended && fb_below)) {
+            mask |= 1U << i;
+            mem += l->mem;
+            bw += l->bw;
+            ovls++;
+        } else {
+            fb_below = 1;
+        }
+    }
+    return mask;
+}
+
+/* depth first over layer i with the choices made for the layers below it */
+static void assign_search(struct assign_state *s, int i, __u32 mask, __u32 score,
+                          int ovls, __u32 mem, __u32 bw, int fb_below)
+{
+    const struct ovl_candidate *l;
+
+    /* once the overlays are used up the remaining layers go to SGX */
+    if (i == s->num || ovls == s->max_ovls) {
+        if (score > s->best_score) {
+            s->best_score = score;
+            s->best_mask = mask;
+        }
+        return;
+    }
+
+    l = &s->layers[i];
+    if (l->eligible && mem + l->mem < s->max_mem &&
+        bw + l->bw <= s->max_bw &&
+        !(l->blended && fb_below))
+        assign_search(s, i + 1, mask | (1U << i), score + l->score,
+                      ovls + 1, mem + l->mem, bw + l->bw, fb_below);
+    assign_search(s, i + 1, mask, score, ovls, mem, bw, 1);
+}
+
+__u32 overlay_assign(const struct ovl_candidate *layers, int num,
+                     int max_ovls, __u32 max_mem, __u32 max_bw)
+{
+    struct assign_state s = {
+        .layers = layers,
+        .num = num < MAX_ASSIGN_LAYERS ? num : MAX_ASSIGN_LAYERS,
+        .max_ovls = max_ovls,
+        .max_mem = max_mem,
+        .max_bw = max_bw,
+    };
+
+    s.best_mask = overlay_assign_greedy(layers, s.num, max_ovls, max_mem, max_bw);
+    s.best_score = mask_score(layers, s.num, s.best_mask);
+    if (max_ovls > 0)
+        assign_search(&s, 0, 0, 0, 0, 0, 0, 0);
+    return s.best_mask;
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OMAP4_HWC_OVERLAY_ASSIGN_H
+#define OMAP4_HWC_OVERLAY_ASSIGN_H
+
+#include <linux/types.h>
+
+/* layers beyond this are left to the greedy assignment */
+#define MAX_ASSIGN_LAYERS 32
+
+/* a layer, in z-order, as seen by the overlay assignment */
+struct ovl_candidate {
+    __u32 score;        /* SGX composition cost the layer saves on DSS */
+    __u32 mem;          /* 1D TILER slot usage */
+    __u32 bw;           /* DSS fetch bandwidth, KB/s */
+    __u8 eligible;      /* DSS can render it */
+    __u8 blended;
+};
+
+/* bytes SGX fetches and writes to compose a layer into a 32-bit fb */
+__u32 overlay_score(__u32 src_w, __u32 src_h, __u32 bits_per_pixel,
+                    __u32 dst_w, __u32 dst_h);
+
+/*
+ * DSS fetch rate in KB/s while a layer is scanned out: a source line per
+ * output line, times the vertical downscale, at line_rate output lines a
+ * second. Decimation is not modelled, so heavy downscales overestimate.
+ * Rotated TILER views split bursts across pages and cost half again;
+ * unrotated TILER 2D fetch is costed like 1D. Callers only flag rotated
+ * NV12, the one format hwc puts in TILER 2D.
+ */
+__u32 overlay_fetch_bw(__u32 src_w, __u32 src_h, __u32 bits_per_pixel,
+                       __u32 dst_h, __u32 line_rate, int tiler_rotated);
+
+/*
+ * Both return the bitmask of layers to render on DSS, with the rest
+ * composed into the framebuffer by SGX. At most max_ovls layers are
+ * picked, their TILER usage stays below max_mem, their fetch bandwidth
+ * within max_bw, and no blended layer is picked above a framebuffer
+ * layer.
+ *
+ * overlay_assign_greedy() takes eligible layers bottom up while they fit,
+ * as the composer always did. overlay_assign() returns the assignment
+ * with the highest total score, and the greedy one unless another is
+ * strictly better.
+ */
+__u32 overlay_assign_greedy(const struct ovl_candidate *layers, int num,
+                            int max_ovls, __u32 max_mem, __u32 max_bw);
+__u32 overlay_assign(const struct ovl_candidate *layers, int num,
+                     int max_ovls, __u32 max_mem, __u32 max_bw);
+
+#endif
@@ -5,7 +5,7 @@ ifeq ($(TARGET_BOARD_PLATFORM),omap4)
 LOCAL_PATH:= $(call my-dir)
 
 include $(CLEAR_VARS)
-LOCAL_SRC_FILES := ion.c
+LOCAL_SRC_FILES := ion.c ion_registry.c
 LOCAL_MODULE := libion_ti
 LOCAL_MODULE_TAGS := optional
 LOCAL_SHARED_LIBRARIES := liblog
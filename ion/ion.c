@@ -19,7 +19,11 @@
  */
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/types.h>
@@ -29,13 +33,43 @@
 
 #include "linux_ion.h"
 #include "omap_ion.h"
+#include "linux_dma_heap.h"
 #include "ion.h"
 
+/*
+ * Kernels without /dev/ion (stock Linux) export their heaps as
+ * /dev/dma_heap/<name>. There every buffer is a dma-buf fd: handles carry
+ * that fd + 1 so a valid buffer never looks like a NULL handle, and
+ * sharing, importing and mapping are plain dup()s and mmap()s of it.
+ * The backend is picked by the first ion_open() in the process.
+ */
+#define DMA_HEAP_DIR "/dev/dma_heap/"
+#define DMABUF_TO_HANDLE(fd) ((struct ion_handle *)(intptr_t)((fd) + 1))
+#define HANDLE_TO_DMABUF(handle) ((int)(intptr_t)(handle) - 1)
+
+static int use_dma_heap;
+
+/* dma-heaps standing in for the ion heap types, system heap otherwise */
+static const char *dma_heap_names[ION_NUM_HEAPS] = {
+        [ION_HEAP_TYPE_SYSTEM_CONTIG] = "linux,cma",
+        [ION_HEAP_TYPE_CARVEOUT] = "reserved",
+};
+static int dma_heap_fds[ION_NUM_HEAPS];
+static pthread_mutex_t dma_heap_lock = PTHREAD_MUTEX_INITIALIZER;
+
 int ion_open()
 {
         int fd = open("/dev/ion", O_RDWR);
-        if (fd < 0)
-                ALOGE("open /dev/ion failed!\n");
+        if (fd >= 0)
+                return fd;
+        if (errno == ENOENT) {
+                fd = open(DMA_HEAP_DIR "system", O_RDONLY | O_CLOEXEC);
+                if (fd >= 0) {
+                        use_dma_heap = 1;
+                        return fd;
+                }
+        }
+        ALOGE("open /dev/ion failed!\n");
         return fd;
 }
 
@@ -55,6 +89,50 @@ static int ion_ioctl(int fd, int req, void *arg)
         return ret;
 }
 
+/* the heap fd to allocate heap_mask from; fd is the system heap */
+static int dma_heap_fd(int fd, unsigned int heap_mask)
+{
+        int heap, heap_fd = fd;
+        char path[64];
+
+        pthread_mutex_lock(&dma_heap_lock);
+        for (heap = 0; heap < ION_NUM_HEAPS; heap++) {
+                if (!(heap_mask & (1 << heap)) || !dma_heap_names[heap])
+                        continue;
+                /* fds are stored + 1, -1 once a heap is known missing */
+                if (!dma_heap_fds[heap]) {
+                        snprintf(path, sizeof(path), DMA_HEAP_DIR "%s",
+                                 dma_heap_names[heap]);
+                        dma_heap_fds[heap] = open(path, O_RDONLY | O_CLOEXEC) + 1;
+                        if (!dma_heap_fds[heap])
+                                dma_heap_fds[heap] = -1;
+                }
+                if (dma_heap_fds[heap] > 0) {
+                        heap_fd = dma_heap_fds[heap] - 1;
+                        break;
+                }
+        }
+        pthread_mutex_unlock(&dma_heap_lock);
+        return heap_fd;
+}
+
+/* dma-heap buffers are always page aligned, align is not honoured beyond that */
+static int dma_heap_alloc(int fd, size_t len, unsigned int heap_mask,
+                          struct ion_handle **handle)
+{
+        int ret;
+        struct dma_heap_allocation_data data = {
+                .len = len,
+                .fd_flags = O_RDWR | O_CLOEXEC,
+        };
+
+        ret = ion_ioctl(dma_heap_fd(fd, heap_mask), DMA_HEAP_IOCTL_ALLOC, &data);
+        if (ret < 0)
+                return ret;
+        *handle = DMABUF_TO_HANDLE((int)data.fd);
+        return 0;
+}
+
 int ion_alloc(int fd, size_t len, size_t align, unsigned int flags,
               struct ion_handle **handle)
 {
@@ -65,6 +143,9 @@ int ion_alloc(int fd, size_t len, size_t align, unsigned int flags,
                 .flags = flags,
         };
 
+        if (use_dma_heap)
+                return dma_heap_alloc(fd, len, flags, handle);
+
         ret = ion_ioctl(fd, ION_IOC_ALLOC, &data);
         if (ret < 0)
                 return ret;
@@ -88,6 +169,18 @@ int ion_alloc_tiler(int fd, size_t w, size_t h, int fmt, unsigned int flags,
                 .arg = (unsigned long)(&alloc_data),
         };
 
+        if (use_dma_heap) {
+                /* no tiler: hand out a linear buffer with a 32 byte aligned
+                 * stride; TILER_PIXEL_FMT_PAGE sizes are in bytes already */
+                static const int bpp[] = { 1, 2, 4, 1 };
+
+                if (fmt < TILER_PIXEL_FMT_MIN || fmt > TILER_PIXEL_FMT_MAX)
+                        return -EINVAL;
+                *stride = (w * bpp[fmt] + 31) & ~31;
+                return dma_heap_alloc(fd, *stride * h, ION_HEAP_SYSTEM_MASK,
+                                      handle);
+        }
+
         ret = ion_ioctl(fd, ION_IOC_CUSTOM, &custom_data);
         if (ret < 0)
                 return ret;
@@ -101,6 +194,9 @@ int ion_free(int fd, struct ion_handle *handle)
         struct ion_handle_data data = {
                 .handle = handle,
         };
+
+        if (use_dma_heap)
+                return close(HANDLE_TO_DMABUF(handle)) < 0 ? -errno : 0;
         return ion_ioctl(fd, ION_IOC_FREE, &data);
 }
 
@@ -110,9 +206,15 @@ int ion_map(int fd, struct ion_handle *handle, size_t length, int prot,
         struct ion_fd_data data = {
                 .handle = handle,
         };
-        int ret = ion_ioctl(fd, ION_IOC_MAP, &data);
-        if (ret < 0)
-                return ret;
+        int ret = 0;
+
+        if (use_dma_heap) {
+                data.fd = dup(HANDLE_TO_DMABUF(handle));
+        } else {
+                ret = ion_ioctl(fd, ION_IOC_MAP, &data);
+                if (ret < 0)
+                        return ret;
+        }
         *map_fd = data.fd;
         if (*map_fd < 0) {
                 ALOGE("map ioctl returned negative fd\n");
@@ -132,9 +234,15 @@ int ion_share(int fd, struct ion_handle *handle, int *share_fd)
         struct ion_fd_data data = {
                 .handle = handle,
         };
-        int ret = ion_ioctl(fd, ION_IOC_SHARE, &data);
-        if (ret < 0)
-                return ret;
+        int ret = 0;
+
+        if (use_dma_heap) {
+                data.fd = dup(HANDLE_TO_DMABUF(handle));
+        } else {
+                ret = ion_ioctl(fd, ION_IOC_SHARE, &data);
+                if (ret < 0)
+                        return ret;
+        }
         *share_fd = data.fd;
         if (*share_fd < 0) {
                 ALOGE("map ioctl returned negative fd\n");
@@ -148,9 +256,34 @@ int ion_import(int fd, int share_fd, struct ion_handle **handle)
         struct ion_fd_data data = {
                 .fd = share_fd,
         };
-        int ret = ion_ioctl(fd, ION_IOC_IMPORT, &data);
+        int ret;
+
+        if (use_dma_heap) {
+                ret = dup(share_fd);
+                if (ret < 0)
+                        return -errno;
+                *handle = DMABUF_TO_HANDLE(ret);
+                return 0;
+        }
+        ret = ion_ioctl(fd, ION_IOC_IMPORT, &data);
         if (ret < 0)
                 return ret;
         *handle = data.handle;
         return ret;
 }
+
+int ion_sync_range(int buf_fd, size_t offset, size_t len, unsigned int flags)
+{
+        struct dma_buf_sync sync = {
+                .flags = flags & DMA_BUF_SYNC_VALID_FLAGS_MASK,
+        };
+
+        /* legacy ion buffers are kept coherent by their users (ProcMgr) */
+        if (!use_dma_heap || !len)
+                return 0;
+        if (offset + len < offset)
+                return -EINVAL;
+        /* DMA_BUF_IOCTL_SYNC has no range, the kernel maintains the whole
+         * buffer; empty ranges are the only ones that can be skipped */
+        return ion_ioctl(buf_fd, DMA_BUF_IOCTL_SYNC, &sync);
+}
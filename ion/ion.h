@@ -33,3 +33,49 @@ int ion_map(int fd, struct ion_handle *handle, size_t length, int prot,
 int ion_share(int fd, struct ion_handle *handle, int *share_fd);
 int ion_import(int fd, int share_fd, struct ion_handle **handle);
 
+/*
+ * CPU access brackets for buffers from the dma-heap backend: call with
+ * ION_SYNC_START before touching [offset, offset + len) of a mapping and
+ * with ION_SYNC_END afterwards. buf_fd is any fd of the buffer (share or
+ * map fd). A no-op on /dev/ion, where ProcMgr handles coherency.
+ *
+ * DMA_BUF_IOCTL_SYNC takes no range: the kernel maintains the whole
+ * buffer whatever offset and len are. They are only validated, and an
+ * empty range skips the ioctl. Callers still pass the bytes they touch,
+ * so they get ranged maintenance if the kernel ever offers it.
+ */
+#define ION_SYNC_READ   (1 << 0)
+#define ION_SYNC_WRITE  (1 << 1)
+#define ION_SYNC_RW     (ION_SYNC_READ | ION_SYNC_WRITE)
+#define ION_SYNC_START  (0 << 2)
+#define ION_SYNC_END    (1 << 2)
+int ion_sync_range(int buf_fd, size_t offset, size_t len, unsigned int flags);
+
+
+/*
+ * Process wide buffer registry (ion_registry.c). ion_registry_open()
+ * returns the ion client shared by all users in the process; buffers
+ * are allocated through the registry, looked up by share fd and their
+ * mappings are cached and refcounted. client names are only used for
+ * accounting. Every alloc or import is paired with a release.
+ */
+int ion_registry_open();
+int ion_registry_close();
+int ion_registry_alloc(size_t len, size_t align, unsigned int heap_mask,
+                       const char *client, struct ion_handle **handle,
+                       int *share_fd);
+/* another reference on a registered buffer, for a user handed its share
+ * fd; -ENOENT if the registry doesn't track it. handle may be NULL */
+int ion_registry_import(int share_fd, const char *client,
+                        struct ion_handle **handle);
+/* share fd of the registered mapping containing [addr, addr + len), or
+ * -ENOENT. The caller must hold a reference on that buffer */
+int ion_registry_lookup(const void *addr, size_t len);
+int ion_registry_map(int share_fd, unsigned char **ptr);
+int ion_registry_unmap(int share_fd);
+int ion_registry_release(int share_fd, const char *client);
+int ion_registry_free(struct ion_handle *handle, const char *client);
+/* ion_sync_range() on the registered mapping containing [addr, addr + len);
+ * maintains the whole buffer, see above */
+int ion_registry_sync(const void *addr, size_t len, unsigned int flags);
+void ion_registry_dump(int fd);
@@ -0,0 +1,465 @@
+/*
+ *  ion_registry.c
+ *
+ * Process wide registry of ion buffers
+ *
+ *   Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*
+ * Every user in the process (camera HAL, DOMX proxies, DCC) shares one
+ * /dev/ion client and looks buffers up by share fd. A buffer is mapped
+ * into the process only once; later users take a reference on the cached
+ * mapping. Bytes are accounted per heap and per named client for
+ * ion_registry_dump().
+ *
+ * Buffers are keyed by fd number. The registry allocates every buffer it
+ * tracks and keeps its share fd open until the last release, so the
+ * number can't be reused for another buffer while the entry exists.
+ * Callers must pass the share fd they were given rather than a dup() of it.
+ * Other users of a buffer take their own reference with
+ * ion_registry_import() and drop it with ion_registry_release(); the
+ * buffer is freed when the last reference goes.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+
+#define LOG_TAG "ion"
+#include <cutils/log.h>
+
+#include "linux_ion.h"
+#include "omap_ion.h"
+#include "ion.h"
+
+#define REGISTRY_HASH_SIZE      64
+#define REGISTRY_MAX_CLIENTS    16
+#define REGISTRY_MAX_HEAPS      32
+#define REGISTRY_CLIENT_NAME    32
+
+struct registry_buffer {
+        struct registry_buffer *next;
+        int share_fd;
+        size_t len;
+        int heap;
+        int refs;
+        struct ion_handle *handle;
+        unsigned char *ptr;
+        int map_refs;
+        unsigned short client_refs[REGISTRY_MAX_CLIENTS];
+};
+
+struct registry_client {
+        char name[REGISTRY_CLIENT_NAME];
+        size_t bytes;
+        int buffers;
+};
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static int registry_fd = -1;
+static int registry_users;
+static struct registry_buffer *registry_hash[REGISTRY_HASH_SIZE];
+static struct registry_client registry_clients[REGISTRY_MAX_CLIENTS];
+static size_t registry_heap_bytes[REGISTRY_MAX_HEAPS];
+static size_t registry_unknown_heap_bytes;
+static size_t registry_mapped_bytes;
+static unsigned int registry_map_hits, registry_map_misses;
+
+static struct registry_buffer *registry_find(int share_fd)
+{
+        struct registry_buffer *buf;
+
+        for (buf = registry_hash[share_fd % REGISTRY_HASH_SIZE]; buf; buf = buf->next)
+                if (buf->share_fd == share_fd)
+                        return buf;
+        return NULL;
+}
+
+static struct registry_buffer *registry_find_handle(struct ion_handle *handle)
+{
+        struct registry_buffer *buf;
+        int i;
+
+        for (i = 0; i < REGISTRY_HASH_SIZE; i++)
+                for (buf = registry_hash[i]; buf; buf = buf->next)
+                        if (buf->handle == handle)
+                                return buf;
+        return NULL;
+}
+
+static struct registry_buffer *registry_find_addr(const void *addr, size_t len)
+{
+        const unsigned char *p = addr;
+        struct registry_buffer *buf;
+        int i;
+
+        for (i = 0; i < REGISTRY_HASH_SIZE; i++)
+                for (buf = registry_hash[i]; buf; buf = buf->next)
+                        if (buf->ptr && p >= buf->ptr &&
+                            p + len <= buf->ptr + buf->len)
+                                return buf;
+        return NULL;
+}
+
+static struct registry_buffer *registry_add(int share_fd, size_t len, int heap)
+{
+        struct registry_buffer *buf = calloc(1, sizeof(*buf));
+
+        if (!buf)
+                return NULL;
+        buf->share_fd = share_fd;
+        buf->len = len;
+        buf->heap = heap;
+        buf->next = registry_hash[share_fd % REGISTRY_HASH_SIZE];
+        registry_hash[share_fd % REGISTRY_HASH_SIZE] = buf;
+
+        if (heap >= 0)
+                registry_heap_bytes[heap] += len;
+        else
+                registry_unknown_heap_bytes += len;
+        return buf;
+}
+
+static void registry_remove(struct registry_buffer *buf)
+{
+        struct registry_buffer **pp = &registry_hash[buf->share_fd % REGISTRY_HASH_SIZE];
+
+        while (*pp != buf)
+                pp = &(*pp)->next;
+        *pp = buf->next;
+
+        if (buf->heap >= 0)
+                registry_heap_bytes[buf->heap] -= buf->len;
+        else
+                registry_unknown_heap_bytes -= buf->len;
+        free(buf);
+}
+
+static int registry_client_id(const char *name)
+{
+        int i, free_slot = -1;
+
+        if (!name)
+                name = "unknown";
+        for (i = 0; i < REGISTRY_MAX_CLIENTS; i++) {
+                if (registry_clients[i].name[0] == '\0') {
+                        if (free_slot < 0)
+                                free_slot = i;
+                } else if (!strncmp(registry_clients[i].name, name,
+                                    REGISTRY_CLIENT_NAME - 1)) {
+                        return i;
+                }
+        }
+        if (free_slot < 0) {
+                /* out of slots: account against the last one */
+                return REGISTRY_MAX_CLIENTS - 1;
+        }
+        strncpy(registry_clients[free_slot].name, name, REGISTRY_CLIENT_NAME - 1);
+        return free_slot;
+}
+
+static void registry_client_get(struct registry_buffer *buf, const char *name)
+{
+        int id = registry_client_id(name);
+
+        if (buf->client_refs[id]++ == 0) {
+                registry_clients[id].bytes += buf->len;
+                registry_clients[id].buffers++;
+        }
+}
+
+static void registry_client_put(struct registry_buffer *buf, const char *name)
+{
+        int id = registry_client_id(name);
+
+        if (buf->client_refs[id] == 0)
+                return;
+        if (--buf->client_refs[id] == 0) {
+                registry_clients[id].bytes -= buf->len;
+                registry_clients[id].buffers--;
+        }
+}
+
+static int registry_heap_index(unsigned int heap_mask)
+{
+        int heap;
+
+        for (heap = 0; heap < REGISTRY_MAX_HEAPS; heap++)
+                if (heap_mask & (1U << heap))
+                        return heap;
+        return -1;
+}
+
+int ion_registry_open()
+{
+        int fd;
+
+        pthread_mutex_lock(&registry_lock);
+        if (registry_fd < 0)
+                registry_fd = ion_open();
+        if (registry_fd >= 0)
+                registry_users++;
+        fd = registry_fd;
+        pthread_mutex_unlock(&registry_lock);
+        return fd;
+}
+
+int ion_registry_close()
+{
+        pthread_mutex_lock(&registry_lock);
+        if (registry_users > 0 && --registry_users == 0) {
+                ion_close(registry_fd);
+                registry_fd = -1;
+        }
+        pthread_mutex_unlock(&registry_lock);
+        return 0;
+}
+
+int ion_registry_alloc(size_t len, size_t align, unsigned int heap_mask,
+                       const char *client, struct ion_handle **handle,
+                       int *share_fd)
+{
+        struct registry_buffer *buf;
+        struct ion_handle *temp;
+        int fd, ret;
+
+        pthread_mutex_lock(&registry_lock);
+        if (registry_fd < 0) {
+                ret = -EBADF;
+                goto out;
+        }
+
+        ret = ion_alloc(registry_fd, len, align, heap_mask, &temp);
+        if (ret < 0)
+                goto out;
+        ret = ion_share(registry_fd, temp, &fd);
+        if (ret < 0) {
+                ion_free(registry_fd, temp);
+                goto out;
+        }
+
+        buf = registry_add(fd, len, registry_heap_index(heap_mask));
+        if (!buf) {
+                close(fd);
+                ion_free(registry_fd, temp);
+                ret = -ENOMEM;
+                goto out;
+        }
+        buf->handle = temp;
+        buf->refs = 1;
+        registry_client_get(buf, client);
+
+        *handle = temp;
+        *share_fd = fd;
+        ret = 0;
+out:
+        pthread_mutex_unlock(&registry_lock);
+        return ret;
+}
+
+int ion_registry_import(int share_fd, const char *client,
+                        struct ion_handle **handle)
+{
+        struct registry_buffer *buf;
+        int ret = 0;
+
+        pthread_mutex_lock(&registry_lock);
+        buf = registry_find(share_fd);
+        if (!buf) {
+                ret = -ENOENT;
+                goto out;
+        }
+        buf->refs++;
+        registry_client_get(buf, client);
+        if (handle)
+                *handle = buf->handle;
+out:
+        pthread_mutex_unlock(&registry_lock);
+        return ret;
+}
+
+int ion_registry_lookup(const void *addr, size_t len)
+{
+        struct registry_buffer *buf;
+        int fd;
+
+        pthread_mutex_lock(&registry_lock);
+        buf = registry_find_addr(addr, len);
+        fd = buf ? buf->share_fd : -ENOENT;
+        pthread_mutex_unlock(&registry_lock);
+        return fd;
+}
+
+int ion_registry_map(int share_fd, unsigned char **ptr)
+{
+        struct registry_buffer *buf;
+        void *addr;
+        int ret = 0;
+
+        pthread_mutex_lock(&registry_lock);
+        buf = registry_find(share_fd);
+        if (!buf || !buf->len) {
+                ret = -EINVAL;
+                goto out;
+        }
+        if (!buf->map_refs) {
+                addr = mmap(NULL, buf->len, PROT_READ | PROT_WRITE, MAP_SHARED,
+                            share_fd, 0);
+                if (addr == MAP_FAILED) {
+                        ALOGE("mmap failed: %s\n", strerror(errno));
+                        ret = -errno;
+                        goto out;
+                }
+                buf->ptr = addr;
+                registry_mapped_bytes += buf->len;
+                registry_map_misses++;
+        } else {
+                registry_map_hits++;
+        }
+        buf->map_refs++;
+        *ptr = buf->ptr;
+out:
+        pthread_mutex_unlock(&registry_lock);
+        return ret;
+}
+
+int ion_registry_unmap(int share_fd)
+{
+        struct registry_buffer *buf;
+        int ret = 0;
+
+        pthread_mutex_lock(&registry_lock);
+        buf = registry_find(share_fd);
+        if (!buf || !buf->map_refs) {
+                ret = -EINVAL;
+                goto out;
+        }
+        if (--buf->map_refs == 0) {
+                munmap(buf->ptr, buf->len);
+                buf->ptr = NULL;
+                registry_mapped_bytes -= buf->len;
+        }
+out:
+        pthread_mutex_unlock(&registry_lock);
+        return ret;
+}
+
+int ion_registry_sync(const void *addr, size_t len, unsigned int flags)
+{
+        struct registry_buffer *buf;
+        int fd = -1;
+        size_t offset = 0;
+
+        pthread_mutex_lock(&registry_lock);
+        buf = registry_find_addr(addr, len);
+        if (buf) {
+                fd = buf->share_fd;
+                offset = (const unsigned char *)addr - buf->ptr;
+        }
+        pthread_mutex_unlock(&registry_lock);
+        if (fd < 0)
+                return -ENOENT;
+        return ion_sync_range(fd, offset, len, flags);
+}
+
+static int registry_put(struct registry_buffer *buf, const char *client)
+{
+        registry_client_put(buf, client);
+        if (--buf->refs > 0)
+                return 0;
+
+        if (buf->map_refs) {
+                ALOGW("releasing ion buffer %d with %d mappings\n",
+                      buf->share_fd, buf->map_refs);
+                munmap(buf->ptr, buf->len);
+                registry_mapped_bytes -= buf->len;
+        }
+        if (registry_fd >= 0)
+                ion_free(registry_fd, buf->handle);
+        close(buf->share_fd);
+        registry_remove(buf);
+        return 0;
+}
+
+int ion_registry_release(int share_fd, const char *client)
+{
+        struct registry_buffer *buf;
+        int ret;
+
+        pthread_mutex_lock(&registry_lock);
+        buf = registry_find(share_fd);
+        ret = buf ? registry_put(buf, client) : -EINVAL;
+        pthread_mutex_unlock(&registry_lock);
+        return ret;
+}
+
+int ion_registry_free(struct ion_handle *handle, const char *client)
+{
+        struct registry_buffer *buf;
+        int ret;
+
+        pthread_mutex_lock(&registry_lock);
+        buf = registry_find_handle(handle);
+        ret = buf ? registry_put(buf, client) : -EINVAL;
+        pthread_mutex_unlock(&registry_lock);
+        return ret;
+}
+
+void ion_registry_dump(int fd)
+{
+        char line[128];
+        int i, len;
+
+        pthread_mutex_lock(&registry_lock);
+
+        len = snprintf(line, sizeof(line),
+                       "ion registry: mapped %zu bytes, map hits %u misses %u\n",
+                       registry_mapped_bytes, registry_map_hits,
+                       registry_map_misses);
+        write(fd, line, len);
+
+        for (i = 0; i < REGISTRY_MAX_HEAPS; i++) {
+                if (!registry_heap_bytes[i])
+                        continue;
+                len = snprintf(line, sizeof(line), "  heap %2d: %zu bytes\n",
+                               i, registry_heap_bytes[i]);
+                write(fd, line, len);
+        }
+        if (registry_unknown_heap_bytes) {
+                len = snprintf(line, sizeof(line), "  unknown heap: %zu bytes\n",
+                               registry_unknown_heap_bytes);
+                write(fd, line, len);
+        }
+
+        for (i = 0; i < REGISTRY_MAX_CLIENTS; i++) {
+                if (!registry_clients[i].buffers)
+                        continue;
+                len = snprintf(line, sizeof(line), "  %-31s %3d buffers %zu bytes\n",
+                               registry_clients[i].name,
+                               registry_clients[i].buffers,
+                               registry_clients[i].bytes);
+                write(fd, line, len);
+        }
+
+        pthread_mutex_unlock(&registry_lock);
+}
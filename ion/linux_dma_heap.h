@@ -0,0 +1,38 @@
+/*
+ * Userspace ABI of the Linux dma-heap and dma-buf sync ioctls, copied by
+ * hand from include/uapi/linux/dma-heap.h and include/uapi/linux/dma-buf.h
+ * because the libc headers this library builds against predate them.
+ * Only what ion.c uses is here. These are kernel ABI and don't change;
+ * drop this file once the libc headers provide linux/dma-heap.h.
+ */
+#ifndef _LINUX_DMA_HEAP_H
+#define _LINUX_DMA_HEAP_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+struct dma_heap_allocation_data {
+        __u64 len;
+        __u32 fd;
+        __u32 fd_flags;
+        __u64 heap_flags;
+};
+
+#define DMA_HEAP_IOC_MAGIC 'H'
+#define DMA_HEAP_IOCTL_ALLOC _IOWR(DMA_HEAP_IOC_MAGIC, 0x0, struct dma_heap_allocation_data)
+
+struct dma_buf_sync {
+        __u64 flags;
+};
+
+#define DMA_BUF_SYNC_READ (1 << 0)
+#define DMA_BUF_SYNC_WRITE (2 << 0)
+#define DMA_BUF_SYNC_RW (DMA_BUF_SYNC_READ | DMA_BUF_SYNC_WRITE)
+#define DMA_BUF_SYNC_START (0 << 2)
+#define DMA_BUF_SYNC_END (1 << 2)
+#define DMA_BUF_SYNC_VALID_FLAGS_MASK (DMA_BUF_SYNC_RW | DMA_BUF_SYNC_END)
+
+#define DMA_BUF_BASE 'b'
+#define DMA_BUF_IOCTL_SYNC _IOW(DMA_BUF_BASE, 0, struct dma_buf_sync)
+
+#endif
@@ -1,6 +1,11 @@
+#define _GNU_SOURCE /* dladdr() on glibc hosts */
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <dlfcn.h>
 
 #include "mapinfo.h"
 
@@ -18,30 +23,32 @@ extern void __real_free(void *ptr);
 #endif
 
 // 6f000000-6f01e000 rwxp 00000000 00:0c 16389419   /system/lib/libcomposer.so
-// 012345678901234567890123456789012345678901234567890123456789
-// 0         1         2         3         4         5
 
 static mapinfo *parse_maps_line(char *line)
 {
     mapinfo *mi;
-    int len = strlen(line);
+    unsigned long start, end;
+    char perms[5];
+    int len = strlen(line), name = 0;
 
     if(len < 1) return 0;
     line[--len] = 0;
 
-    if(len < 50) return 0;
-    if(line[20] != 'x') return 0;
+    /* fields are not fixed width where addresses have more than 8 digits */
+    if(sscanf(line, "%lx-%lx %4s %*x %*s %*d %n", &start, &end, perms, &name) < 3)
+        return 0;
+    if(!name || !line[name] || perms[2] != 'x') return 0;
 
-    mi = __real_malloc(sizeof(mapinfo) + (len - 47));
+    mi = __real_malloc(sizeof(mapinfo) + (len - name) + 1);
     if(mi == 0) return 0;
 
-    mi->start = strtoul(line, 0, 16);
-    mi->end = strtoul(line + 9, 0, 16);
+    mi->start = start;
+    mi->end = end;
     /* To be filled in parse_elf_info if the mapped section starts with
      * elf_header
      */
     mi->next = 0;
-    strcpy(mi->name, line + 49);
+    strcpy(mi->name, line + name);
 
     return mi;
 }
@@ -77,7 +84,7 @@ void deinit_mapinfo(mapinfo *mi)
 }
 
 /* Map a pc address to the name of the containing ELF file */
-const char *map_to_name(mapinfo *mi, unsigned pc, const char* def)
+const char *map_to_name(mapinfo *mi, uintptr_t pc, const char* def)
 {
     while(mi) {
         if((pc >= mi->start) && (pc < mi->end)){
@@ -88,19 +95,222 @@ const char *map_to_name(mapinfo *mi, unsigned pc, const char* def)
     return def;
 }
 
+static inline uintptr_t relative_pc(const mapinfo *mi, uintptr_t pc)
+{
+    // Only calculate the relative offset for shared libraries
+    return strstr(mi->name, ".so") ? pc - mi->start : pc;
+}
+
 /* Find the containing map info for the pc */
-const mapinfo *pc_to_mapinfo(mapinfo *mi, unsigned pc, unsigned *rel_pc)
+const mapinfo *pc_to_mapinfo(mapinfo *mi, uintptr_t pc, uintptr_t *rel_pc)
 {
     *rel_pc = pc;
     while(mi) {
         if((pc >= mi->start) && (pc < mi->end)){
-            // Only calculate the relative offset for shared libraries
-            if (strstr(mi->name, ".so")) {
-                *rel_pc -= mi->start;
-            }
+            *rel_pc = relative_pc(mi, pc);
             return mi;
         }
         mi = mi->next;
     }
     return NULL;
 }
+
+#define PC_CACHE_BITS       12
+#define MAPS_REREAD_S       1
+
+/* one reading of /proc/pid/maps, sorted by start address */
+struct maps {
+    struct maps *older;     /* the previous reading, results may still point there */
+    mapinfo *list;
+    const mapinfo **sorted;
+    unsigned num;
+};
+
+struct pc_cache_entry {
+    uintptr_t pc;
+    unsigned gen;           /* maps generation the entry was made from */
+    const mapinfo *mi;
+    unsigned sym_offset;
+    char *symbol;
+};
+
+struct mapindex {
+    int pid;
+    pthread_mutex_t lock;
+    struct maps *maps;
+    unsigned gen;           /* 0 means "no entry" in the cache */
+    time_t read_s;
+    struct pc_cache_entry cache[1 << PC_CACHE_BITS];
+};
+
+static time_t now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+static int cmp_start(const void *a, const void *b)
+{
+    const mapinfo *ma = *(const mapinfo * const *)a;
+    const mapinfo *mb = *(const mapinfo * const *)b;
+    return ma->start < mb->start ? -1 : ma->start > mb->start;
+}
+
+static struct maps *read_maps(int pid)
+{
+    struct maps *m = __real_malloc(sizeof(*m));
+    mapinfo *mi;
+    unsigned n = 0;
+
+    if (!m)
+        return NULL;
+    m->older = NULL;
+    m->list = init_mapinfo(pid);
+    for (mi = m->list; mi; mi = mi->next)
+        n++;
+    m->sorted = __real_malloc((n ? n : 1) * sizeof(*m->sorted));
+    if (!m->sorted) {
+        deinit_mapinfo(m->list);
+        __real_free(m);
+        return NULL;
+    }
+    m->num = 0;
+    for (mi = m->list; mi; mi = mi->next)
+        m->sorted[m->num++] = mi;
+    qsort(m->sorted, m->num, sizeof(*m->sorted), cmp_start);
+    return m;
+}
+
+static void free_maps(struct maps *m)
+{
+    struct maps *older;
+    while (m) {
+        older = m->older;
+        deinit_mapinfo(m->list);
+        __real_free(m->sorted);
+        __real_free(m);
+        m = older;
+    }
+}
+
+static const mapinfo *find_map(const struct maps *m, uintptr_t pc)
+{
+    unsigned lo = 0, hi = m ? m->num : 0, mid;
+
+    /* find the last mapping starting at or below pc */
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (m->sorted[mid]->start <= pc)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (!lo || pc >= m->sorted[lo - 1]->end)
+        return NULL;
+    return m->sorted[lo - 1];
+}
+
+mapindex *init_mapindex(int pid)
+{
+    mapindex *idx = __real_malloc(sizeof(*idx));
+
+    if (!idx)
+        return NULL;
+    memset(idx, 0, sizeof(*idx));
+    idx->pid = pid;
+    pthread_mutex_init(&idx->lock, NULL);
+    idx->maps = read_maps(pid);
+    idx->gen = 1;
+    idx->read_s = now_s();
+    return idx;
+}
+
+void deinit_mapindex(mapindex *idx)
+{
+    unsigned i;
+
+    if (!idx)
+        return;
+    for (i = 0; i < (1 << PC_CACHE_BITS); i++)
+        __real_free(idx->cache[i].symbol);
+    free_maps(idx->maps);
+    pthread_mutex_destroy(&idx->lock);
+    __real_free(idx);
+}
+
+static void lookup_symbol(struct pc_cache_entry *e)
+{
+    Dl_info info;
+    size_t len;
+
+    e->symbol = NULL;
+    e->sym_offset = 0;
+    if (!e->mi || !dladdr((void *)e->pc, &info) || !info.dli_sname)
+        return;
+    len = strlen(info.dli_sname) + 1;
+    e->symbol = __real_malloc(len);
+    if (e->symbol) {
+        memcpy(e->symbol, info.dli_sname, len);
+        e->sym_offset = e->pc - (uintptr_t)info.dli_saddr;
+    }
+}
+
+int mapindex_lookup(mapindex *idx, uintptr_t pc, mapsym *sym)
+{
+    struct pc_cache_entry *e;
+
+    sym->mi = NULL;
+    sym->rel_pc = pc;
+    sym->sym_offset = 0;
+    sym->symbol[0] = 0;
+    if (!idx)
+        return -1;
+
+    pthread_mutex_lock(&idx->lock);
+    e = &idx->cache[((uint32_t)pc * 2654435761u) >> (32 - PC_CACHE_BITS)];
+    /* a cached miss is retried once the maps may be re-read */
+    if (e->gen != idx->gen || e->pc != pc ||
+        (!e->mi && now_s() - idx->read_s >= MAPS_REREAD_S)) {
+        const mapinfo *mi = find_map(idx->maps, pc);
+
+        /* not mapped: maybe a library was loaded after we last looked */
+        if (!mi && now_s() - idx->read_s >= MAPS_REREAD_S) {
+            struct maps *m = read_maps(idx->pid);
+            idx->read_s = now_s();
+            if (m) {
+                /*
+                 * The new generation invalidates every cache entry, so
+                 * only results handed out may point at the current
+                 * reading; anything older goes.
+                 */
+                if (idx->maps) {
+                    free_maps(idx->maps->older);
+                    idx->maps->older = NULL;
+                }
+                m->older = idx->maps;
+                idx->maps = m;
+                idx->gen++;
+                mi = find_map(m, pc);
+            }
+        }
+
+        __real_free(e->symbol);
+        e->pc = pc;
+        e->gen = idx->gen;
+        e->mi = mi;
+        lookup_symbol(e);
+    }
+
+    sym->mi = e->mi;
+    if (e->mi)
+        sym->rel_pc = relative_pc(e->mi, pc);
+    if (e->symbol) {
+        strncpy(sym->symbol, e->symbol, sizeof(sym->symbol) - 1);
+        sym->symbol[sizeof(sym->symbol) - 1] = 0;
+        sym->sym_offset = e->sym_offset;
+    }
+    pthread_mutex_unlock(&idx->lock);
+
+    return sym->mi ? 0 : -1;
+}
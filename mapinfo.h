@@ -1,16 +1,38 @@
 #ifndef MAPINFO_H
 #define MAPINFO_H
 
+#include <stdint.h>
+
 typedef struct mapinfo {
     struct mapinfo *next;
-    unsigned start;
-    unsigned end;
+    uintptr_t start;
+    uintptr_t end;
     char name[];
 } mapinfo;
 
 mapinfo *init_mapinfo(int pid);
 void deinit_mapinfo(mapinfo *mi);
-const char *map_to_name(mapinfo *mi, unsigned pc, const char* def);
-const mapinfo *pc_to_mapinfo(mapinfo *mi, unsigned pc, unsigned *rel_pc);
+const char *map_to_name(mapinfo *mi, uintptr_t pc, const char* def);
+const mapinfo *pc_to_mapinfo(mapinfo *mi, uintptr_t pc, uintptr_t *rel_pc);
+
+/*
+ * Sorted index of the executable mappings, for symbolizing many pcs: a pc
+ * cache in front of a binary search. When a pc is not mapped the maps are
+ * re-read, at most once a second, to pick up libraries loaded since. The
+ * mapinfo of a result stays valid until the maps have been re-read twice.
+ */
+typedef struct mapindex mapindex;
+
+typedef struct mapsym {
+    const mapinfo *mi;      /* NULL if the pc is not mapped */
+    uintptr_t rel_pc;
+    unsigned sym_offset;
+    char symbol[128];       /* empty if unknown */
+} mapsym;
+
+mapindex *init_mapindex(int pid);
+void deinit_mapindex(mapindex *idx);
+/* returns 0 if pc is mapped, -1 otherwise */
+int mapindex_lookup(mapindex *idx, uintptr_t pc, mapsym *sym);
 
 #endif
@@ -28,21 +28,32 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-/** Simple implementation of lib_object using doubly-linked lists. This
-   implementation should outperform more sophisticated data structures
-   like blanced binary trees when the tables have fewer than 10 to 20
-   elements.  */
+/** Implementation of lib_object using a doubly-linked list of the objects,
+   for iteration, and a hash table of the keys, for search. The hash table
+   is allocated when the first object is added, grows with the table and is
+   released when the last object is removed, so a table needs no explicit
+   initialization beyond zeroing nor any destruction once emptied.
 
+   If the hash table cannot be allocated, searches fall back to walking
+   the list.  */
+
+#include <stdlib.h>
 #include <string.h>
 #include "s_type.h"
 
 #include "lib_object.h"
 
+/* Initial number of buckets; the table doubles whenever it holds more
+   objects than buckets */
+#define LIB_OBJECT_MIN_BUCKETS 16
+
 /* Generic node */
 typedef struct LIB_OBJECT_NODE
 {
    struct LIB_OBJECT_NODE* pPrevious;
    struct LIB_OBJECT_NODE* pNext;
+   /* Next node in the same hash bucket */
+   struct LIB_OBJECT_NODE* pHashNext;
    union
    {
       uint16_t nHandle;
@@ -61,6 +72,18 @@ typedef struct LIB_OBJECT_NODE
 }
 LIB_OBJECT_NODE;
 
+/* Generic table */
+typedef struct
+{
+   LIB_OBJECT_NODE* pRoot;
+   LIB_OBJECT_NODE** ppBuckets;
+   uint32_t nBuckets;
+   uint32_t nCount;
+   /* Last handle allocated, for handle tables */
+   uint32_t nLastHandle;
+}
+LIB_OBJECT_TABLE;
+
 typedef enum
 {
    LIB_OBJECT_NODE_TYPE_HANDLE16,
@@ -70,6 +93,115 @@ typedef enum
 }
 LIB_OBJECT_NODE_TYPE;
 
+/* -----------------------------------------------------------------------
+   Hash functions
+   -----------------------------------------------------------------------*/
+
+/* FNV-1a */
+static uint32_t libObjectHashBytes(const uint8_t* pBytes, uint32_t nLength)
+{
+   uint32_t nHash = 2166136261u;
+   uint32_t i;
+   for (i = 0; i < nLength; i++)
+   {
+      nHash = (nHash ^ pBytes[i]) * 16777619u;
+   }
+   return nHash;
+}
+
+/* Hash of a key given as in the search functions */
+static uint32_t libObjectHashKey(
+   uint32_t nKey1,
+   void* pKey2,
+   LIB_OBJECT_NODE_TYPE eNodeType)
+{
+   switch (eNodeType)
+   {
+   default:
+   case LIB_OBJECT_NODE_TYPE_HANDLE16:
+      /* Handles are allocated sequentially: use them directly */
+      return nKey1;
+   case LIB_OBJECT_NODE_TYPE_STORAGE_NAME:
+      return libObjectHashBytes((const uint8_t*)pKey2, sizeof(S_STORAGE_NAME));
+   case LIB_OBJECT_NODE_TYPE_FILENAME:
+      return libObjectHashBytes((const uint8_t*)pKey2, nKey1);
+   }
+}
+
+static uint32_t libObjectHashNode(
+   LIB_OBJECT_NODE* pNode,
+   LIB_OBJECT_NODE_TYPE eNodeType)
+{
+   switch (eNodeType)
+   {
+   default:
+   case LIB_OBJECT_NODE_TYPE_HANDLE16:
+      return libObjectHashKey(pNode->key.nHandle, NULL, eNodeType);
+   case LIB_OBJECT_NODE_TYPE_STORAGE_NAME:
+      return libObjectHashKey(0, &pNode->key.sStorageName, eNodeType);
+   case LIB_OBJECT_NODE_TYPE_FILENAME:
+      return libObjectHashKey(pNode->key.f.nFilenameLength, pNode->key.f.sFilename, eNodeType);
+   }
+}
+
+static void libObjectHashInsert(
+   LIB_OBJECT_TABLE* pTable,
+   LIB_OBJECT_NODE* pNode,
+   LIB_OBJECT_NODE_TYPE eNodeType)
+{
+   LIB_OBJECT_NODE** ppBucket =
+      &pTable->ppBuckets[libObjectHashNode(pNode, eNodeType) & (pTable->nBuckets - 1)];
+   pNode->pHashNext = *ppBucket;
+   *ppBucket = pNode;
+}
+
+static void libObjectHashRemove(
+   LIB_OBJECT_TABLE* pTable,
+   LIB_OBJECT_NODE* pNode,
+   LIB_OBJECT_NODE_TYPE eNodeType)
+{
+   LIB_OBJECT_NODE** ppNode =
+      &pTable->ppBuckets[libObjectHashNode(pNode, eNodeType) & (pTable->nBuckets - 1)];
+   while (*ppNode != pNode)
+   {
+      ppNode = &(*ppNode)->pHashNext;
+   }
+   *ppNode = pNode->pHashNext;
+}
+
+/* Resize the hash table to nBuckets (a power of two) and rehash all the
+   objects. Returns false on allocation failure, keeping the current hash
+   table */
+static bool libObjectHashResize(
+   LIB_OBJECT_TABLE* pTable,
+   uint32_t nBuckets,
+   LIB_OBJECT_NODE_TYPE eNodeType)
+{
+   LIB_OBJECT_NODE** ppBuckets;
+   LIB_OBJECT_NODE* pNode;
+
+   ppBuckets = (LIB_OBJECT_NODE**)calloc(nBuckets, sizeof(LIB_OBJECT_NODE*));
+   if (ppBuckets == NULL)
+   {
+      return false;
+   }
+   free(pTable->ppBuckets);
+   pTable->ppBuckets = ppBuckets;
+   pTable->nBuckets = nBuckets;
+
+   pNode = pTable->pRoot;
+   if (pNode != NULL)
+   {
+      do
+      {
+         libObjectHashInsert(pTable, pNode, eNodeType);
+         pNode = pNode->pNext;
+      }
+      while (pNode != pTable->pRoot);
+   }
+   return true;
+}
+
 /* -----------------------------------------------------------------------
    Search functions
    -----------------------------------------------------------------------*/
@@ -108,14 +240,32 @@ static bool libObjectKeyEqualNode(
 
 /* Polymorphic search function */
 static LIB_OBJECT_NODE* libObjectSearch(
-   LIB_OBJECT_NODE* pRoot,
+   LIB_OBJECT_TABLE* pTable,
    uint32_t nKey1,
    void* pKey2,
    LIB_OBJECT_NODE_TYPE eNodeType)
 {
-   if (pRoot != NULL)
+   LIB_OBJECT_NODE* pNode;
+
+   if (pTable->ppBuckets != NULL)
+   {
+      pNode = pTable->ppBuckets[libObjectHashKey(nKey1, pKey2, eNodeType) & (pTable->nBuckets - 1)];
+      while (pNode != NULL)
+      {
+         if (libObjectKeyEqualNode(pNode, nKey1, pKey2, eNodeType))
+         {
+            /* Match found */
+            return pNode;
+         }
+         pNode = pNode->pHashNext;
+      }
+      return NULL;
+   }
+
+   /* No hash table: walk the list */
+   pNode = pTable->pRoot;
+   if (pNode != NULL)
    {
-      LIB_OBJECT_NODE* pNode = pRoot;
       do
       {
          if (libObjectKeyEqualNode(pNode, nKey1, pKey2, eNodeType))
@@ -125,7 +275,7 @@ static LIB_OBJECT_NODE* libObjectSearch(
          }
          pNode = pNode->pNext;
       }
-      while (pNode != pRoot);
+      while (pNode != pTable->pRoot);
    }
    return NULL;
 }
@@ -135,7 +285,7 @@ LIB_OBJECT_NODE_HANDLE16* libObjectHandle16Search(
                uint32_t nHandle)
 {
    return (LIB_OBJECT_NODE_HANDLE16*)libObjectSearch(
-      (LIB_OBJECT_NODE*)pTable->pRoot, nHandle, NULL, LIB_OBJECT_NODE_TYPE_HANDLE16);
+      (LIB_OBJECT_TABLE*)pTable, nHandle, NULL, LIB_OBJECT_NODE_TYPE_HANDLE16);
 }
 
 
@@ -144,7 +294,7 @@ LIB_OBJECT_NODE_STORAGE_NAME* libObjectStorageNameSearch(
                S_STORAGE_NAME* pStorageName)
 {
    return (LIB_OBJECT_NODE_STORAGE_NAME*)libObjectSearch(
-      (LIB_OBJECT_NODE*)pTable->pRoot, 0, pStorageName, LIB_OBJECT_NODE_TYPE_STORAGE_NAME);
+      (LIB_OBJECT_TABLE*)pTable, 0, pStorageName, LIB_OBJECT_NODE_TYPE_STORAGE_NAME);
 }
 
 LIB_OBJECT_NODE_FILENAME* libObjectFilenameSearch(
@@ -153,80 +303,95 @@ LIB_OBJECT_NODE_FILENAME* libObjectFilenameSearch(
                uint32_t  nFilenameLength)
 {
    return (LIB_OBJECT_NODE_FILENAME*)libObjectSearch(
-      (LIB_OBJECT_NODE*)pTable->pRoot, nFilenameLength, pFilename, LIB_OBJECT_NODE_TYPE_FILENAME);
+      (LIB_OBJECT_TABLE*)pTable, nFilenameLength, pFilename, LIB_OBJECT_NODE_TYPE_FILENAME);
 }
 
 /* -----------------------------------------------------------------------
    Add functions
    -----------------------------------------------------------------------*/
 
+/* Find a free handle after the last one allocated. Handles are handed
+   out in increasing order and only wrap around once 0xFFFF has been
+   used, so this is O(1) amortized unless the table is nearly full */
+static bool libObjectAllocateHandle(
+   LIB_OBJECT_TABLE* pTable,
+   LIB_OBJECT_NODE* pNew)
+{
+   uint32_t nHandle = pTable->nLastHandle;
+
+   if (pTable->nCount >= LIB_OBJECT_HANDLE16_MAX)
+   {
+      /* No free handle */
+      return false;
+   }
+   do
+   {
+      nHandle = (nHandle >= LIB_OBJECT_HANDLE16_MAX) ? 1 : nHandle + 1;
+   }
+   while (libObjectSearch(pTable, nHandle, NULL, LIB_OBJECT_NODE_TYPE_HANDLE16) != NULL);
+
+   pNew->key.nHandle = (uint16_t)nHandle;
+   pTable->nLastHandle = nHandle;
+   return true;
+}
+
 /* Polymorphic add function. Add the node at the end of the linked list */
 static bool libObjectAdd(
-   LIB_OBJECT_NODE** ppRoot,
+   LIB_OBJECT_TABLE* pTable,
    LIB_OBJECT_NODE* pNew,
    LIB_OBJECT_NODE_TYPE eNodeType)
 {
-   LIB_OBJECT_NODE* pRoot;
-   LIB_OBJECT_NODE* pLast;
-   if (*ppRoot == NULL)
+   LIB_OBJECT_NODE* pRoot = pTable->pRoot;
+
+   if (eNodeType == LIB_OBJECT_NODE_TYPE_HANDLE16)
    {
-      *ppRoot = pNew;
-      pNew->pNext = pNew;
-      pNew->pPrevious = pNew;
-      if (eNodeType == LIB_OBJECT_NODE_TYPE_HANDLE16)
+      if (pRoot == NULL)
       {
-         pNew->key.nHandle = 1;
+         /* Start again from 1 in an empty table */
+         pTable->nLastHandle = 0;
+      }
+      if (!libObjectAllocateHandle(pTable, pNew))
+      {
+         return false;
       }
-      return true;
+   }
+
+   if (pRoot == NULL)
+   {
+      pTable->pRoot = pNew;
+      pNew->pNext = pNew;
+      pNew->pPrevious = pNew;
    }
    else
    {
-      pRoot = *ppRoot;
-      pLast = pRoot->pPrevious;
-      if (eNodeType == LIB_OBJECT_NODE_TYPE_HANDLE16)
-      {
-         if (pLast->key.nHandle == LIB_OBJECT_HANDLE16_MAX)
-         {
-            /* We cannot just assign last handle + 1 because it will
-               overflow. So, scan the whole list */
-            goto scan_list;
-         }
-         pNew->key.nHandle = pLast->key.nHandle + 1;
-      }
+      LIB_OBJECT_NODE* pLast = pRoot->pPrevious;
       pLast->pNext = pNew;
       pNew->pPrevious = pLast;
       pNew->pNext = pRoot;
       pRoot->pPrevious = pNew;
+   }
+   pTable->nCount++;
+
+   if (eNodeType == LIB_OBJECT_NODE_TYPE_UNINDEXED)
+   {
       return true;
    }
-scan_list:
+   if (pTable->ppBuckets == NULL || pTable->nCount > pTable->nBuckets)
    {
-      LIB_OBJECT_NODE* pNode = pRoot;
-      uint32_t nFreeHandle = 1;
-      do
+      /* Rehashes pNew along with the other objects */
+      if (libObjectHashResize(
+            pTable,
+            pTable->ppBuckets == NULL ? LIB_OBJECT_MIN_BUCKETS : pTable->nBuckets * 2,
+            eNodeType))
       {
-         if (pNode->key.nHandle > nFreeHandle)
-         {
-            /* nMaxHandle+1 is not allocated. Insert pNew just before pNode */
-            pNew->key.nHandle = nFreeHandle;
-            pNew->pNext = pNode;
-            pNew->pPrevious = pNode->pPrevious;
-            pNode->pPrevious->pNext = pNew;
-            pNode->pPrevious = pNew;
-            if (pNode == pRoot)
-            {
-               /* Special case, pNew is the new root */
-               *ppRoot = pNew;
-            }
-            return true;
-         }
-         pNode = pNode->pNext;
-         nFreeHandle++;
+         return true;
       }
-      while (pNode != pRoot);
-      /* No free handle */
-      return false;
    }
+   if (pTable->ppBuckets != NULL)
+   {
+      libObjectHashInsert(pTable, pNew, eNodeType);
+   }
+   return true;
 }
 
 bool libObjectHandle16Add(
@@ -234,7 +399,7 @@ bool libObjectHandle16Add(
                LIB_OBJECT_NODE_HANDLE16* pObject)
 {
    return libObjectAdd(
-      (LIB_OBJECT_NODE**)&pTable->pRoot,
+      (LIB_OBJECT_TABLE*)pTable,
       (LIB_OBJECT_NODE*)pObject,
       LIB_OBJECT_NODE_TYPE_HANDLE16);
 }
@@ -245,7 +410,7 @@ void libObjectStorageNameAdd(
                LIB_OBJECT_NODE_STORAGE_NAME* pObject)
 {
    libObjectAdd(
-      (LIB_OBJECT_NODE**)&pTable->pRoot,
+      (LIB_OBJECT_TABLE*)pTable,
       (LIB_OBJECT_NODE*)pObject,
       LIB_OBJECT_NODE_TYPE_STORAGE_NAME);
 }
@@ -256,7 +421,7 @@ void libObjectFilenameAdd(
                LIB_OBJECT_NODE_FILENAME* pObject)
 {
    libObjectAdd(
-      (LIB_OBJECT_NODE**)&pTable->pRoot,
+      (LIB_OBJECT_TABLE*)pTable,
       (LIB_OBJECT_NODE*)pObject,
       LIB_OBJECT_NODE_TYPE_FILENAME);
 }
@@ -267,7 +432,7 @@ void libObjectUnindexedAdd(
          LIB_OBJECT_NODE_UNINDEXED* pObject)
 {
    libObjectAdd(
-      (LIB_OBJECT_NODE**)&pTable->pRoot,
+      (LIB_OBJECT_TABLE*)pTable,
       (LIB_OBJECT_NODE*)pObject,
       LIB_OBJECT_NODE_TYPE_UNINDEXED);
 }
@@ -276,36 +441,50 @@ void libObjectUnindexedAdd(
 /* -----------------------------------------------------------------------
    Remove functions
    -----------------------------------------------------------------------*/
-static void libObjectRemove(LIB_OBJECT_NODE** ppRoot, LIB_OBJECT_NODE* pObject)
+static void libObjectRemove(
+   LIB_OBJECT_TABLE* pTable,
+   LIB_OBJECT_NODE* pObject,
+   LIB_OBJECT_NODE_TYPE eNodeType)
 {
    LIB_OBJECT_NODE* pPrevious = pObject->pPrevious;
    LIB_OBJECT_NODE* pNext = pObject->pNext;
 
+   if (pTable->ppBuckets != NULL)
+   {
+      libObjectHashRemove(pTable, pObject, eNodeType);
+   }
+
    pPrevious->pNext = pNext;
    pNext->pPrevious = pPrevious;
+   pTable->nCount--;
 
    if (pPrevious == pObject)
    {
       /* Removed the last object in the table */
-      *ppRoot = NULL;
+      pTable->pRoot = NULL;
+      free(pTable->ppBuckets);
+      pTable->ppBuckets = NULL;
+      pTable->nBuckets = 0;
    }
-   else if (pObject == *ppRoot)
+   else if (pObject == pTable->pRoot)
    {
       /* Removed the first object in the list */
-      *ppRoot = pNext;
+      pTable->pRoot = pNext;
    }
 }
 
-static LIB_OBJECT_NODE* libObjectRemoveOne(LIB_OBJECT_NODE** ppRoot)
+static LIB_OBJECT_NODE* libObjectRemoveOne(
+   LIB_OBJECT_TABLE* pTable,
+   LIB_OBJECT_NODE_TYPE eNodeType)
 {
-   if (*ppRoot == NULL)
+   if (pTable->pRoot == NULL)
    {
       return NULL;
    }
    else
    {
-      LIB_OBJECT_NODE* pObject = *ppRoot;
-      libObjectRemove(ppRoot, pObject);
+      LIB_OBJECT_NODE* pObject = pTable->pRoot;
+      libObjectRemove(pTable, pObject, eNodeType);
       return pObject;
    }
 }
@@ -314,14 +493,14 @@ void libObjectHandle16Remove(
                LIB_OBJECT_TABLE_HANDLE16* pTable,
                LIB_OBJECT_NODE_HANDLE16* pObject)
 {
-   libObjectRemove((LIB_OBJECT_NODE**)&pTable->pRoot, (LIB_OBJECT_NODE*)pObject);
+   libObjectRemove((LIB_OBJECT_TABLE*)pTable, (LIB_OBJECT_NODE*)pObject, LIB_OBJECT_NODE_TYPE_HANDLE16);
    pObject->nHandle = 0;
 }
 
 LIB_OBJECT_NODE_HANDLE16* libObjectHandle16RemoveOne(
                LIB_OBJECT_TABLE_HANDLE16* pTable)
 {
-   LIB_OBJECT_NODE_HANDLE16* pObject = (LIB_OBJECT_NODE_HANDLE16*)libObjectRemoveOne((LIB_OBJECT_NODE**)&pTable->pRoot);
+   LIB_OBJECT_NODE_HANDLE16* pObject = (LIB_OBJECT_NODE_HANDLE16*)libObjectRemoveOne((LIB_OBJECT_TABLE*)pTable, LIB_OBJECT_NODE_TYPE_HANDLE16);
    if (pObject != NULL)
    {
       pObject->nHandle = 0;
@@ -333,38 +512,38 @@ void libObjectStorageNameRemove(
                LIB_OBJECT_TABLE_STORAGE_NAME* pTable,
                LIB_OBJECT_NODE_STORAGE_NAME* pObject)
 {
-   libObjectRemove((LIB_OBJECT_NODE**)&pTable->pRoot, (LIB_OBJECT_NODE*)pObject);
+   libObjectRemove((LIB_OBJECT_TABLE*)pTable, (LIB_OBJECT_NODE*)pObject, LIB_OBJECT_NODE_TYPE_STORAGE_NAME);
 }
 
 LIB_OBJECT_NODE_STORAGE_NAME* libObjectStorageNameRemoveOne(
                LIB_OBJECT_TABLE_STORAGE_NAME* pTable)
 {
-   return (LIB_OBJECT_NODE_STORAGE_NAME*)libObjectRemoveOne((LIB_OBJECT_NODE**)&pTable->pRoot);
+   return (LIB_OBJECT_NODE_STORAGE_NAME*)libObjectRemoveOne((LIB_OBJECT_TABLE*)pTable, LIB_OBJECT_NODE_TYPE_STORAGE_NAME);
 }
 
 void libObjectFilenameRemove(
                LIB_OBJECT_TABLE_FILENAME* pTable,
                LIB_OBJECT_NODE_FILENAME* pObject)
 {
-   libObjectRemove((LIB_OBJECT_NODE**)&pTable->pRoot, (LIB_OBJECT_NODE*)pObject);
+   libObjectRemove((LIB_OBJECT_TABLE*)pTable, (LIB_OBJECT_NODE*)pObject, LIB_OBJECT_NODE_TYPE_FILENAME);
 }
 
 LIB_OBJECT_NODE_FILENAME* libObjectFilenameRemoveOne(
                LIB_OBJECT_TABLE_FILENAME* pTable)
 {
-   return (LIB_OBJECT_NODE_FILENAME*)libObjectRemoveOne((LIB_OBJECT_NODE**)&pTable->pRoot);
+   return (LIB_OBJECT_NODE_FILENAME*)libObjectRemoveOne((LIB_OBJECT_TABLE*)pTable, LIB_OBJECT_NODE_TYPE_FILENAME);
 }
 
 void libObjectUnindexedRemove(
          LIB_OBJECT_TABLE_UNINDEXED* pTable,
          LIB_OBJECT_NODE_UNINDEXED* pObject)
 {
-   libObjectRemove((LIB_OBJECT_NODE**)&pTable->pRoot, (LIB_OBJECT_NODE*)pObject);
+   libObjectRemove((LIB_OBJECT_TABLE*)pTable, (LIB_OBJECT_NODE*)pObject, LIB_OBJECT_NODE_TYPE_UNINDEXED);
 }
 
 LIB_OBJECT_NODE_UNINDEXED* libObjectUnindexedRemoveOne(LIB_OBJECT_TABLE_UNINDEXED* pTable)
 {
-   return (LIB_OBJECT_NODE_UNINDEXED*)libObjectRemoveOne((LIB_OBJECT_NODE**)&pTable->pRoot);
+   return (LIB_OBJECT_NODE_UNINDEXED*)libObjectRemoveOne((LIB_OBJECT_TABLE*)pTable, LIB_OBJECT_NODE_TYPE_UNINDEXED);
 }
 
 
@@ -53,6 +53,10 @@ S_STORAGE_NAME;
  * - objects identified by a S_STORAGE_NAME
  * - objects identified by a filename, which is a variable-size up-to-64 bytes byte array
  * - unindexed objects
+ *
+ * Tables must be zero-initialized before use. Search by key is O(1) on
+ * average: the table allocates a hash index when its first object is
+ * added and frees it when its last object is removed.
  **/
 
 /* -------------------------------------------------------------------------
@@ -85,7 +89,7 @@ S_STORAGE_NAME;
 typedef struct
 {
    /* Implementation-defined fields */
-   uint32_t _l[2];
+   void* _l[3];
 
    /* Public field */
    uint16_t   nHandle;
@@ -98,6 +102,10 @@ LIB_OBJECT_NODE_HANDLE16;
 typedef struct
 {
    LIB_OBJECT_NODE_HANDLE16* pRoot;
+
+   /* Implementation-defined fields */
+   void* _p;
+   uint32_t _n[3];
 }
 LIB_OBJECT_TABLE_HANDLE16;
 
@@ -159,7 +167,7 @@ LIB_OBJECT_NODE_HANDLE16* libObjectHandle16Next(
 typedef struct
 {
    /* Implementation-defined fields */
-   uint32_t _l[2];
+   void* _l[3];
 
    /* Public fields */
    S_STORAGE_NAME sStorageName;
@@ -172,6 +180,10 @@ LIB_OBJECT_NODE_STORAGE_NAME;
 typedef struct
 {
    LIB_OBJECT_NODE_STORAGE_NAME* pRoot;
+
+   /* Implementation-defined fields */
+   void* _p;
+   uint32_t _n[3];
 }
 LIB_OBJECT_TABLE_STORAGE_NAME;
 
@@ -229,7 +241,7 @@ LIB_OBJECT_NODE_STORAGE_NAME* libObjectStorageNameNext(
 typedef struct
 {
    /* Implementation-defined fields */
-   uint32_t _l[2];
+   void* _l[3];
 
    /* Public fields */
    uint8_t  sFilename[64];
@@ -243,6 +255,10 @@ LIB_OBJECT_NODE_FILENAME;
 typedef struct
 {
    LIB_OBJECT_NODE_FILENAME* pRoot;
+
+   /* Implementation-defined fields */
+   void* _p;
+   uint32_t _n[3];
 }
 LIB_OBJECT_TABLE_FILENAME;
 
@@ -301,7 +317,7 @@ LIB_OBJECT_NODE_FILENAME* libObjectFilenameNext(
 typedef struct
 {
    /* Implementation-defined fields */
-   uint32_t _l[2];
+   void* _l[3];
 }
 LIB_OBJECT_NODE_UNINDEXED;
 
@@ -311,6 +327,10 @@ LIB_OBJECT_NODE_UNINDEXED;
 typedef struct
 {
    LIB_OBJECT_NODE_UNINDEXED* pRoot;
+
+   /* Implementation-defined fields */
+   void* _p;
+   uint32_t _n[3];
 }
 LIB_OBJECT_TABLE_UNINDEXED;
 
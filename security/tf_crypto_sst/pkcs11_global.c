@@ -107,6 +107,211 @@ void stubFinalizeContext(void)
 }
 
 
+/* ------------------------------------------------------------------------
+   Internal shared memory pool
+------------------------------------------------------------------------- */
+
+void stubSharedMemoryPoolInit(STUB_SHARED_MEMORY_POOL* pPool)
+{
+   memset(pPool, 0, sizeof(STUB_SHARED_MEMORY_POOL));
+   libMutexInit(&pPool->sMutex);
+}
+
+void stubSharedMemoryPoolDestroy(STUB_SHARED_MEMORY_POOL* pPool)
+{
+   uint32_t i;
+
+   for (i = 0; i < STUB_SHARED_MEMORY_POOL_BLOCKS; i++)
+   {
+      if (pPool->sBlocks[i].buffer != NULL)
+      {
+         TEEC_ReleaseSharedMemory(&pPool->sBlocks[i]);
+      }
+   }
+   libMutexDestroy(&pPool->sMutex);
+   memset(pPool, 0, sizeof(STUB_SHARED_MEMORY_POOL));
+}
+
+TEEC_SharedMemory* stubSharedMemoryAcquire(STUB_SHARED_MEMORY_POOL* pPool, uint32_t nSize)
+{
+   TEEC_SharedMemory* pBlock = NULL;
+   uint32_t nBlockSize;
+   uint32_t i;
+   int32_t  nFree = -1;
+
+   if (nSize == 0 || nSize > STUB_SHARED_MEMORY_MAX_SIZE)
+   {
+      return NULL;
+   }
+
+   libMutexLock(&pPool->sMutex);
+   if (nSize <= STUB_SHARED_MEMORY_KEEP_SIZE)
+   {
+      pPool->nSmallUses++;
+   }
+   else
+   {
+      pPool->nSmallUses = 0;
+   }
+   for (i = 0; i < STUB_SHARED_MEMORY_POOL_BLOCKS; i++)
+   {
+      if (pPool->bBusy[i])
+      {
+         continue;
+      }
+      if (pPool->sBlocks[i].buffer != NULL && pPool->sBlocks[i].size >= nSize)
+      {
+         /* Reuse a block that is large enough */
+         pPool->bBusy[i] = true;
+         pBlock = &pPool->sBlocks[i];
+         goto end;
+      }
+      /* Otherwise prefer an unallocated block, then the smallest one */
+      if (nFree < 0 ||
+          (pPool->sBlocks[nFree].buffer != NULL &&
+           (pPool->sBlocks[i].buffer == NULL || pPool->sBlocks[i].size < pPool->sBlocks[nFree].size)))
+      {
+         nFree = i;
+      }
+   }
+   if (nFree < 0)
+   {
+      /* All blocks are in use by other threads */
+      goto end;
+   }
+
+   /* (Re)allocate the block. The size is rounded up to a power of two so
+      that a growing buffer does not reallocate on every command */
+   pBlock = &pPool->sBlocks[nFree];
+   if (pBlock->buffer != NULL)
+   {
+      TEEC_ReleaseSharedMemory(pBlock);
+   }
+   nBlockSize = STUB_SHARED_MEMORY_MIN_SIZE;
+   while (nBlockSize < nSize)
+   {
+      nBlockSize <<= 1;
+   }
+   memset(pBlock, 0, sizeof(TEEC_SharedMemory));
+   pBlock->size  = nBlockSize;
+   pBlock->flags = TEEC_MEM_INPUT | TEEC_MEM_OUTPUT;
+   if (TEEC_AllocateSharedMemory(&g_sContext, pBlock) != TEEC_SUCCESS)
+   {
+      memset(pBlock, 0, sizeof(TEEC_SharedMemory));
+      pBlock = NULL;
+      goto end;
+   }
+   pPool->bBusy[nFree] = true;
+
+end:
+   libMutexUnlock(&pPool->sMutex);
+   return pBlock;
+}
+
+void stubSharedMemoryRelease(STUB_SHARED_MEMORY_POOL* pPool, TEEC_SharedMemory* pBlock)
+{
+   uint32_t i;
+
+   if (pBlock == NULL)
+   {
+      return;
+   }
+   libMutexLock(&pPool->sMutex);
+   pPool->bBusy[pBlock - pPool->sBlocks] = false;
+
+   /* Shrink back to the low-water mark once the large requests are over
+      and no other thread is using the pool */
+   if (pPool->nSmallUses < STUB_SHARED_MEMORY_TRIM_USES)
+   {
+      goto end;
+   }
+   for (i = 0; i < STUB_SHARED_MEMORY_POOL_BLOCKS; i++)
+   {
+      if (pPool->bBusy[i])
+      {
+         goto end;
+      }
+   }
+   for (i = 0; i < STUB_SHARED_MEMORY_POOL_BLOCKS; i++)
+   {
+      if (pPool->sBlocks[i].buffer != NULL && pPool->sBlocks[i].size > STUB_SHARED_MEMORY_KEEP_SIZE)
+      {
+         TEEC_ReleaseSharedMemory(&pPool->sBlocks[i]);
+         memset(&pPool->sBlocks[i], 0, sizeof(TEEC_SharedMemory));
+      }
+   }
+
+end:
+   libMutexUnlock(&pPool->sMutex);
+}
+
+uint32_t stubSetInputMemref(TEEC_Operation* pOperation, uint32_t nParamIndex,
+                            TEEC_SharedMemory* pBlock, uint32_t nOffset,
+                            const void* pBuffer, uint32_t nSize)
+{
+   TEEC_Parameter* pParam = &pOperation->params[nParamIndex];
+
+   if (pBlock == NULL || pBuffer == NULL)
+   {
+      pParam->tmpref.buffer = (void*)pBuffer;
+      pParam->tmpref.size   = nSize;
+      return TEEC_MEMREF_TEMP_INPUT;
+   }
+   memcpy((uint8_t*)pBlock->buffer + nOffset, pBuffer, nSize);
+   pParam->memref.parent = pBlock;
+   pParam->memref.offset = nOffset;
+   pParam->memref.size   = nSize;
+   return TEEC_MEMREF_PARTIAL_INPUT;
+}
+
+uint32_t stubSetOutputMemref(TEEC_Operation* pOperation, uint32_t nParamIndex,
+                             TEEC_SharedMemory* pBlock, uint32_t nOffset,
+                             void* pBuffer, uint32_t nSize)
+{
+   TEEC_Parameter* pParam = &pOperation->params[nParamIndex];
+
+   if (pBlock == NULL || pBuffer == NULL)
+   {
+      pParam->tmpref.buffer = pBuffer;
+      pParam->tmpref.size   = nSize;
+      return TEEC_MEMREF_TEMP_OUTPUT;
+   }
+   pParam->memref.parent = pBlock;
+   pParam->memref.offset = nOffset;
+   pParam->memref.size   = nSize;
+   return TEEC_MEMREF_PARTIAL_OUTPUT;
+}
+
+void stubGetOutputMemref(TEEC_Operation* pOperation, uint32_t nParamIndex, void* pBuffer, uint32_t nSize)
+{
+   TEEC_Parameter* pParam = &pOperation->params[nParamIndex];
+   uint32_t nParamType = (pOperation->paramTypes >> (4*nParamIndex)) & 0xF;
+
+   if (nParamType != TEEC_MEMREF_PARTIAL_OUTPUT)
+   {
+      /* The data is already in pBuffer */
+      return;
+   }
+   /* memref.size is the size written by the service */
+   if (nSize > pParam->memref.size)
+   {
+      nSize = pParam->memref.size;
+   }
+   memcpy(pBuffer, (uint8_t*)pParam->memref.parent->buffer + pParam->memref.offset, nSize);
+}
+
+uint32_t stubGetOutputMemrefSize(TEEC_Operation* pOperation, uint32_t nParamIndex)
+{
+   TEEC_Parameter* pParam = &pOperation->params[nParamIndex];
+   uint32_t nParamType = (pOperation->paramTypes >> (4*nParamIndex)) & 0xF;
+
+   if (nParamType == TEEC_MEMREF_PARTIAL_OUTPUT)
+   {
+      return (uint32_t)pParam->memref.size;
+   }
+   return (uint32_t)pParam->tmpref.size;
+}
+
 /* ------------------------------------------------------------------------
                           Internal monitor management
 ------------------------------------------------------------------------- */
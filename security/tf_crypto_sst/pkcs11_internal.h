@@ -53,7 +53,7 @@
  * If the size is a multiple of 4, just returns the size
  * Otherwise, return the size so that the (end of the buffer)+1 is 4-bytes aligned.
  */
-#define PKCS11_GET_SIZE_WITH_ALIGNMENT(a)  (uint32_t)(((uint32_t)a+3) & ~3)
+#define PKCS11_GET_SIZE_WITH_ALIGNMENT(a)  (uint32_t)(((uint32_t)(a)+3) & ~3)
 
 
 /**
@@ -71,6 +71,68 @@ void stubMutexUnlock(void);
 TEEC_Result stubInitializeContext(void);
 void stubFinalizeContext(void);
 
+/**
+ * Pool of shared memory blocks allocated in g_sContext and reused across
+ * the commands of a session, so that the data buffers are passed as
+ * registered memrefs instead of temporary memrefs, which the driver must
+ * map and release on every command.
+ *
+ * Blocks are allocated on first use and grown as needed, up to
+ * STUB_SHARED_MEMORY_MAX_SIZE. Larger requests, or requests that find
+ * all the blocks busy, fall back to temporary memrefs.
+ *
+ * Blocks larger than STUB_SHARED_MEMORY_KEEP_SIZE are released once the
+ * pool is idle after STUB_SHARED_MEMORY_TRIM_USES consecutive requests
+ * that would fit in that size, so that a single large command does not
+ * pin its memory for the rest of the session.
+ *
+ * The pool must be destroyed before g_sContext is finalized.
+ */
+#define STUB_SHARED_MEMORY_POOL_BLOCKS  2
+#define STUB_SHARED_MEMORY_MIN_SIZE     (4*1024)
+#define STUB_SHARED_MEMORY_MAX_SIZE     (2*1024*1024)
+#define STUB_SHARED_MEMORY_KEEP_SIZE    (64*1024)
+#define STUB_SHARED_MEMORY_TRIM_USES    16
+
+typedef struct
+{
+   LIB_MUTEX         sMutex;
+   TEEC_SharedMemory sBlocks[STUB_SHARED_MEMORY_POOL_BLOCKS];
+   bool              bBusy[STUB_SHARED_MEMORY_POOL_BLOCKS];
+   /* Consecutive requests of at most STUB_SHARED_MEMORY_KEEP_SIZE */
+   uint32_t          nSmallUses;
+}
+STUB_SHARED_MEMORY_POOL;
+
+void stubSharedMemoryPoolInit(STUB_SHARED_MEMORY_POOL* pPool);
+void stubSharedMemoryPoolDestroy(STUB_SHARED_MEMORY_POOL* pPool);
+
+/**
+ * Returns a block of at least nSize bytes reserved for the caller, or NULL
+ * if temporary memrefs must be used. The block must be given back with
+ * stubSharedMemoryRelease.
+ */
+TEEC_SharedMemory* stubSharedMemoryAcquire(STUB_SHARED_MEMORY_POOL* pPool, uint32_t nSize);
+void stubSharedMemoryRelease(STUB_SHARED_MEMORY_POOL* pPool, TEEC_SharedMemory* pBlock);
+
+/**
+ * Set the parameter nParamIndex of pOperation to a buffer, and return the
+ * parameter type to use. If pBlock is not NULL, the buffer is passed at
+ * offset nOffset of the block: the input data is copied into the block,
+ * and stubGetOutputMemref copies the output data back. Otherwise, the
+ * buffer is passed as a temporary memref. A NULL output buffer is always
+ * passed as a temporary memref, as the service uses it to query the size.
+ */
+uint32_t stubSetInputMemref(TEEC_Operation* pOperation, uint32_t nParamIndex,
+                            TEEC_SharedMemory* pBlock, uint32_t nOffset,
+                            const void* pBuffer, uint32_t nSize);
+uint32_t stubSetOutputMemref(TEEC_Operation* pOperation, uint32_t nParamIndex,
+                             TEEC_SharedMemory* pBlock, uint32_t nOffset,
+                             void* pBuffer, uint32_t nSize);
+void stubGetOutputMemref(TEEC_Operation* pOperation, uint32_t nParamIndex, void* pBuffer, uint32_t nSize);
+/* The output size returned by the service, for either kind of memref */
+uint32_t stubGetOutputMemrefSize(TEEC_Operation* pOperation, uint32_t nParamIndex);
+
 /** Whether the cryptoki library is initialized or not */
 extern bool g_bCryptokiInitialized;
 
@@ -111,6 +173,10 @@ typedef struct
    /* Table of secondary sessions */
    LIB_OBJECT_TABLE_HANDLE16 sSecondarySessionTable;
 
+   /* Shared memory blocks for the data of the primary session and of its
+      secondary sessions */
+   STUB_SHARED_MEMORY_POOL sSharedMemoryPool;
+
 } PKCS11_PRIMARY_SESSION_CONTEXT, * PPKCS11_PRIMARY_SESSION_CONTEXT;
 
 /**
@@ -30,6 +30,10 @@
 
 #include "pkcs11_internal.h"
 
+#ifdef LINUX
+#include <unistd.h>
+#endif
+
 /* ------------------------------------------------------------------------
 Internal Functions
 ------------------------------------------------------------------------- */
@@ -93,6 +97,25 @@ static CK_RV static_checkPreConditionsAndUpdateHandles(
    return CKR_OK;
 }
 
+/**
+* Reserves a block of the session shared memory pool for an input buffer
+* of nInputSize bytes at offset 0, followed by an output buffer of
+* nOutputSize bytes at offset PKCS11_GET_SIZE_WITH_ALIGNMENT(nInputSize).
+* Returns NULL if the buffers must be passed as temporary memrefs.
+*/
+static TEEC_SharedMemory* static_acquireSharedMemory(
+         PPKCS11_PRIMARY_SESSION_CONTEXT pSession,
+         CK_ULONG                        nInputSize,
+         CK_ULONG                        nOutputSize)
+{
+   if ((nInputSize > STUB_SHARED_MEMORY_MAX_SIZE) || (nOutputSize > STUB_SHARED_MEMORY_MAX_SIZE))
+   {
+      return NULL;
+   }
+   return stubSharedMemoryAcquire(&pSession->sSharedMemoryPool,
+                                  PKCS11_GET_SIZE_WITH_ALIGNMENT(nInputSize) + (uint32_t)nOutputSize);
+}
+
 /******************************************/
 /* The buffer must be freed by the caller */
 /******************************************/
@@ -333,6 +356,8 @@ static CK_RV static_C_CallForSingle(
    uint32_t          nCommandIDAndSession = nCommandID;
    uint32_t          nParamType0 = TEEC_NONE;
    uint32_t          nParamType1 = TEEC_NONE;
+   uint32_t          nResultLen = 0;
+   TEEC_SharedMemory* pBlock;
    PPKCS11_PRIMARY_SESSION_CONTEXT pSession;
 
    nErrorCode = static_checkPreConditionsAndUpdateHandles(&hSession, &nCommandIDAndSession, &pSession);
@@ -341,13 +366,18 @@ static CK_RV static_C_CallForSingle(
       return nErrorCode;
    }
 
+   if (bReceive && (pResult != NULL) && (pulResultLen != NULL))
+   {
+      nResultLen = (uint32_t)*pulResultLen;
+   }
+
    memset(&sOperation, 0, sizeof(TEEC_Operation));
 
+   pBlock = static_acquireSharedMemory(pSession, bSend ? ulDataLen : 0, nResultLen);
+
    if (bSend)
    {
-      nParamType0 = TEEC_MEMREF_TEMP_INPUT;
-      sOperation.params[0].tmpref.buffer = (uint8_t*)pData;
-      sOperation.params[0].tmpref.size   = (uint32_t)ulDataLen;
+      nParamType0 = stubSetInputMemref(&sOperation, 0, pBlock, 0, pData, (uint32_t)ulDataLen);
    }
 
    if (bReceive)
@@ -359,19 +389,13 @@ static CK_RV static_C_CallForSingle(
             achieve this result by sending an invalid parameter type */
          nParamType1 = TEEC_NONE;
       }
-      else if (pResult == NULL)
-      {
-         /* If pResult is NULL, the caller only wants the buffer length.
-            Send a NULL output memref */
-         nParamType1 = TEEC_MEMREF_TEMP_OUTPUT;
-         sOperation.params[1].tmpref.buffer = (uint8_t*)NULL;
-      }
       else
       {
-         /* send the result buffer information */
-         nParamType1 = TEEC_MEMREF_TEMP_OUTPUT;
-         sOperation.params[1].tmpref.buffer = (uint8_t*)pResult;
-         sOperation.params[1].tmpref.size   = (uint32_t)*pulResultLen;
+         /* send the result buffer information. If pResult is NULL, the
+            caller only wants the buffer length: a NULL output memref is sent */
+         nParamType1 = stubSetOutputMemref(&sOperation, 1,
+                                           pBlock, PKCS11_GET_SIZE_WITH_ALIGNMENT(bSend ? ulDataLen : 0),
+                                           pResult, nResultLen);
       }
    }
 
@@ -395,13 +419,19 @@ static CK_RV static_C_CallForSingle(
  end:
    if (bReceive)
    {
+      if (nErrorCode == CKR_OK)
+      {
+         /* Copy the data to pResult if it went through the shared memory */
+         stubGetOutputMemref(&sOperation, 1, pResult, nResultLen);
+      }
       if ((nErrorCode == CKR_OK) || (nErrorCode == CKR_BUFFER_TOO_SMALL))
       {
          /* The service has returned the actual result */
-         /* The data is already in pResult, we get the returned length */
-         *pulResultLen = sOperation.params[1].tmpref.size;
+         /* We get the returned length */
+         *pulResultLen = stubGetOutputMemrefSize(&sOperation, 1);
       }
    }
+   stubSharedMemoryRelease(&pSession->sSharedMemoryPool, pBlock);
 
    return nErrorCode;
 }
@@ -431,6 +461,7 @@ static CK_RV static_C_CallUpdate(
    uint32_t          nCommandIDAndSession = nCommandID;
    uint32_t          nParamType0 = TEEC_NONE;
    uint32_t          nParamType1 = TEEC_NONE;
+   TEEC_SharedMemory* pBlock;
    PPKCS11_PRIMARY_SESSION_CONTEXT pSession;
 
    nErrorCode = static_checkPreConditionsAndUpdateHandles(&hSession, &nCommandIDAndSession, &pSession);
@@ -439,18 +470,18 @@ static CK_RV static_C_CallUpdate(
       return nErrorCode;
    }
 
-   if (pulResultLen != NULL)
+   if (bReceive && (pResult != NULL) && (pulResultLen != NULL))
    {
-      nResultLen = *pulResultLen;
+      nResultLen = (uint32_t)*pulResultLen;
    }
 
    memset(&sOperation, 0, sizeof(TEEC_Operation));
 
+   pBlock = static_acquireSharedMemory(pSession, bSend ? ulDataLen : 0, nResultLen);
+
    if (bSend)
    {
-      nParamType0 = TEEC_MEMREF_TEMP_INPUT;
-      sOperation.params[0].tmpref.buffer = (void*)pData;
-      sOperation.params[0].tmpref.size   = ulDataLen;
+      nParamType0 = stubSetInputMemref(&sOperation, 0, pBlock, 0, pData, (uint32_t)ulDataLen);
    }
 
    if (bReceive)
@@ -462,19 +493,14 @@ static CK_RV static_C_CallUpdate(
             achieve this result by setting an invalid parameter type */
          nParamType1 = TEEC_NONE;
       }
-      else if (pResult == NULL)
-      {
-         /* If pResult is NULL, the caller only wants the output buffer length.
-            Pass a NULL output ref */
-         nParamType1 = TEEC_MEMREF_TEMP_OUTPUT;
-         sOperation.params[1].tmpref.buffer = NULL;
-      }
       else
       {
-         /* send the result buffer information */
-         nParamType1 = TEEC_MEMREF_TEMP_OUTPUT;
-         sOperation.params[1].tmpref.buffer = pResult;
-         sOperation.params[1].tmpref.size   = (uint32_t)*pulResultLen;
+         /* send the result buffer information. If pResult is NULL, the
+            caller only wants the output buffer length: a NULL output ref
+            is passed */
+         nParamType1 = stubSetOutputMemref(&sOperation, 1,
+                                           pBlock, PKCS11_GET_SIZE_WITH_ALIGNMENT(bSend ? ulDataLen : 0),
+                                           pResult, nResultLen);
       }
    }
 
@@ -498,19 +524,228 @@ static CK_RV static_C_CallUpdate(
  end:
    if (bReceive)
    {
+      if (nErrorCode == CKR_OK)
+      {
+         /* Copy the data to pResult if it went through the shared memory */
+         stubGetOutputMemref(&sOperation, 1, pResult, nResultLen);
+      }
       if ((nErrorCode == CKR_OK) || (nErrorCode == CKR_BUFFER_TOO_SMALL))
       {
          /* The service has returned the actual result */
-         /* The data is already in pResult, we get the returned length */
-         *pulResultLen = sOperation.params[1].tmpref.size;
+         /* We get the returned length */
+         *pulResultLen = stubGetOutputMemrefSize(&sOperation, 1);
       }
    }
+   stubSharedMemoryRelease(&pSession->sSharedMemoryPool, pBlock);
 
    return nErrorCode;
 }
 
-/* Splits the buffer pData in chunks of nChunkSize size
- * and calls static_C_CallUpdate for each chunk
+/**
+* Copies done around the processing of a chunk by the service: the output
+* of the previous chunk is copied back to the caller buffer, then the
+* input of the next chunk is copied into its block.
+*/
+typedef struct
+{
+   CK_BYTE*          pResult;
+   const uint8_t*    pResultBlock;
+   uint32_t          nResultLen;
+   uint8_t*          pDataBlock;
+   const CK_BYTE*    pData;
+   uint32_t          nDataLen;
+}
+PKCS11_STAGING_JOB;
+
+/* Below this size, the copies are not worth a thread */
+#define PKCS11_STAGING_THREAD_MIN_SIZE  (64*1024)
+
+static void* static_runStagingJob(void* pArg)
+{
+   PKCS11_STAGING_JOB* pJob = (PKCS11_STAGING_JOB*)pArg;
+
+   if (pJob->nResultLen != 0)
+   {
+      memcpy(pJob->pResult, pJob->pResultBlock, pJob->nResultLen);
+   }
+   if (pJob->nDataLen != 0)
+   {
+      memcpy(pJob->pDataBlock, pJob->pData, pJob->nDataLen);
+   }
+   return NULL;
+}
+
+#ifdef LINUX
+/**
+* Whether a staging thread can run beside the calling thread
+*/
+static bool static_canOverlapStaging(void)
+{
+   static int32_t nProcessors = 0;
+
+   if (nProcessors == 0)
+   {
+      nProcessors = (int32_t)sysconf(_SC_NPROCESSORS_ONLN);
+   }
+   return (nProcessors > 1);
+}
+#endif
+
+/**
+* Streams pData through the shared memory blocks ppBlocks[0] and
+* ppBlocks[1] in chunks of nChunkSize bytes. Each block holds the input of
+* a chunk at offset 0 and, if bReceive, its output at offset nChunkSize.
+*
+* When both blocks are available, the copies of the previous and next
+* chunks are done by a staging thread while the service processes the
+* current chunk in the other block. With ppBlocks[1] == NULL, the copies
+* are done between the commands.
+*
+* The output is only supported for symmetric operations, that produce
+* as many bytes as they consume.
+*/
+static CK_RV static_C_CallPipelinedUpdate(
+                           PPKCS11_PRIMARY_SESSION_CONTEXT pSession,
+                           uint32_t           nCommandIDAndSession,
+                           TEEC_SharedMemory** ppBlocks,
+                           uint32_t           nChunkSize,
+                           const CK_BYTE*     pData,
+                           CK_ULONG           ulDataLen,
+                           CK_BYTE*           pResult,
+                           CK_ULONG           ulResultLen,
+                           CK_ULONG*          pulResultLen,
+                           bool               bReceive)
+{
+   TEEC_Result          teeErr;
+   uint32_t             nErrorOrigin;
+   TEEC_Operation       sOperation;
+   CK_RV                nErrorCode = CKR_OK;
+   PKCS11_STAGING_JOB   sJob;
+   TEEC_SharedMemory*   pBlock;
+   uint32_t             nBlock = 0;
+   uint32_t             nPartDataLen;
+   uint32_t             nPartResultLen;
+   uint32_t             nNextDataLen;
+   bool                 bThread;
+#ifdef LINUX
+   pthread_t            hThread;
+#endif
+
+   memset(&sJob, 0, sizeof(PKCS11_STAGING_JOB));
+
+   /* Stage the first chunk */
+   nPartDataLen = (ulDataLen <= nChunkSize ? (uint32_t)ulDataLen : nChunkSize);
+   memcpy(ppBlocks[0]->buffer, pData, nPartDataLen);
+
+   while (ulDataLen > 0)
+   {
+      pBlock = ppBlocks[nBlock];
+      nPartResultLen = 0;
+      if (bReceive)
+      {
+         nPartResultLen = (ulResultLen <= nChunkSize ? (uint32_t)ulResultLen : nChunkSize);
+      }
+      nNextDataLen = (ulDataLen - nPartDataLen <= nChunkSize ?
+                        (uint32_t)(ulDataLen - nPartDataLen) : nChunkSize);
+
+      memset(&sOperation, 0, sizeof(TEEC_Operation));
+      sOperation.params[0].memref.parent = pBlock;
+      sOperation.params[0].memref.offset = 0;
+      sOperation.params[0].memref.size   = nPartDataLen;
+      sOperation.params[1].memref.parent = pBlock;
+      sOperation.params[1].memref.offset = nChunkSize;
+      sOperation.params[1].memref.size   = nPartResultLen;
+      sOperation.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT,
+                                               bReceive ? TEEC_MEMREF_PARTIAL_OUTPUT : TEEC_NONE,
+                                               TEEC_NONE, TEEC_NONE);
+
+      /* With two blocks, copy back the previous output and stage the next
+         input in the other block while the service works on this one */
+      bThread = false;
+      if (ppBlocks[1] != NULL)
+      {
+         sJob.pDataBlock = (uint8_t*)ppBlocks[nBlock ^ 1]->buffer;
+         sJob.pData      = pData + nPartDataLen;
+         sJob.nDataLen   = nNextDataLen;
+#ifdef LINUX
+         if ((sJob.nResultLen + sJob.nDataLen >= PKCS11_STAGING_THREAD_MIN_SIZE) &&
+             static_canOverlapStaging())
+         {
+            bThread = (pthread_create(&hThread, NULL, static_runStagingJob, &sJob) == 0);
+         }
+#endif
+      }
+
+      teeErr = TEEC_InvokeCommand(   &pSession->sSession,
+                                     nCommandIDAndSession,        /* commandID */
+                                     &sOperation,                 /* IN OUT operation */
+                                     &nErrorOrigin                /* OUT returnOrigin, optional */
+                                    );
+      if (bThread)
+      {
+#ifdef LINUX
+         pthread_join(hThread, NULL);
+#endif
+      }
+      else if (ppBlocks[1] != NULL)
+      {
+         /* Without a thread, the copies are done after the command, so that
+            the service still finds the current chunk in the cache */
+         static_runStagingJob(&sJob);
+      }
+      if (teeErr != TEEC_SUCCESS)
+      {
+         return (nErrorOrigin == TEEC_ORIGIN_TRUSTED_APP ?
+                  teeErr :
+                  ckInternalTeeErrorToCKError(teeErr));
+      }
+
+      if (bReceive)
+      {
+         /* memref.size is the size written by the service */
+         nPartResultLen = (uint32_t)sOperation.params[1].memref.size;
+      }
+      sJob.pResult      = pResult;
+      sJob.pResultBlock = (uint8_t*)pBlock->buffer + nChunkSize;
+      sJob.nResultLen   = nPartResultLen;
+
+      if (ppBlocks[1] == NULL)
+      {
+         /* A single block: the output must be copied back before the next
+            input overwrites the block */
+         sJob.pDataBlock = (uint8_t*)pBlock->buffer;
+         sJob.pData      = pData + nPartDataLen;
+         sJob.nDataLen   = nNextDataLen;
+         static_runStagingJob(&sJob);
+         sJob.nResultLen = 0;
+      }
+      else
+      {
+         nBlock ^= 1;
+      }
+
+      ulDataLen -= nPartDataLen;
+      pData += nPartDataLen;
+      if (bReceive)
+      {
+         ulResultLen -= nPartResultLen;
+         pResult += nPartResultLen;
+         *pulResultLen += nPartResultLen;
+      }
+      nPartDataLen = nNextDataLen;
+   }
+
+   /* Copy back the output of the last chunk */
+   sJob.nDataLen = 0;
+   static_runStagingJob(&sJob);
+
+   return nErrorCode;
+}
+
+/* Splits the buffer pData in chunks and calls the service for each chunk.
+ * The chunks go through the shared memory pool of the session, in chunks of
+ * nSharedChunkSize, or if the pool has no block available as temporary
+ * memrefs of nChunkSize with static_C_CallUpdate
  */
 static CK_RV static_C_CallSplitUpdate(
                            uint32_t           nCommandID,
@@ -521,13 +756,18 @@ static CK_RV static_C_CallSplitUpdate(
                            CK_ULONG*          pulResultLen,
                            bool               bSend,
                            bool               bReceive,
-                           uint32_t           nChunkSize)
+                           uint32_t           nChunkSize,
+                           uint32_t           nSharedChunkSize)
 {
    CK_RV nErrorCode;
    CK_ULONG nPartDataLen;
    CK_ULONG nPartResultLen = 0;
    CK_ULONG ulResultLen = 0;
    bool bIsSymOperation = false;
+   CK_SESSION_HANDLE hCryptoSession = hSession;
+   uint32_t nCommandIDAndSession = nCommandID;
+   TEEC_SharedMemory* pBlocks[2];
+   PPKCS11_PRIMARY_SESSION_CONTEXT pSession;
 
    if (pulResultLen != NULL)
    {
@@ -540,6 +780,31 @@ static CK_RV static_C_CallSplitUpdate(
       *pulResultLen = 0;
    }
 
+   if (bSend &&
+       ((!bReceive) || (bIsSymOperation && (pResult != NULL))) &&
+       (static_checkPreConditionsAndUpdateHandles(&hCryptoSession, &nCommandIDAndSession, &pSession) == CKR_OK))
+   {
+      pBlocks[0] = static_acquireSharedMemory(pSession, nSharedChunkSize, bReceive ? nSharedChunkSize : 0);
+      if (pBlocks[0] != NULL)
+      {
+         /* The second block is optional */
+         pBlocks[1] = static_acquireSharedMemory(pSession, nSharedChunkSize, bReceive ? nSharedChunkSize : 0);
+         nErrorCode = static_C_CallPipelinedUpdate(pSession,
+                                 nCommandIDAndSession,
+                                 pBlocks,
+                                 nSharedChunkSize,
+                                 pData,
+                                 ulDataLen,
+                                 pResult,
+                                 ulResultLen,
+                                 pulResultLen,
+                                 bReceive);
+         stubSharedMemoryRelease(&pSession->sSharedMemoryPool, pBlocks[1]);
+         stubSharedMemoryRelease(&pSession->sSharedMemoryPool, pBlocks[0]);
+         return nErrorCode;
+      }
+   }
+
    while (ulDataLen > 0)
    {
       nPartDataLen = (ulDataLen <= nChunkSize ?
@@ -600,6 +865,7 @@ static CK_RV static_C_Call_CallForUpdate(
 {
    CK_RV                   nErrorCode;
    uint32_t                nChunkSize;
+   uint32_t                nSharedChunkSize;
 
    TEEC_ImplementationLimits  limits;
 
@@ -616,6 +882,24 @@ static CK_RV static_C_Call_CallForUpdate(
    */
    nChunkSize = limits.tmprefMaxSize - limits.pageSize;
 
+   /* Registered memory is not mapped per command, so the chunks can be as
+      large as a block of the session pool, holding the input and the
+      output of the chunk */
+   nSharedChunkSize = STUB_SHARED_MEMORY_MAX_SIZE;
+   if ((limits.sharedMemMaxSize != 0) && (limits.sharedMemMaxSize < nSharedChunkSize))
+   {
+      nSharedChunkSize = limits.sharedMemMaxSize;
+   }
+   if (bReceive)
+   {
+      nSharedChunkSize /= 2;
+   }
+   nSharedChunkSize &= ~(limits.pageSize - 1);
+   if (nSharedChunkSize < nChunkSize)
+   {
+      nSharedChunkSize = nChunkSize;
+   }
+
    if (ulDataLen > nChunkSize)
    {
       /* inoutMaxSize = 0  means unlimited size */
@@ -627,7 +911,8 @@ static CK_RV static_C_Call_CallForUpdate(
                                  pulResultLen,
                                  bSend,
                                  bReceive,
-                                 nChunkSize);
+                                 nChunkSize,
+                                 nSharedChunkSize);
    }
    else
    {
@@ -1387,6 +1672,8 @@ CK_RV PKCS11_EXPORT C_SeedRandom(
    TEEC_Operation sOperation;
    CK_RV       nErrorCode = CKR_OK;
    uint32_t    nCommandIDAndSession = SERVICE_SYSTEM_PKCS11_C_SEEDRANDOM_COMMAND_ID;
+   uint32_t    nParamType0;
+   TEEC_SharedMemory* pBlock;
    PPKCS11_PRIMARY_SESSION_CONTEXT pSession;
 
    nErrorCode = static_checkPreConditionsAndUpdateHandles(&hSession, &nCommandIDAndSession, &pSession);
@@ -1395,14 +1682,15 @@ CK_RV PKCS11_EXPORT C_SeedRandom(
       return nErrorCode;
    }
    memset(&sOperation, 0, sizeof(TEEC_Operation));
-   sOperation.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
-   sOperation.params[0].tmpref.buffer = (uint8_t*)pSeed;
-   sOperation.params[0].tmpref.size   = (uint32_t)ulSeedLen;
+   pBlock = static_acquireSharedMemory(pSession, ulSeedLen, 0);
+   nParamType0 = stubSetInputMemref(&sOperation, 0, pBlock, 0, pSeed, (uint32_t)ulSeedLen);
+   sOperation.paramTypes = TEEC_PARAM_TYPES(nParamType0, TEEC_NONE, TEEC_NONE, TEEC_NONE);
    teeErr = TEEC_InvokeCommand(   &pSession->sSession,
                                   nCommandIDAndSession,        /* commandID */
                                   &sOperation,                 /* IN OUT operation */
                                   &nErrorOrigin                /* OUT returnOrigin, optional */
                                  );
+   stubSharedMemoryRelease(&pSession->sSharedMemoryPool, pBlock);
 
    nErrorCode = (nErrorOrigin == TEEC_ORIGIN_TRUSTED_APP ?
                   teeErr :
@@ -1420,6 +1708,7 @@ CK_RV PKCS11_EXPORT C_GenerateRandom(
    TEEC_Operation sOperation;
    CK_RV       nErrorCode = CKR_OK;
    uint32_t    nCommandIDAndSession = SERVICE_SYSTEM_PKCS11_C_GENERATERANDOM_COMMAND_ID;
+   TEEC_SharedMemory* pBlock;
    PPKCS11_PRIMARY_SESSION_CONTEXT pSession;
 
    nErrorCode = static_checkPreConditionsAndUpdateHandles(&hSession, &nCommandIDAndSession, &pSession);
@@ -1428,18 +1717,21 @@ CK_RV PKCS11_EXPORT C_GenerateRandom(
       return nErrorCode;
    }
 
+   /* The same block serves all the 1024-byte requests */
+   pBlock = static_acquireSharedMemory(pSession, 0, ulRandomLen < 1024 ? ulRandomLen : 1024);
+
    do
    {
       CK_ULONG nArrayLength;
+      uint32_t nParamType0;
       nArrayLength = 1024;
       if (ulRandomLen < nArrayLength)
       {
          nArrayLength = ulRandomLen;
       }
       memset(&sOperation, 0, sizeof(TEEC_Operation));
-      sOperation.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
-      sOperation.params[0].tmpref.buffer = (uint8_t*)pRandomData;
-      sOperation.params[0].tmpref.size   = (uint32_t)nArrayLength;
+      nParamType0 = stubSetOutputMemref(&sOperation, 0, pBlock, 0, pRandomData, (uint32_t)nArrayLength);
+      sOperation.paramTypes = TEEC_PARAM_TYPES(nParamType0, TEEC_NONE, TEEC_NONE, TEEC_NONE);
       teeErr = TEEC_InvokeCommand(   &pSession->sSession,
                                      nCommandIDAndSession,        /* commandID */
                                      &sOperation,                 /* IN OUT operation */
@@ -1447,11 +1739,13 @@ CK_RV PKCS11_EXPORT C_GenerateRandom(
                                     );
       if (teeErr != TEEC_SUCCESS)
       {
+         stubSharedMemoryRelease(&pSession->sSharedMemoryPool, pBlock);
          nErrorCode = (nErrorOrigin == TEEC_ORIGIN_TRUSTED_APP ?
                         teeErr :
                         ckInternalTeeErrorToCKError(teeErr));
          return nErrorCode;
       }
+      stubGetOutputMemref(&sOperation, 0, pRandomData, (uint32_t)nArrayLength);
 
       ulRandomLen -= nArrayLength;
       pRandomData += nArrayLength;
@@ -1462,6 +1756,7 @@ CK_RV PKCS11_EXPORT C_GenerateRandom(
    }
    while(1);
 
+   stubSharedMemoryRelease(&pSession->sSharedMemoryPool, pBlock);
    return CKR_OK;
 }
 
@@ -1489,6 +1784,9 @@ CK_RV PKCS11_EXPORT C_Verify(
    TEEC_Operation sOperation;
    CK_RV       nErrorCode = CKR_OK;
    uint32_t    nCommandIDAndSession = SERVICE_SYSTEM_PKCS11_C_VERIFY_COMMAND_ID;
+   uint32_t    nParamType0;
+   uint32_t    nParamType1;
+   TEEC_SharedMemory* pBlock;
    PPKCS11_PRIMARY_SESSION_CONTEXT pSession;
 
    nErrorCode = static_checkPreConditionsAndUpdateHandles(&hSession, &nCommandIDAndSession, &pSession);
@@ -1498,16 +1796,18 @@ CK_RV PKCS11_EXPORT C_Verify(
    }
 
    memset(&sOperation, 0, sizeof(TEEC_Operation));
-   sOperation.params[0].tmpref.buffer = (uint8_t*)pData;
-   sOperation.params[0].tmpref.size   = (uint32_t)ulDataLen;
-   sOperation.params[1].tmpref.buffer = (uint8_t*)pSignature;
-   sOperation.params[1].tmpref.size   = (uint32_t)ulSignatureLen;
-   sOperation.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE);
+   /* The signature follows the data in the shared memory block */
+   pBlock = static_acquireSharedMemory(pSession, ulDataLen, ulSignatureLen);
+   nParamType0 = stubSetInputMemref(&sOperation, 0, pBlock, 0, pData, (uint32_t)ulDataLen);
+   nParamType1 = stubSetInputMemref(&sOperation, 1, pBlock, PKCS11_GET_SIZE_WITH_ALIGNMENT(ulDataLen),
+                                    pSignature, (uint32_t)ulSignatureLen);
+   sOperation.paramTypes = TEEC_PARAM_TYPES(nParamType0, nParamType1, TEEC_NONE, TEEC_NONE);
    teeErr = TEEC_InvokeCommand(   &pSession->sSession,
                                   nCommandIDAndSession,        /* commandID */
                                   &sOperation,                 /* IN OUT operation */
                                   &nErrorOrigin                /* OUT returnOrigin, optional */
                                  );
+   stubSharedMemoryRelease(&pSession->sSharedMemoryPool, pBlock);
    nErrorCode = (nErrorOrigin == TEEC_ORIGIN_TRUSTED_APP ?
                   teeErr :
                   ckInternalTeeErrorToCKError(teeErr));
@@ -94,13 +94,15 @@ CK_RV PKCS11_EXPORT C_OpenSession(CK_SLOT_ID              slotID,        /* the
       pSession->sHeader.nMagicWord  = PKCS11_SESSION_MAGIC;
       pSession->sHeader.nSessionTag = PKCS11_PRIMARY_SESSION_TAG;
       memset(&pSession->sSession, 0, sizeof(TEEC_Session));
-      pSession->sSecondarySessionTable.pRoot = NULL_PTR;
+      memset(&pSession->sSecondarySessionTable, 0,
+               sizeof(pSession->sSecondarySessionTable));
 
       /* The structure must be initialized first (in a portable manner)
          to make it work on Win32 */
       memset(&pSession->sSecondarySessionTableMutex, 0,
                sizeof(pSession->sSecondarySessionTableMutex));
       libMutexInit(&pSession->sSecondarySessionTableMutex);
+      stubSharedMemoryPoolInit(&pSession->sSharedMemoryPool);
 
       switch (slotID)
       {
@@ -275,6 +277,7 @@ error:
 
    if ((flags & CKVF_OPEN_SUB_SESSION) == 0)
    {
+      stubSharedMemoryPoolDestroy(&pSession->sSharedMemoryPool);
       libMutexDestroy(&pSession->sSecondarySessionTableMutex);
       free(pSession);
    }
@@ -352,6 +355,7 @@ CK_RV PKCS11_EXPORT C_CloseSession(CK_SESSION_HANDLE hSession) /* the session's
       libMutexUnlock(&pSession->sSecondarySessionTableMutex);
 
       libMutexDestroy(&pSession->sSecondarySessionTableMutex);
+      stubSharedMemoryPoolDestroy(&pSession->sSharedMemoryPool);
 
       /* free primary session context */
       free(pSession);
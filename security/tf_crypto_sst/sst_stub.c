@@ -46,6 +46,9 @@
 static TEEC_Session g_SSTSession;
 static bool g_bSSTInitialized = false;
 
+/* Shared memory blocks for the SSTRead and SSTWrite data */
+static STUB_SHARED_MEMORY_POOL g_sSSTSharedMemoryPool;
+
 
 /* ------------------------------------------------------------------------
             TEEC -> SST error code translation
@@ -137,6 +140,7 @@ SST_ERROR SST_EXPORT_API SSTInit(void)
       goto end_finalize_context;
    }
 
+   stubSharedMemoryPoolInit(&g_sSSTSharedMemoryPool);
    g_bSSTInitialized = true;
    stubMutexUnlock();
    return SST_SUCCESS;
@@ -154,6 +158,7 @@ SST_ERROR SST_EXPORT_API SSTTerminate(void)
    if (g_bSSTInitialized)
    {
       TEEC_CloseSession(&g_SSTSession);
+      stubSharedMemoryPoolDestroy(&g_sSSTSharedMemoryPool);
       stubFinalizeContext();
       g_bSSTInitialized = false;
    }
@@ -334,6 +339,8 @@ SST_ERROR SST_EXPORT_API SSTWrite(SST_HANDLE       hFile,
    TEEC_Result       nError;
    TEEC_Operation    sOperation;
    uint32_t          nReturnOrigin;
+   uint32_t          nParamType1;
+   TEEC_SharedMemory* pBlock;
 
    if (pBuffer == NULL)
    {
@@ -351,16 +358,17 @@ SST_ERROR SST_EXPORT_API SSTWrite(SST_HANDLE       hFile,
       return SST_ERROR_GENERIC;
    }
 
-   sOperation.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE);
+   pBlock = stubSharedMemoryAcquire(&g_sSSTSharedMemoryPool, nSize);
+   nParamType1 = stubSetInputMemref(&sOperation, 1, pBlock, 0, pBuffer, nSize);
+   sOperation.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, nParamType1, TEEC_NONE, TEEC_NONE);
    sOperation.params[0].value.a       = hFile;
-   sOperation.params[1].tmpref.buffer = (void*)pBuffer;
-   sOperation.params[1].tmpref.size   = nSize;
 
    nError = TEEC_InvokeCommand(pSession,
                                SERVICE_SYSTEM_SST_WRITE_COMMAND_ID, /* commandID */
                                &sOperation,                  /* IN OUT operation */
                                &nReturnOrigin            /* OUT returnOrigin, optional */
                               );
+   stubSharedMemoryRelease(&g_sSSTSharedMemoryPool, pBlock);
 
    return static_SSTConvertErrorCode(nError);
 }
@@ -375,6 +383,8 @@ SST_ERROR SST_EXPORT_API SSTRead(SST_HANDLE   hFile,
    TEEC_Result       nError;
    TEEC_Operation    sOperation;
    uint32_t          nReturnOrigin;
+   uint32_t          nParamType1;
+   TEEC_SharedMemory* pBlock;
 
    if ((pBuffer == NULL) || (pnCount == NULL))
    {
@@ -393,10 +403,10 @@ SST_ERROR SST_EXPORT_API SSTRead(SST_HANDLE   hFile,
       return SST_SUCCESS;
    }
 
-   sOperation.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE, TEEC_NONE);
+   pBlock = stubSharedMemoryAcquire(&g_sSSTSharedMemoryPool, nSize);
+   nParamType1 = stubSetOutputMemref(&sOperation, 1, pBlock, 0, pBuffer, nSize);
+   sOperation.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, nParamType1, TEEC_NONE, TEEC_NONE);
    sOperation.params[0].value.a       = hFile;
-   sOperation.params[1].tmpref.buffer = pBuffer;
-   sOperation.params[1].tmpref.size   = nSize;
 
    nError = TEEC_InvokeCommand(pSession,
                                SERVICE_SYSTEM_SST_READ_COMMAND_ID, /* commandID */
@@ -404,7 +414,13 @@ SST_ERROR SST_EXPORT_API SSTRead(SST_HANDLE   hFile,
                                &nReturnOrigin            /* OUT returnOrigin, optional */
                               );
 
-   *pnCount = sOperation.params[1].tmpref.size; /* The returned buffer size */
+   if (nError == TEEC_SUCCESS)
+   {
+      stubGetOutputMemref(&sOperation, 1, pBuffer, nSize);
+   }
+   stubSharedMemoryRelease(&g_sSSTSharedMemoryPool, pBlock);
+
+   *pnCount = stubGetOutputMemrefSize(&sOperation, 1); /* The returned buffer size */
    return static_SSTConvertErrorCode(nError);
 }
 
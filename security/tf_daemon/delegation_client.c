@@ -34,6 +34,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 /*
  * When porting to a new OS, insert here the appropriate include files
@@ -62,6 +63,7 @@ int fdatasync(int fd);
 #include <syslog.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <pthread.h>
 #include <semaphore.h>
 #define PATH_SEPARATOR '/'
@@ -83,6 +85,7 @@ int fdatasync(int fd);
 #include <assert.h>
 
 #include "service_delegation_protocol.h"
+#include "delegation_trace.h"
 
 #include "s_version.h"
 #include "s_error.h"
@@ -388,6 +391,50 @@ static char* g_pPartitionNames[16];
  */
 static FILE* g_pPartitionFiles[16];
 
+/* READ and WRITE instructions queued for coalescing, see queueSectorIO */
+typedef struct
+{
+   uint32_t nPartitionID;
+   bool     bWrite;
+   uint32_t nSectorIndex;
+   uint32_t nWorkspaceOffset;
+} DELEGATION_SECTOR_IO;
+
+static DELEGATION_SECTOR_IO g_sPendingIO[ECHANGE_BUFFER_INSTRUCTIONS_NB];
+static uint32_t g_nPendingIO;
+
+/* When not NULL, the instruction batches are recorded to this file */
+static FILE* g_pRecordFile;
+
+/* SYNC instructions are acknowledged when received but the data is only
+   synchronized with the file-system when the partition is next modified
+   or closed, or at the end of the instruction batch, see syncPartition.
+   Back-to-back SYNCs thus cost a single one. g_nPendingSyncs counts the
+   acknowledged SYNCs of each partition. A partition is dirty when it may
+   have been modified since its last successful synchronization; all of
+   them are dirty at start-up since a previous daemon may have left
+   unsynchronized data. */
+static uint32_t g_nPendingSyncs[16];
+static bool g_bPartitionDirty[16] = {
+   true, true, true, true, true, true, true, true,
+   true, true, true, true, true, true, true, true };
+
+/* Partitions are enlarged by writes of this many bytes */
+#define PARTITION_FILL_BUFFER_SIZE (64*1024)
+static uint8_t g_pFillBuffer[PARTITION_FILL_BUFFER_SIZE];
+
+/* Counters and cumulated times, in microseconds, of the partition growths
+   and synchronizations. Logged at shutdown */
+static struct
+{
+   uint32_t nGrowCount;
+   uint64_t nGrowBytes;
+   uint64_t nGrowTime;
+   uint32_t nSyncInstructions;
+   uint32_t nSyncCalls;
+   uint64_t nSyncTime;
+} g_sPartitionStats;
+
 /*----------------------------------------------------------------------------
  * Utilities functions
  *----------------------------------------------------------------------------*/
@@ -406,6 +453,7 @@ static void printUsage(void)
 #endif
    LogInfo("-d         Turns on debug mode.  If not specified, the daemon will fork itself");
    LogInfo("           and get detached from the console.");
+   LogInfo("-record <file>  Record the instructions received to <file>, for replay on a host.");
 #ifndef SUPPORT_DELEGATION_EXTENSION
    LogInfo("-workspaceSize <integer>  Set the size in bytes of the workspace. Must be greater or equal to 8 sectors.");
    LogInfo("           (default is 128KB)");
@@ -508,6 +556,35 @@ int static_checkStorageDirAndAccessRights(char * directoryName)
 
 
 
+/**
+ * Returns a monotonic time in microseconds, used for the partition statistics
+ **/
+static uint64_t getTimeUs(void)
+{
+#if defined(LINUX) || (defined __ANDROID32__)
+   struct timespec sNow;
+   clock_gettime(CLOCK_MONOTONIC, &sNow);
+   return (uint64_t)sNow.tv_sec * 1000000 + sNow.tv_nsec / 1000;
+#else
+   return 0;
+#endif
+}
+
+/**
+ * Logs the partition growth and synchronization statistics
+ **/
+static void logPartitionStats(void)
+{
+   LogInfo("Partition growths: %u, %u KB in %u ms",
+      g_sPartitionStats.nGrowCount,
+      (uint32_t)(g_sPartitionStats.nGrowBytes / 1024),
+      (uint32_t)(g_sPartitionStats.nGrowTime / 1000));
+   LogInfo("Partition syncs: %u SYNC instructions, %u synchronizations in %u ms",
+      g_sPartitionStats.nSyncInstructions,
+      g_sPartitionStats.nSyncCalls,
+      (uint32_t)(g_sPartitionStats.nSyncTime / 1000));
+}
+
 /*----------------------------------------------------------------------------
  * Instructions
  *----------------------------------------------------------------------------*/
@@ -560,6 +637,8 @@ static TEEC_Result partitionCreate(uint32_t nPartitionID)
       return S_ERROR_BAD_STATE;
    }
 
+   g_bPartitionDirty[nPartitionID] = true;
+
    /* Create the file unconditionnally */
    LogInfo("Create storage file \"%s\"", g_pPartitionNames[nPartitionID]);
    g_pPartitionFiles[nPartitionID] = fopen(g_pPartitionNames[nPartitionID], "w+b");
@@ -625,80 +704,105 @@ static TEEC_Result partitionOpen(uint32_t nPartitionID, uint32_t* pnPartitionSiz
 
 
 /**
- * This function executes the CLOSE_PARTITION instruction.
- * It closes the partition file.
+ * This function executes the SYNC instruction. The synchronization itself
+ * is deferred to syncPartition, so that back-to-back SYNCs of a partition
+ * cost a single one.
  *
- * @param nPartitionID: the partition identifier
+ * @param pPartitionID: the partition identifier
  **/
-static TEEC_Result partitionClose(uint32_t nPartitionID)
+static TEEC_Result partitionSync(uint32_t nPartitionID)
 {
    if (g_pPartitionFiles[nPartitionID] == NULL)
    {
-      /* The partition is currently not opened */
+      /* The partition is not currently opened */
       return S_ERROR_BAD_STATE;
    }
-   fclose(g_pPartitionFiles[nPartitionID]);
-   g_pPartitionFiles[nPartitionID] = NULL;
+   g_sPartitionStats.nSyncInstructions++;
+   g_nPendingSyncs[nPartitionID]++;
    return S_SUCCESS;
 }
 
 /**
- * This function executes the READ instruction.
+ * This function synchronizes a partition with the file-system if SYNC
+ * instructions are pending on it, and counts them as executed if the
+ * synchronization succeeds. A partition that has not been modified since
+ * its last synchronization is not synchronized again.
  *
- * @param nPartitionID: the partition identifier
- * @param nSectorIndex: the index of the sector to read
- * @param nWorkspaceOffset: the offset in the workspace where the sector must be written
+ * @param pPartitionID: the partition identifier
  **/
-static TEEC_Result partitionRead(uint32_t nPartitionID, uint32_t nSectorIndex, uint32_t nWorkspaceOffset)
+static TEEC_Result syncPartition(uint32_t nPartitionID)
 {
-   FILE* pFile;
-
-   TRACE_INFO(">Partition %1X: read sector 0x%08X into workspace at offset 0x%08X",
-      nPartitionID, nSectorIndex, nWorkspaceOffset);
+   TEEC_Result nError = S_SUCCESS;
+   int result;
+   uint64_t nStart;
 
-   pFile = g_pPartitionFiles[nPartitionID];
+   FILE* pFile = g_pPartitionFiles[nPartitionID];
 
-   if (pFile == NULL)
+   if (g_nPendingSyncs[nPartitionID] == 0)
    {
-      /* The partition is not opened */
-      return S_ERROR_BAD_STATE;
+      return S_SUCCESS;
+   }
+   if (!g_bPartitionDirty[nPartitionID])
+   {
+      goto end;
    }
+   nStart = getTimeUs();
 
-   if (fseek(pFile, nSectorIndex*g_nSectorSize, SEEK_SET) != 0)
+   /* First make sure that the data in the stdio buffers
+      is flushed to the file descriptor */
+   result=fflush(pFile);
+   if (result)
    {
-      LogError("fseek error: %s", strerror(errno));
-      return errno2serror();
+      nError=errno2serror();
+      goto end;
    }
+   /* Then synchronize the file descriptor with the file-system */
 
-   if (fread(g_pWorkspaceBuffer + nWorkspaceOffset,
-             g_nSectorSize, 1,
-             pFile) != 1)
+#if defined(LINUX) || (defined __ANDROID32__)
+   result=fdatasync(fileno(pFile));
+#endif
+#if defined (__SYMBIAN32__)
+   result=fsync(fileno(pFile));
+#endif
+#ifdef WIN32
+   result=_commit(_fileno(pFile));
+#endif
+   g_sPartitionStats.nSyncCalls++;
+   g_sPartitionStats.nSyncTime += getTimeUs() - nStart;
+   if (result)
    {
-      if (feof(pFile))
-      {
-         LogError("fread error: End-Of-File detected");
-         return S_ERROR_ITEM_NOT_FOUND;
-      }
-      LogError("fread error: %s", strerror(errno));
-      return errno2serror();
+      nError=errno2serror();
+      goto end;
    }
+   g_bPartitionDirty[nPartitionID] = false;
 
-   return S_SUCCESS;
+end:
+   if (nError == S_SUCCESS)
+   {
+      g_pExchangeBuffer->sAdministrativeData.nSyncExecuted += g_nPendingSyncs[nPartitionID];
+   }
+   g_nPendingSyncs[nPartitionID] = 0;
+   return nError;
 }
 
 /**
- * This function executes the WRITE instruction.
+ * This function reads or writes nSectorCount consecutive sectors of a
+ * partition, starting at nSectorIndex. Each sector is transferred from or to
+ * its own location in the workspace, given in pBuffers.
  *
  * @param nPartitionID: the partition identifier
- * @param nSectorIndex: the index of the sector to read
- * @param nWorkspaceOffset: the offset in the workspace where the sector must be read
+ * @param bWrite: true to write the sectors, false to read them
+ * @param nSectorIndex: the index of the first sector
+ * @param pBuffers: the workspace location of each sector
+ * @param nSectorCount: the number of sectors
  **/
-static TEEC_Result partitionWrite(uint32_t nPartitionID, uint32_t nSectorIndex, uint32_t nWorkspaceOffset)
+static TEEC_Result partitionTransfer(uint32_t nPartitionID, bool bWrite, uint32_t nSectorIndex,
+                                     uint8_t** pBuffers, uint32_t nSectorCount)
 {
    FILE* pFile;
 
-   TRACE_INFO(">Partition %1X: write sector 0x%X from workspace at offset 0x%X",
-      nPartitionID, nSectorIndex, nWorkspaceOffset);
+   TRACE_INFO(">Partition %1X: %s %d sectors from 0x%08X",
+      nPartitionID, bWrite ? "write" : "read", nSectorCount, nSectorIndex);
 
    pFile = g_pPartitionFiles[nPartitionID];
 
@@ -707,23 +811,220 @@ static TEEC_Result partitionWrite(uint32_t nPartitionID, uint32_t nSectorIndex,
       /* The partition is not opened */
       return S_ERROR_BAD_STATE;
    }
-
-   if (fseek(pFile, nSectorIndex*g_nSectorSize, SEEK_SET) != 0)
+   if (bWrite)
    {
-      LogError("fseek error: %s", strerror(errno));
-      return errno2serror();
+      g_bPartitionDirty[nPartitionID] = true;
    }
 
-   if (fwrite(g_pWorkspaceBuffer + nWorkspaceOffset,
-              g_nSectorSize, 1,
-              pFile) != 1)
+#if defined(LINUX) || (defined __ANDROID32__)
    {
-      LogError("fread error: %s", strerror(errno));
-      return errno2serror();
+      /* One system call for the whole run, bypassing the stdio buffer.
+         Bionic has no preadv/pwritev, hence lseek and readv/writev */
+      struct iovec sIov[ECHANGE_BUFFER_INSTRUCTIONS_NB];
+      struct iovec* pIov = sIov;
+      int fd = fileno(pFile);
+      uint32_t i;
+
+      /* Anything stdio still buffers (from SET_SIZE) must reach the file first */
+      if (fflush(pFile) != 0)
+      {
+         LogError("fflush error: %s", strerror(errno));
+         return errno2serror();
+      }
+      if (lseek(fd, (off_t)nSectorIndex * g_nSectorSize, SEEK_SET) == (off_t)-1)
+      {
+         LogError("lseek error: %s", strerror(errno));
+         return errno2serror();
+      }
+      for (i = 0; i < nSectorCount; i++)
+      {
+         sIov[i].iov_base = pBuffers[i];
+         sIov[i].iov_len  = g_nSectorSize;
+      }
+      while (nSectorCount != 0)
+      {
+         ssize_t nDone = bWrite ? writev(fd, pIov, nSectorCount) : readv(fd, pIov, nSectorCount);
+         if (nDone < 0)
+         {
+            if (errno == EINTR)
+            {
+               continue;
+            }
+            LogError("%s error: %s", bWrite ? "writev" : "readv", strerror(errno));
+            return errno2serror();
+         }
+         if (nDone == 0)
+         {
+            LogError("readv error: End-Of-File detected");
+            return S_ERROR_ITEM_NOT_FOUND;
+         }
+         /* Short transfer: skip what was done and go on with the rest */
+         while (nSectorCount != 0 && (size_t)nDone >= pIov->iov_len)
+         {
+            nDone -= pIov->iov_len;
+            pIov++;
+            nSectorCount--;
+         }
+         if (nDone != 0)
+         {
+            pIov->iov_base = (uint8_t*)pIov->iov_base + nDone;
+            pIov->iov_len -= nDone;
+         }
+      }
+   }
+#else
+   while (nSectorCount != 0)
+   {
+      if (fseek(pFile, nSectorIndex*g_nSectorSize, SEEK_SET) != 0)
+      {
+         LogError("fseek error: %s", strerror(errno));
+         return errno2serror();
+      }
+      if (bWrite)
+      {
+         if (fwrite(*pBuffers, g_nSectorSize, 1, pFile) != 1)
+         {
+            LogError("fwrite error: %s", strerror(errno));
+            return errno2serror();
+         }
+      }
+      else if (fread(*pBuffers, g_nSectorSize, 1, pFile) != 1)
+      {
+         if (feof(pFile))
+         {
+            LogError("fread error: End-Of-File detected");
+            return S_ERROR_ITEM_NOT_FOUND;
+         }
+         LogError("fread error: %s", strerror(errno));
+         return errno2serror();
+      }
+      pBuffers++;
+      nSectorIndex++;
+      nSectorCount--;
    }
+#endif
    return S_SUCCESS;
 }
 
+/**
+ * This function executes the READ and WRITE instructions queued by
+ * queueSectorIO. The queued instructions of each partition are executed in
+ * order, and consecutive instructions of a partition in the same direction
+ * on consecutive sectors are merged into a single transfer. The first error
+ * on a partition is recorded in its error state and the remaining
+ * instructions of that partition are skipped, as if executed one by one.
+ **/
+static void flushSectorIO(void)
+{
+   uint8_t* pBuffers[ECHANGE_BUFFER_INSTRUCTIONS_NB];
+   uint32_t nPartitionID;
+
+   for (nPartitionID = 0; nPartitionID < 16; nPartitionID++)
+   {
+      uint32_t* pErrorState = &g_pExchangeBuffer->sAdministrativeData.nPartitionErrorStates[nPartitionID];
+      DELEGATION_SECTOR_IO* pRun = NULL;
+      uint32_t nRunLength = 0;
+      uint32_t i;
+
+      for (i = 0; i <= g_nPendingIO; i++)
+      {
+         DELEGATION_SECTOR_IO* pIO = (i < g_nPendingIO) ? &g_sPendingIO[i] : NULL;
+
+         if (pIO != NULL && pIO->nPartitionID != nPartitionID)
+         {
+            continue;
+         }
+         if (pRun != NULL &&
+             pIO != NULL &&
+             pIO->bWrite == pRun->bWrite &&
+             pIO->nSectorIndex == pRun->nSectorIndex + nRunLength)
+         {
+            /* Extends the current run */
+            pBuffers[nRunLength++] = g_pWorkspaceBuffer + pIO->nWorkspaceOffset;
+            continue;
+         }
+         if (pRun != NULL && *pErrorState == S_SUCCESS)
+         {
+            *pErrorState = partitionTransfer(nPartitionID, pRun->bWrite, pRun->nSectorIndex,
+                                             pBuffers, nRunLength);
+            TRACE_INFO("INSTRUCTION: ID=0x%x pid=%d sid=%d count=%d err=%d",
+               pRun->bWrite ? DELEGATION_INSTRUCTION_PARTITION_WRITE : DELEGATION_INSTRUCTION_PARTITION_READ,
+               nPartitionID, pRun->nSectorIndex, nRunLength, *pErrorState);
+         }
+         pRun = pIO;
+         if (pIO != NULL)
+         {
+            pBuffers[0] = g_pWorkspaceBuffer + pIO->nWorkspaceOffset;
+            nRunLength = 1;
+         }
+      }
+   }
+   g_nPendingIO = 0;
+}
+
+/**
+ * This function queues a READ or WRITE instruction for flushSectorIO.
+ *
+ * Instructions on different partitions are executed partition by partition,
+ * so they may run in a different order than received. That is only safe if
+ * they do not use the same workspace area. An instruction that conflicts
+ * with a queued instruction of another partition (one of them reads the
+ * sector into the workspace area the other one uses) first flushes the queue.
+ *
+ * @param nPartitionID: the partition identifier
+ * @param bWrite: true for WRITE, false for READ
+ * @param nSectorIndex: the index of the sector
+ * @param nWorkspaceOffset: the offset of the sector in the workspace
+ **/
+static void queueSectorIO(uint32_t nPartitionID, bool bWrite, uint32_t nSectorIndex, uint32_t nWorkspaceOffset)
+{
+   DELEGATION_SECTOR_IO* pIO;
+   uint32_t i;
+
+   if (nWorkspaceOffset > g_nWorkspaceSize - g_nSectorSize)
+   {
+      /* Not executed: record the error in sequence with the queued instructions */
+      flushSectorIO();
+      LogError("Workspace offset 0x%08X out of range", nWorkspaceOffset);
+      g_pExchangeBuffer->sAdministrativeData.nPartitionErrorStates[nPartitionID] = S_ERROR_BAD_PARAMETERS;
+      return;
+   }
+
+   if (bWrite && g_nPendingSyncs[nPartitionID] != 0)
+   {
+      /* The SYNCs received before this WRITE must not cover it: they are
+         executed first. Only reads of the partition can be queued since */
+      uint32_t* pErrorState = &g_pExchangeBuffer->sAdministrativeData.nPartitionErrorStates[nPartitionID];
+      TEEC_Result nError = syncPartition(nPartitionID);
+      if (nError != S_SUCCESS && *pErrorState == S_SUCCESS)
+      {
+         *pErrorState = nError;
+      }
+   }
+
+   for (i = 0; i < g_nPendingIO; i++)
+   {
+      pIO = &g_sPendingIO[i];
+      if (pIO->nPartitionID != nPartitionID &&
+          (!bWrite || !pIO->bWrite) &&
+          nWorkspaceOffset < pIO->nWorkspaceOffset + g_nSectorSize &&
+          pIO->nWorkspaceOffset < nWorkspaceOffset + g_nSectorSize)
+      {
+         flushSectorIO();
+         break;
+      }
+   }
+   if (g_nPendingIO == ECHANGE_BUFFER_INSTRUCTIONS_NB)
+   {
+      flushSectorIO();
+   }
+
+   pIO = &g_sPendingIO[g_nPendingIO++];
+   pIO->nPartitionID     = nPartitionID;
+   pIO->bWrite           = bWrite;
+   pIO->nSectorIndex     = nSectorIndex;
+   pIO->nWorkspaceOffset = nWorkspaceOffset;
+}
 
 /**
  * This function executes the SET_SIZE instruction.
@@ -735,6 +1036,7 @@ static TEEC_Result partitionSetSize(uint32_t nPartitionID, uint32_t nNewSectorCo
 {
    FILE* pFile;
    uint32_t nCurrentSectorCount;
+   TEEC_Result nError;
 
    pFile = g_pPartitionFiles[nPartitionID];
 
@@ -743,6 +1045,12 @@ static TEEC_Result partitionSetSize(uint32_t nPartitionID, uint32_t nNewSectorCo
       /* The partition is not opened */
       return S_ERROR_BAD_STATE;
    }
+   /* The SYNCs received before the SET_SIZE must not cover it */
+   nError = syncPartition(nPartitionID);
+   if (nError != S_SUCCESS)
+   {
+      return nError;
+   }
 
    /* Determine the current size of the partition */
    if (fseek(pFile, 0, SEEK_END) != 0)
@@ -751,6 +1059,7 @@ static TEEC_Result partitionSetSize(uint32_t nPartitionID, uint32_t nNewSectorCo
       return errno2serror();
    }
    nCurrentSectorCount = ftell(pFile) / g_nSectorSize;
+   g_bPartitionDirty[nPartitionID] = true;
 
    if (nNewSectorCount > nCurrentSectorCount)
    {
@@ -760,15 +1069,30 @@ static TEEC_Result partitionSetSize(uint32_t nPartitionID, uint32_t nNewSectorCo
          might not really reserve the storage space but use a
          sparse representation. In this case, a subsequent write instruction
          could fail due to out-of-space, which we want to avoid. */
+      uint64_t nStart = getTimeUs();
+
+      if (g_pFillBuffer[0] != 0xA5)
+      {
+         memset(g_pFillBuffer, 0xA5, sizeof(g_pFillBuffer));
+      }
       nAddedBytesCount = (nNewSectorCount-nCurrentSectorCount)*g_nSectorSize;
+      g_sPartitionStats.nGrowCount++;
+      g_sPartitionStats.nGrowBytes += nAddedBytesCount;
       while (nAddedBytesCount)
       {
-         if (fputc(0xA5, pFile)!=0xA5)
+         uint32_t nChunk = nAddedBytesCount;
+         if (nChunk > sizeof(g_pFillBuffer))
+         {
+            nChunk = sizeof(g_pFillBuffer);
+         }
+         if (fwrite(g_pFillBuffer, 1, nChunk, pFile) != nChunk)
          {
+            LogError("fwrite error: %s", strerror(errno));
             return errno2serror();
          }
-         nAddedBytesCount--;
+         nAddedBytesCount -= nChunk;
       }
+      g_sPartitionStats.nGrowTime += getTimeUs() - nStart;
    }
    else if (nNewSectorCount < nCurrentSectorCount)
    {
@@ -792,48 +1116,44 @@ static TEEC_Result partitionSetSize(uint32_t nPartitionID, uint32_t nNewSectorCo
 }
 
 /**
- * This function executes the SYNC instruction.
- *
- * @param pPartitionID: the partition identifier
+ * This function executes the synchronizations deferred by the SYNC
+ * instructions of the batch. A failure is reported in the error state of
+ * the partition, unless an earlier error is already there.
  **/
-static TEEC_Result partitionSync(uint32_t nPartitionID)
+static void syncPartitions(void)
 {
-   TEEC_Result nError = S_SUCCESS;
-   int result;
+   uint32_t nPartitionID;
 
-   FILE* pFile = g_pPartitionFiles[nPartitionID];
-
-   if (pFile == NULL)
+   for (nPartitionID = 0; nPartitionID < 16; nPartitionID++)
    {
-      /* The partition is not currently opened */
-      return S_ERROR_BAD_STATE;
+      TEEC_Result nError = syncPartition(nPartitionID);
+      if (nError != S_SUCCESS &&
+          g_pExchangeBuffer->sAdministrativeData.nPartitionErrorStates[nPartitionID] == S_SUCCESS)
+      {
+         g_pExchangeBuffer->sAdministrativeData.nPartitionErrorStates[nPartitionID] = nError;
+      }
    }
+}
 
-   /* First make sure that the data in the stdio buffers
-      is flushed to the file descriptor */
-   result=fflush(pFile);
-   if (result)
-   {
-      nError=errno2serror();
-      goto end;
-   }
-   /* Then synchronize the file descriptor with the file-system */
+/**
+ * This function executes the CLOSE_PARTITION instruction.
+ * It closes the partition file.
+ *
+ * @param nPartitionID: the partition identifier
+ **/
+static TEEC_Result partitionClose(uint32_t nPartitionID)
+{
+   TEEC_Result nError;
 
-#if defined(LINUX) || (defined __ANDROID32__)
-   result=fdatasync(fileno(pFile));
-#endif
-#if defined (__SYMBIAN32__)
-   result=fsync(fileno(pFile));
-#endif
-#ifdef WIN32
-   result=_commit(_fileno(pFile));
-#endif
-   if (result)
+   if (g_pPartitionFiles[nPartitionID] == NULL)
    {
-      nError=errno2serror();
+      /* The partition is currently not opened */
+      return S_ERROR_BAD_STATE;
    }
-
-end:
+   /* The SYNCs received before the CLOSE must be executed on this file */
+   nError = syncPartition(nPartitionID);
+   fclose(g_pPartitionFiles[nPartitionID]);
+   g_pPartitionFiles[nPartitionID] = NULL;
    return nError;
 }
 
@@ -919,6 +1239,19 @@ static int runSession(TEEC_Context* pContext, TEEC_Session* pSession, TEEC_Opera
          pOperation->params[1].tmpref.size = 0;
       }
 
+      if (g_pRecordFile != NULL)
+      {
+         uint32_t nRecordSize = pOperation->params[1].tmpref.size;
+         if (fwrite(&nRecordSize, sizeof(nRecordSize), 1, g_pRecordFile) != 1 ||
+             fwrite(g_pExchangeBuffer->sInstructions, nRecordSize, 1, g_pRecordFile) != 1 ||
+             fflush(g_pRecordFile) != 0)
+         {
+            LogWarning("Cannot record instructions, recording stopped: %s", strerror(errno));
+            fclose(g_pRecordFile);
+            g_pRecordFile = NULL;
+         }
+      }
+
       /* Reset the operation results */
       nError = TEEC_SUCCESS;
       g_pExchangeBuffer->sAdministrativeData.nSyncExecuted = 0;
@@ -942,6 +1275,34 @@ static int runSession(TEEC_Context* pContext, TEEC_Session* pSession, TEEC_Opera
          {
             goto instruction_parse_end;
          }
+         if ((nInstructionID & 0x0F) == DELEGATION_INSTRUCTION_PARTITION_READ ||
+             (nInstructionID & 0x0F) == DELEGATION_INSTRUCTION_PARTITION_WRITE)
+         {
+            /* Parse parameters. The instruction is queued even if the
+               partition is in error: flushSectorIO skips it then */
+            uint32_t nPartitionID = (nInstructionID & 0xF0) >> 4;
+            uint32_t nSectorID;
+            uint32_t nWorkspaceOffset;
+            if (nInstructionsIndex + 8 <= nInstructionsBufferSize)
+            {
+               nSectorID        = pInstruction->sReadWrite.nSectorID;
+               nWorkspaceOffset = pInstruction->sReadWrite.nWorkspaceOffset;
+               nInstructionsIndex+=8;
+            }
+            else
+            {
+               goto instruction_parse_end;
+            }
+            queueSectorIO(nPartitionID,
+                          (nInstructionID & 0x0F) == DELEGATION_INSTRUCTION_PARTITION_WRITE,
+                          nSectorID,
+                          nWorkspaceOffset);
+            continue;
+         }
+
+         /* Any other instruction is executed after the queued reads and writes */
+         flushSectorIO();
+
          if ((nInstructionID & 0x0F) == 0)
          {
             /* Partition-independent instruction */
@@ -949,6 +1310,8 @@ static int runSession(TEEC_Context* pContext, TEEC_Session* pSession, TEEC_Opera
             {
             case DELEGATION_INSTRUCTION_SHUTDOWN:
                {
+                  syncPartitions();
+                  logPartitionStats();
                   exit(0);
                   /* The implementation of the TF Client API will automatically
                      destroy the context and release any associated resource */
@@ -1021,51 +1384,9 @@ static int runSession(TEEC_Context* pContext, TEEC_Session* pSession, TEEC_Opera
                      }
                      break;
                   }
-               case DELEGATION_INSTRUCTION_PARTITION_READ:
-                  {
-                     /* Parse parameters */
-                     uint32_t nSectorID;
-                     uint32_t nWorkspaceOffset;
-                     if (nInstructionsIndex + 8 <= nInstructionsBufferSize)
-                     {
-                        nSectorID        = pInstruction->sReadWrite.nSectorID;
-                        nWorkspaceOffset = pInstruction->sReadWrite.nWorkspaceOffset;
-                        nInstructionsIndex+=8;
-                     }
-                     else
-                     {
-                        goto instruction_parse_end;
-                     }
-                     nError = partitionRead(nPartitionID, nSectorID, nWorkspaceOffset);
-                     TRACE_INFO("INSTRUCTION: ID=0x%x pid=%d sid=%d woff=%d err=%d", (nInstructionID & 0x0F), nPartitionID, nSectorID, nWorkspaceOffset, nError);
-                     break;
-                  }
-               case DELEGATION_INSTRUCTION_PARTITION_WRITE:
-                  {
-                     /* Parse parameters */
-                     uint32_t nSectorID;
-                     uint32_t nWorkspaceOffset;
-                     if (nInstructionsIndex + 8 <= nInstructionsBufferSize)
-                     {
-                        nSectorID        = pInstruction->sReadWrite.nSectorID;
-                        nWorkspaceOffset = pInstruction->sReadWrite.nWorkspaceOffset;
-                        nInstructionsIndex+=8;
-                     }
-                     else
-                     {
-                        goto instruction_parse_end;
-                     }
-                     nError = partitionWrite(nPartitionID, nSectorID, nWorkspaceOffset);
-                     TRACE_INFO("INSTRUCTION: ID=0x%x pid=%d sid=%d woff=%d err=%d", (nInstructionID & 0x0F), nPartitionID, nSectorID, nWorkspaceOffset, nError);
-                     break;
-                  }
                case DELEGATION_INSTRUCTION_PARTITION_SYNC:
                   nError = partitionSync(nPartitionID);
                   TRACE_INFO("INSTRUCTION: ID=0x%x pid=%d err=%d", (nInstructionID & 0x0F), nPartitionID, nError);
-                  if (nError == S_SUCCESS)
-                  {
-                     g_pExchangeBuffer->sAdministrativeData.nSyncExecuted++;
-                  }
                   break;
                case DELEGATION_INSTRUCTION_PARTITION_SET_SIZE:
                   {
@@ -1097,6 +1418,8 @@ static int runSession(TEEC_Context* pContext, TEEC_Session* pSession, TEEC_Opera
          }
       }
 instruction_parse_end:
+      flushSectorIO();
+      syncPartitions();
       memset(pOperation, 0, sizeof(TEEC_Operation));
    }
 }
@@ -1155,6 +1478,21 @@ static int createSession(TEEC_Context* pContext, TEEC_Session* pSession, TEEC_Op
    memset(g_pExchangeBuffer, 0x00, nExchangeBufferSize);
    memset(g_pPartitionFiles,0,16*sizeof(FILE*));
 
+   if (g_pRecordFile != NULL)
+   {
+      DELEGATION_TRACE_HEADER sHeader;
+      sHeader.nMagic         = DELEGATION_TRACE_MAGIC;
+      sHeader.nVersion       = DELEGATION_TRACE_VERSION;
+      sHeader.nSectorSize    = g_nSectorSize;
+      sHeader.nWorkspaceSize = g_nWorkspaceSize;
+      if (fwrite(&sHeader, sizeof(sHeader), 1, g_pRecordFile) != 1)
+      {
+         LogWarning("Cannot record instructions, recording stopped: %s", strerror(errno));
+         fclose(g_pRecordFile);
+         g_pRecordFile = NULL;
+      }
+   }
+
    /* Register the exchange buffer as a shared memory block */
    sExchangeSharedMem.buffer = g_pExchangeBuffer;
    sExchangeSharedMem.size   = nExchangeBufferSize;
@@ -1207,6 +1545,27 @@ int main(int argc, char* argv[])
       {
          debug = true;
       }
+      else if (strcmp(argv[0], "-record") == 0)
+      {
+         argc--;
+         argv++;
+         if (argc == 0)
+         {
+            printUsage();
+            return 1;
+         }
+         if (g_pRecordFile != NULL)
+         {
+            LogError("Only one record file may be specified");
+            return 1;
+         }
+         g_pRecordFile = fopen(argv[0], "wb");
+         if (g_pRecordFile == NULL)
+         {
+            LogError("Cannot create record file %s: %s", argv[0], strerror(errno));
+            return 1;
+         }
+      }
 #ifdef SUPPORT_DELEGATION_EXTENSION
       else if (strcmp(argv[0], "-c") == 0)
       {
@@ -0,0 +1,56 @@
+/**
+ * Copyright(c) 2011 Trusted Logic.   All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *  * Neither the name Trusted Logic nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __DELEGATION_TRACE_H__
+#define __DELEGATION_TRACE_H__
+
+#include "s_type.h"
+
+/*
+ * Instruction trace written by the daemon with the "-record <file>" option
+ * and replayed on a host by test/tf_daemon/delegation_replay. All fields
+ * are 32-bit little-endian words.
+ *
+ * The file is a DELEGATION_TRACE_HEADER followed by one record per
+ * GET_INSTRUCTIONS: a 32-bit size in bytes, then the instruction buffer as
+ * returned by the service. The workspace content is not recorded.
+ */
+#define DELEGATION_TRACE_MAGIC     0x544C4744 /* "DGLT" */
+#define DELEGATION_TRACE_VERSION   1
+
+typedef struct
+{
+   uint32_t nMagic;
+   uint32_t nVersion;
+   uint32_t nSectorSize;
+   uint32_t nWorkspaceSize;
+} DELEGATION_TRACE_HEADER;
+
+#endif /* __DELEGATION_TRACE_H__ */
@@ -638,6 +638,21 @@ bad_format:
 }
 
 
+S_RESULT libManifest2GetNextItemNoDuplicateCheck(
+   LIB_MANIFEST2_CONTEXT* pContext,
+   OUT uint8_t** ppName,
+   OUT uint32_t* pNameLength,
+   OUT uint8_t** ppValue,
+   OUT uint32_t* pValueLength)
+{
+   return static_libManifest2GetNextItemInternal(
+      pContext,
+      ppName,
+      pNameLength,
+      ppValue,
+      pValueLength);
+}
+
 S_RESULT libManifest2CheckFormat(
    LIB_MANIFEST2_CONTEXT* pContext,
    uint32_t* pnItemCount)
@@ -97,6 +97,19 @@ S_RESULT libManifest2GetNextItem(
    OUT uint8_t** ppValue,
    OUT uint32_t* pValueLength);
 
+/**
+ * Same as libManifest2GetNextItem, without the checks for duplicate sections
+ * and properties. Those checks parse the manifest again from the start of
+ * the section for each item, which is quadratic in the number of items:
+ * callers that index the items can detect the duplicates themselves.
+ **/
+S_RESULT libManifest2GetNextItemNoDuplicateCheck(
+   LIB_MANIFEST2_CONTEXT* pContext,
+   OUT uint8_t** ppName,
+   OUT uint32_t* pNameLength,
+   OUT uint8_t** ppValue,
+   OUT uint32_t* pValueLength);
+
 S_RESULT libManifest2CheckFormat(
    LIB_MANIFEST2_CONTEXT* pContext,
    uint32_t* pnItemCount);
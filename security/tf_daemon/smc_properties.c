@@ -274,6 +274,7 @@ int smcPropertiesParse(const char *configFile)
    if (nResult!=S_SUCCESS)
    {
       printf("Parsing error in file %s : %x.\n", configFile, nResult);
+      SMCPropFreeConfigFile(&gConfFile);
       return 1;
    }
 
@@ -281,6 +282,7 @@ int smcPropertiesParse(const char *configFile)
    if (!smcPropertiesCheck(gConfFile))
    {
       printf("Properties check failed.\n");
+      SMCPropFreeConfigFile(&gConfFile);
       return 1;
    }
 
@@ -40,6 +40,14 @@
 #include <errno.h>
 #endif
 
+#if defined (LINUX) || defined (__ANDROID32__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define SMC_PROP_MMAP_FILE
+#endif
+
 #include "smc_properties_parser.h"
 #include "lib_manifest2.h"
 #include "s_error.h"
@@ -113,95 +121,87 @@ static void TRACE_INFO(const char* format, ...)
    private functions.
    ---------------------------------------------------------------------------------*/
 
-static NODE* static_listFindNodeElement(NODE* pList,char* pName,bool bIsCaseSensitive)
+/* Hash of the case-folded name (FNV-1a), so that both the case-sensitive
+   and the case-insensitive lookups can use it */
+static uint32_t static_listHashName(const char* pName)
 {
-   int32_t nCmp;
+   uint32_t nHash = 2166136261u;
 
-   assert(pName!=NULL);
+   while (*pName != 0)
+   {
+      nHash = (nHash ^ (uint8_t)tolower((uint8_t)*pName)) * 16777619u;
+      pName++;
+   }
+   return nHash;
+}
+
+
+/* Resize the hash table to nBuckets (a power of two) and rehash all the
+   nodes. Returns false on allocation failure, keeping the current hash
+   table */
+static bool static_listHashResize(LIST* pList,uint32_t nBuckets)
+{
+   NODE** ppBuckets;
+   NODE* pNode;
 
-   while (pList!=NULL)
+   ppBuckets=(NODE**)calloc(nBuckets,sizeof(NODE*));
+   if (ppBuckets==NULL)
    {
-      if (bIsCaseSensitive)
-      {
-         nCmp=strcmp(pName,pList->pName);
-      }
-      else
-      {
-         nCmp=STRICMP(pName,pList->pName);
-      }
-      if (nCmp>0)
-      {
-         pList=pList->pRight;
-      }
-      else if (nCmp<0)
-      {
-         pList=pList->pLeft;
-      }
-      else
-      {
-         break;
-      }
+      return false;
    }
-   return pList;
+   free(pList->ppBuckets);
+   pList->ppBuckets=ppBuckets;
+   pList->nBuckets=nBuckets;
+
+   for (pNode=pList->pFirst;pNode!=NULL;pNode=pNode->pNext)
+   {
+      NODE** ppBucket=&ppBuckets[pNode->nHash & (nBuckets-1)];
+      pNode->pHashNext=*ppBucket;
+      *ppBucket=pNode;
+   }
+   return true;
 }
 
 
-static S_RESULT static_listSortedAddNode(NODE* pList,NODE* pNode)
+static NODE* static_listFindNodeElement(LIST* pList,char* pName,uint32_t nHash,bool bIsCaseSensitive)
 {
-   int32_t nCmp;
+   NODE* pNode;
 
-   do {
-      nCmp=strcmp(pNode->pName,pList->pName);
-      if (nCmp>0)
+   assert(pName!=NULL);
+
+   if (pList->ppBuckets==NULL)
+   {
+      return NULL;
+   }
+   for (pNode=pList->ppBuckets[nHash & (pList->nBuckets-1)];pNode!=NULL;pNode=pNode->pHashNext)
+   {
+      if (pNode->nHash!=nHash)
       {
-         if (pList->pRight!=NULL)
-         {
-            pList=pList->pRight;
-         }
-         else
-         {
-            pList->pRight=pNode;
-            /* update linked list */
-            pNode->pPrevious=pList;
-            pNode->pNext=pList->pNext;
-            if (pList->pNext!=NULL)
-            {
-               pList->pNext->pPrevious=pNode;
-            }
-            pList->pNext=pNode;
-            return S_SUCCESS;
-         }
+         continue;
       }
-      else if (nCmp<0)
+      if (bIsCaseSensitive)
       {
-         if (pList->pLeft!=NULL)
+         if (strcmp(pName,pNode->pName)==0)
          {
-            pList=pList->pLeft;
+            break;
          }
-         else
+      }
+      else
+      {
+         if (STRICMP(pName,pNode->pName)==0)
          {
-            pList->pLeft=pNode;
-            /* update linked list */
-            pNode->pNext=pList;
-            pNode->pPrevious=pList->pPrevious;
-            if (pList->pPrevious!=NULL)
-            {
-               pList->pPrevious->pNext=pNode;
-            }
-            pList->pPrevious=pNode;
-            return S_SUCCESS;
+            break;
          }
       }
-   } while (nCmp!=0);
-
-   TRACE_ERROR("%s already exist !\n",pNode->pName);
-   return S_ERROR_ITEM_EXISTS;
+   }
+   return pNode;
 }
 
 
-static S_RESULT SMCPropListSortedAdd(LIST* pList,NODE* pNode)
+/* Append pNode to the list. Names are unique (case-sensitive) */
+static S_RESULT SMCPropListAdd(LIST* pList,NODE* pNode)
 {
-   S_RESULT nResult;
+   NODE** ppBucket;
 
    assert(pList!=NULL && pNode!=NULL);
 
@@ -211,32 +211,66 @@ static S_RESULT SMCPropListSortedAdd(LIST* pList,NODE* pNode)
       return S_ERROR_BAD_PARAMETERS;
    }
 
-   if (pList->pRoot==NULL)
+   pNode->nHash=static_listHashName(pNode->pName);
+   if (static_listFindNodeElement(pList,pNode->pName,pNode->nHash,true)!=NULL)
    {
-      pList->pRoot=pNode;
-      pList->pFirst=pNode;
-      return S_SUCCESS;
+      TRACE_ERROR("%s already exist !\n",pNode->pName);
+      return S_ERROR_ITEM_EXISTS;
    }
-   else
+
+   /* Keep at most one node per bucket on average */
+   if (pList->nCount>=pList->nBuckets)
    {
-      nResult=static_listSortedAddNode(pList->pRoot,pNode);
-      /* update the first node of the linked list */
-      if (nResult==S_SUCCESS && pNode->pPrevious==NULL)
+      if (!static_listHashResize(pList,pList->nBuckets==0 ? 16 : 2*pList->nBuckets)
+          && pList->ppBuckets==NULL)
       {
-         pList->pFirst=pNode;
+         return S_ERROR_OUT_OF_MEMORY;
       }
    }
-   return nResult;
+
+   ppBucket=&pList->ppBuckets[pNode->nHash & (pList->nBuckets-1)];
+   pNode->pHashNext=*ppBucket;
+   *ppBucket=pNode;
+
+   /* update linked list */
+   pNode->pNext=NULL;
+   pNode->pPrevious=pList->pLast;
+   if (pList->pLast!=NULL)
+   {
+      pList->pLast->pNext=pNode;
+   }
+   else
+   {
+      pList->pFirst=pNode;
+   }
+   pList->pLast=pNode;
+   pList->nCount++;
+   return S_SUCCESS;
 }
 
 
 static NODE* SMCPropListFindElement(LIST* pList,char* pName,bool bIsCaseSensitive)
 {
-   if (pList->pRoot!=NULL)
+   return static_listFindNodeElement(pList,pName,static_listHashName(pName),bIsCaseSensitive);
+}
+
+
+/* Free the properties of a property list and its hash table, leaving it
+   empty */
+static void static_listFreeProperties(LIST* pList)
+{
+   NODE* pNode=pList->pFirst;
+
+   while (pNode!=NULL)
    {
-      return static_listFindNodeElement(pList->pRoot,pName,bIsCaseSensitive);
+      PROPERTY* pProperty=(PROPERTY*)pNode;
+      pNode=pNode->pNext;
+      free(pProperty->sNode.pName);
+      free(pProperty->pValue);
+      free(pProperty);
    }
-   return NULL;
+   free(pList->ppBuckets);
+   memset(pList,0,sizeof(LIST));
 }
 
 
@@ -249,6 +283,7 @@ static S_RESULT SMCPropYacc(uint8_t* pBuffer, uint32_t nBufferLength,
    PROPERTY* pProperty=NULL;
    SERVICE_SECTION* pServSection;
    SERVICE_SECTION* pPreviousService=NULL;
+   bool bSystemSectionFound=false;
 
    uint8_t* pName;
    uint32_t nNameLength;
@@ -268,7 +303,9 @@ static S_RESULT SMCPropYacc(uint8_t* pBuffer, uint32_t nBufferLength,
 
    while (true)
    {
-      nError = libManifest2GetNextItem(
+      /* The lists reject the duplicate properties: skip the (quadratic)
+         duplicate checks of the manifest parser */
+      nError = libManifest2GetNextItemNoDuplicateCheck(
          &sParserContext,
          &pName,
          &nNameLength,
@@ -286,10 +323,8 @@ static S_RESULT SMCPropYacc(uint8_t* pBuffer, uint32_t nBufferLength,
          goto error;
       }
 
-      /* Duplicate name and value in as zero-terminated strings */
-      /* Unclean: those strings are not going to be deallocated
-         This is not a problem because this code is run in a tool
-      */
+      /* Duplicate name and value in as zero-terminated strings. Those of
+         the properties are freed by SMCPropFreeConfigFile */
       pNameZ = malloc(nNameLength+1);
       if (pNameZ == NULL)
       {
@@ -304,8 +339,17 @@ static S_RESULT SMCPropYacc(uint8_t* pBuffer, uint32_t nBufferLength,
          /* It's a section */
          if (STRICMP(pNameZ, SYSTEM_SECTION_NAME) == 0)
          {
+            if (bSystemSectionFound)
+            {
+               TRACE_ERROR("Configuration file: duplicate section %s\n", pNameZ);
+               nError=S_ERROR_BAD_FORMAT;
+               goto error;
+            }
+            bSystemSectionFound=true;
             free(pNameZ);
+            pNameZ=NULL;
             pPublicPropertyList=&pConfFile->sSystemSectionPropertyList;
+            pPrivatePropertyList=NULL;
          }
          else
          {
@@ -332,7 +376,14 @@ static S_RESULT SMCPropYacc(uint8_t* pBuffer, uint32_t nBufferLength,
                   goto error;
                }
             }
+            if (pServSection->inSCF)
+            {
+               TRACE_ERROR("Configuration file: duplicate section %s\n", pNameZ);
+               nError=S_ERROR_BAD_FORMAT;
+               goto error;
+            }
             free(pNameZ);
+            pNameZ=NULL;
 
             pServSection->inSCF=true;
             if (pPreviousService!=NULL)
@@ -374,28 +425,33 @@ static S_RESULT SMCPropYacc(uint8_t* pBuffer, uint32_t nBufferLength,
 
          if (pPrivatePropertyList==NULL)
          {
-            nError=SMCPropListSortedAdd(pPublicPropertyList,(NODE*)pProperty);
-            if (nError!=S_SUCCESS)
-            {
-               goto error;
-            }
+            nError=SMCPropListAdd(pPublicPropertyList,(NODE*)pProperty);
          }
          else
          {
-            if ((nValueLength > strlen(CONFIG_PROPERTY_NAME)) &&
+            if ((nNameLength > strlen(CONFIG_PROPERTY_NAME)) &&
                 (memcmp(pProperty->sNode.pName, CONFIG_PROPERTY_NAME, strlen(CONFIG_PROPERTY_NAME)) == 0))
             {
-               nError=SMCPropListSortedAdd(pPrivatePropertyList,(NODE*)pProperty);
+               nError=SMCPropListAdd(pPrivatePropertyList,(NODE*)pProperty);
             }
             else
             {
-               nError=SMCPropListSortedAdd(pPublicPropertyList,(NODE*)pProperty);
-            }
-            if (nError!=S_SUCCESS)
-            {
-               goto error;
+               nError=SMCPropListAdd(pPublicPropertyList,(NODE*)pProperty);
             }
          }
+         if (nError==S_ERROR_ITEM_EXISTS)
+         {
+            /* Duplicate property in the section */
+            nError=S_ERROR_BAD_FORMAT;
+         }
+         if (nError!=S_SUCCESS)
+         {
+            goto error;
+         }
+         /* Now owned by the list */
+         pProperty=NULL;
+         pNameZ=NULL;
+         pValueZ=NULL;
       }
    }
 
@@ -417,12 +473,90 @@ error:
 	  TRACE_ERROR("Configuration file: service \"%s\" not found\n", pNameZ);
          break;
       }
+      /* The item being parsed, if not yet in a list */
+      free(pProperty);
+      free(pValueZ);
+      free(pNameZ);
    }
    return nError;
 }
 
 
-S_RESULT static_readFile(const char* pFilename, void** ppFile, uint32_t* pnFileLength)
+#ifdef SMC_PROP_MMAP_FILE
+
+/* Map the file read-only: the parser copies the names and values it keeps,
+   so the file does not need to be read into an allocated buffer */
+static S_RESULT static_readFile(const char* pFilename, void** ppFile, uint32_t* pnFileLength)
+{
+   S_RESULT nResult = S_SUCCESS;
+   struct stat sStat;
+   void* pBuff;
+   int hFile;
+
+   hFile = open(pFilename, O_RDONLY);
+   if (hFile < 0)
+   {
+      TRACE_ERROR("static_readFile: open(%s) failed [%d]", pFilename, GET_LAST_ERR);
+      nResult = S_ERROR_ITEM_NOT_FOUND;
+      goto error;
+   }
+   if (fstat(hFile, &sStat) != 0)
+   {
+      TRACE_ERROR("static_readFile: fstat(%s) failed [%d]", pFilename, GET_LAST_ERR);
+      nResult = S_ERROR_UNDERLYING_OS;
+      goto error;
+   }
+   if (sStat.st_size == 0)
+   {
+      /* mmap rejects empty mappings */
+      close(hFile);
+      *ppFile = NULL;
+      *pnFileLength = 0;
+      return S_SUCCESS;
+   }
+   if ((uint64_t)sStat.st_size > 0xFFFFFFFF)
+   {
+      TRACE_ERROR("static_readFile: %s is too large", pFilename);
+      nResult = S_ERROR_OUT_OF_MEMORY;
+      goto error;
+   }
+
+   pBuff = mmap(NULL, (size_t)sStat.st_size, PROT_READ, MAP_PRIVATE, hFile, 0);
+   if (pBuff == MAP_FAILED)
+   {
+      TRACE_ERROR("static_readFile: mmap(%s) failed [%d]", pFilename, GET_LAST_ERR);
+      nResult = S_ERROR_UNDERLYING_OS;
+      goto error;
+   }
+   /* The file is parsed once, front to back */
+   madvise(pBuff, (size_t)sStat.st_size, MADV_SEQUENTIAL);
+   close(hFile);
+
+   *ppFile = pBuff;
+   *pnFileLength = (uint32_t)sStat.st_size;
+   return S_SUCCESS;
+
+error:
+   if (hFile >= 0)
+   {
+      close(hFile);
+   }
+   *ppFile = NULL;
+   *pnFileLength = 0;
+   return nResult;
+}
+
+static void static_releaseFile(void* pFile, uint32_t nFileLength)
+{
+   if (pFile != NULL)
+   {
+      munmap(pFile, nFileLength);
+   }
+}
+
+#else /* SMC_PROP_MMAP_FILE */
+
+static S_RESULT static_readFile(const char* pFilename, void** ppFile, uint32_t* pnFileLength)
 {
    S_RESULT nResult = S_SUCCESS;
    long nFilesize;
@@ -468,6 +602,7 @@ S_RESULT static_readFile(const char* pFilename, void** ppFile, uint32_t* pnFileL
       goto error;
    }
    ((char*)pBuff)[nFilesize] = 0;
+   fclose(pFile);
 
    *ppFile = pBuff;
    *pnFileLength = nFilesize;
@@ -483,6 +618,13 @@ error:
    return nResult;
 }
 
+static void static_releaseFile(void* pFile, uint32_t nFileLength)
+{
+   (void)nFileLength;
+   free(pFile);
+}
+
+#endif /* SMC_PROP_MMAP_FILE */
 
 
 
@@ -522,8 +664,8 @@ uint32_t SMCPropGetSystemPropertyAsInt(CONF_FILE* pConfFile, char* pPropertyName
 S_RESULT SMCPropParseConfigFile(char* pConfigFilename,CONF_FILE* pConfFile)
 {
    S_RESULT nError=S_SUCCESS;
-   void* pFile;
-   uint32_t nFileLength;
+   void* pFile=NULL;
+   uint32_t nFileLength=0;
    bool bReuseManifest;
 
    assert(pConfFile!=NULL);
@@ -548,9 +690,33 @@ S_RESULT SMCPropParseConfigFile(char* pConfigFilename,CONF_FILE* pConfFile)
 
    if(pConfigFilename != NULL)
    {
-      free(pFile);
+      static_releaseFile(pFile,nFileLength);
    }
 
 error:
    return nError;
 }
+
+
+void SMCPropFreeConfigFile(CONF_FILE* pConfFile)
+{
+   SERVICE_SECTION* pServSection;
+
+   assert(pConfFile!=NULL);
+
+   static_listFreeProperties(&pConfFile->sSystemSectionPropertyList);
+
+   /* The sections belong to their section list, only their properties
+      come from the file */
+   pServSection=pConfFile->pFirstSectionInSCF;
+   while (pServSection!=NULL)
+   {
+      SERVICE_SECTION* pNextInSCF=pServSection->pNextInSCF;
+      static_listFreeProperties(&pServSection->sPublicPropertyList);
+      static_listFreeProperties(&pServSection->sPrivatePropertyList);
+      pServSection->inSCF=false;
+      pServSection->pNextInSCF=NULL;
+      pServSection=pNextInSCF;
+   }
+   pConfFile->pFirstSectionInSCF=NULL;
+}
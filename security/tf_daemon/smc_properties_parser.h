@@ -57,17 +57,21 @@ extern "C" {
 
 typedef struct NODE
 {
-   struct NODE* pLeft;
-   struct NODE* pRight;
-   struct NODE* pNext;
+   struct NODE* pHashNext;  /* next node in the same hash bucket */
+   struct NODE* pNext;      /* list in definition order */
    struct NODE* pPrevious;
    char* pName;
+   uint32_t nHash;          /* hash of the case-folded name */
 } NODE;
 
+/* Nodes indexed by name. A zero-filled LIST is an empty list */
 typedef struct
 {
-   NODE* pRoot;
+   NODE** ppBuckets;
+   uint32_t nBuckets;       /* power of two */
+   uint32_t nCount;
    NODE* pFirst;
+   NODE* pLast;
 } LIST;
 
 typedef struct
@@ -116,6 +120,8 @@ uint32_t SMCPropStringToInt           (char* pValue);
 char*    SMCPropGetSystemProperty     (CONF_FILE* pConfFile, char* pPropertyName);
 uint32_t SMCPropGetSystemPropertyAsInt(CONF_FILE* pConfFile, char* pPropertyName);
 S_RESULT SMCPropParseConfigFile       (char* pConfigFilename,CONF_FILE* pConfFile);
+/* Free the properties parsed into pConfFile, leaving its property lists empty */
+void     SMCPropFreeConfigFile        (CONF_FILE* pConfFile);
 
 
 #ifdef __cplusplus
@@ -26,6 +26,7 @@
  * SUCH DAMAGE.
  */
 #include <unwind.h>
+#include <stdint.h>
 #include <sys/types.h>
 
 // =============================================================================
@@ -38,15 +39,7 @@ typedef struct
     intptr_t* addrs;
 } stack_crawl_state_t;
 
-
-/* depends how the system includes define this */
-#ifdef HAVE_UNWIND_CONTEXT_STRUCT
-typedef struct _Unwind_Context __unwind_context;
-#else
-typedef _Unwind_Context __unwind_context;
-#endif
-
-static _Unwind_Reason_Code trace_function(__unwind_context *context, void *arg)
+static _Unwind_Reason_Code trace_function(struct _Unwind_Context *context, void *arg)
 {
     stack_crawl_state_t* state = (stack_crawl_state_t*)arg;
     if (state->count) {
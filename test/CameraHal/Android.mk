@@ -37,3 +37,22 @@ endif
 include $(BUILD_HEAPTRACKED_EXECUTABLE)
 
 
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	frame_ref_stress.cpp \
+	../../camera/FrameRefTable.cpp
+
+LOCAL_C_INCLUDES += \
+	$(LOCAL_PATH)/../../camera/inc
+
+LOCAL_STATIC_LIBRARIES:= libcutils
+LOCAL_LDLIBS += -lpthread -lrt
+
+LOCAL_MODULE:= frame_ref_stress
+LOCAL_MODULE_TAGS:= tests
+
+LOCAL_CFLAGS += -Wall
+
+include $(BUILD_HOST_EXECUTABLE)
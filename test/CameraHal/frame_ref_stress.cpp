@@ -0,0 +1,289 @@
+/*
+ * Host stress test for the lock-free FrameRefTable used by BaseCameraAdapter.
+ *
+ * A producer thread hands each free buffer to two preview subscribers and,
+ * while "recording", to one video subscriber, after setting the lane counts
+ * like setInitFrameRefCount does. The subscribers return the frames from their
+ * own threads like returnFrame does, with the combined release: whoever drops
+ * the last reference of both lanes refills the buffer. Every delivered frame
+ * must be refilled exactly once.
+ *
+ * A second phase races reset(), as used by stopPreview, against the releases
+ * and checks that no count survives or comes back after the reset.
+ *
+ * usage: frame_ref_stress [frames]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "FrameRefTable.h"
+
+using namespace android;
+
+#define BUFFER_COUNT        8
+#define PREVIEW_SUBSCRIBERS 2
+#define VIDEO_SUBSCRIBERS   1
+#define SUBSCRIBERS         ( PREVIEW_SUBSCRIBERS + VIDEO_SUBSCRIBERS )
+#define RESET_ROUNDS        20000
+//A buffer not refilled within this many seconds is lost
+#define REFILL_TIMEOUT      5
+
+static FrameRefTable gTable;
+static volatile int32_t gFailures;
+
+static void check(bool condition, const char *message)
+{
+    if ( !condition && ( 10 > android_atomic_inc(&gFailures) ) )
+        {
+        printf("FAILED: %s\n", message);
+        }
+}
+
+static int keyFor(int index)
+{
+    return ( index + 1 ) * 0x1000;
+}
+
+/* Bounded FIFO of buffer indices, the test's stand-in for the frame queues */
+class IndexQueue
+{
+public:
+    IndexQueue() : mHead(0), mCount(0)
+        {
+        pthread_mutex_init(&mLock, NULL);
+        pthread_cond_init(&mCond, NULL);
+        }
+
+    void put(int index)
+        {
+        pthread_mutex_lock(&mLock);
+        mItems[( mHead + mCount ) % QUEUE_SIZE] = index;
+        mCount++;
+        pthread_cond_signal(&mCond);
+        pthread_mutex_unlock(&mLock);
+        }
+
+    //Returns -1 if nothing was queued within timeout seconds, 0 waits forever
+    int get(int timeout = 0)
+        {
+        struct timespec deadline;
+        int index;
+
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout;
+        pthread_mutex_lock(&mLock);
+        while ( 0 == mCount )
+            {
+            if ( 0 == timeout )
+                {
+                pthread_cond_wait(&mCond, &mLock);
+                }
+            else if ( 0 != pthread_cond_timedwait(&mCond, &mLock, &deadline) )
+                {
+                pthread_mutex_unlock(&mLock);
+                return -1;
+                }
+            }
+        index = mItems[mHead];
+        mHead = ( mHead + 1 ) % QUEUE_SIZE;
+        mCount--;
+        pthread_mutex_unlock(&mLock);
+        return index;
+        }
+
+private:
+    static const int QUEUE_SIZE = BUFFER_COUNT + 1;
+    int mItems[QUEUE_SIZE];
+    int mHead;
+    int mCount;
+    pthread_mutex_t mLock;
+    pthread_cond_t mCond;
+};
+
+static IndexQueue gFree;
+static IndexQueue gSubscriberQueues[SUBSCRIBERS];
+static volatile int32_t gDelivered[BUFFER_COUNT];
+static volatile int32_t gRefilled[BUFFER_COUNT];
+static volatile int32_t gIsFree[BUFFER_COUNT];
+
+static void *subscriberThread(void *arg)
+{
+    int subscriber = ( int ) ( intptr_t ) arg;
+    FrameRefTable::Lane lane = ( subscriber < PREVIEW_SUBSCRIBERS ) ?
+                               FrameRefTable::LANE_FRAME : FrameRefTable::LANE_VIDEO;
+
+    while ( true )
+        {
+        int index = gSubscriberQueues[subscriber].get();
+        int refCount;
+
+        if ( 0 > index )
+            {
+            break;
+            }
+
+        refCount = gTable.release(keyFor(index), lane, true);
+        check(0 <= refCount, "frame returned with a zero count");
+        if ( 0 == refCount )
+            {
+            android_atomic_inc(&gRefilled[index]);
+            check(0 == android_atomic_cmpxchg(0, 1, &gIsFree[index]),
+                  "buffer refilled twice");
+            gFree.put(index);
+            }
+        }
+
+    return NULL;
+}
+
+static void runDelivery(unsigned int frames)
+{
+    pthread_t threads[SUBSCRIBERS];
+    unsigned int frame;
+    int i;
+
+    gTable.clear();
+    for ( i = 0 ; i < BUFFER_COUNT ; i++ )
+        {
+        gTable.add(keyFor(i), 0);
+        gIsFree[i] = 1;
+        gFree.put(i);
+        }
+
+    for ( i = 0 ; i < SUBSCRIBERS ; i++ )
+        {
+        pthread_create(&threads[i], NULL, subscriberThread, ( void * ) ( intptr_t ) i);
+        }
+
+    for ( frame = 0 ; frame < frames ; frame++ )
+        {
+        int index = gFree.get(REFILL_TIMEOUT);
+        if ( 0 > index )
+            {
+            check(false, "buffer never refilled");
+            break;
+            }
+        //Record every other thousand frames, like start/stopVideoCapture
+        bool recording = ( 0 != ( ( frame / 1000 ) & 1 ) );
+        int subscribers = recording ? SUBSCRIBERS : PREVIEW_SUBSCRIBERS;
+
+        check(0 == android_atomic_cmpxchg(1, 0, &gIsFree[index]), "buffer delivered twice");
+        android_atomic_inc(&gDelivered[index]);
+
+        gTable.set(keyFor(index), PREVIEW_SUBSCRIBERS, FrameRefTable::LANE_FRAME);
+        gTable.set(keyFor(index), recording ? VIDEO_SUBSCRIBERS : 0, FrameRefTable::LANE_VIDEO);
+        for ( i = 0 ; i < subscribers ; i++ )
+            {
+            gSubscriberQueues[i].put(index);
+            }
+        }
+
+    //Wait until every buffer came back
+    for ( i = 0 ; i < BUFFER_COUNT ; i++ )
+        {
+        if ( 0 > gFree.get(REFILL_TIMEOUT) )
+            {
+            check(false, "buffer never refilled");
+            }
+        }
+    for ( i = 0 ; i < SUBSCRIBERS ; i++ )
+        {
+        gSubscriberQueues[i].put(-1);
+        pthread_join(threads[i], NULL);
+        }
+
+    for ( i = 0 ; i < BUFFER_COUNT ; i++ )
+        {
+        check(gDelivered[i] == gRefilled[i], "delivered and refilled frames differ");
+        check(0 == gTable.get(keyFor(i), FrameRefTable::LANE_FRAME) &&
+              0 == gTable.get(keyFor(i), FrameRefTable::LANE_VIDEO),
+              "count left after all the frames came back");
+        }
+}
+
+static volatile int32_t gReleases;
+
+static void *releaseThread(void *arg)
+{
+    FrameRefTable::Lane lane = ( FrameRefTable::Lane ) ( intptr_t ) arg;
+    int i;
+
+    for ( i = 0 ; i < BUFFER_COUNT ; i++ )
+        {
+        if ( 0 <= gTable.release(keyFor(i), lane, true) )
+            {
+            android_atomic_inc(&gReleases);
+            }
+        }
+
+    return NULL;
+}
+
+static void runReset()
+{
+    pthread_t threads[SUBSCRIBERS];
+    int round;
+    int i;
+
+    for ( round = 0 ; round < RESET_ROUNDS ; round++ )
+        {
+        gReleases = 0;
+        for ( i = 0 ; i < BUFFER_COUNT ; i++ )
+            {
+            gTable.set(keyFor(i), PREVIEW_SUBSCRIBERS, FrameRefTable::LANE_FRAME);
+            gTable.set(keyFor(i), VIDEO_SUBSCRIBERS, FrameRefTable::LANE_VIDEO);
+            }
+
+        for ( i = 0 ; i < SUBSCRIBERS ; i++ )
+            {
+            pthread_create(&threads[i], NULL, releaseThread,
+                           ( void * ) ( intptr_t ) ( ( i < PREVIEW_SUBSCRIBERS ) ?
+                                                     FrameRefTable::LANE_FRAME :
+                                                     FrameRefTable::LANE_VIDEO ));
+            }
+        gTable.reset();
+        for ( i = 0 ; i < SUBSCRIBERS ; i++ )
+            {
+            pthread_join(threads[i], NULL);
+            }
+
+        check(gReleases <= BUFFER_COUNT * SUBSCRIBERS, "more releases than references");
+        for ( i = 0 ; i < BUFFER_COUNT ; i++ )
+            {
+            if ( 0 != gTable.get(keyFor(i), FrameRefTable::LANE_FRAME) ||
+                 0 != gTable.get(keyFor(i), FrameRefTable::LANE_VIDEO) )
+                {
+                check(false, "count survived the reset");
+                return;
+                }
+            }
+        }
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int frames = ( argc > 1 ) ? ( unsigned int ) atoi(argv[1]) : 1000000;
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    runDelivery(frames);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("%u frames to %d preview and %d video subscribers in %.3f s\n",
+           frames, PREVIEW_SUBSCRIBERS, VIDEO_SUBSCRIBERS,
+           ( end.tv_sec - start.tv_sec ) + ( end.tv_nsec - start.tv_nsec ) / 1e9);
+
+    runReset();
+    printf("%d reset rounds against concurrent releases\n", RESET_ROUNDS);
+
+    if ( 0 != gFailures )
+        {
+        printf("%d checks failed\n", gFailures);
+        return 1;
+        }
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,40 @@
+LOCAL_PATH:= $(call my-dir)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	overlay_assign_test.c \
+	../../hwc/overlay_assign.c
+
+LOCAL_C_INCLUDES += \
+	$(LOCAL_PATH)/../../hwc
+
+LOCAL_MODULE:= overlay_assign_test
+LOCAL_MODULE_TAGS:= tests
+
+LOCAL_CFLAGS += -Wall
+
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	hwc_replay.c \
+	../../hwc/overlay_assign.c
+
+LOCAL_C_INCLUDES += \
+	$(LOCAL_PATH)/include \
+	$(LOCAL_PATH)/../../kernel-headers \
+	$(LOCAL_PATH)/../../hwc \
+	external/libpng \
+	external/zlib
+
+LOCAL_STATIC_LIBRARIES:= libpng libz
+LOCAL_LDLIBS += -lpthread
+
+LOCAL_MODULE:= hwc_replay
+LOCAL_MODULE_TAGS:= tests
+
+LOCAL_CFLAGS += -Wall -D__user= -DLOG_TAG=\"ti_hwc\"
+
+include $(BUILD_HOST_EXECUTABLE)
@@ -0,0 +1,507 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replays a composition trace recorded with debug.hwc.trace against the
+ * real prepare/set paths of hwc.c on a Linux host. dsscomp, the omapfb
+ * nodes and the IMG framebuffer HAL are simulated: the display comes
+ * from the trace header, ioctls succeed and Post2 only counts.
+ *
+ * usage: hwc_replay [-v] [-n <repeat>] [-o <new trace>] <trace>
+ *
+ * Reports prepare latency percentiles (host and recorded), the overlay
+ * vs SGX split, and every frame whose plan differs from the recorded
+ * one. Exits non-zero if any plan differs, so a trace recorded on a
+ * device doubles as a regression test for composition changes; -o
+ * records the replayed plans to refresh such a baseline.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdarg.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/* hwc.c is built into the runner so the simulation can see its state */
+static int sim_open(const char *path, int flags, ...);
+static int sim_ioctl(int fd, unsigned long request, ...);
+static void *sim_mmap(void *addr, size_t len, int prot, int flags, int fd, off_t off);
+#define open sim_open
+#define ioctl sim_ioctl
+#define mmap sim_mmap
+#include "../../hwc/hwc.c"
+#undef open
+#undef ioctl
+#undef mmap
+
+int host_log_verbose;
+
+static struct hwc_trace_header header;
+static const char *record_path;
+static unsigned int post2_count;
+
+/* --- simulated platform --- */
+
+static int sim_open(const char *path, int flags, ...)
+{
+    if (!strncmp(path, "/dev/", 5))
+        return open("/dev/null", O_RDWR);
+    /* no switch nodes: HDMI and dock start unplugged */
+    errno = ENOENT;
+    return -1;
+}
+
+static int sim_ioctl(int fd, unsigned long request, ...)
+{
+    va_list ap;
+    void *arg;
+
+    va_start(ap, request);
+    arg = va_arg(ap, void *);
+    va_end(ap);
+
+    switch (request) {
+    case DSSCIOC_QUERY_DISPLAY: {
+        struct dsscomp_display_info *dis = arg;
+        if (dis->ix) {
+            errno = ENODEV;
+            return -1;
+        }
+        dis->enabled = 1;
+        dis->channel = header.lcd_channel;
+        dis->timings.x_res = header.lcd_xres;
+        dis->timings.y_res = header.lcd_yres;
+        dis->timings.pixel_clock = header.lcd_pixel_clock;
+        dis->width_in_mm = header.lcd_width_mm;
+        dis->height_in_mm = header.lcd_height_mm;
+        dis->modedb_len = 0;
+        return 0;
+    }
+    case FBIOGET_FSCREENINFO: {
+        struct fb_fix_screeninfo *fix = arg;
+        memset(fix, 0, sizeof(*fix));
+        fix->smem_len = header.fb_width * header.fb_height * 4 * 2;
+        return 0;
+    }
+    default:
+        /* SETUP_DISPC, SETUP_DISPLAY, FBIOBLANK, OMAPFB_ENABLEVSYNC */
+        return 0;
+    }
+}
+
+static void *sim_mmap(void *addr, size_t len, int prot, int flags, int fd, off_t off)
+{
+    void *p = malloc(len);
+    return p ? p : MAP_FAILED;
+}
+
+int property_get(const char *key, char *value, const char *default_value)
+{
+    /* the idle thread must not force SGX behind the replay's back */
+    if (!strcmp(key, "debug.hwc.idle"))
+        default_value = "0";
+    else if (!strcmp(key, "debug.hwc.trace") && record_path)
+        default_value = record_path;
+    strncpy(value, default_value ? default_value : "", PROPERTY_VALUE_MAX - 1);
+    value[PROPERTY_VALUE_MAX - 1] = '\0';
+    return strlen(value);
+}
+
+static int uevent_fds[2] = { -1, -1 };
+
+int uevent_init()
+{
+    return pipe(uevent_fds) ? 0 : 1;
+}
+
+int uevent_get_fd()
+{
+    return uevent_fds[0];
+}
+
+int uevent_next_event(char *buffer, int buffer_length)
+{
+    return 0;
+}
+
+EGLBoolean eglSwapBuffers(EGLDisplay dpy, EGLSurface surface)
+{
+    return EGL_TRUE;
+}
+
+static int sim_post2(framebuffer_device_t *fb, buffer_handle_t *buffers,
+                     int num_buffers, void *data, int data_length)
+{
+    post2_count++;
+    return 0;
+}
+
+static IMG_framebuffer_device_public_t sim_fb = {
+    .Post2 = sim_post2,
+};
+
+static IMG_gralloc_module_public_t sim_gralloc = {
+    .base.common.author = "Imagination Technologies",
+    .psFrameBufferDevice = &sim_fb,
+};
+
+int hw_get_module(const char *id, const struct hw_module_t **module)
+{
+    *module = &sim_gralloc.base.common;
+    return 0;
+}
+
+static void sim_invalidate(const struct hwc_procs *procs)
+{
+}
+
+static void sim_vsync(const struct hwc_procs *procs, int disp, int64_t timestamp)
+{
+}
+
+static hwc_procs_t sim_procs = {
+    .invalidate = sim_invalidate,
+    .vsync = sim_vsync,
+};
+
+/* --- buffers: one fake gralloc handle per recorded handle id --- */
+
+struct sim_buffer {
+    __u32 id;
+    IMG_native_handle_t handle;
+};
+
+static struct sim_buffer *buffers;
+static unsigned int num_buffers, max_buffers;
+
+static IMG_native_handle_t *get_buffer(struct hwc_trace_layer *l)
+{
+    unsigned int i;
+
+    if (!l->handle)
+        return NULL;
+    for (i = 0; i < num_buffers; i++)
+        if (buffers[i].id == l->handle)
+            goto found;
+
+    if (num_buffers == max_buffers) {
+        max_buffers = max_buffers ? max_buffers * 2 : 64;
+        buffers = realloc(buffers, max_buffers * sizeof(*buffers));
+        if (!buffers) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    i = num_buffers++;
+    memset(&buffers[i], 0, sizeof(buffers[i]));
+    buffers[i].id = l->handle;
+    buffers[i].handle.base.numFds = IMG_NATIVE_HANDLE_NUMFDS;
+    buffers[i].handle.base.numInts = IMG_NATIVE_HANDLE_NUMINTS;
+found:
+    /* the recorded attributes win if a handle id got recycled */
+    buffers[i].handle.iFormat = l->format;
+    buffers[i].handle.iWidth = l->width;
+    buffers[i].handle.iHeight = l->height;
+    buffers[i].handle.usage = l->usage;
+    return &buffers[i].handle;
+}
+
+/* --- trace --- */
+
+struct frame {
+    struct hwc_trace_frame f;
+    struct hwc_trace_layer *layers;
+    struct hwc_trace_ovl *ovls;
+};
+
+/* dsscomp_setup_dispc_data.ovls */
+#define MAX_TRACE_OVLS 5
+
+static struct frame *frames;
+static unsigned int num_frames;
+
+static int load_trace(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    unsigned int max_frames = 0;
+    struct frame fr;
+
+    if (!fp) {
+        fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        header.magic != HWC_TRACE_MAGIC || header.version != HWC_TRACE_VERSION) {
+        fprintf(stderr, "%s: not a version %d hwc trace\n", path, HWC_TRACE_VERSION);
+        fclose(fp);
+        return -1;
+    }
+
+    while (fread(&fr.f, sizeof(fr.f), 1, fp) == 1) {
+        if (fr.f.num_layers > 1024 || fr.f.num_ovls > MAX_TRACE_OVLS)
+            break;
+        fr.layers = calloc(fr.f.num_layers + 1, sizeof(*fr.layers));
+        fr.ovls = calloc(fr.f.num_ovls + 1, sizeof(*fr.ovls));
+        if (!fr.layers || !fr.ovls ||
+            fread(fr.layers, sizeof(*fr.layers), fr.f.num_layers, fp) != fr.f.num_layers ||
+            fread(fr.ovls, sizeof(*fr.ovls), fr.f.num_ovls, fp) != fr.f.num_ovls) {
+            /* a device trace may end mid record */
+            free(fr.layers);
+            free(fr.ovls);
+            break;
+        }
+        if (num_frames == max_frames) {
+            max_frames = max_frames ? max_frames * 2 : 256;
+            frames = realloc(frames, max_frames * sizeof(*frames));
+            if (!frames) {
+                fprintf(stderr, "out of memory\n");
+                exit(1);
+            }
+        }
+        frames[num_frames++] = fr;
+    }
+    fclose(fp);
+    return 0;
+}
+
+/* --- replay --- */
+
+struct stats {
+    __u32 *host_us;
+    __u32 *device_us;
+    unsigned int frames;
+    unsigned int sgx_frames;
+    unsigned int ovl_layers;
+    unsigned int sgx_layers;
+    unsigned int diff_frames;
+    unsigned int diff_ext_frames;
+};
+
+static int diff_frame(unsigned int ix, struct frame *fr, hwc_display_contents_1_t *list,
+                      omap4_hwc_device_t *hwc_dev)
+{
+    struct dsscomp_setup_dispc_data *dsscomp = &hwc_dev->dsscomp_data;
+    struct hwc_trace_layer l;
+    struct hwc_trace_ovl o;
+    int diffs = 0;
+    unsigned int i;
+
+    if (hwc_dev->use_sgx != fr->f.use_sgx || dsscomp->num_ovls != fr->f.num_ovls ||
+        hwc_dev->post2_layers != fr->f.post2_layers) {
+        if (host_log_verbose)
+            printf("frame %u: sgx %u->%d ovls %u->%d post2 %u->%d\n", ix,
+                   fr->f.use_sgx, hwc_dev->use_sgx, fr->f.num_ovls, dsscomp->num_ovls,
+                   fr->f.post2_layers, hwc_dev->post2_layers);
+        diffs++;
+    }
+    for (i = 0; i < fr->f.num_layers; i++) {
+        if (list->hwLayers[i].compositionType == fr->layers[i].composition_type)
+            continue;
+        if (host_log_verbose) {
+            trace_layer(&l, &list->hwLayers[i]);
+            printf("frame %u: layer %u %dx%d %s -> %s\n", ix, i, l.width, l.height,
+                   fr->layers[i].composition_type == HWC_OVERLAY ? "OV" : "FB",
+                   l.composition_type == HWC_OVERLAY ? "OV" : "FB");
+        }
+        diffs++;
+    }
+    for (i = 0; i < fr->f.num_ovls && i < (unsigned int) dsscomp->num_ovls; i++) {
+        trace_ovl(&o, &dsscomp->ovls[i]);
+        /* buffer addresses are only meaningful on the device */
+        o.ba = fr->ovls[i].ba;
+        if (!memcmp(&o, &fr->ovls[i], sizeof(o)))
+            continue;
+        if (host_log_verbose)
+            printf("frame %u: ovl %u (%ux%u z%u) -> (%ux%u z%u)\n", ix, o.ix,
+                   fr->ovls[i].width, fr->ovls[i].height, fr->ovls[i].zorder,
+                   o.width, o.height, o.zorder);
+        diffs++;
+    }
+    return diffs;
+}
+
+static void replay_frame(unsigned int ix, struct frame *fr, omap4_hwc_device_t *hwc_dev,
+                         hwc_display_contents_1_t *list, struct stats *st)
+{
+    hwc_composer_device_1_t *dev = &hwc_dev->base;
+    unsigned int i;
+    __u32 start;
+    int sgx = 0;
+
+    list->flags = fr->f.list_flags;
+    list->numHwLayers = fr->f.num_layers;
+    for (i = 0; i < fr->f.num_layers; i++) {
+        struct hwc_trace_layer *l = &fr->layers[i];
+        hwc_layer_1_t *layer = &list->hwLayers[i];
+
+        memset(layer, 0, sizeof(*layer));
+        layer->compositionType = HWC_FRAMEBUFFER;
+        layer->flags = l->flags;
+        layer->handle = (buffer_handle_t) get_buffer(l);
+        layer->transform = l->transform;
+        layer->blending = l->blending;
+        layer->sourceCrop = (hwc_rect_t) { l->crop[0], l->crop[1], l->crop[2], l->crop[3] };
+        layer->displayFrame = (hwc_rect_t) { l->frame[0], l->frame[1], l->frame[2], l->frame[3] };
+        layer->visibleRegionScreen.numRects = 1;
+        layer->visibleRegionScreen.rects = &layer->displayFrame;
+        layer->acquireFenceFd = -1;
+        layer->releaseFenceFd = -1;
+    }
+
+    /* idle and layer-change fallbacks are state the trace carries in */
+    pthread_mutex_lock(&hwc_dev->lock);
+    hwc_dev->force_sgx = fr->f.force_sgx;
+    pthread_mutex_unlock(&hwc_dev->lock);
+
+    start = time_us();
+    dev->prepare(dev, 1, &list);
+    st->host_us[st->frames] = time_us() - start;
+    st->device_us[st->frames] = fr->f.prepare_us;
+
+    for (i = 0; i < fr->f.num_layers; i++) {
+        if (list->hwLayers[i].compositionType == HWC_OVERLAY) {
+            st->ovl_layers++;
+        } else {
+            st->sgx_layers++;
+            sgx = 1;
+        }
+    }
+    st->sgx_frames += sgx;
+
+    if (diff_frame(ix, fr, list, hwc_dev)) {
+        st->diff_frames++;
+        /* cloning state comes from hotplug events the replay does not see */
+        if (fr->f.ext_enabled)
+            st->diff_ext_frames++;
+    }
+
+    dev->set(dev, 1, &list);
+    st->frames++;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    __u32 x = *(const __u32 *) a, y = *(const __u32 *) b;
+    return x < y ? -1 : x > y;
+}
+
+static void print_latency(const char *name, __u32 *us, unsigned int n)
+{
+    qsort(us, n, sizeof(*us), cmp_u32);
+    printf("%-18s p50 %5uus  p90 %5uus  p99 %5uus  max %5uus\n", name,
+           us[n * 50 / 100], us[n * 90 / 100], us[n * 99 / 100], us[n - 1]);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: hwc_replay [-v] [-n <repeat>] [-o <new trace>] <trace>\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    omap4_hwc_device_t *hwc_dev;
+    hwc_display_contents_1_t *list;
+    hw_device_t *device;
+    struct stats st;
+    unsigned int i, max_layers = 0;
+    int repeat = 1, opt, err;
+
+    while ((opt = getopt(argc, argv, "vn:o:")) != -1) {
+        switch (opt) {
+        case 'v':
+            host_log_verbose = 1;
+            break;
+        case 'n':
+            repeat = atoi(optarg);
+            if (repeat < 1)
+                usage();
+            break;
+        case 'o':
+            record_path = optarg;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind != argc - 1)
+        usage();
+
+    if (load_trace(argv[optind]))
+        return 2;
+    if (!num_frames) {
+        fprintf(stderr, "%s: no frames\n", argv[optind]);
+        return 2;
+    }
+
+    sim_fb.base.width = header.fb_width;
+    sim_fb.base.height = header.fb_height;
+    sim_fb.base.stride = header.fb_width;
+    sim_fb.base.format = header.fb_format;
+
+    err = omap4_hwc_device_open(&HAL_MODULE_INFO_SYM.base.common,
+                                HWC_HARDWARE_COMPOSER, &device);
+    if (err) {
+        fprintf(stderr, "hwc open failed: %d\n", err);
+        return 2;
+    }
+    hwc_dev = (omap4_hwc_device_t *) device;
+    hwc_dev->base.registerProcs(&hwc_dev->base, &sim_procs);
+    /* nobody drains the post pipe with the idle timer off */
+    fcntl(hwc_dev->pipe_fds[1], F_SETFL, O_NONBLOCK);
+
+    for (i = 0; i < num_frames; i++)
+        if (frames[i].f.num_layers > max_layers)
+            max_layers = frames[i].f.num_layers;
+    list = calloc(1, sizeof(*list) + max_layers * sizeof(hwc_layer_1_t));
+    memset(&st, 0, sizeof(st));
+    st.host_us = calloc((size_t) num_frames * repeat, sizeof(__u32));
+    st.device_us = calloc((size_t) num_frames * repeat, sizeof(__u32));
+    if (!list || !st.host_us || !st.device_us) {
+        fprintf(stderr, "out of memory\n");
+        return 2;
+    }
+    /* any non-NULL dpy/sur: set() only checks them to detect blanking */
+    list->dpy = (hwc_display_t) list;
+    list->sur = (hwc_surface_t) list;
+
+    while (repeat--)
+        for (i = 0; i < num_frames; i++)
+            replay_frame(i, &frames[i], hwc_dev, list, &st);
+
+    printf("%s: %ux%u lcd %ux%u, %u frames (%u replayed), %u buffers, %u posts\n",
+           argv[optind], header.fb_width, header.fb_height, header.lcd_xres,
+           header.lcd_yres, num_frames, st.frames, num_buffers, post2_count);
+    print_latency("prepare (host)", st.host_us, st.frames);
+    print_latency("prepare (device)", st.device_us, st.frames);
+    printf("layers: %u overlay, %u SGX; %u of %u frames use SGX\n",
+           st.ovl_layers, st.sgx_layers, st.sgx_frames, st.frames);
+    printf("plan diffs: %u frames (%u while cloning)\n", st.diff_frames, st.diff_ext_frames);
+    printf("plan cache: %u/%u hits\n", hwc_dev->plan.hits,
+           hwc_dev->plan.hits + hwc_dev->plan.misses);
+    printf("fb reuse: %u of %u SGX compositions skipped\n", hwc_dev->fb_content.skipped,
+           hwc_dev->fb_content.skipped + hwc_dev->fb_content.composed);
+
+    device->close(device);
+    return st.diff_frames ? 1 : 0;
+}
@@ -0,0 +1,14 @@
+/* host stand-in for <EGL/egl.h>, used by hwc_replay */
+#ifndef HWC_HOST_EGL_EGL_H
+#define HWC_HOST_EGL_EGL_H
+
+typedef unsigned int EGLBoolean;
+typedef void *EGLDisplay;
+typedef void *EGLSurface;
+
+#define EGL_FALSE 0
+#define EGL_TRUE  1
+
+EGLBoolean eglSwapBuffers(EGLDisplay dpy, EGLSurface surface);
+
+#endif
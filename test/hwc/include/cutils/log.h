@@ -0,0 +1,20 @@
+/* host stand-in for <cutils/log.h>, used by hwc_replay */
+#ifndef HWC_HOST_CUTILS_LOG_H
+#define HWC_HOST_CUTILS_LOG_H
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/* set by the replay runner; errors are always shown */
+extern int host_log_verbose;
+
+#define HOST_LOG(lvl, ...) do { fprintf(stderr, lvl "/" LOG_TAG ": " __VA_ARGS__); \
+                                fputc('\n', stderr); } while (0)
+#define ALOGE(...) HOST_LOG("E", __VA_ARGS__)
+#define ALOGW(...) do { if (host_log_verbose) HOST_LOG("W", __VA_ARGS__); } while (0)
+#define ALOGI(...) do { if (host_log_verbose) HOST_LOG("I", __VA_ARGS__); } while (0)
+#define ALOGD(...) do { if (host_log_verbose) HOST_LOG("D", __VA_ARGS__); } while (0)
+#define ALOGV(...) do { } while (0)
+
+#endif
@@ -0,0 +1,12 @@
+/* host stand-in for <cutils/native_handle.h>, used by hwc_replay */
+#ifndef HWC_HOST_CUTILS_NATIVE_HANDLE_H
+#define HWC_HOST_CUTILS_NATIVE_HANDLE_H
+
+typedef struct native_handle {
+    int version;
+    int numFds;
+    int numInts;
+    int data[0];
+} native_handle_t;
+
+#endif
@@ -0,0 +1,10 @@
+/* host stand-in for <cutils/properties.h>, used by hwc_replay */
+#ifndef HWC_HOST_CUTILS_PROPERTIES_H
+#define HWC_HOST_CUTILS_PROPERTIES_H
+
+#define PROPERTY_KEY_MAX   32
+#define PROPERTY_VALUE_MAX 92
+
+int property_get(const char *key, char *value, const char *default_value);
+
+#endif
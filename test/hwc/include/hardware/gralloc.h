@@ -0,0 +1,33 @@
+/* host stand-in for <hardware/gralloc.h>, used by hwc_replay */
+#ifndef HWC_HOST_HARDWARE_GRALLOC_H
+#define HWC_HOST_HARDWARE_GRALLOC_H
+
+#include <hardware/hardware.h>
+#include <system/graphics.h>
+
+#define GRALLOC_HARDWARE_MODULE_ID "gralloc"
+
+enum {
+    GRALLOC_USAGE_PROTECTED     = 0x00004000,
+    GRALLOC_USAGE_EXTERNAL_DISP = 0x00002000,
+};
+
+typedef const native_handle_t *buffer_handle_t;
+
+typedef struct gralloc_module_t {
+    struct hw_module_t common;
+} gralloc_module_t;
+
+typedef struct framebuffer_device_t {
+    struct hw_device_t common;
+    uint32_t flags;
+    uint32_t width;
+    uint32_t height;
+    int stride;
+    int format;
+    float xdpi;
+    float ydpi;
+    float fps;
+} framebuffer_device_t;
+
+#endif
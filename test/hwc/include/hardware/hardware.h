@@ -0,0 +1,45 @@
+/* host stand-in for <hardware/hardware.h>, used by hwc_replay */
+#ifndef HWC_HOST_HARDWARE_HARDWARE_H
+#define HWC_HOST_HARDWARE_HARDWARE_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <cutils/native_handle.h>
+
+#define MAKE_TAG_CONSTANT(A,B,C,D) (((A) << 24) | ((B) << 16) | ((C) << 8) | (D))
+#define HARDWARE_MODULE_TAG MAKE_TAG_CONSTANT('H', 'W', 'M', 'T')
+#define HARDWARE_DEVICE_TAG MAKE_TAG_CONSTANT('H', 'W', 'D', 'T')
+#define HARDWARE_MAKE_API_VERSION(maj,min) ((((maj) & 0xff) << 8) | ((min) & 0xff))
+#define HARDWARE_HAL_API_VERSION HARDWARE_MAKE_API_VERSION(1, 0)
+
+#define HAL_PRIORITY_URGENT_DISPLAY (-8)
+
+struct hw_module_t;
+struct hw_device_t;
+
+typedef struct hw_module_methods_t {
+    int (*open)(const struct hw_module_t *module, const char *id,
+                struct hw_device_t **device);
+} hw_module_methods_t;
+
+typedef struct hw_module_t {
+    uint32_t tag;
+    uint16_t module_api_version;
+    uint16_t hal_api_version;
+    const char *id;
+    const char *name;
+    const char *author;
+    struct hw_module_methods_t *methods;
+    void *dso;
+} hw_module_t;
+
+typedef struct hw_device_t {
+    uint32_t tag;
+    uint32_t version;
+    struct hw_module_t *module;
+    int (*close)(struct hw_device_t *device);
+} hw_device_t;
+
+int hw_get_module(const char *id, const struct hw_module_t **module);
+
+#endif
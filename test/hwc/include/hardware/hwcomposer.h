@@ -0,0 +1,122 @@
+/* host stand-in for <hardware/hwcomposer.h> (HWC 1.0), used by hwc_replay */
+#ifndef HWC_HOST_HARDWARE_HWCOMPOSER_H
+#define HWC_HOST_HARDWARE_HWCOMPOSER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <hardware/gralloc.h>
+
+#define HWC_HARDWARE_MODULE_ID "hwcomposer"
+#define HWC_HARDWARE_COMPOSER "composer"
+#define HWC_MODULE_API_VERSION_0_1 HARDWARE_MAKE_API_VERSION(0, 1)
+#define HWC_DEVICE_API_VERSION_1_0 HARDWARE_MAKE_API_VERSION(1, 0)
+
+enum {
+    HWC_EGL_ERROR = -1
+};
+
+enum {
+    HWC_HINT_TRIPLE_BUFFER = 0x00000001,
+    HWC_HINT_CLEAR_FB      = 0x00000002
+};
+
+enum {
+    HWC_SKIP_LAYER = 0x00000001,
+};
+
+enum {
+    HWC_FRAMEBUFFER = 0,
+    HWC_BACKGROUND = 1,
+    HWC_OVERLAY = 2,
+};
+
+enum {
+    HWC_BLENDING_NONE     = 0x0100,
+    HWC_BLENDING_PREMULT  = 0x0105,
+    HWC_BLENDING_COVERAGE = 0x0405
+};
+
+enum {
+    HWC_TRANSFORM_FLIP_H  = 0x01,
+    HWC_TRANSFORM_FLIP_V  = 0x02,
+    HWC_TRANSFORM_ROT_90  = 0x04,
+    HWC_TRANSFORM_ROT_180 = 0x03,
+    HWC_TRANSFORM_ROT_270 = 0x07,
+};
+
+enum {
+    HWC_GEOMETRY_CHANGED = 0x00000001,
+};
+
+enum {
+    HWC_BACKGROUND_LAYER_SUPPORTED = 0,
+    HWC_VSYNC_PERIOD = 1,
+};
+
+enum {
+    HWC_EVENT_VSYNC = 0
+};
+
+typedef struct hwc_rect {
+    int left;
+    int top;
+    int right;
+    int bottom;
+} hwc_rect_t;
+
+typedef struct hwc_region {
+    size_t numRects;
+    hwc_rect_t const *rects;
+} hwc_region_t;
+
+typedef struct hwc_layer_1 {
+    int32_t compositionType;
+    uint32_t hints;
+    uint32_t flags;
+    buffer_handle_t handle;
+    uint32_t transform;
+    int32_t blending;
+    hwc_rect_t sourceCrop;
+    hwc_rect_t displayFrame;
+    hwc_region_t visibleRegionScreen;
+    int acquireFenceFd;
+    int releaseFenceFd;
+} hwc_layer_1_t;
+
+typedef void *hwc_display_t;
+typedef void *hwc_surface_t;
+
+typedef struct hwc_display_contents_1 {
+    int retireFenceFd;
+    hwc_display_t dpy;
+    hwc_surface_t sur;
+    uint32_t flags;
+    size_t numHwLayers;
+    hwc_layer_1_t hwLayers[0];
+} hwc_display_contents_1_t;
+
+typedef struct hwc_procs {
+    void (*invalidate)(const struct hwc_procs *procs);
+    void (*vsync)(const struct hwc_procs *procs, int disp, int64_t timestamp);
+} hwc_procs_t;
+
+typedef struct hwc_module {
+    struct hw_module_t common;
+} hwc_module_t;
+
+typedef struct hwc_composer_device_1 {
+    struct hw_device_t common;
+    int (*prepare)(struct hwc_composer_device_1 *dev,
+                   size_t numDisplays, hwc_display_contents_1_t **displays);
+    int (*set)(struct hwc_composer_device_1 *dev,
+               size_t numDisplays, hwc_display_contents_1_t **displays);
+    int (*eventControl)(struct hwc_composer_device_1 *dev, int dpy,
+                        int event, int enabled);
+    int (*blank)(struct hwc_composer_device_1 *dev, int dpy, int blank);
+    int (*query)(struct hwc_composer_device_1 *dev, int what, int *value);
+    void (*registerProcs)(struct hwc_composer_device_1 *dev,
+                          hwc_procs_t const *procs);
+    void (*dump)(struct hwc_composer_device_1 *dev, char *buff, int buff_len);
+} hwc_composer_device_1_t;
+
+#endif
@@ -0,0 +1,9 @@
+/* host stand-in for <hardware_legacy/uevent.h>, used by hwc_replay */
+#ifndef HWC_HOST_HARDWARE_LEGACY_UEVENT_H
+#define HWC_HOST_HARDWARE_LEGACY_UEVENT_H
+
+int uevent_init();
+int uevent_get_fd();
+int uevent_next_event(char *buffer, int buffer_length);
+
+#endif
@@ -0,0 +1,14 @@
+/* host stand-in for <system/graphics.h>, used by hwc_replay */
+#ifndef HWC_HOST_SYSTEM_GRAPHICS_H
+#define HWC_HOST_SYSTEM_GRAPHICS_H
+
+enum {
+    HAL_PIXEL_FORMAT_RGBA_8888 = 1,
+    HAL_PIXEL_FORMAT_RGBX_8888 = 2,
+    HAL_PIXEL_FORMAT_RGB_888   = 3,
+    HAL_PIXEL_FORMAT_RGB_565   = 4,
+    HAL_PIXEL_FORMAT_BGRA_8888 = 5,
+    HAL_PIXEL_FORMAT_YV12      = 0x32315659,
+};
+
+#endif
@@ -0,0 +1,154 @@
+/* host stand-in for <video/dsscomp.h> used by hwc_replay; only what hwc.c uses */
+#ifndef HWC_HOST_VIDEO_DSSCOMP_H
+#define HWC_HOST_VIDEO_DSSCOMP_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/* from the OMAP kernel's <linux/fb.h> */
+#ifndef FB_FLAG_RATIO_4_3
+#define FB_FLAG_RATIO_4_3   64
+#define FB_FLAG_RATIO_16_9  128
+#endif
+
+enum omap_color_mode {
+    OMAP_DSS_COLOR_RGB16    = 1 << 4,
+    OMAP_DSS_COLOR_RGB24U   = 1 << 5,
+    OMAP_DSS_COLOR_ARGB32   = 1 << 8,
+    OMAP_DSS_COLOR_NV12     = 1 << 14,
+};
+
+enum omap_channel {
+    OMAP_DSS_CHANNEL_LCD    = 0,
+    OMAP_DSS_CHANNEL_DIGIT  = 1,
+    OMAP_DSS_CHANNEL_LCD2   = 2,
+};
+
+enum omap_dss_ilace_mode {
+    OMAP_DSS_ILACE_NONE     = 0,
+};
+
+enum omap_dss_buffer_addressing_type {
+    OMAP_DSS_BUFADDR_DIRECT,
+    OMAP_DSS_BUFADDR_BYTYPE,
+    OMAP_DSS_BUFADDR_ION,
+    OMAP_DSS_BUFADDR_GRALLOC,
+    OMAP_DSS_BUFADDR_OVL_IX,
+    OMAP_DSS_BUFADDR_LAYER_IX,
+    OMAP_DSS_BUFADDR_FB,
+};
+
+enum dsscomp_setup_mode {
+    DSSCOMP_SETUP_MODE_APPLY    = (1 << 0),
+    DSSCOMP_SETUP_MODE_DISPLAY  = (1 << 1),
+    DSSCOMP_SETUP_MODE_CAPTURE  = (1 << 2),
+    DSSCOMP_SETUP_APPLY         = DSSCOMP_SETUP_MODE_APPLY,
+    DSSCOMP_SETUP_DISPLAY       = DSSCOMP_SETUP_MODE_APPLY | DSSCOMP_SETUP_MODE_DISPLAY,
+};
+
+struct dss2_rect_t {
+    __s32 x;
+    __s32 y;
+    __u32 w;
+    __u32 h;
+};
+
+struct omap_dss_cconv_coefs {
+    __s16 ry, rcr, rcb;
+    __s16 gy, gcr, gcb;
+    __s16 by, bcr, bcb;
+    __u16 full_range;
+};
+
+struct dss2_vc1_range_map_info {
+    __u8 enable;
+    __u8 range_y;
+    __u8 range_uv;
+};
+
+struct dss2_ovl_cfg {
+    __u16 width;
+    __u16 height;
+    __u32 stride;
+    enum omap_color_mode color_mode;
+    __u8 pre_mult_alpha;
+    __u8 global_alpha;
+    __u8 rotation;
+    __u8 mirror;
+    enum omap_dss_ilace_mode ilace;
+    struct dss2_rect_t win;
+    struct dss2_rect_t crop;
+    struct omap_dss_cconv_coefs cconv;
+    struct dss2_vc1_range_map_info vc1;
+    __u8 ix;
+    __u8 zorder;
+    __u8 enabled;
+    __u8 zonly;
+    __u8 mgr_ix;
+};
+
+struct dss2_ovl_info {
+    struct dss2_ovl_cfg cfg;
+    enum omap_dss_buffer_addressing_type addressing;
+    __u32 ba;
+    __u32 uv;
+};
+
+struct dss2_mgr_info {
+    __u32 ix;
+    __u32 default_color;
+    __u8 interlaced;
+    __u8 alpha_blending;
+    __u8 swap_rb;
+};
+
+struct dsscomp_setup_dispc_data {
+    __u32 sync_id;
+    enum dsscomp_setup_mode mode;
+    __u16 num_ovls;
+    __u16 num_mgrs;
+    __u16 get_sync_obj;
+    struct dss2_ovl_info ovls[5];
+    struct dss2_mgr_info mgrs[3];
+};
+
+struct omap_video_timings {
+    __u16 x_res;
+    __u16 y_res;
+    __u32 pixel_clock;
+};
+
+struct dsscomp_videomode {
+    const char *name;
+    __u32 refresh;
+    __u32 xres;
+    __u32 yres;
+    __u32 pixclock;
+    __u32 flag;
+    __u32 vmode;
+};
+
+struct dsscomp_display_info {
+    __u32 ix;
+    __u32 overlays_available;
+    __u32 overlays_owned;
+    enum omap_channel channel;
+    __u8 enabled;
+    struct omap_video_timings timings;
+    struct dss2_mgr_info mgr;
+    __u16 width_in_mm;
+    __u16 height_in_mm;
+    __u32 modedb_len;
+    struct dsscomp_videomode modedb[];
+};
+
+struct dsscomp_setup_display_data {
+    __u32 ix;
+    struct dsscomp_videomode mode;
+};
+
+#define DSSCIOC_SETUP_DISPC     _IOW('O', 128, struct dsscomp_setup_dispc_data)
+#define DSSCIOC_QUERY_DISPLAY   _IOWR('O', 131, struct dsscomp_display_info)
+#define DSSCIOC_SETUP_DISPLAY   _IOW('O', 132, struct dsscomp_setup_display_data)
+
+#endif
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Runs the greedy and the cost-based overlay assignment over a corpus of
+ * layer stacks and reports the area SGX still has to compose with each.
+ * Fails if the cost-based assignment breaks a hardware constraint or
+ * saves less than the greedy one.
+ *
+ * usage: overlay_assign_test [layer_stacks.txt]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "overlay_assign.h"
+
+#define MAX_TILER_SLOT (16 << 20)
+#define HW_ALIGN 32
+#define ALIGN(x, a) (((x) + (a) - 1) & ~((a) - 1))
+/* 720p60 panel */
+#define LINE_RATE (720 * 60)
+
+struct stack {
+    char name[64];
+    int max_ovls;
+    __u32 max_bw;
+    int num;
+    struct ovl_candidate layers[MAX_ASSIGN_LAYERS];
+    __u32 area[MAX_ASSIGN_LAYERS];
+};
+
+static int parse_layer(struct stack *s, const char *line)
+{
+    char fmt[16];
+    unsigned int src_w, src_h, dst_w, dst_h, blended, eligible, bpp;
+    struct ovl_candidate *l;
+
+    if (sscanf(line, "layer %15s %u %u %u %u %u %u", fmt, &src_w, &src_h,
+               &dst_w, &dst_h, &blended, &eligible) != 7 ||
+        s->num >= MAX_ASSIGN_LAYERS)
+        return -1;
+
+    if (!strcmp(fmt, "NV12"))
+        bpp = 12;
+    else if (!strcmp(fmt, "RGB565"))
+        bpp = 16;
+    else if (!strcmp(fmt, "RGBA") || !strcmp(fmt, "RGBX"))
+        bpp = 32;
+    else
+        return -1;
+
+    l = &s->layers[s->num];
+    l->score = overlay_score(src_w, src_h, bpp, dst_w, dst_h);
+    /* NV12 is in TILER 2D, other buffers take 1D TILER space */
+    l->mem = bpp == 12 ? 0 : ALIGN(src_w, HW_ALIGN) * bpp / 8 * src_h;
+    l->bw = overlay_fetch_bw(src_w, src_h, bpp, dst_h, LINE_RATE, 0);
+    l->blended = blended;
+    l->eligible = eligible;
+    s->area[s->num++] = dst_w * dst_h;
+    return 0;
+}
+
+static __u32 sgx_area(struct stack *s, __u32 mask)
+{
+    __u32 area = 0;
+    int i;
+
+    for (i = 0; i < s->num; i++)
+        if (!(mask & (1U << i)))
+            area += s->area[i];
+    return area;
+}
+
+static __u32 score(struct stack *s, __u32 mask)
+{
+    __u32 total = 0;
+    int i;
+
+    for (i = 0; i < s->num; i++)
+        if (mask & (1U << i))
+            total += s->layers[i].score;
+    return total;
+}
+
+static const char *check(struct stack *s, __u32 mask)
+{
+    __u32 mem = 0, bw = 0;
+    int i, ovls = 0, fb_below = 0;
+
+    for (i = 0; i < s->num; i++) {
+        if (!(mask & (1U << i))) {
+            fb_below = 1;
+            continue;
+        }
+        if (!s->layers[i].eligible)
+            return "ineligible layer on DSS";
+        if (s->layers[i].blended && fb_below)
+            return "blended layer above the framebuffer";
+        mem += s->layers[i].mem;
+        bw += s->layers[i].bw;
+        ovls++;
+    }
+    if (s->num < MAX_ASSIGN_LAYERS && (mask >> s->num))
+        return "layer out of range";
+    if (ovls > s->max_ovls)
+        return "too many overlays";
+    if (mem >= MAX_TILER_SLOT)
+        return "TILER slot overflow";
+    if (bw > s->max_bw)
+        return "fetch bandwidth over budget";
+    return NULL;
+}
+
+static int run(struct stack *s, unsigned long long *before, unsigned long long *after)
+{
+    __u32 greedy = overlay_assign_greedy(s->layers, s->num, s->max_ovls, MAX_TILER_SLOT,
+                                         s->max_bw);
+    __u32 best = overlay_assign(s->layers, s->num, s->max_ovls, MAX_TILER_SLOT, s->max_bw);
+    const char *err = check(s, best);
+
+    if (!err && score(s, best) < score(s, greedy))
+        err = "worse than greedy";
+
+    printf("%-32s %02x -> %02x  SGX area %8u -> %8u%s%s\n", s->name,
+           greedy, best, sgx_area(s, greedy), sgx_area(s, best),
+           err ? "  FAIL: " : "", err ? err : "");
+    *before += sgx_area(s, greedy);
+    *after += sgx_area(s, best);
+    return err ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = argc > 1 ? argv[1] : "layer_stacks.txt";
+    FILE *f = fopen(path, "r");
+    char line[256];
+    struct stack s;
+    unsigned long long before = 0, after = 0;
+    int in_stack = 0, stacks = 0, failed = 0, lineno = 0;
+
+    if (!f) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return 2;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        if (!strncmp(line, "stack ", 6)) {
+            unsigned int budget_mb = 0;
+
+            memset(&s, 0, sizeof(s));
+            if (sscanf(line, "stack %63s %d %u", s.name, &s.max_ovls, &budget_mb) < 2)
+                goto bad_line;
+            s.max_bw = budget_mb ? budget_mb * 1024 : 0xffffffff;
+            in_stack = 1;
+        } else if (in_stack && !strncmp(line, "layer ", 6)) {
+            if (parse_layer(&s, line))
+                goto bad_line;
+        } else if (in_stack && !strncmp(line, "end", 3)) {
+            failed += run(&s, &before, &after);
+            stacks++;
+            in_stack = 0;
+        } else {
+            goto bad_line;
+        }
+    }
+    fclose(f);
+
+    printf("%d stacks, SGX composed area %llu -> %llu", stacks, before, after);
+    if (before)
+        printf(" (%llu%%)", after * 100 / before);
+    printf(", %d failed\n", failed);
+    return failed ? 1 : 0;
+
+bad_line:
+    fprintf(stderr, "%s:%d: cannot parse: %s", path, lineno, line);
+    fclose(f);
+    return 2;
+}
@@ -0,0 +1,21 @@
+LOCAL_PATH:= $(call my-dir)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	ion_bench.c \
+	../../ion/ion.c \
+	../../ion/ion_registry.c
+
+LOCAL_C_INCLUDES += \
+	$(LOCAL_PATH)/../../ion
+
+LOCAL_STATIC_LIBRARIES:= liblog
+LOCAL_LDLIBS += -lpthread -lrt
+
+LOCAL_MODULE:= ion_bench
+LOCAL_MODULE_TAGS:= tests
+
+LOCAL_CFLAGS += -Wall
+
+include $(BUILD_HOST_EXECUTABLE)
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Times the libion buffer path through the registry on a Linux host with
+ * /dev/dma_heap/system (or on a device with /dev/ion):
+ *
+ *   - allocating and freeing a page and a 1080p NV12 frame
+ *   - the first mapping of a frame and the cached mappings after it
+ *   - ION_SYNC_START/END brackets around the whole frame, around the
+ *     rows the JPEG encoder reads for a 160x120 thumbnail, and around an
+ *     empty range
+ *   - a thumbnail-sized CPU read inside its sync brackets
+ *
+ * DMA_BUF_IOCTL_SYNC has no range, so expect the same cost for the whole
+ * frame and the thumbnail rows. Also checks the registry's lookups.
+ *
+ * usage: ion_bench [iterations]
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ion.h"
+
+#define FRAME_WIDTH     1920
+#define FRAME_HEIGHT    1080
+#define FRAME_SIZE      (FRAME_WIDTH * FRAME_HEIGHT * 3 / 2)
+#define THUMB_WIDTH     160
+#define THUMB_HEIGHT    120
+#define PAGE_BYTES      4096
+#define CLIENT          "ion_bench"
+
+static int failures;
+
+static void check(int condition, const char *message)
+{
+        if (!condition) {
+                printf("FAILED: %s\n", message);
+                failures++;
+        }
+}
+
+static double now(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *what, double seconds, int iterations)
+{
+        printf("%-36s %9.2f us\n", what, seconds * 1e6 / iterations);
+}
+
+static void bench_alloc(size_t len, const char *what, int iterations)
+{
+        struct ion_handle *handle;
+        double start;
+        int i, share_fd;
+
+        start = now();
+        for (i = 0; i < iterations; i++) {
+                if (ion_registry_alloc(len, 0, ION_HEAP_SYSTEM_MASK, CLIENT,
+                                       &handle, &share_fd)) {
+                        check(0, "alloc");
+                        return;
+                }
+                ion_registry_free(handle, CLIENT);
+        }
+        report(what, now() - start, iterations);
+}
+
+static void bench_sync(unsigned char *frame, size_t offset, size_t len,
+                       const char *what, int iterations)
+{
+        double start;
+        int i;
+
+        start = now();
+        for (i = 0; i < iterations; i++) {
+                ion_registry_sync(frame + offset, len, ION_SYNC_READ | ION_SYNC_START);
+                ion_registry_sync(frame + offset, len, ION_SYNC_READ | ION_SYNC_END);
+        }
+        report(what, now() - start, iterations);
+}
+
+int main(int argc, char *argv[])
+{
+        int iterations = (argc > 1) ? atoi(argv[1]) : 1000;
+        struct ion_handle *handle;
+        unsigned char *frame, *ptr;
+        unsigned int sum = 0;
+        size_t thumb_offset, thumb_len;
+        double start, first_map;
+        int fd, share_fd, i, y;
+
+        fd = ion_registry_open();
+        if (fd < 0) {
+                printf("neither /dev/ion nor /dev/dma_heap/system, nothing to measure\n");
+                return 0;
+        }
+
+        bench_alloc(PAGE_BYTES, "alloc + free, 4 KB", iterations);
+        bench_alloc(FRAME_SIZE, "alloc + free, 1080p NV12", iterations / 10 + 1);
+
+        if (ion_registry_alloc(FRAME_SIZE, 0, ION_HEAP_SYSTEM_MASK, CLIENT,
+                               &handle, &share_fd)) {
+                check(0, "frame alloc");
+                goto out;
+        }
+
+        start = now();
+        check(ion_registry_map(share_fd, &frame) == 0, "first map");
+        first_map = now() - start;
+        report("first map (mmap)", first_map, 1);
+
+        start = now();
+        for (i = 0; i < iterations; i++) {
+                check(ion_registry_map(share_fd, &ptr) == 0 && ptr == frame,
+                      "cached map");
+                ion_registry_unmap(share_fd);
+        }
+        report("cached map + unmap", now() - start, iterations);
+
+        /* the rows the JPEG encoder reads for a thumbnail in the middle */
+        thumb_offset = (FRAME_HEIGHT / 2) * FRAME_WIDTH + FRAME_WIDTH / 2;
+        thumb_len = (THUMB_HEIGHT - 1) * FRAME_WIDTH + THUMB_WIDTH;
+
+        memset(frame, 0x5a, FRAME_SIZE);
+        bench_sync(frame, 0, FRAME_SIZE, "sync start + end, whole frame", iterations);
+        bench_sync(frame, thumb_offset, thumb_len, "sync start + end, thumbnail rows",
+                   iterations);
+        bench_sync(frame, thumb_offset, 0, "sync start + end, empty range", iterations);
+
+        start = now();
+        for (i = 0; i < iterations; i++) {
+                ion_registry_sync(frame + thumb_offset, thumb_len,
+                                  ION_SYNC_READ | ION_SYNC_START);
+                for (y = 0; y < THUMB_HEIGHT; y++)
+                        sum += frame[thumb_offset + y * FRAME_WIDTH + (y % THUMB_WIDTH)];
+                ion_registry_sync(frame + thumb_offset, thumb_len,
+                                  ION_SYNC_READ | ION_SYNC_END);
+        }
+        report("thumbnail read in sync brackets", now() - start, iterations);
+        check(sum == 0x5aU * THUMB_HEIGHT * iterations, "frame contents");
+
+        check(ion_registry_sync(frame + FRAME_SIZE - 1, 2, ION_SYNC_READ) == -ENOENT,
+              "sync past the end of the mapping");
+        check(ion_registry_sync(&sum, sizeof(sum), ION_SYNC_READ) == -ENOENT,
+              "sync of unregistered memory");
+
+        check(ion_registry_lookup(frame + thumb_offset, thumb_len) == share_fd,
+              "lookup by address");
+        check(ion_registry_lookup(&sum, sizeof(sum)) == -ENOENT,
+              "lookup of unregistered memory");
+        {
+                struct ion_handle *imported = NULL;
+
+                /* a second user keeps the buffer after the owner releases */
+                check(ion_registry_import(share_fd, "import", &imported) == 0 &&
+                      imported == handle, "import");
+                check(ion_registry_release(share_fd, CLIENT) == 0, "owner release");
+                check(ion_registry_map(share_fd, &ptr) == 0 && ptr == frame,
+                      "map after owner release");
+                ion_registry_unmap(share_fd);
+                check(ion_registry_import(share_fd + 1000, "import", NULL) == -ENOENT,
+                      "import of unknown fd");
+                handle = imported;
+        }
+
+        ion_registry_unmap(share_fd);
+        check(ion_registry_map(share_fd + 1000, &ptr) == -EINVAL, "map of unknown fd");
+        fflush(stdout);
+        ion_registry_dump(1);
+        ion_registry_free(handle, "import");
+        check(ion_registry_map(share_fd, &ptr) == -EINVAL, "map after last release");
+out:
+        ion_registry_close();
+
+        if (failures) {
+                printf("%d checks failed\n", failures);
+                return 1;
+        }
+        printf("all checks passed\n");
+        return 0;
+}
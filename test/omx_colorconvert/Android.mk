@@ -0,0 +1,61 @@
+LOCAL_PATH:= $(call my-dir)
+
+COLORCONVERT_PATH := $(LOCAL_PATH)/../../domx/omx_proxy_component/omx_colorconvert
+
+# C path on the host
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	colorconvert_test.c \
+	../../domx/omx_proxy_component/omx_colorconvert/src/colorconvert_cpu.c
+
+LOCAL_C_INCLUDES += \
+	$(COLORCONVERT_PATH)/inc
+
+LOCAL_LDLIBS += -lpthread -lrt
+
+LOCAL_MODULE:= colorconvert_test
+LOCAL_MODULE_TAGS:= tests
+
+LOCAL_CFLAGS += -Wall -O2
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# NEON kernel on the host, against a scalar model of the intrinsics
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	colorconvert_test.c \
+	../../domx/omx_proxy_component/omx_colorconvert/src/colorconvert_cpu.c
+
+LOCAL_C_INCLUDES += \
+	$(LOCAL_PATH)/neon_model \
+	$(COLORCONVERT_PATH)/inc
+
+LOCAL_LDLIBS += -lpthread -lrt
+
+LOCAL_MODULE:= colorconvert_neon_model_test
+LOCAL_MODULE_TAGS:= tests
+
+LOCAL_CFLAGS += -Wall -O2 -D__ARM_NEON__
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# NEON kernel on the device
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	colorconvert_test.c \
+	../../domx/omx_proxy_component/omx_colorconvert/src/colorconvert_cpu.c
+
+LOCAL_C_INCLUDES += \
+	$(COLORCONVERT_PATH)/inc
+
+LOCAL_ARM_NEON:= true
+
+LOCAL_MODULE:= colorconvert_neon_test
+LOCAL_MODULE_TAGS:= tests
+
+LOCAL_CFLAGS += -Wall -O2
+
+include $(BUILD_EXECUTABLE)
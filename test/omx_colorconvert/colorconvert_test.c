@@ -0,0 +1,392 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks the encoder proxies' CPU RGBA/BGRA to NV12 converter and times it.
+ *
+ * Bit accuracy: every size, stride, format, matrix and thread count must
+ * match, bit for bit, a plain per-pixel reference of the fixed point
+ * equations documented in colorconvert_cpu.c, and the reference must stay
+ * within MAX_LUMA_ERROR and MAX_CHROMA_ERROR of the floating point
+ * BT.601/BT.709 equations.
+ * Padding around the destination planes must be left untouched.
+ *
+ * Benchmark: converts <frames> 720p and 1080p frames with 1, 2 and 4
+ * threads and reports the time per frame.
+ *
+ * Whether the NEON kernel or the C path is under test depends on the
+ * build, see Android.mk.
+ *
+ * usage: colorconvert_test [frames]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "colorconvert_cpu.h"
+
+#if defined(__arm__) && !defined(__ARM_NEON__)
+#error "build with LOCAL_ARM_NEON := true, this target must test the NEON kernel"
+#endif
+
+/* Largest differences to the floating point equations, in code values.
+ * Chroma adds the 8 bit coefficients' error (up to 1.15 for BT.709) to the
+ * rounding of the 2x2 average */
+#define MAX_LUMA_ERROR 1.0
+#define MAX_CHROMA_ERROR 1.5
+/* Bytes of padding checked after each destination row */
+#define GUARD 16
+#define GUARD_VALUE 0xa5
+
+static int g_nFailures;
+
+static void check(int bCondition, const char *pMessage)
+{
+	if (!bCondition && (g_nFailures++ < 10))
+	{
+		printf("FAILED: %s\n", pMessage);
+	}
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Coefficients in the order Yr Yg Yb Ur Ug Ub Vr Vg Vb, see colorconvert_cpu.c */
+static const int tRefCoeffs[2][9] = {
+	{ 66, 129, 25, 38, 74, 112, 112, 94, 18 },
+	{ 47, 157, 16, 26, 86, 112, 112, 102, 10 },
+};
+
+/* Kr, Kb of each matrix */
+static const double tKrKb[2][2] = {
+	{ 0.299, 0.114 },
+	{ 0.2126, 0.0722 },
+};
+
+static int clamp(int v)
+{
+	return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+static void pixel(const uint8_t *pSrc, int nSrcStride, int nFormat,
+		  int x, int y, int *r, int *g, int *b)
+{
+	const uint8_t *p = pSrc + y * nSrcStride + 4 * x;
+
+	*r = p[nFormat == COLORCONVERT_CPU_FMT_RGBA ? 0 : 2];
+	*g = p[1];
+	*b = p[nFormat == COLORCONVERT_CPU_FMT_RGBA ? 2 : 0];
+}
+
+/* One pixel at a time, straight from the equations */
+static void referenceToNV12(const uint8_t *pSrc, int nSrcStride, int nFormat,
+			    uint8_t *pDstY, uint8_t *pDstUV, int nDstStride,
+			    int nWidth, int nHeight, int nStandard)
+{
+	const int *c = tRefCoeffs[nStandard];
+	int x, y, dx, dy, r, g, b, sr, sg, sb;
+
+	for (y = 0; y < nHeight; y++)
+	{
+		for (x = 0; x < nWidth; x++)
+		{
+			pixel(pSrc, nSrcStride, nFormat, x, y, &r, &g, &b);
+			pDstY[y * nDstStride + x] =
+				((c[0] * r + c[1] * g + c[2] * b + 128) >> 8) + 16;
+		}
+	}
+
+	for (y = 0; y < nHeight; y += 2)
+	{
+		for (x = 0; x < nWidth; x += 2)
+		{
+			sr = sg = sb = 0;
+			for (dy = 0; dy < 2; dy++)
+			{
+				for (dx = 0; dx < 2; dx++)
+				{
+					/* Odd sizes replicate the last row/column */
+					pixel(pSrc, nSrcStride, nFormat,
+					      x + dx < nWidth ? x + dx : x,
+					      y + dy < nHeight ? y + dy : y, &r, &g, &b);
+					sr += r;
+					sg += g;
+					sb += b;
+				}
+			}
+			r = (sr + 2) >> 2;
+			g = (sg + 2) >> 2;
+			b = (sb + 2) >> 2;
+			pDstUV[(y / 2) * nDstStride + x] =
+				clamp(((c[5] * b - c[3] * r - c[4] * g + 128) >> 8) + 128);
+			pDstUV[(y / 2) * nDstStride + x + 1] =
+				clamp(((c[6] * r - c[7] * g - c[8] * b + 128) >> 8) + 128);
+		}
+	}
+}
+
+static double absDiff(double a, double b)
+{
+	return a > b ? a - b : b - a;
+}
+
+static double g_fLumaError;
+static double g_fChromaError;
+
+/* Tracks the distance of the reference output to the limited range equations */
+static void floatError(const uint8_t *pSrc, int nSrcStride, int nFormat,
+		       const uint8_t *pDstY, const uint8_t *pDstUV, int nDstStride,
+		       int nWidth, int nHeight, int nStandard)
+{
+	double kr = tKrKb[nStandard][0], kb = tKrKb[nStandard][1];
+	double kg = 1.0 - kr - kb;
+	double fY, fCb, fCr, fR, fG, fB, e;
+	int x, y, dx, dy, r, g, b;
+
+	for (y = 0; y < nHeight; y++)
+	{
+		for (x = 0; x < nWidth; x++)
+		{
+			pixel(pSrc, nSrcStride, nFormat, x, y, &r, &g, &b);
+			fY = 16.0 + (kr * r + kg * g + kb * b) * 219.0 / 255.0;
+			e = absDiff(pDstY[y * nDstStride + x], fY);
+			g_fLumaError = e > g_fLumaError ? e : g_fLumaError;
+		}
+	}
+
+	for (y = 0; y < nHeight; y += 2)
+	{
+		for (x = 0; x < nWidth; x += 2)
+		{
+			fR = fG = fB = 0.0;
+			for (dy = 0; dy < 2; dy++)
+			{
+				for (dx = 0; dx < 2; dx++)
+				{
+					pixel(pSrc, nSrcStride, nFormat,
+					      x + dx < nWidth ? x + dx : x,
+					      y + dy < nHeight ? y + dy : y, &r, &g, &b);
+					fR += r / 4.0;
+					fG += g / 4.0;
+					fB += b / 4.0;
+				}
+			}
+			fY = kr * fR + kg * fG + kb * fB;
+			fCb = 128.0 + (fB - fY) / (2.0 * (1.0 - kb)) * 224.0 / 255.0;
+			fCr = 128.0 + (fR - fY) / (2.0 * (1.0 - kr)) * 224.0 / 255.0;
+			e = absDiff(pDstUV[(y / 2) * nDstStride + x], fCb);
+			g_fChromaError = e > g_fChromaError ? e : g_fChromaError;
+			e = absDiff(pDstUV[(y / 2) * nDstStride + x + 1], fCr);
+			g_fChromaError = e > g_fChromaError ? e : g_fChromaError;
+		}
+	}
+}
+
+static uint32_t g_nSeed = 12345;
+
+static uint8_t random8(void)
+{
+	g_nSeed = g_nSeed * 1103515245 + 12345;
+	return (uint8_t) (g_nSeed >> 16);
+}
+
+/* Random pixels, with saturated colors and flat areas mixed in */
+static void fillSource(uint8_t *pSrc, int nSrcStride, int nWidth, int nHeight)
+{
+	static const uint8_t tCorners[] = { 0, 255 };
+	int x, y, i;
+
+	for (y = 0; y < nHeight; y++)
+	{
+		for (x = 0; x < nWidth; x++)
+		{
+			uint8_t *p = pSrc + y * nSrcStride + 4 * x;
+
+			for (i = 0; i < 4; i++)
+			{
+				p[i] = ((x / 8 + y) % 3 == 0) ?
+					tCorners[random8() & 1] : random8();
+			}
+		}
+	}
+}
+
+static void checkCase(void *hCpuCC, int nThreads, int nWidth, int nHeight,
+		      int nFormat, int nStandard)
+{
+	int nSrcStride = 4 * nWidth + 4 * (nWidth % 3);
+	int nDstStride = nWidth + (nWidth & 1) + GUARD;
+	int nUVHeight = (nHeight + 1) / 2;
+	uint8_t *pSrc = malloc(nSrcStride * nHeight);
+	uint8_t *pY = malloc(nDstStride * nHeight);
+	uint8_t *pUV = malloc(nDstStride * nUVHeight);
+	uint8_t *pRefY = malloc(nDstStride * nHeight);
+	uint8_t *pRefUV = malloc(nDstStride * nUVHeight);
+	char sMessage[128];
+	int nRet, x, y, nBad = 0;
+
+	fillSource(pSrc, nSrcStride, nWidth, nHeight);
+	memset(pY, GUARD_VALUE, nDstStride * nHeight);
+	memset(pUV, GUARD_VALUE, nDstStride * nUVHeight);
+	memset(pRefY, GUARD_VALUE, nDstStride * nHeight);
+	memset(pRefUV, GUARD_VALUE, nDstStride * nUVHeight);
+
+	nRet = COLORCONVERT_CPU_RGBToNV12(hCpuCC, pSrc, nSrcStride, nFormat,
+					  pY, pUV, nDstStride, nWidth, nHeight,
+					  nStandard);
+	referenceToNV12(pSrc, nSrcStride, nFormat, pRefY, pRefUV, nDstStride,
+			nWidth, nHeight, nStandard);
+
+	/* Same bytes, padding included, so overruns show up too */
+	for (y = 0; y < nHeight; y++)
+	{
+		for (x = 0; x < nDstStride; x++)
+		{
+			nBad += (pY[y * nDstStride + x] != pRefY[y * nDstStride + x]);
+		}
+	}
+	for (y = 0; y < nUVHeight; y++)
+	{
+		for (x = 0; x < nDstStride; x++)
+		{
+			nBad += (pUV[y * nDstStride + x] != pRefUV[y * nDstStride + x]);
+		}
+	}
+
+	snprintf(sMessage, sizeof(sMessage), "%dx%d %s %s, %d threads: %d bytes differ",
+		 nWidth, nHeight, nFormat == COLORCONVERT_CPU_FMT_RGBA ? "RGBA" : "BGRA",
+		 nStandard == COLORCONVERT_CPU_BT601 ? "BT.601" : "BT.709",
+		 nThreads, nBad);
+	check(nRet == 0 && nBad == 0, sMessage);
+
+	floatError(pSrc, nSrcStride, nFormat, pRefY, pRefUV, nDstStride,
+		   nWidth, nHeight, nStandard);
+
+	free(pSrc);
+	free(pY);
+	free(pUV);
+	free(pRefY);
+	free(pRefUV);
+}
+
+static void checkAccuracy(void)
+{
+	static const int tSizes[][2] = {
+		{ 1, 1 }, { 2, 2 }, { 3, 5 }, { 15, 7 }, { 16, 16 }, { 17, 9 },
+		{ 33, 5 }, { 47, 31 }, { 64, 3 }, { 176, 144 }, { 1280, 720 },
+		{ 1920, 1080 },
+	};
+	void *hCpuCC;
+	int nThreads, i, nFormat, nStandard;
+
+	for (nThreads = 1; nThreads <= COLORCONVERT_CPU_MAX_THREADS; nThreads++)
+	{
+		check(COLORCONVERT_CPU_open(&hCpuCC, nThreads) == 0, "open");
+		for (i = 0; i < (int) (sizeof(tSizes) / sizeof(tSizes[0])); i++)
+		{
+			for (nFormat = COLORCONVERT_CPU_FMT_RGBA; nFormat <= COLORCONVERT_CPU_FMT_BGRA; nFormat++)
+			{
+				for (nStandard = COLORCONVERT_CPU_BT601; nStandard <= COLORCONVERT_CPU_BT709; nStandard++)
+				{
+					checkCase(hCpuCC, nThreads, tSizes[i][0], tSizes[i][1],
+						  nFormat, nStandard);
+				}
+			}
+		}
+		COLORCONVERT_CPU_close(hCpuCC);
+	}
+
+	printf("reference vs floating point equations: luma %.3f, chroma %.3f\n",
+	       g_fLumaError, g_fChromaError);
+	check(g_fLumaError <= MAX_LUMA_ERROR, "luma too far from the equations");
+	check(g_fChromaError <= MAX_CHROMA_ERROR, "chroma too far from the equations");
+}
+
+static void benchmark(int nFrames)
+{
+	static const int tSizes[][2] = { { 1280, 720 }, { 1920, 1080 } };
+	static const int tThreads[] = { 1, 2, 4 };
+	uint8_t *pSrc = malloc(4 * 1920 * 1080);
+	uint8_t *pDst = malloc(1920 * 1080 * 3 / 2);
+	void *hCpuCC;
+	double fStart, fTime;
+	int i, j, n;
+
+	fillSource(pSrc, 4 * 1920, 1920, 1080);
+	for (i = 0; i < 2; i++)
+	{
+		int nWidth = tSizes[i][0], nHeight = tSizes[i][1];
+
+		for (j = 0; j < 3; j++)
+		{
+			COLORCONVERT_CPU_open(&hCpuCC, tThreads[j]);
+			/* Warm up the threads and the caches */
+			COLORCONVERT_CPU_RGBToNV12(hCpuCC, pSrc, 4 * nWidth,
+						   COLORCONVERT_CPU_FMT_RGBA, pDst,
+						   pDst + nWidth * nHeight, nWidth,
+						   nWidth, nHeight, COLORCONVERT_CPU_BT601);
+			fStart = now();
+			for (n = 0; n < nFrames; n++)
+			{
+				COLORCONVERT_CPU_RGBToNV12(hCpuCC, pSrc, 4 * nWidth,
+							   COLORCONVERT_CPU_FMT_RGBA, pDst,
+							   pDst + nWidth * nHeight, nWidth,
+							   nWidth, nHeight, COLORCONVERT_CPU_BT601);
+			}
+			fTime = now() - fStart;
+			COLORCONVERT_CPU_close(hCpuCC);
+
+			printf("%dx%d, %d threads: %.2f ms/frame, %.1f fps\n",
+			       nWidth, nHeight, tThreads[j], fTime * 1e3 / nFrames,
+			       nFrames / fTime);
+		}
+	}
+
+	free(pSrc);
+	free(pDst);
+}
+
+int main(int argc, char *argv[])
+{
+	int nFrames = (argc > 1) ? atoi(argv[1]) : 30;
+
+#ifdef __ARM_NEON__
+	printf("NEON kernel\n");
+#else
+	printf("C path\n");
+#endif
+	checkAccuracy();
+	if (nFrames > 0)
+	{
+		benchmark(nFrames);
+	}
+
+	if (g_nFailures != 0)
+	{
+		printf("%d checks failed\n", g_nFailures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
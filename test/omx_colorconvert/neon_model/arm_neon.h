@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) Texas Instruments - http://www.ti.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Scalar model of the NEON intrinsics used by colorconvert_cpu.c, following
+ * the lane arithmetic of the ARM architecture manual (wrapping multiplies,
+ * rounding shifts computed without overflow, saturating narrows). Lets the
+ * host build compile and check the NEON kernel; it says nothing about its
+ * speed. Only the intrinsics the kernel uses are modelled.
+ */
+
+#ifndef NEON_MODEL_ARM_NEON_H
+#define NEON_MODEL_ARM_NEON_H
+
+#include <stdint.h>
+
+typedef struct { uint8_t v[8]; } uint8x8_t;
+typedef struct { uint8_t v[16]; } uint8x16_t;
+typedef struct { uint16_t v[8]; } uint16x8_t;
+typedef struct { int16_t v[8]; } int16x8_t;
+typedef struct { uint8x16_t val[4]; } uint8x16x4_t;
+typedef struct { uint8x8_t val[2]; } uint8x8x2_t;
+
+static inline uint8x8_t vdup_n_u8(uint8_t a)
+{
+	uint8x8_t r;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		r.v[i] = a;
+	return r;
+}
+
+static inline int16x8_t vdupq_n_s16(int16_t a)
+{
+	int16x8_t r;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		r.v[i] = a;
+	return r;
+}
+
+static inline uint16x8_t vmull_u8(uint8x8_t a, uint8x8_t b)
+{
+	uint16x8_t r;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		r.v[i] = (uint16_t) (a.v[i] * b.v[i]);
+	return r;
+}
+
+static inline uint16x8_t vmlal_u8(uint16x8_t a, uint8x8_t b, uint8x8_t c)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		a.v[i] = (uint16_t) (a.v[i] + b.v[i] * c.v[i]);
+	return a;
+}
+
+static inline uint8x8_t vadd_u8(uint8x8_t a, uint8x8_t b)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		a.v[i] = (uint8_t) (a.v[i] + b.v[i]);
+	return a;
+}
+
+#define vrshrn_n_u16(a, n) neon_model_vrshrn_n_u16(a, n)
+static inline uint8x8_t neon_model_vrshrn_n_u16(uint16x8_t a, int n)
+{
+	uint8x8_t r;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		r.v[i] = (uint8_t) (((uint32_t) a.v[i] + (1u << (n - 1))) >> n);
+	return r;
+}
+
+#define vrshrq_n_u16(a, n) neon_model_vrshrq_n_u16(a, n)
+static inline uint16x8_t neon_model_vrshrq_n_u16(uint16x8_t a, int n)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		a.v[i] = (uint16_t) (((uint32_t) a.v[i] + (1u << (n - 1))) >> n);
+	return a;
+}
+
+#define vrshrq_n_s16(a, n) neon_model_vrshrq_n_s16(a, n)
+static inline int16x8_t neon_model_vrshrq_n_s16(int16x8_t a, int n)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		a.v[i] = (int16_t) (((int32_t) a.v[i] + (1 << (n - 1))) >> n);
+	return a;
+}
+
+static inline uint8x16x4_t vld4q_u8(const uint8_t *p)
+{
+	uint8x16x4_t r;
+	int i, j;
+
+	for (i = 0; i < 16; i++)
+		for (j = 0; j < 4; j++)
+			r.val[j].v[i] = p[4 * i + j];
+	return r;
+}
+
+static inline void vst1q_u8(uint8_t *p, uint8x16_t a)
+{
+	int i;
+
+	for (i = 0; i < 16; i++)
+		p[i] = a.v[i];
+}
+
+static inline void vst2_u8(uint8_t *p, uint8x8x2_t a)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+	{
+		p[2 * i] = a.val[0].v[i];
+		p[2 * i + 1] = a.val[1].v[i];
+	}
+}
+
+static inline uint8x16_t vcombine_u8(uint8x8_t lo, uint8x8_t hi)
+{
+	uint8x16_t r;
+	int i;
+
+	for (i = 0; i < 8; i++)
+	{
+		r.v[i] = lo.v[i];
+		r.v[i + 8] = hi.v[i];
+	}
+	return r;
+}
+
+static inline uint8x8_t vget_low_u8(uint8x16_t a)
+{
+	uint8x8_t r;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		r.v[i] = a.v[i];
+	return r;
+}
+
+static inline uint8x8_t vget_high_u8(uint8x16_t a)
+{
+	uint8x8_t r;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		r.v[i] = a.v[i + 8];
+	return r;
+}
+
+static inline int16x8_t vreinterpretq_s16_u16(uint16x8_t a)
+{
+	int16x8_t r;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		r.v[i] = (int16_t) a.v[i];
+	return r;
+}
+
+static inline uint16x8_t vpaddlq_u8(uint8x16_t a)
+{
+	uint16x8_t r;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		r.v[i] = (uint16_t) (a.v[2 * i] + a.v[2 * i + 1]);
+	return r;
+}
+
+static inline uint16x8_t vpadalq_u8(uint16x8_t a, uint8x16_t b)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		a.v[i] = (uint16_t) (a.v[i] + b.v[2 * i] + b.v[2 * i + 1]);
+	return a;
+}
+
+static inline int16x8_t vmulq_n_s16(int16x8_t a, int16_t b)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		a.v[i] = (int16_t) (a.v[i] * b);
+	return a;
+}
+
+static inline int16x8_t vmlsq_n_s16(int16x8_t a, int16x8_t b, int16_t c)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		a.v[i] = (int16_t) (a.v[i] - b.v[i] * c);
+	return a;
+}
+
+static inline int16x8_t vaddq_s16(int16x8_t a, int16x8_t b)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		a.v[i] = (int16_t) (a.v[i] + b.v[i]);
+	return a;
+}
+
+static inline uint8x8_t vqmovun_s16(int16x8_t a)
+{
+	uint8x8_t r;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		r.v[i] = (uint8_t) (a.v[i] < 0 ? 0 : (a.v[i] > 255 ? 255 : a.v[i]));
+	return r;
+}
+
+#endif /* NEON_MODEL_ARM_NEON_H */
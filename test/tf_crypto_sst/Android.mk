@@ -0,0 +1,43 @@
+LOCAL_PATH:= $(call my-dir)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	lib_object_bench.c \
+	../../security/tf_crypto_sst/lib_object.c
+
+LOCAL_C_INCLUDES += \
+	$(LOCAL_PATH)/../../security/tf_crypto_sst \
+	$(LOCAL_PATH)/../../security/tf_sdk/include
+
+LOCAL_MODULE:= lib_object_bench
+LOCAL_MODULE_TAGS:= tests
+
+LOCAL_CFLAGS += -Wall -DLINUX
+
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	tee_stub_bench.c \
+	../../security/tf_crypto_sst/lib_object.c \
+	../../security/tf_crypto_sst/lib_mutex_linux.c \
+	../../security/tf_crypto_sst/sst_stub.c \
+	../../security/tf_crypto_sst/mtc.c \
+	../../security/tf_crypto_sst/pkcs11_global.c \
+	../../security/tf_crypto_sst/pkcs11_object.c \
+	../../security/tf_crypto_sst/pkcs11_session.c
+
+LOCAL_C_INCLUDES += \
+	$(LOCAL_PATH)/../../security/tf_crypto_sst \
+	$(LOCAL_PATH)/../../security/tf_sdk/include
+
+LOCAL_MODULE:= tee_stub_bench
+LOCAL_MODULE_TAGS:= tests
+
+LOCAL_CFLAGS += -Wall -DLINUX
+LOCAL_CFLAGS += -Dmalloc=benchMalloc -Dcalloc=benchCalloc -Dfree=benchFree
+LOCAL_LDLIBS += -lpthread
+
+include $(BUILD_HOST_EXECUTABLE)
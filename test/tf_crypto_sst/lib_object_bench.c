@@ -0,0 +1,181 @@
+/*
+ * Host microbenchmark and check of the lib_object tables: fills each kind
+ * of table with 10k objects, then times add, search, handle reuse,
+ * iteration and removal.
+ *
+ * usage: lib_object_bench [objects]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "s_type.h"
+#include "lib_object.h"
+
+#define DEFAULT_OBJECTS 10000
+
+typedef struct
+{
+   LIB_OBJECT_NODE_HANDLE16 sHandleNode;
+   LIB_OBJECT_NODE_STORAGE_NAME sStorageNameNode;
+   LIB_OBJECT_NODE_FILENAME sFilenameNode;
+}
+BENCH_OBJECT;
+
+static int nFailures;
+
+static double now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char* pName, uint32_t nOps, double fStart)
+{
+   double fSecs = now() - fStart;
+   printf("%-22s %8u ops %9.3f ms %8.1f ns/op\n",
+          pName, nOps, fSecs * 1e3, fSecs * 1e9 / nOps);
+}
+
+static void check(bool bCondition, const char* pWhat, uint32_t i)
+{
+   if (!bCondition)
+   {
+      if (nFailures++ < 10)
+      {
+         printf("FAILED: %s (object %u)\n", pWhat, i);
+      }
+   }
+}
+
+static void setKeys(BENCH_OBJECT* pObject, uint32_t i)
+{
+   memset(&pObject->sStorageNameNode.sStorageName, 0, sizeof(S_STORAGE_NAME));
+   pObject->sStorageNameNode.sStorageName.nStorageType = i % 3;
+   pObject->sStorageNameNode.sStorageName.nLoginType = i;
+   pObject->sStorageNameNode.sStorageName.sClientUUID.time_low = i * 2654435761u;
+
+   pObject->sFilenameNode.nFilenameLength = (uint8_t)snprintf(
+      (char*)pObject->sFilenameNode.sFilename, sizeof(pObject->sFilenameNode.sFilename),
+      "00000000/object%08x.dat", i);
+}
+
+int main(int argc, char** argv)
+{
+   uint32_t nObjects = argc > 1 ? (uint32_t)atoi(argv[1]) : DEFAULT_OBJECTS;
+   LIB_OBJECT_TABLE_HANDLE16 sHandles;
+   LIB_OBJECT_TABLE_STORAGE_NAME sStorageNames;
+   LIB_OBJECT_TABLE_FILENAME sFilenames;
+   BENCH_OBJECT* pObjects;
+   double fStart;
+   uint32_t i, nCount;
+
+   if (nObjects == 0 || nObjects >= LIB_OBJECT_HANDLE16_MAX)
+   {
+      printf("objects must be in [1, %u)\n", LIB_OBJECT_HANDLE16_MAX);
+      return 2;
+   }
+
+   pObjects = calloc(nObjects, sizeof(BENCH_OBJECT));
+   if (pObjects == NULL)
+   {
+      return 2;
+   }
+   memset(&sHandles, 0, sizeof(sHandles));
+   memset(&sStorageNames, 0, sizeof(sStorageNames));
+   memset(&sFilenames, 0, sizeof(sFilenames));
+   for (i = 0; i < nObjects; i++)
+   {
+      setKeys(&pObjects[i], i);
+   }
+
+   fStart = now();
+   for (i = 0; i < nObjects; i++)
+   {
+      check(libObjectHandle16Add(&sHandles, &pObjects[i].sHandleNode), "handle add", i);
+      libObjectStorageNameAdd(&sStorageNames, &pObjects[i].sStorageNameNode);
+      libObjectFilenameAdd(&sFilenames, &pObjects[i].sFilenameNode);
+   }
+   report("add (x3 tables)", nObjects, fStart);
+
+   fStart = now();
+   for (i = 0; i < nObjects; i++)
+   {
+      check(libObjectHandle16Search(&sHandles, pObjects[i].sHandleNode.nHandle)
+            == &pObjects[i].sHandleNode, "handle search", i);
+   }
+   report("handle16 search", nObjects, fStart);
+
+   fStart = now();
+   for (i = 0; i < nObjects; i++)
+   {
+      check(libObjectStorageNameSearch(&sStorageNames, &pObjects[i].sStorageNameNode.sStorageName)
+            == &pObjects[i].sStorageNameNode, "storage name search", i);
+   }
+   report("storage name search", nObjects, fStart);
+
+   fStart = now();
+   for (i = 0; i < nObjects; i++)
+   {
+      check(libObjectFilenameSearch(&sFilenames, pObjects[i].sFilenameNode.sFilename,
+                                    pObjects[i].sFilenameNode.nFilenameLength)
+            == &pObjects[i].sFilenameNode, "filename search", i);
+   }
+   report("filename search", nObjects, fStart);
+
+   check(libObjectHandle16Search(&sHandles, 0) == NULL, "search of handle 0", 0);
+   check(libObjectFilenameSearch(&sFilenames, (uint8_t*)"missing", 7) == NULL,
+         "search of a missing filename", 0);
+
+   /* Free and reallocate handles in a full table, past the wrap-around */
+   fStart = now();
+   for (i = 0; i < 2 * LIB_OBJECT_HANDLE16_MAX; i++)
+   {
+      LIB_OBJECT_NODE_HANDLE16* pNode = &pObjects[i % nObjects].sHandleNode;
+      libObjectHandle16Remove(&sHandles, pNode);
+      check(libObjectHandle16Add(&sHandles, pNode) && pNode->nHandle != 0, "handle reuse", i);
+      check(libObjectHandle16Search(&sHandles, pNode->nHandle) == pNode, "reused handle search", i);
+   }
+   report("handle16 remove+add", 2 * LIB_OBJECT_HANDLE16_MAX, fStart);
+
+   fStart = now();
+   nCount = 0;
+   {
+      LIB_OBJECT_NODE_FILENAME* pNode = NULL;
+      while ((pNode = libObjectFilenameNext(&sFilenames, pNode)) != NULL)
+      {
+         nCount++;
+      }
+   }
+   report("filename iteration", nCount, fStart);
+   check(nCount == nObjects, "iteration count", nCount);
+
+   fStart = now();
+   for (i = 0; i < nObjects; i += 2)
+   {
+      libObjectStorageNameRemove(&sStorageNames, &pObjects[i].sStorageNameNode);
+   }
+   for (i = 0; i < nObjects; i++)
+   {
+      check((libObjectStorageNameSearch(&sStorageNames, &pObjects[i].sStorageNameNode.sStorageName) != NULL)
+            == (i % 2 == 1), "search after remove", i);
+   }
+   while (libObjectHandle16RemoveOne(&sHandles) != NULL);
+   while (libObjectStorageNameRemoveOne(&sStorageNames) != NULL);
+   while (libObjectFilenameRemoveOne(&sFilenames) != NULL);
+   report("remove", nObjects * 3, fStart);
+   check(sHandles.pRoot == NULL && sStorageNames.pRoot == NULL && sFilenames.pRoot == NULL,
+         "tables empty", 0);
+
+   /* An emptied table starts again from handle 1 */
+   check(libObjectHandle16Add(&sHandles, &pObjects[0].sHandleNode)
+         && pObjects[0].sHandleNode.nHandle == 1, "first handle", 0);
+   libObjectHandle16Remove(&sHandles, &pObjects[0].sHandleNode);
+
+   free(pObjects);
+   printf("%s\n", nFailures ? "FAILED" : "OK");
+   return nFailures ? 1 : 0;
+}
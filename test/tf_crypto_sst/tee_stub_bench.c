@@ -0,0 +1,625 @@
+/*
+ * Host benchmark and check of the data path of the PKCS#11 and SST stubs.
+ * The library is linked against a simulated TEE client API: the service
+ * digests, encrypts (XOR) and stores files in memory, and each temporary
+ * memref costs a mapping and a copy of the buffer, as in the driver.
+ * Registered memrefs are accessed in place.
+ *
+ * Times C_DigestUpdate, C_EncryptUpdate, SSTWrite and SSTRead for a range
+ * of buffer sizes, checks the results, and reports the throughput, the
+ * number of commands and the mean time per command (a chunk for the split
+ * buffers), the temporary memrefs and the shared memory allocations.
+ * Then checks that the shared memory pools shrink back once only small
+ * buffers are passed.
+ *
+ * usage: tee_stub_bench [megabytes [latency]]
+ *
+ * latency adds a sleep of that many microseconds to each command, for the
+ * world switch and the processing in the secure world.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "s_type.h"
+#include "tee_client_api.h"
+#include "tee_client_api_ex.h"
+#include "cryptoki.h"
+#include "sst.h"
+#include "service_system_protocol.h"
+
+#define DEFAULT_MEGABYTES 16
+
+static int nFailures;
+static uint32_t g_nTempMemrefs;
+static uint32_t g_nCommands;
+static uint32_t g_nLatency;
+static uint32_t g_nAllocations;
+static size_t g_nSharedBytes;
+
+static double now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void check(bool bCondition, const char* pWhat, uint32_t nSize)
+{
+   if (!bCondition)
+   {
+      if (nFailures++ < 10)
+      {
+         printf("FAILED: %s (%u bytes)\n", pWhat, nSize);
+      }
+   }
+}
+
+/*----------------------------------------------------------------------------
+ * The library casts its session contexts to 32-bit handles, as on the
+ * target. Its allocations are routed here by the Android.mk and, on a
+ * 64-bit host, served below 4 GB. That memory is never given back.
+ *----------------------------------------------------------------------------*/
+
+#undef malloc
+#undef calloc
+#undef free
+
+#if defined(__LP64__)
+
+#define LOW_HEAP_SIZE (16 * 1024 * 1024)
+
+static uint8_t* g_pLowHeap;
+static size_t g_nLowHeapUsed;
+
+void* benchMalloc(size_t nSize)
+{
+   void* pBuffer;
+
+   if (g_pLowHeap == NULL)
+   {
+      g_pLowHeap = mmap(NULL, LOW_HEAP_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+      if (g_pLowHeap == MAP_FAILED)
+      {
+         abort();
+      }
+   }
+   nSize = (nSize + 15) & ~(size_t)15;
+   if (g_nLowHeapUsed + nSize > LOW_HEAP_SIZE)
+   {
+      return NULL;
+   }
+   pBuffer = g_pLowHeap + g_nLowHeapUsed;
+   g_nLowHeapUsed += nSize;
+   return pBuffer;
+}
+
+void* benchCalloc(size_t nCount, size_t nSize)
+{
+   /* The low heap is never reused, so it is still zeroed */
+   return benchMalloc(nCount * nSize);
+}
+
+void benchFree(void* pBuffer)
+{
+   (void)pBuffer;
+}
+
+#else
+
+void* benchMalloc(size_t nSize)
+{
+   return malloc(nSize);
+}
+
+void* benchCalloc(size_t nCount, size_t nSize)
+{
+   return calloc(nCount, nSize);
+}
+
+void benchFree(void* pBuffer)
+{
+   free(pBuffer);
+}
+
+#endif
+
+/*----------------------------------------------------------------------------
+ * Simulated TEE client API
+ *----------------------------------------------------------------------------*/
+
+#define SIM_PAGE_SIZE      4096
+#define SIM_TMPREF_MAX     (1024 * 1024)
+#define SIM_SST_FILE_MAX   (64 * 1024 * 1024)
+
+static uint32_t g_nDigest;
+static uint8_t* g_pSSTFile;
+static uint32_t g_nSSTFileSize;
+static uint32_t g_nSSTPosition;
+
+TEEC_Result TEEC_InitializeContext(const char* name, TEEC_Context* context)
+{
+   (void)name;
+   (void)context;
+   return TEEC_SUCCESS;
+}
+
+void TEEC_FinalizeContext(TEEC_Context* context)
+{
+   (void)context;
+}
+
+TEEC_Result TEEC_AllocateSharedMemory(TEEC_Context* context, TEEC_SharedMemory* sharedMem)
+{
+   (void)context;
+   sharedMem->buffer = mmap(NULL, sharedMem->size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (sharedMem->buffer == MAP_FAILED)
+   {
+      sharedMem->buffer = NULL;
+      return TEEC_ERROR_OUT_OF_MEMORY;
+   }
+   g_nAllocations++;
+   g_nSharedBytes += sharedMem->size;
+   return TEEC_SUCCESS;
+}
+
+TEEC_Result TEEC_RegisterSharedMemory(TEEC_Context* context, TEEC_SharedMemory* sharedMem)
+{
+   (void)context;
+   (void)sharedMem;
+   return TEEC_SUCCESS;
+}
+
+void TEEC_ReleaseSharedMemory(TEEC_SharedMemory* sharedMem)
+{
+   munmap(sharedMem->buffer, sharedMem->size);
+   g_nSharedBytes -= sharedMem->size;
+}
+
+void TEEC_GetImplementationLimits(TEEC_ImplementationLimits* limits)
+{
+   memset(limits, 0, sizeof(TEEC_ImplementationLimits));
+   limits->pageSize         = SIM_PAGE_SIZE;
+   limits->tmprefMaxSize    = SIM_TMPREF_MAX;
+   limits->sharedMemMaxSize = 8 * SIM_TMPREF_MAX;
+}
+
+TEEC_Result TEEC_ReadSignatureFile(void** ppSignatureFile, uint32_t* pnSignatureFileLength)
+{
+   (void)ppSignatureFile;
+   (void)pnSignatureFileLength;
+   return TEEC_ERROR_ITEM_NOT_FOUND;
+}
+
+TEEC_Result TEEC_OpenSession(TEEC_Context* context, TEEC_Session* session,
+                             const TEEC_UUID* destination, uint32_t connectionMethod,
+                             void* connectionData, TEEC_Operation* operation,
+                             uint32_t* errorOrigin)
+{
+   (void)context;
+   (void)session;
+   (void)destination;
+   (void)connectionMethod;
+   (void)connectionData;
+   (void)operation;
+   (void)errorOrigin;
+   return TEEC_SUCCESS;
+}
+
+void TEEC_CloseSession(TEEC_Session* session)
+{
+   (void)session;
+}
+
+/* A cheap checksum stands for the digest, so that the transport dominates */
+static uint32_t simDigest(uint32_t nDigest, const uint8_t* pBuffer, uint32_t nSize)
+{
+   uint32_t nWord;
+   uint32_t i;
+
+   for (i = 0; i + 4 <= nSize; i += 4)
+   {
+      memcpy(&nWord, pBuffer + i, 4);
+      nDigest = ((nDigest << 5) | (nDigest >> 27)) ^ nWord;
+   }
+   for (; i < nSize; i++)
+   {
+      nDigest = ((nDigest << 5) | (nDigest >> 27)) ^ pBuffer[i];
+   }
+   return nDigest;
+}
+
+/* The service side view of a memref parameter */
+typedef struct
+{
+   uint8_t* pBuffer;
+   uint32_t nSize;
+   void*    pMapping;
+   size_t   nMappingSize;
+}
+SIM_MEMREF;
+
+static void simMapMemref(TEEC_Operation* operation, uint32_t i, SIM_MEMREF* pMemref)
+{
+   uint32_t nType = (operation->paramTypes >> (4 * i)) & 0xF;
+   TEEC_Parameter* pParam = &operation->params[i];
+
+   memset(pMemref, 0, sizeof(SIM_MEMREF));
+   if (nType == TEEC_MEMREF_TEMP_INPUT || nType == TEEC_MEMREF_TEMP_OUTPUT)
+   {
+      pMemref->nSize = (uint32_t)pParam->tmpref.size;
+      if (pParam->tmpref.buffer == NULL)
+      {
+         return;
+      }
+      /* The driver maps the pages of the client buffer for the call */
+      g_nTempMemrefs++;
+      pMemref->nMappingSize = (pMemref->nSize + SIM_PAGE_SIZE - 1) & ~(SIM_PAGE_SIZE - 1);
+      if (pMemref->nMappingSize == 0)
+      {
+         pMemref->nMappingSize = SIM_PAGE_SIZE;
+      }
+      pMemref->pMapping = mmap(NULL, pMemref->nMappingSize, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      pMemref->pBuffer = pMemref->pMapping;
+      if (nType == TEEC_MEMREF_TEMP_INPUT)
+      {
+         memcpy(pMemref->pBuffer, pParam->tmpref.buffer, pMemref->nSize);
+      }
+   }
+   else if (nType == TEEC_MEMREF_PARTIAL_INPUT || nType == TEEC_MEMREF_PARTIAL_OUTPUT)
+   {
+      pMemref->pBuffer = (uint8_t*)pParam->memref.parent->buffer + pParam->memref.offset;
+      pMemref->nSize   = (uint32_t)pParam->memref.size;
+   }
+}
+
+static void simUnmapMemref(TEEC_Operation* operation, uint32_t i, SIM_MEMREF* pMemref, uint32_t nWritten)
+{
+   uint32_t nType = (operation->paramTypes >> (4 * i)) & 0xF;
+
+   if (pMemref->pMapping != NULL)
+   {
+      if (nType == TEEC_MEMREF_TEMP_OUTPUT && nWritten <= pMemref->nSize)
+      {
+         memcpy(operation->params[i].tmpref.buffer, pMemref->pBuffer, nWritten);
+      }
+      munmap(pMemref->pMapping, pMemref->nMappingSize);
+   }
+   if (nType == TEEC_MEMREF_PARTIAL_OUTPUT)
+   {
+      operation->params[i].memref.size = nWritten;
+   }
+   else
+   {
+      operation->params[i].tmpref.size = nWritten;
+   }
+}
+
+TEEC_Result TEEC_InvokeCommand(TEEC_Session* session, uint32_t commandID,
+                               TEEC_Operation* operation, uint32_t* errorOrigin)
+{
+   SIM_MEMREF sIn;
+   SIM_MEMREF sOut;
+   TEEC_Result nResult = TEEC_SUCCESS;
+   uint32_t nWritten = 0;
+   uint32_t i;
+
+   (void)session;
+
+   g_nCommands++;
+   if (g_nLatency != 0)
+   {
+      struct timespec ts;
+      ts.tv_sec  = g_nLatency / 1000000;
+      ts.tv_nsec = (g_nLatency % 1000000) * 1000;
+      nanosleep(&ts, NULL);
+   }
+   if (errorOrigin != NULL)
+   {
+      *errorOrigin = TEEC_ORIGIN_TRUSTED_APP;
+   }
+
+   switch (commandID & 0x00007FFF)
+   {
+   case SERVICE_SYSTEM_PKCS11_C_OPEN_SESSION_COMMAND_ID:
+      operation->params[0].value.a = 1;
+      break;
+
+   case SERVICE_SYSTEM_PKCS11_C_DIGESTINIT_COMMAND_ID:
+      g_nDigest = 2166136261u;
+      break;
+
+   case SERVICE_SYSTEM_PKCS11_C_DIGESTUPDATE_COMMAND_ID:
+      simMapMemref(operation, 0, &sIn);
+      g_nDigest = simDigest(g_nDigest, sIn.pBuffer, sIn.nSize);
+      simUnmapMemref(operation, 0, &sIn, sIn.nSize);
+      break;
+
+   case SERVICE_SYSTEM_PKCS11_C_DIGESTFINAL_COMMAND_ID:
+      simMapMemref(operation, 1, &sOut);
+      if (sOut.pBuffer == NULL || sOut.nSize < 4)
+      {
+         nResult = (sOut.pBuffer == NULL) ? TEEC_SUCCESS : CKR_BUFFER_TOO_SMALL;
+      }
+      else
+      {
+         memcpy(sOut.pBuffer, &g_nDigest, 4);
+      }
+      simUnmapMemref(operation, 1, &sOut, 4);
+      break;
+
+   case SERVICE_SYSTEM_PKCS11_C_ENCRYPTUPDATE_COMMAND_ID:
+      simMapMemref(operation, 0, &sIn);
+      simMapMemref(operation, 1, &sOut);
+      nWritten = sIn.nSize;
+      if (sOut.pBuffer == NULL || sOut.nSize < sIn.nSize)
+      {
+         nResult = (sOut.pBuffer == NULL) ? TEEC_SUCCESS : CKR_BUFFER_TOO_SMALL;
+      }
+      else
+      {
+         for (i = 0; i < sIn.nSize; i++)
+         {
+            sOut.pBuffer[i] = sIn.pBuffer[i] ^ 0x5A;
+         }
+      }
+      simUnmapMemref(operation, 0, &sIn, sIn.nSize);
+      simUnmapMemref(operation, 1, &sOut, nWritten);
+      break;
+
+   case SERVICE_SYSTEM_SST_OPEN_COMMAND_ID:
+      g_nSSTFileSize = 0;
+      g_nSSTPosition = 0;
+      operation->params[0].value.a = 1;
+      break;
+
+   case SERVICE_SYSTEM_SST_SEEK_COMMAND_ID:
+      g_nSSTPosition = operation->params[1].value.a;
+      break;
+
+   case SERVICE_SYSTEM_SST_WRITE_COMMAND_ID:
+      simMapMemref(operation, 1, &sIn);
+      if (g_nSSTPosition + sIn.nSize > SIM_SST_FILE_MAX)
+      {
+         nResult = TEEC_ERROR_OUT_OF_MEMORY;
+         break;
+      }
+      memcpy(g_pSSTFile + g_nSSTPosition, sIn.pBuffer, sIn.nSize);
+      g_nSSTPosition += sIn.nSize;
+      if (g_nSSTPosition > g_nSSTFileSize)
+      {
+         g_nSSTFileSize = g_nSSTPosition;
+      }
+      simUnmapMemref(operation, 1, &sIn, sIn.nSize);
+      break;
+
+   case SERVICE_SYSTEM_SST_READ_COMMAND_ID:
+      simMapMemref(operation, 1, &sOut);
+      nWritten = g_nSSTFileSize - g_nSSTPosition;
+      if (nWritten > sOut.nSize)
+      {
+         nWritten = sOut.nSize;
+      }
+      memcpy(sOut.pBuffer, g_pSSTFile + g_nSSTPosition, nWritten);
+      g_nSSTPosition += nWritten;
+      simUnmapMemref(operation, 1, &sOut, nWritten);
+      break;
+
+   default:
+      break;
+   }
+   return nResult;
+}
+
+/*----------------------------------------------------------------------------
+ * Benchmarks
+ *----------------------------------------------------------------------------*/
+
+static const uint32_t g_nSizes[] = { 64, 1024, 16 * 1024 + 13, 256 * 1024, 3 * 1024 * 1024 + 13, 16 * 1024 * 1024 };
+#define SIZE_COUNT (sizeof(g_nSizes) / sizeof(g_nSizes[0]))
+
+static uint8_t* g_pInput;
+static uint8_t* g_pOutput;
+
+static void report(const char* pName, uint32_t nSize, uint32_t nCalls, double fStart,
+                   uint32_t nCommands, uint32_t nTempMemrefs, uint32_t nAllocations)
+{
+   double fSecs = now() - fStart;
+   nCommands = g_nCommands - nCommands;
+   printf("%-16s %8u B x %6u %7.3f s %7.1f MB/s %7u cmd %8.1f us/cmd %7u tmpref %2u alloc\n",
+          pName, nSize, nCalls, fSecs, (double)nSize * nCalls / fSecs / (1024 * 1024),
+          nCommands, fSecs * 1e6 / nCommands,
+          g_nTempMemrefs - nTempMemrefs, g_nAllocations - nAllocations);
+}
+
+static void benchDigest(CK_SESSION_HANDLE hSession, uint32_t nSize, uint32_t nCalls)
+{
+   CK_MECHANISM sMechanism = { CKM_SHA_1, NULL, 0 };
+   uint32_t nCommands = g_nCommands;
+   uint32_t nTempMemrefs = g_nTempMemrefs;
+   uint32_t nAllocations = g_nAllocations;
+   uint32_t nExpected = 2166136261u;
+   uint32_t nDigest = 0;
+   CK_ULONG nDigestLen = sizeof(nDigest);
+   double fStart;
+   uint32_t i;
+
+   for (i = 0; i < nCalls; i++)
+   {
+      nExpected = simDigest(nExpected, g_pInput, nSize);
+   }
+
+   fStart = now();
+   check(C_DigestInit(hSession, &sMechanism) == CKR_OK, "C_DigestInit", nSize);
+   for (i = 0; i < nCalls; i++)
+   {
+      check(C_DigestUpdate(hSession, g_pInput, nSize) == CKR_OK, "C_DigestUpdate", nSize);
+   }
+   check(C_DigestFinal(hSession, (CK_BYTE*)&nDigest, &nDigestLen) == CKR_OK, "C_DigestFinal", nSize);
+   report("C_DigestUpdate", nSize, nCalls, fStart, nCommands, nTempMemrefs, nAllocations);
+   check(nDigestLen == 4 && nDigest == nExpected, "digest value", nSize);
+}
+
+static void benchEncrypt(CK_SESSION_HANDLE hSession, uint32_t nSize, uint32_t nCalls)
+{
+   uint32_t nCommands = g_nCommands;
+   uint32_t nTempMemrefs = g_nTempMemrefs;
+   uint32_t nAllocations = g_nAllocations;
+   CK_ULONG nOutputLen;
+   double fStart;
+   uint32_t i;
+
+   /* Length query and short buffer, on buffers that are not split */
+   if (nSize <= SIM_TMPREF_MAX / 2)
+   {
+      nOutputLen = 0;
+      check(C_EncryptUpdate(hSession, g_pInput, nSize, NULL, &nOutputLen) == CKR_OK &&
+            nOutputLen == nSize, "C_EncryptUpdate length query", nSize);
+      nOutputLen = nSize / 2;
+      check(C_EncryptUpdate(hSession, g_pInput, nSize, g_pOutput, &nOutputLen) == CKR_BUFFER_TOO_SMALL &&
+            nOutputLen == nSize, "C_EncryptUpdate short buffer", nSize);
+   }
+
+   nCommands = g_nCommands;
+   nTempMemrefs = g_nTempMemrefs;
+   nAllocations = g_nAllocations;
+   fStart = now();
+   for (i = 0; i < nCalls; i++)
+   {
+      nOutputLen = nSize;
+      check(C_EncryptUpdate(hSession, g_pInput, nSize, g_pOutput, &nOutputLen) == CKR_OK &&
+            nOutputLen == nSize, "C_EncryptUpdate", nSize);
+   }
+   report("C_EncryptUpdate", nSize, nCalls, fStart, nCommands, nTempMemrefs, nAllocations);
+   for (i = 0; i < nSize; i++)
+   {
+      if (g_pOutput[i] != (g_pInput[i] ^ 0x5A))
+      {
+         check(false, "encrypted data", nSize);
+         break;
+      }
+   }
+}
+
+static void benchSST(uint32_t nSize, uint32_t nCalls)
+{
+   uint32_t nCommands = g_nCommands;
+   uint32_t nTempMemrefs = g_nTempMemrefs;
+   uint32_t nAllocations = g_nAllocations;
+   SST_HANDLE hFile;
+   uint32_t nCount;
+   double fStart;
+   uint32_t i;
+
+   if ((uint64_t)nSize * nCalls > SIM_SST_FILE_MAX)
+   {
+      nCalls = SIM_SST_FILE_MAX / nSize;
+   }
+   check(SSTOpen("bench", SST_O_READ | SST_O_WRITE | SST_O_CREATE, 0, &hFile) == SST_SUCCESS,
+         "SSTOpen", nSize);
+
+   fStart = now();
+   for (i = 0; i < nCalls; i++)
+   {
+      g_pInput[0] = (uint8_t)i;
+      check(SSTWrite(hFile, g_pInput, nSize) == SST_SUCCESS, "SSTWrite", nSize);
+   }
+   report("SSTWrite", nSize, nCalls, fStart, nCommands, nTempMemrefs, nAllocations);
+
+   check(SSTSeek(hFile, 0, SST_SEEK_SET) == SST_SUCCESS, "SSTSeek", nSize);
+   nCommands = g_nCommands;
+   nTempMemrefs = g_nTempMemrefs;
+   nAllocations = g_nAllocations;
+   fStart = now();
+   for (i = 0; i < nCalls; i++)
+   {
+      check(SSTRead(hFile, g_pOutput, nSize, &nCount) == SST_SUCCESS && nCount == nSize,
+            "SSTRead", nSize);
+      check(g_pOutput[0] == (uint8_t)i && memcmp(g_pOutput + 1, g_pInput + 1, nSize - 1) == 0,
+            "SSTRead data", nSize);
+   }
+   report("SSTRead", nSize, nCalls, fStart, nCommands, nTempMemrefs, nAllocations);
+
+   /* Read at the end of file */
+   check(SSTRead(hFile, g_pOutput, nSize, &nCount) == SST_SUCCESS && nCount == 0,
+         "SSTRead end of file", nSize);
+   SSTCloseHandle(hFile);
+}
+
+/* After the large buffers, small ones must let the pools shrink */
+#define TRIM_SIZE   1024
+#define TRIM_CALLS  64
+#define TRIM_KEEP   (64 * 1024)
+
+static void benchTrim(CK_SESSION_HANDLE hSession)
+{
+   size_t nBefore = g_nSharedBytes;
+
+   benchDigest(hSession, TRIM_SIZE, TRIM_CALLS);
+   benchEncrypt(hSession, TRIM_SIZE, TRIM_CALLS);
+   benchSST(TRIM_SIZE, TRIM_CALLS);
+
+   printf("shared memory: %u KB after the large buffers, %u KB after the small ones\n",
+          (uint32_t)(nBefore / 1024), (uint32_t)(g_nSharedBytes / 1024));
+   /* Two blocks in each of the PKCS#11 and SST pools */
+   check(g_nSharedBytes <= 4 * TRIM_KEEP, "shared memory pools shrink", (uint32_t)g_nSharedBytes);
+}
+
+int main(int argc, char* argv[])
+{
+   uint32_t nMegabytes = (argc > 1) ? (uint32_t)atoi(argv[1]) : DEFAULT_MEGABYTES;
+   uint32_t nMaxSize = g_nSizes[SIZE_COUNT - 1];
+   CK_SESSION_HANDLE hSession;
+   uint32_t i;
+
+   g_pInput   = mmap(NULL, nMaxSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   g_pOutput  = mmap(NULL, nMaxSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   g_pSSTFile = mmap(NULL, SIM_SST_FILE_MAX, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (g_pInput == MAP_FAILED || g_pOutput == MAP_FAILED || g_pSSTFile == MAP_FAILED)
+   {
+      printf("out of memory\n");
+      return 1;
+   }
+   g_nLatency = (argc > 2) ? (uint32_t)atoi(argv[2]) : 0;
+   for (i = 0; i < nMaxSize; i++)
+   {
+      g_pInput[i] = (uint8_t)(i * 7 + (i >> 8));
+   }
+
+   check(C_Initialize(NULL) == CKR_OK, "C_Initialize", 0);
+   check(C_OpenSession(CKV_TOKEN_SYSTEM, CKF_SERIAL_SESSION, NULL, NULL, &hSession) == CKR_OK,
+         "C_OpenSession", 0);
+   check(SSTInit() == SST_SUCCESS, "SSTInit", 0);
+
+   for (i = 0; i < SIZE_COUNT; i++)
+   {
+      uint32_t nCalls = (uint32_t)(((uint64_t)nMegabytes << 20) / g_nSizes[i]);
+      if (nCalls == 0)
+      {
+         nCalls = 1;
+      }
+      benchDigest(hSession, g_nSizes[i], nCalls);
+      benchEncrypt(hSession, g_nSizes[i], nCalls);
+      benchSST(g_nSizes[i], nCalls);
+   }
+
+   benchTrim(hSession);
+
+   check(SSTTerminate() == SST_SUCCESS, "SSTTerminate", 0);
+   check(C_CloseSession(hSession) == CKR_OK, "C_CloseSession", 0);
+   check(C_Finalize(NULL) == CKR_OK, "C_Finalize", 0);
+
+   if (nFailures != 0)
+   {
+      printf("%d checks FAILED\n", nFailures);
+      return 1;
+   }
+   printf("all checks passed\n");
+   return 0;
+}
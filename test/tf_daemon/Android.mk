@@ -0,0 +1,35 @@
+LOCAL_PATH:= $(call my-dir)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	delegation_replay.c
+
+LOCAL_C_INCLUDES += \
+	$(LOCAL_PATH)/../../security/tf_daemon \
+	$(LOCAL_PATH)/../../security/tf_sdk/include
+
+LOCAL_MODULE:= delegation_replay
+LOCAL_MODULE_TAGS:= tests
+
+LOCAL_CFLAGS += -Wall -DLINUX -DINCLUDE_CLIENT_DELEGATION -DNDEBUG
+
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	smc_properties_bench.c \
+	../../security/tf_daemon/smc_properties_parser.c \
+	../../security/tf_daemon/lib_manifest2.c
+
+LOCAL_C_INCLUDES += \
+	$(LOCAL_PATH)/../../security/tf_daemon \
+	$(LOCAL_PATH)/../../security/tf_sdk/include
+
+LOCAL_MODULE:= smc_properties_bench
+LOCAL_MODULE_TAGS:= tests
+
+LOCAL_CFLAGS += -Wall -DLINUX -DNDEBUG
+
+include $(BUILD_HOST_EXECUTABLE)
@@ -0,0 +1,274 @@
+/*
+ * Replays an instruction trace recorded with "tf_daemon -record <file>"
+ * against the real instruction loop of delegation_client.c on a Linux
+ * host. The TEE client API is simulated: each GET_INSTRUCTIONS returns the
+ * next recorded batch and SHUTDOWN is sent once the trace is exhausted.
+ * The partition files are created in <storageDir>.
+ *
+ * usage: delegation_replay <trace> <storageDir>
+ *        delegation_replay -g <trace> [batches [sectorSize]]
+ *
+ * -g writes a synthetic trace instead: two partitions, then batches of
+ * sequential sector reads and writes interleaved between the partitions,
+ * each batch followed by a SYNC of both partitions.
+ *
+ * Reports the replay time and the sector throughput, and the number of
+ * readv/writev system calls issued for the sectors.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/uio.h>
+
+#include "s_type.h"
+#include "s_error.h"
+#include "tee_client_api.h"
+#include "service_delegation_protocol.h"
+#include "delegation_trace.h"
+
+/* Count the vectored system calls that transfer sectors */
+static uint32_t g_nTransferCalls;
+
+static ssize_t sim_readv(int fd, const struct iovec* pIov, int nCount)
+{
+   g_nTransferCalls++;
+   return readv(fd, pIov, nCount);
+}
+
+static ssize_t sim_writev(int fd, const struct iovec* pIov, int nCount)
+{
+   g_nTransferCalls++;
+   return writev(fd, pIov, nCount);
+}
+
+#define readv sim_readv
+#define writev sim_writev
+#include "../../security/tf_daemon/delegation_client.c"
+#undef readv
+#undef writev
+
+static FILE* g_pTrace;
+static DELEGATION_TRACE_HEADER g_sTraceHeader;
+static uint32_t g_nBatches;
+static uint32_t g_nSectors;
+static struct timespec g_sStart;
+
+static double elapsed(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (ts.tv_sec - g_sStart.tv_sec) + (ts.tv_nsec - g_sStart.tv_nsec) / 1e9;
+}
+
+static void report(void)
+{
+   double fSecs = elapsed();
+   printf("%u batches, %u sectors of %u bytes in %.3f s: %.1f MB/s, %u readv/writev calls\n",
+          g_nBatches, g_nSectors, g_sTraceHeader.nSectorSize, fSecs,
+          (double)g_nSectors * g_sTraceHeader.nSectorSize / fSecs / (1024 * 1024),
+          g_nTransferCalls);
+}
+
+/*----------------------------------------------------------------------------
+ * Simulated TEE client API
+ *----------------------------------------------------------------------------*/
+
+TEEC_Result TEEC_InitializeContext(const char* name, TEEC_Context* context)
+{
+   (void)name;
+   (void)context;
+   return TEEC_SUCCESS;
+}
+
+void TEEC_FinalizeContext(TEEC_Context* context)
+{
+   (void)context;
+}
+
+TEEC_Result TEEC_RegisterSharedMemory(TEEC_Context* context, TEEC_SharedMemory* sharedMem)
+{
+   (void)context;
+   (void)sharedMem;
+   return TEEC_SUCCESS;
+}
+
+TEEC_Result TEEC_OpenSession(TEEC_Context* context, TEEC_Session* session,
+                             const TEEC_UUID* destination, uint32_t connectionMethod,
+                             void* connectionData, TEEC_Operation* operation,
+                             uint32_t* errorOrigin)
+{
+   (void)context;
+   (void)session;
+   (void)destination;
+   (void)connectionMethod;
+   (void)connectionData;
+   (void)errorOrigin;
+   operation->params[0].value.a = g_sTraceHeader.nSectorSize;
+   return TEEC_SUCCESS;
+}
+
+TEEC_Result TEEC_InvokeCommand(TEEC_Session* session, uint32_t commandID,
+                               TEEC_Operation* operation, uint32_t* errorOrigin)
+{
+   uint32_t nSize;
+   uint32_t i;
+
+   (void)session;
+   (void)commandID;
+   (void)errorOrigin;
+
+   if (g_nBatches == 0)
+   {
+      clock_gettime(CLOCK_MONOTONIC, &g_sStart);
+   }
+   if (fread(&nSize, sizeof(nSize), 1, g_pTrace) != 1 ||
+       nSize > sizeof(g_pExchangeBuffer->sInstructions) ||
+       fread(g_pExchangeBuffer->sInstructions, nSize, 1, g_pTrace) != 1)
+   {
+      g_pExchangeBuffer->sInstructions[0] = DELEGATION_INSTRUCTION_SHUTDOWN;
+      operation->params[1].tmpref.size = 4;
+      return TEEC_SUCCESS;
+   }
+   operation->params[1].tmpref.size = nSize;
+   g_nBatches++;
+
+   for (i = 0; i < nSize / 4; i++)
+   {
+      uint32_t nID = g_pExchangeBuffer->sInstructions[i];
+      if ((nID & 0x0F) == DELEGATION_INSTRUCTION_PARTITION_READ ||
+          (nID & 0x0F) == DELEGATION_INSTRUCTION_PARTITION_WRITE)
+      {
+         g_nSectors++;
+         i += 2;
+      }
+      else if ((nID & 0x0F) == DELEGATION_INSTRUCTION_PARTITION_SET_SIZE)
+      {
+         i += 1;
+      }
+   }
+   return TEEC_SUCCESS;
+}
+
+/*----------------------------------------------------------------------------
+ * Synthetic trace
+ *----------------------------------------------------------------------------*/
+
+#define GEN_PARTITION_SECTORS 1024
+
+static void writeBatch(FILE* pFile, const uint32_t* pInstructions, uint32_t nWords)
+{
+   uint32_t nSize = nWords * 4;
+   fwrite(&nSize, sizeof(nSize), 1, pFile);
+   fwrite(pInstructions, nSize, 1, pFile);
+}
+
+static int generate(const char* pName, uint32_t nBatches, uint32_t nSectorSize)
+{
+   uint32_t sInstructions[ECHANGE_BUFFER_INSTRUCTIONS_NB];
+   uint32_t nSectorsPerPartition = 16;
+   uint32_t nNextSector[2] = { 0, 0 };
+   uint32_t nBatch;
+   uint32_t p;
+   uint32_t n;
+   FILE* pFile;
+
+   pFile = fopen(pName, "wb");
+   if (pFile == NULL)
+   {
+      perror(pName);
+      return 1;
+   }
+   g_sTraceHeader.nMagic         = DELEGATION_TRACE_MAGIC;
+   g_sTraceHeader.nVersion       = DELEGATION_TRACE_VERSION;
+   g_sTraceHeader.nSectorSize    = nSectorSize;
+   g_sTraceHeader.nWorkspaceSize = DEFAULT_WORKSPACE_SIZE;
+   fwrite(&g_sTraceHeader, sizeof(g_sTraceHeader), 1, pFile);
+
+   /* The workspace holds the sectors of both partitions */
+   if (2 * nSectorsPerPartition * nSectorSize > DEFAULT_WORKSPACE_SIZE)
+   {
+      nSectorsPerPartition = DEFAULT_WORKSPACE_SIZE / nSectorSize / 2;
+   }
+
+   n = 0;
+   for (p = 0; p < 2; p++)
+   {
+      sInstructions[n++] = (p << 4) | DELEGATION_INSTRUCTION_PARTITION_CREATE;
+      sInstructions[n++] = (p << 4) | DELEGATION_INSTRUCTION_PARTITION_SET_SIZE;
+      sInstructions[n++] = GEN_PARTITION_SECTORS;
+      sInstructions[n++] = (p << 4) | DELEGATION_INSTRUCTION_PARTITION_SYNC;
+   }
+   writeBatch(pFile, sInstructions, n);
+
+   for (nBatch = 0; nBatch < nBatches; nBatch++)
+   {
+      /* Every third batch reads back, the others write */
+      uint32_t nOp = (nBatch % 3 == 2) ? DELEGATION_INSTRUCTION_PARTITION_READ
+                                       : DELEGATION_INSTRUCTION_PARTITION_WRITE;
+      uint32_t i;
+
+      n = 0;
+      for (i = 0; i < nSectorsPerPartition; i++)
+      {
+         for (p = 0; p < 2; p++)
+         {
+            sInstructions[n++] = (p << 4) | nOp;
+            sInstructions[n++] = (nNextSector[p] + i) % GEN_PARTITION_SECTORS;
+            sInstructions[n++] = (p * nSectorsPerPartition + i) * nSectorSize;
+         }
+      }
+      for (p = 0; p < 2; p++)
+      {
+         sInstructions[n++] = (p << 4) | DELEGATION_INSTRUCTION_PARTITION_SYNC;
+         if (nOp == DELEGATION_INSTRUCTION_PARTITION_WRITE)
+         {
+            nNextSector[p] = (nNextSector[p] + nSectorsPerPartition) % GEN_PARTITION_SECTORS;
+         }
+      }
+      writeBatch(pFile, sInstructions, n);
+   }
+   fclose(pFile);
+   return 0;
+}
+
+int main(int argc, char* argv[])
+{
+   char* sArgs[4];
+
+   if (argc >= 3 && strcmp(argv[1], "-g") == 0)
+   {
+      return generate(argv[2],
+                      argc > 3 ? (uint32_t)atoi(argv[3]) : 1000,
+                      argc > 4 ? (uint32_t)atoi(argv[4]) : 4096);
+   }
+   if (argc != 3)
+   {
+      fprintf(stderr, "usage: %s <trace> <storageDir>\n", argv[0]);
+      fprintf(stderr, "       %s -g <trace> [batches [sectorSize]]\n", argv[0]);
+      return 1;
+   }
+
+   g_pTrace = fopen(argv[1], "rb");
+   if (g_pTrace == NULL)
+   {
+      perror(argv[1]);
+      return 1;
+   }
+   if (fread(&g_sTraceHeader, sizeof(g_sTraceHeader), 1, g_pTrace) != 1 ||
+       g_sTraceHeader.nMagic != DELEGATION_TRACE_MAGIC ||
+       g_sTraceHeader.nVersion != DELEGATION_TRACE_VERSION)
+   {
+      fprintf(stderr, "%s: not a delegation trace\n", argv[1]);
+      return 1;
+   }
+   g_nWorkspaceSize = g_sTraceHeader.nWorkspaceSize;
+   atexit(report);
+
+   sArgs[0] = argv[0];
+   sArgs[1] = "-d";
+   sArgs[2] = "-storageDir";
+   sArgs[3] = argv[2];
+   return delegation_main(4, sArgs);
+}
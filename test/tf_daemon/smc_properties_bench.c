@@ -0,0 +1,178 @@
+/*
+ * Measures the parsing of the daemon configuration file on a Linux host:
+ * generates a [Global] section with <properties> properties, in sorted
+ * name order, then times SMCPropParseConfigFile and <lookups> rounds of
+ * SMCPropGetSystemProperty over all the names, checking every value.
+ * Also checks that duplicate properties and sections are rejected, and
+ * that SMCPropFreeConfigFile leaves the lists empty.
+ *
+ * usage: smc_properties_bench [properties [lookups]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "s_type.h"
+#include "s_error.h"
+#include "smc_properties_parser.h"
+
+static uint32_t g_nFailures;
+
+static void check(bool bCondition, const char* pMessage)
+{
+   if (!bCondition)
+   {
+      printf("FAILED: %s\n", pMessage);
+      g_nFailures++;
+   }
+}
+
+static double now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Not part of this tree: SMCPropGetSystemPropertyAsInt only */
+S_RESULT libString2GetStringAsInt(const char* pValue, uint32_t* pnValue)
+{
+   char* pEnd;
+
+   if (pValue == NULL)
+   {
+      return S_ERROR_BAD_PARAMETERS;
+   }
+   *pnValue = (uint32_t)strtoul(pValue, &pEnd, 0);
+   return (*pEnd == 0) ? S_SUCCESS : S_ERROR_BAD_FORMAT;
+}
+
+static char g_sFilename[] = "/tmp/smc_properties_bench.XXXXXX";
+
+static void writeFile(const char* pContent)
+{
+   FILE* pFile = fopen(g_sFilename, "wb");
+   fputs(pContent, pFile);
+   fclose(pFile);
+}
+
+static S_RESULT parse(const char* pContent, CONF_FILE* pConfFile)
+{
+   writeFile(pContent);
+   SMCPropFreeConfigFile(pConfFile);
+   return SMCPropParseConfigFile(g_sFilename, pConfFile);
+}
+
+static void checkFormat(void)
+{
+   CONF_FILE sConfFile;
+
+   memset(&sConfFile, 0, sizeof(sConfFile));
+   check(parse("[Global]\na: 1\nB: 2\nc: 3\n", &sConfFile) == S_SUCCESS, "parse");
+   check(strcmp(SMCPropGetSystemProperty(&sConfFile, "a"), "1") == 0, "value a");
+   check(strcmp(SMCPropGetSystemProperty(&sConfFile, "B"), "2") == 0, "value B");
+   check(SMCPropGetSystemProperty(&sConfFile, "b") == NULL, "lookup is case-sensitive");
+   check(SMCPropGetSystemProperty(&sConfFile, "d") == NULL, "missing property");
+   check(SMCPropGetSystemPropertyAsInt(&sConfFile, "c") == 3, "value as int");
+
+   check(parse("[Global]\na: 1\nA: 2\n", &sConfFile) == S_SUCCESS,
+         "properties differing by case");
+   check(parse("[Global]\na: 1\nb: 2\na: 3\n", &sConfFile) == S_ERROR_BAD_FORMAT,
+         "duplicate property");
+   check(parse("[Global]\na: 1\n[GLOBAL]\nb: 2\n", &sConfFile) == S_ERROR_BAD_FORMAT,
+         "duplicate section");
+   check(parse("a: 1\n[Global]\n", &sConfFile) == S_ERROR_BAD_FORMAT,
+         "property outside any section");
+   check(parse("[Service]\na: 1\n", &sConfFile) == S_ERROR_ITEM_NOT_FOUND,
+         "unknown section");
+   check(parse("", &sConfFile) == S_SUCCESS, "empty file");
+   check(parse("# comment only", &sConfFile) == S_SUCCESS, "no item");
+   SMCPropFreeConfigFile(&sConfFile);
+   check(sConfFile.sSystemSectionPropertyList.pFirst == NULL &&
+         sConfFile.sSystemSectionPropertyList.ppBuckets == NULL, "lists freed");
+}
+
+int main(int argc, char* argv[])
+{
+   uint32_t nProperties = (argc > 1) ? (uint32_t)atoi(argv[1]) : 5000;
+   uint32_t nLookups = (argc > 2) ? (uint32_t)atoi(argv[2]) : 10;
+   CONF_FILE sConfFile;
+   NODE* pNode;
+   FILE* pFile;
+   char sName[64];
+   char sValue[64];
+   double fParse;
+   double fLookup;
+   long nFileSize;
+   uint32_t nCount;
+   uint32_t i;
+   uint32_t j;
+   int hFile;
+
+   hFile = mkstemp(g_sFilename);
+   if (hFile < 0)
+   {
+      perror(g_sFilename);
+      return 1;
+   }
+   close(hFile);
+
+   checkFormat();
+
+   /* Sorted names: the worst case for an unbalanced tree */
+   pFile = fopen(g_sFilename, "wb");
+   fprintf(pFile, "# generated\n[Global]\n");
+   for (i = 0; i < nProperties; i++)
+   {
+      fprintf(pFile, "config.property.%08u: value %u\n", i, i * 7);
+   }
+   nFileSize = ftell(pFile);
+   fclose(pFile);
+
+   memset(&sConfFile, 0, sizeof(sConfFile));
+   fParse = now();
+   check(SMCPropParseConfigFile(g_sFilename, &sConfFile) == S_SUCCESS, "parse generated file");
+   fParse = now() - fParse;
+
+   nCount = 0;
+   for (pNode = sConfFile.sSystemSectionPropertyList.pFirst; pNode != NULL; pNode = pNode->pNext)
+   {
+      nCount++;
+   }
+   check(nCount == nProperties, "property count");
+
+   fLookup = now();
+   for (j = 0; j < nLookups; j++)
+   {
+      for (i = 0; i < nProperties; i++)
+      {
+         char* pValue;
+
+         sprintf(sName, "config.property.%08u", i);
+         pValue = SMCPropGetSystemProperty(&sConfFile, sName);
+         if (j == 0)
+         {
+            sprintf(sValue, "value %u", i * 7);
+            check(pValue != NULL && strcmp(pValue, sValue) == 0, "generated value");
+         }
+      }
+   }
+   fLookup = now() - fLookup;
+   SMCPropFreeConfigFile(&sConfFile);
+
+   unlink(g_sFilename);
+
+   printf("%u properties, %ld bytes: parse %.3f ms, %u lookups %.3f ms (%.0f ns/lookup)\n",
+          nProperties, nFileSize, fParse * 1e3, nLookups * nProperties, fLookup * 1e3,
+          (nLookups != 0 && nProperties != 0) ? fLookup * 1e9 / ((double)nLookups * nProperties) : 0.0);
+   if (g_nFailures != 0)
+   {
+      printf("%u checks failed\n", g_nFailures);
+      return 1;
+   }
+   printf("all checks passed\n");
+   return 0;
+}
@@ -1,6 +1,20 @@
+#define _GNU_SOURCE /* dladdr() on glibc hosts */
 #include <stdio.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <math.h>
+
+#include "heaptracker.h"
+#include "mapinfo.h"
 
 static void printf_log(const char *fmt, ...)
 {
@@ -10,20 +24,282 @@ static void printf_log(const char *fmt, ...)
     va_end(lst);
 }
 
-/* Override this for non-printf reporting */
-extern void (*malloc_log)(const char *fmt, ...);
 static void ctor(void) __attribute__((constructor));
 static void ctor(void)
 {
     malloc_log = printf_log;
 }
 
-int main(void)
+/*
+ * "tm bench [iterations]" measures malloc/free throughput at 1 to 8
+ * threads. Each thread keeps a window of live allocations and replaces
+ * one per iteration, so frees hit both its own and older allocations.
+ */
+#define BENCH_LIVE	64
+#define BENCH_THREADS	8
+
+static int bench_iterations = 200000;
+
+static void *bench_thread(void *arg)
+{
+	char *live[BENCH_LIVE] = { 0 };
+	unsigned seed = (unsigned)(uintptr_t)arg;
+	int i;
+
+	for (i = 0; i < bench_iterations; i++) {
+		int slot = i % BENCH_LIVE;
+
+		seed = seed * 1103515245 + 12345;
+		free(live[slot]);
+		live[slot] = malloc(16 + (seed >> 16) % 1024);
+	}
+	for (i = 0; i < BENCH_LIVE; i++)
+		free(live[i]);
+	return NULL;
+}
+
+static int bench(void)
+{
+	pthread_t threads[BENCH_THREADS];
+	struct timespec start, end;
+	int n, i;
+
+	for (n = 1; n <= BENCH_THREADS; n *= 2) {
+		double secs;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < n; i++)
+			pthread_create(&threads[i], NULL, bench_thread, (void *)(uintptr_t)(i + 1));
+		for (i = 0; i < n; i++)
+			pthread_join(threads[i], NULL);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+		printf("%d thread%s: %8.0f malloc+free/s (%.3fs)\n", n, n > 1 ? "s" : " ",
+		       n * (double)bench_iterations / secs, secs);
+	}
+	return 0;
+}
+
+/*
+ * "tm leaks [allocations]" leaks blocks from a few call sites and
+ * reports the tracking overhead and how long the leak report takes.
+ */
+#define LEAK_SITES	4
+
+static void * __attribute__((noinline)) leak_from(int site, size_t size)
+{
+	switch (site) {
+	case 0: return malloc(size);
+	case 1: return calloc(1, size);
+	case 2: return realloc(NULL, size);
+	default: return malloc(size);
+	}
+}
+
+static void * volatile leaked;
+
+static int leaks(int num)
+{
+	struct timespec start, end;
+	int i;
+
+	for (i = 0; i < num; i++)
+		leaked = leak_from(i % LEAK_SITES, 16 + i % 256);
+	heaptracker_dump_stats();
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	heaptracker_free_leaked_memory();
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	printf("leak report of %d allocations: %.3fs\n", num,
+	       (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+	return 0;
+}
+
+/*
+ * "tm heap [allocations]" keeps blocks of two sizes live from two sites and
+ * dumps the live heap; run with HEAPTRACKER_SAMPLE set to compare the
+ * scaled estimate against the known totals. The estimate must also be
+ * unbiased: its average over HEAP_ROUNDS rounds has to be within four
+ * standard errors of the known total, plus 0.5% for interval sampling,
+ * whose estimate barely changes from round to round. Sampled or
+ * not, every block must be aligned like malloc's.
+ */
+#define HEAP_ROUNDS	50
+
+static void quiet_log(const char *fmt, ...)
+{
+}
+
+static int heap(int num)
+{
+	char **small = malloc(num * sizeof(*small));
+	char **large = malloc(num / 8 * sizeof(*large));
+	double expected, est, sum = 0, sum_sq = 0, mean, stderr_, bias;
+	int i, round, misaligned = 0;
+
+	expected = (double)num * (48 + sizeof(*small)) + num / 8 * (4096.0 + sizeof(*large));
+	printf("expected: %d bytes in %d allocations of 48, %d bytes in %d of 4096\n",
+	       num * 48, num, num / 8 * 4096, num / 8);
+
+	for (round = 0; round < HEAP_ROUNDS; round++) {
+		for (i = 0; i < num; i++)
+			small[i] = malloc(48);
+		for (i = 0; i < num / 8; i++)
+			large[i] = malloc(4096);
+		for (i = 0; i < num; i++)
+			misaligned += (uintptr_t)small[i] % __alignof__(max_align_t) != 0;
+		for (i = 0; i < num / 8; i++)
+			misaligned += (uintptr_t)large[i] % __alignof__(max_align_t) != 0;
+
+		/* one full report, then only the estimates */
+		if (round)
+			malloc_log = quiet_log;
+		est = heaptracker_dump_live_heap();
+		malloc_log = printf_log;
+		sum += est;
+		sum_sq += est * est;
+
+		for (i = 0; i < num; i++)
+			free(small[i]);
+		for (i = 0; i < num / 8; i++)
+			free(large[i]);
+	}
+	free(small);
+	free(large);
+
+	mean = sum / HEAP_ROUNDS;
+	stderr_ = sqrt((sum_sq / HEAP_ROUNDS - mean * mean) / (HEAP_ROUNDS - 1));
+	bias = (mean - expected) / expected;
+	printf("estimate over %d rounds: %.0f bytes for %.0f, bias %+.2f%% (standard error %.2f%%)\n",
+	       HEAP_ROUNDS, mean, expected, bias * 100, stderr_ / expected * 100);
+	if (misaligned) {
+		printf("FAILED: %d blocks not aligned to %d bytes\n", misaligned,
+		       (int)__alignof__(max_align_t));
+		return 1;
+	}
+	if (fabs(mean - expected) > 4 * stderr_ + expected / 200) {
+		printf("FAILED: estimate is biased\n");
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * "tm symbolize [frames]" resolves frames of real backtraces, through the
+ * linear mapinfo list and through the sorted index with its pc cache, and
+ * checks that the index picks up code mapped after a pc missed: a page of
+ * the executable is mapped without access, looked up, made executable and
+ * looked up again once the maps may be re-read.
+ */
+#define SYM_DEPTH	15
+#define SYM_STACKS	64
+
+extern int heaptracker_stacktrace(intptr_t *, size_t);
+
+static int __attribute__((noinline)) sym_collect(intptr_t *bt, int level)
+{
+	int depth;
+
+	if (!level)
+		return heaptracker_stacktrace(bt, SYM_DEPTH);
+	depth = sym_collect(bt, level - 1);
+	__asm__ __volatile__("");	/* no tail call, keep the frame */
+	return depth;
+}
+
+static double since(const struct timespec *start)
+{
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int symbolize(int frames)
+{
+	static intptr_t bt[SYM_STACKS][SYM_DEPTH];
+	static int depth[SYM_STACKS];
+	struct timespec start;
+	mapinfo *list = init_mapinfo(getpid());
+	mapindex *idx = init_mapindex(getpid());
+	unsigned found = 0, named = 0;
+	uintptr_t rel_pc;
+	mapsym ms;
+	char *late;
+	int i, fd, failed = 0;
+
+	for (i = 0; i < SYM_STACKS; i++)
+		depth[i] = sym_collect(bt[i], i % 8);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < frames; i++) {
+		int s = i % SYM_STACKS;
+		found += !!pc_to_mapinfo(list, bt[s][i % depth[s]], &rel_pc);
+	}
+	printf("list:   %d frames in %.3fs (%u mapped)\n", frames, since(&start), found);
+
+	/* what symbolizing costs without the cache */
+	found = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < frames; i++) {
+		int s = i % SYM_STACKS;
+		Dl_info info;
+		found += dladdr((void *)bt[s][i % depth[s]], &info) && info.dli_sname;
+	}
+	printf("dladdr: %d frames in %.3fs (%u named)\n", frames, since(&start), found);
+
+	found = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < frames; i++) {
+		int s = i % SYM_STACKS;
+		found += !mapindex_lookup(idx, bt[s][i % depth[s]], &ms);
+		named += !!ms.symbol[0];
+	}
+	printf("index:  %d frames in %.3fs (%u mapped, %u named)\n", frames, since(&start),
+	       found, named);
+
+	fd = open("/proc/self/exe", O_RDONLY);
+	late = mmap(NULL, 4096, PROT_NONE, MAP_PRIVATE, fd, 0);
+	if (fd >= 0 && late != MAP_FAILED) {
+		if (!mapindex_lookup(idx, (uintptr_t)late, &ms)) {
+			printf("FAILED: inaccessible page mapped as code\n");
+			failed = 1;
+		}
+		mprotect(late, 4096, PROT_READ | PROT_EXEC);
+		sleep(2);
+		if (mapindex_lookup(idx, (uintptr_t)late, &ms)) {
+			printf("FAILED: page made executable later not found\n");
+			failed = 1;
+		}
+		munmap(late, 4096);
+	}
+	if (fd >= 0)
+		close(fd);
+
+	deinit_mapindex(idx);
+	deinit_mapinfo(list);
+	return failed;
+}
+
+int main(int argc, char **argv)
 {
 	char *ptr[6];
 	char *uaf;
 	char *cf, *cb;
 
+	if (argc > 1 && !strcmp(argv[1], "bench")) {
+		if (argc > 2)
+			bench_iterations = atoi(argv[2]);
+		return bench();
+	}
+	if (argc > 1 && !strcmp(argv[1], "symbolize"))
+		return symbolize(argc > 2 ? atoi(argv[2]) : 100000);
+	if (argc > 1 && !strcmp(argv[1], "heap"))
+		return heap(argc > 2 ? atoi(argv[2]) : 100000);
+	if (argc > 1 && !strcmp(argv[1], "leaks"))
+		return leaks(argc > 2 ? atoi(argv[2]) : 100000);
+
 	ptr[0] = malloc(10);
 	ptr[1] = calloc(1,20);
 	ptr[2] = malloc(30);